@@ -3,49 +3,154 @@
  */
 
 #include <stdlib.h>
-#include <assert.h>
 #include "base32.h"
 
 typedef unsigned char uint8_t;
 
+static const char base32abc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+/* Marks characters outside of the alphabet */
+#define _X_ 0xFF
+
+/* Values of the Base32 digits (in either case) */
+static const uint8_t base32val[256] = {
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_,  26,  27,  28,  29,  30,  31, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, _X_, _X_, _X_, _X_, _X_,
+	_X_,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+};
+
 /*
- * Code snagged from the bitzi bitcollider
+ * Encodes src by groups of 5 octets, each giving 8 characters;
+ * the last incomplete group is padded with zero bits but no "="
+ * characters are output (this is what THEX needs).
  *
  * Note:
  *   The output array (dst) must be at least
- *   len * 8 / 5 + 1 characters long.
+ *   BASE32_DESTLEN(len) characters long.
 */
 char *to_base32(const unsigned char src[], const size_t len,
 		char *const dst) {
-	static const char base32abc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-
-	size_t si, index, di;
-	uint8_t word;
-
-	si = di = index = 0;
-
-	while (si < len) {
-		/* Is the current word going to span a byte boundary? */
-		if (index > 3) {
-			word = (uint8_t)(src[si] & (0xFF >> index));
-			index = (index + 5) % 8;
-			word <<= index;
-			if ((si + 1) < len)
-				word |= src[si + 1] >> (8 - index);
-			si++;
-		} else {
-			word = (uint8_t)(src[si] >> (8 - (index + 5))) & 0x1F;
-			index = (index + 5) % 8;
-			if (index == 0)
-				si++;
-		}
+	uint8_t tail[5];
+	char group[9];
+	const uint8_t *s;
+	char *d;
+	size_t si, n, i;
+
+	d = dst;
+	for (si = 0; si + 5 <= len; si += 5) {
+		s = src + si;
+		d[0] = base32abc[s[0] >> 3];
+		d[1] = base32abc[((s[0] & 0x07) << 2) | (s[1] >> 6)];
+		d[2] = base32abc[(s[1] >> 1) & 0x1F];
+		d[3] = base32abc[((s[1] & 0x01) << 4) | (s[2] >> 4)];
+		d[4] = base32abc[((s[2] & 0x0F) << 1) | (s[3] >> 7)];
+		d[5] = base32abc[(s[3] >> 2) & 0x1F];
+		d[6] = base32abc[((s[3] & 0x03) << 3) | (s[4] >> 5)];
+		d[7] = base32abc[s[4] & 0x1F];
+		d += 8;
+	}
 
-		assert(word < 32);
-		dst[di] = base32abc[word];
-		++di;
+	if (si < len) {
+		n = len - si;
+		for (i = 0; i < 5; ++i)
+			tail[i] = i < n ? src[si + i] : 0;
+		to_base32(tail, 5, group);
+		n = (n * 8 + 4) / 5;
+		for (i = 0; i < n; ++i)
+			d[i] = group[i];
+		d += n;
 	}
 
-	dst[di] = 0;
+	*d = 0;
 	return dst;
 }
 
+/*
+ * Decodes len characters of unpadded Base32 (in either case)
+ * by groups of 8 characters, each giving 5 octets.
+ * Fails if a character is outside of the alphabet, if len is not
+ * a length to_base32() can produce, or if the unused trailing bits
+ * are not zero (so that encoding the result gives back the same
+ * string modulo case); *badpos is then set to the position
+ * of the offending character (len for a bad length).
+ * Returns the number of octets written, BASE32_SRCLEN(len),
+ * or -1 on failure.
+ *
+ * Note:
+ *   The output array (dst) must be at least
+ *   BASE32_SRCLEN(len) octets long.
+ */
+long from_base32(const char src[], const size_t len,
+		unsigned char *const dst, size_t *const badpos) {
+	uint8_t v[8];
+	const uint8_t *s;
+	unsigned char *d;
+	size_t si, n, i;
+	uint8_t bad;
+	unsigned long acc;
+	int bits;
+
+	n = len % 8;
+	if (n == 1 || n == 3 || n == 6) {
+		*badpos = len;
+		return -1;
+	}
+
+	d = dst;
+	for (si = 0; si + 8 <= len; si += 8) {
+		s = (const uint8_t *) src + si;
+		bad = 0;
+		for (i = 0; i < 8; ++i) {
+			v[i] = base32val[s[i]];
+			bad |= v[i];
+		}
+		if (bad & 0xE0) {
+			for (i = 0; v[i] != _X_; ++i)
+				;
+			*badpos = si + i;
+			return -1;
+		}
+		d[0] = (unsigned char) ((v[0] << 3) | (v[1] >> 2));
+		d[1] = (unsigned char) ((v[1] << 6) | (v[2] << 1) | (v[3] >> 4));
+		d[2] = (unsigned char) ((v[3] << 4) | (v[4] >> 1));
+		d[3] = (unsigned char) ((v[4] << 7) | (v[5] << 2) | (v[6] >> 3));
+		d[4] = (unsigned char) ((v[6] << 5) | v[7]);
+		d += 5;
+	}
+
+	acc = 0;
+	bits = 0;
+	for (; si < len; ++si) {
+		v[0] = base32val[(uint8_t) src[si]];
+		if (v[0] == _X_) {
+			*badpos = si;
+			return -1;
+		}
+		acc = (acc << 5) | v[0];
+		bits += 5;
+		if (bits >= 8) {
+			bits -= 8;
+			*d++ = (unsigned char) (acc >> bits);
+			acc &= (1UL << bits) - 1;
+		}
+	}
+	if (acc != 0) {
+		*badpos = len - 1;
+		return -1;
+	}
+
+	return (long) (d - dst);
+}
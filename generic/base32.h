@@ -12,10 +12,19 @@
  * Can be used. e.g. to calculate the required length
  * of the dst array passed to to_base32 function.
  */
-#define BASE32_DESTLEN(x) ((x * sizeof(char)) * 8 / 5 + 1)
+#define BASE32_DESTLEN(x) (((x) * 8 + 4) / 5 + 1)
+
+/*
+ * Returns the number of octets encoded by x characters
+ * of unpadded Base32, as decoded by from_base32.
+ */
+#define BASE32_SRCLEN(x) ((x) * 5 / 8)
 
 char *to_base32(const unsigned char src[], const size_t len,
 		char *const dst);
 
+long from_base32(const char src[], const size_t len,
+		unsigned char *const dst, size_t *const badpos);
+
 #endif /* __BASE32_H */
 
@@ -0,0 +1,107 @@
+/*
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include "hex.h"
+
+typedef unsigned char uint8_t;
+
+/* Pairs of hex digits for each octet */
+static const char hexpairs[] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* Marks characters which are not hex digits */
+#define _X_ 0xFF
+
+/* Values of the hex digits (in either case) */
+static const uint8_t hexval[256] = {
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	  0,   1,   2,   3,   4,   5,   6,   7,   8,   9, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_,  10,  11,  12,  13,  14,  15, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_,  10,  11,  12,  13,  14,  15, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+	_X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_, _X_,
+};
+
+/*
+ * Encodes src as lowercase hex digits, two per octet.
+ *
+ * Note:
+ *   The output array (dst) must be at least
+ *   HEX_DESTLEN(len) characters long.
+ */
+char *to_hex(const unsigned char src[], const size_t len,
+		char *const dst) {
+	const char *p;
+	size_t si;
+	char *d;
+
+	d = dst;
+	for (si = 0; si < len; ++si) {
+		p = hexpairs + 2 * src[si];
+		d[0] = p[0];
+		d[1] = p[1];
+		d += 2;
+	}
+
+	*d = 0;
+	return dst;
+}
+
+/*
+ * Decodes len hex digits (in either case), two per octet.
+ * Fails if a character is not a hex digit or if len is odd;
+ * *badpos is then set to the position of the offending character
+ * (len for a bad length).
+ * Returns the number of octets written, len / 2, or -1 on failure.
+ */
+long from_hex(const char src[], const size_t len,
+		unsigned char *const dst, size_t *const badpos) {
+	const uint8_t *s;
+	size_t si;
+	uint8_t hi, lo;
+
+	if (len % 2 != 0) {
+		*badpos = len;
+		return -1;
+	}
+
+	s = (const uint8_t *) src;
+	for (si = 0; si < len; si += 2) {
+		hi = hexval[s[si]];
+		lo = hexval[s[si + 1]];
+		if ((hi | lo) & 0xF0) {
+			*badpos = hi == _X_ ? si : si + 1;
+			return -1;
+		}
+		dst[si / 2] = (unsigned char) ((hi << 4) | lo);
+	}
+
+	return (long) (len / 2);
+}
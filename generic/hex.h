@@ -0,0 +1,21 @@
+/*
+ * $Id$
+ */
+
+#ifndef __HEX_H
+#define __HEX_H
+
+/*
+ * Returns minimal length of a buffer sufficient to hold
+ * the hex digits representing x octets.
+ * Accounts for NUL-terminator.
+ */
+#define HEX_DESTLEN(x) ((x) * 2 + 1)
+
+char *to_hex(const unsigned char src[], const size_t len,
+		char *const dst);
+
+long from_hex(const char src[], const size_t len,
+		unsigned char *const dst, size_t *const badpos);
+
+#endif /* __HEX_H */
@@ -0,0 +1,342 @@
+/*
+ * tclapi.c --
+ *
+ *	This file implements the public C API of the "tth" package
+ *	(see tth.h), exported to other extensions through the stubs
+ *	table in tthStubInit.c.
+ *
+ *	The functions work on raw bytes and do not touch Tcl objects,
+ *	the hashing statistics or the probes of the Tcl commands.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <string.h>
+#include <tcl.h>
+#include "tth.h"
+#include "tigertree.h"
+#include "base32.h"
+#include "tclinput.h"
+
+struct Tth_TigerContext_ {
+	TIGER_CONTEXT context;
+};
+
+struct Tth_TreeContext_ {
+	TT_CONTEXT context;
+};
+
+/*
+ * tt_update() takes the length as a 32-bit word.
+ */
+#define API_MAXCHUNK 0x40000000
+
+static const FILE_ENGINE fileEngines[] = {
+	FE_AUTO, FE_MMAP, FE_READ, FE_STREAM
+};
+
+
+/*
+ *
+ */
+void
+Tth_Tiger (
+		const unsigned char *bytes,
+		Tcl_WideUInt        len,
+		unsigned char       *digest
+		)
+{
+	TIGER_CONTEXT context;
+	word64 res[3];
+
+	tiger_init(&context);
+	tiger_update(&context, bytes, (word64) len);
+	tiger_final(&context, res);
+	tiger_to_canonical((byte *) res);
+	memcpy(digest, res, TTH_DIGESTSIZE);
+}
+
+
+/*
+ *
+ */
+Tth_TigerContext *
+Tth_TigerInit (void)
+{
+	Tth_TigerContext *ctxPtr;
+
+	ctxPtr = (Tth_TigerContext *) ckalloc(sizeof(Tth_TigerContext));
+	tiger_init(&ctxPtr->context);
+
+	return ctxPtr;
+}
+
+
+/*
+ *
+ */
+void
+Tth_TigerUpdate (
+		Tth_TigerContext    *ctxPtr,
+		const unsigned char *bytes,
+		Tcl_WideUInt        len
+		)
+{
+	tiger_update(&ctxPtr->context, bytes, (word64) len);
+}
+
+
+/*
+ * Finalizes the context and frees it.
+ */
+void
+Tth_TigerDigest (
+		Tth_TigerContext *ctxPtr,
+		unsigned char    *digest
+		)
+{
+	word64 res[3];
+
+	tiger_final(&ctxPtr->context, res);
+	tiger_to_canonical((byte *) res);
+	memcpy(digest, res, TTH_DIGESTSIZE);
+	ckfree((char *) ctxPtr);
+}
+
+
+/*
+ *
+ */
+Tth_TreeContext *
+Tth_TreeInit (void)
+{
+	Tth_TreeContext *ctxPtr;
+
+	ctxPtr = (Tth_TreeContext *) ckalloc(sizeof(Tth_TreeContext));
+	tt_init(&ctxPtr->context);
+	/* Not from the per-thread pools: the caller may pass it around */
+	tt_set_heap(&ctxPtr->context);
+
+	return ctxPtr;
+}
+
+
+/*
+ * Makes the context report the nodes of the given level of the tree
+ * (0 being the leaves) to proc. Must be called before the context
+ * is updated.
+ */
+void
+Tth_TreeSetLevel (
+		Tth_TreeContext *ctxPtr,
+		int             level,
+		Tth_LevelProc   *proc,
+		ClientData      clientData
+		)
+{
+	tt_set_level(&ctxPtr->context, level,
+			(tt_level_proc *) proc, clientData);
+}
+
+
+/*
+ *
+ */
+void
+Tth_TreeUpdate (
+		Tth_TreeContext     *ctxPtr,
+		const unsigned char *bytes,
+		Tcl_WideUInt        len
+		)
+{
+	word32 chunk;
+
+	do {
+		chunk = len > API_MAXCHUNK ? API_MAXCHUNK : (word32) len;
+		tt_update(&ctxPtr->context, bytes, chunk);
+		bytes += chunk;
+		len   -= chunk;
+	} while (len > 0);
+}
+
+
+/*
+ * Finalizes the context and frees it.
+ */
+void
+Tth_TreeDigest (
+		Tth_TreeContext *ctxPtr,
+		unsigned char   *digest
+		)
+{
+	tt_digest(&ctxPtr->context, digest);
+	ckfree((char *) ctxPtr);
+}
+
+
+/*
+ * Frees the context without taking its digest.
+ */
+void
+Tth_TreeFree (
+		Tth_TreeContext *ctxPtr
+		)
+{
+	tt_free(&ctxPtr->context);
+	ckfree((char *) ctxPtr);
+}
+
+
+/*
+ *
+ */
+void
+Tth_TreeHash (
+		const unsigned char *bytes,
+		Tcl_WideUInt        len,
+		unsigned char       *digest
+		)
+{
+	TT_CONTEXT context;
+
+	if (len <= API_MAXCHUNK) {
+		tt_hash(bytes, (word32) len, digest);
+		return;
+	}
+
+	tt_init(&context);
+	while (len > 0) {
+		word32 chunk = len > API_MAXCHUNK ? API_MAXCHUNK : (word32) len;
+		tt_update(&context, bytes, chunk);
+		bytes += chunk;
+		len   -= chunk;
+	}
+	tt_digest(&context, digest);
+}
+
+
+/*
+ * Hashes count messages, storing their digests one after another
+ * at digests, which must have room for count * TTH_DIGESTSIZE bytes.
+ */
+void
+Tth_TreeHashBatch (
+		int                       count,
+		const unsigned char *const *bytesv,
+		const Tcl_WideUInt        *lenv,
+		unsigned char             *digests
+		)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		Tth_TreeHash(bytesv[i], lenv[i], digests + i * TTH_DIGESTSIZE);
+	}
+}
+
+
+/*
+ * Hashes the named file using the given engine. The engine actually
+ * used is stored at usedPtr unless it is NULL.
+ */
+int
+Tth_TreeHashFile (
+		Tcl_Interp     *interp,
+		const char     *fileName,
+		Tth_FileEngine engine,
+		unsigned char  *digest,
+		Tth_FileEngine *usedPtr
+		)
+{
+	TT_CONTEXT context;
+	Tcl_Obj *filePtr;
+	FILE_ENGINE used;
+	int code, i;
+
+	if ((unsigned) engine > TTH_ENGINE_STREAM) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "invalid file engine", NULL);
+		return TCL_ERROR;
+	}
+
+	filePtr = Tcl_NewStringObj(fileName, -1);
+	Tcl_IncrRefCount(filePtr);
+
+	tt_init(&context);
+	code = DigestUpdateFromFile(interp, filePtr, fileEngines[engine],
+			DigestUpdateTTH, &context, NULL, &used);
+	Tcl_DecrRefCount(filePtr);
+
+	if (code != TCL_OK) {
+		tt_free(&context);
+		return code;
+	}
+
+	tt_digest(&context, digest);
+	if (usedPtr != NULL) {
+		for (i = 0; fileEngines[i] != used; ++i);
+		*usedPtr = (Tth_FileEngine) i;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Hashes the data read from the channel up to its end.
+ * The channel should be configured for binary input.
+ */
+int
+Tth_TreeHashChannel (
+		Tcl_Interp    *interp,
+		Tcl_Channel   chan,
+		unsigned char *digest
+		)
+{
+	TT_CONTEXT context;
+	char *buffer;
+	int len;
+	const int CHUNKSIZE = 65536;
+
+	buffer = ckalloc(CHUNKSIZE);
+	tt_init(&context);
+	while ((len = Tcl_Read(chan, buffer, CHUNKSIZE)) > 0) {
+		TTH_ThrottleIo(NULL, len);
+		tt_update(&context, (const byte *) buffer, len);
+	}
+	ckfree(buffer);
+
+	if (len < 0) {
+		tt_free(&context);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error reading \"",
+				Tcl_GetChannelName(chan), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+
+	tt_digest(&context, digest);
+
+	return TCL_OK;
+}
+
+
+/*
+ * Writes the base32 form of the digest to buffer, which must have room
+ * for TTH_BASE32SIZE bytes, and returns buffer.
+ */
+char *
+Tth_DigestToBase32 (
+		const unsigned char *digest,
+		char                *buffer
+		)
+{
+	to_base32(digest, TTH_DIGESTSIZE, buffer);
+	return buffer;
+}
@@ -0,0 +1,47 @@
+/*
+ * tclclient.h --
+ *
+ *	This file contains the interface to the client of the local
+ *	hashing daemon (misc/tthd.c) used by [tth digest -daemon].
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __TCLCLIENT_H
+#define __TCLCLIENT_H
+
+#ifndef _WIN32
+
+#define USE_DAEMON 1
+
+#include <tcl.h>
+#include "tiger.h"
+
+/*
+ * Asks the daemon listening on the Unix domain socket socketPtr for
+ * the TTH of the file filePtr; stores the digest and the size of the
+ * file hashed.
+ */
+
+int
+TTH_DigestFromDaemon (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *socketPtr,
+		Tcl_Obj      *filePtr,
+		byte         digest[],
+		Tcl_WideInt  *sizePtr
+		);
+
+#else
+
+#undef USE_DAEMON
+
+#endif /* _WIN32 */
+
+#endif /* ifdef __TCLCLIENT_H */
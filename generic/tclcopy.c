@@ -0,0 +1,808 @@
+/*
+ * tclcopy.c --
+ *
+ *	This file implements a Tcl command which copies data
+ *	between channels or files calculating TTH on it
+ *	in the same pass.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "tigertree.h"
+#include "tclout.h"
+#include "tclmmap.h"
+#include "tclcopy.h"
+
+
+/*
+ *
+ */
+typedef enum {
+	DO_THEX,       /* -thex, default  */
+	DO_HEX,        /* -hex */
+	DO_RAW         /* -raw */
+} DIGEST_OUTPUT;
+
+typedef enum {
+	CM_CHAN,       /* -chan, default */
+	CM_FILE        /* -file */
+} COPY_MODE;
+
+/* Default size of the chunks the data is copied by */
+#define COPY_BUFSIZE (256 * 1024)
+
+#define COPY_ASSOC "tth::copy"
+
+/*
+ * State of one copying operation.
+ */
+typedef struct CopyState CopyState;
+
+/*
+ * Background copyings of an interpreter, abandoned when
+ * the interpreter is deleted.
+ */
+typedef struct {
+	CopyState *firstPtr;
+} CopyList;
+
+struct CopyState {
+	Tcl_Interp    *interp;
+	COPY_MODE     mode;
+	Tcl_Channel   inChan;       /* channels being copied between... */
+	Tcl_Channel   outChan;
+	int           closeChans;   /* ...which we have opened ourselves */
+	int           blocking;     /* original -blocking of inChan, or -1 */
+#ifdef USE_MMAP_COPY
+	TTH_MmapCopy  *mmapPtr;     /* or mapped file being copied */
+#endif
+	byte          *buffer;
+	int           bufSize;
+	Tcl_WideInt   copied;
+	Tcl_WideInt   srcSize;      /* size of a source file, or -1 */
+	TT_CONTEXT    context;
+	DIGEST_OUTPUT output;
+	DIGEST_BITLEN bitlen;
+	Tcl_Obj       *cmdPtr;      /* completion callback, or NULL */
+	Tcl_Obj       *srcPtr;      /* source, for error messages */
+	Tcl_Obj       *dstPtr;      /* destination, for error messages */
+	Tcl_TimerToken timer;       /* next step of a mapped file, or NULL */
+	CopyList      *listPtr;     /* list of a background copying, or NULL */
+	CopyState     *prevPtr;
+	CopyState     *nextPtr;
+};
+
+
+/*
+ *
+ */
+static Tcl_Obj *
+Copy_FormatDigest (
+		CopyState *statePtr,
+		byte      digest[]
+		)
+{
+	switch (statePtr->output) {
+		case DO_HEX:
+			return DigestToHex(digest, statePtr->bitlen);
+		case DO_RAW:
+			return DigestToRaw(digest, statePtr->bitlen);
+		case DO_THEX:
+		default:
+			return DigestToTHEX(digest, statePtr->bitlen);
+	}
+}
+
+
+/*
+ *
+ */
+static void
+Copy_Free (
+		CopyState *statePtr
+		)
+{
+	if (statePtr->closeChans) {
+		Tcl_Close(NULL, statePtr->inChan);
+		Tcl_Close(NULL, statePtr->outChan);
+	}
+#ifdef USE_MMAP_COPY
+	if (statePtr->mmapPtr != NULL) {
+		TTH_MmapCopyClose(statePtr->mmapPtr);
+	}
+#endif
+	if (statePtr->buffer != NULL) {
+		ckfree((char *) statePtr->buffer);
+	}
+	if (statePtr->cmdPtr != NULL) {
+		Tcl_DecrRefCount(statePtr->cmdPtr);
+	}
+	Tcl_DecrRefCount(statePtr->srcPtr);
+	Tcl_DecrRefCount(statePtr->dstPtr);
+	tt_free(&statePtr->context);
+	ckfree((char *) statePtr);
+}
+
+
+/*
+ * Copies the next chunk of data.
+ * Sets *donePtr when the source is exhausted.
+ */
+static int
+Copy_Step (
+		CopyState *statePtr,
+		int       *donePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	int got;
+
+#ifdef USE_MMAP_COPY
+	if (statePtr->mmapPtr != NULL) {
+		return TTH_MmapCopyStep(interp, statePtr->mmapPtr,
+				&statePtr->context, statePtr->bufSize,
+				&statePtr->copied, donePtr);
+	}
+#endif
+
+	got = Tcl_Read(statePtr->inChan, (char *) statePtr->buffer,
+			statePtr->bufSize);
+	if (got == -1 && Tcl_InputBlocked(statePtr->inChan)) {
+		got = 0;
+	}
+	if (got == -1) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to read from \"",
+				Tcl_GetString(statePtr->srcPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+
+	/*
+	 * A non-blocking source may have had less data than asked for,
+	 * or none at all; the rest is read on the next readable event.
+	 */
+	if (got > 0) {
+		tt_update(&statePtr->context, statePtr->buffer, got);
+		if (Tcl_Write(statePtr->outChan, (const char *) statePtr->buffer,
+					got) == -1) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "failed to write to \"",
+					Tcl_GetString(statePtr->dstPtr), "\": ",
+					Tcl_PosixError(interp), NULL);
+			return TCL_ERROR;
+		}
+		statePtr->copied += got;
+	}
+
+	*donePtr = Tcl_Eof(statePtr->inChan);
+
+	if (*donePtr && statePtr->copied < statePtr->srcSize) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "file named \"",
+				Tcl_GetString(statePtr->srcPtr),
+				"\" was truncated while being copied", NULL);
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Puts the source channel in the blocking mode required for
+ * the copying, remembering its original mode.
+ */
+static void
+Copy_SetBlocking (
+		CopyState *statePtr,
+		int       blocking
+		)
+{
+	Tcl_DString value;
+
+	if (statePtr->inChan == NULL || statePtr->closeChans) {
+		return;
+	}
+
+	Tcl_DStringInit(&value);
+	if (Tcl_GetChannelOption(NULL, statePtr->inChan, "-blocking",
+				&value) == TCL_OK
+			&& Tcl_GetBoolean(NULL, Tcl_DStringValue(&value),
+				&statePtr->blocking) == TCL_OK) {
+		Tcl_SetChannelOption(NULL, statePtr->inChan, "-blocking",
+				blocking ? "1" : "0");
+	}
+	Tcl_DStringFree(&value);
+}
+
+
+/*
+ * Restores the original blocking mode of the source channel.
+ */
+static void
+Copy_RestoreBlocking (
+		CopyState *statePtr
+		)
+{
+	if (statePtr->blocking != -1) {
+		Tcl_SetChannelOption(NULL, statePtr->inChan, "-blocking",
+				statePtr->blocking ? "1" : "0");
+		statePtr->blocking = -1;
+	}
+}
+
+
+/*
+ * Finishes the copying: flushes the destination and either
+ * calls the completion callback or sets the interpreter result.
+ */
+static int
+Copy_Finish (
+		CopyState *statePtr,
+		int       code
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	byte digest[TIGERSIZE];
+	Tcl_Obj *digestPtr, *errorPtr, *cmdPtr;
+
+	if (code == TCL_OK && statePtr->outChan != NULL
+			&& Tcl_Flush(statePtr->outChan) != TCL_OK) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to write to \"",
+				Tcl_GetString(statePtr->dstPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		code = TCL_ERROR;
+	}
+
+	tt_digest(&statePtr->context, digest);
+	digestPtr = Copy_FormatDigest(statePtr, digest);
+
+	if (statePtr->cmdPtr == NULL) {
+		if (code == TCL_OK) {
+			Tcl_SetObjResult(interp, digestPtr);
+		} else {
+			Tcl_DecrRefCount(digestPtr);
+		}
+		Copy_Free(statePtr);
+		return code;
+	}
+
+	if (code == TCL_OK) {
+		errorPtr = NULL;
+	} else {
+		errorPtr = Tcl_GetObjResult(interp);
+		Tcl_IncrRefCount(errorPtr);
+		Tcl_ResetResult(interp);
+	}
+
+	cmdPtr = Tcl_DuplicateObj(statePtr->cmdPtr);
+	Tcl_IncrRefCount(cmdPtr);
+	Tcl_ListObjAppendElement(NULL, cmdPtr,
+			Tcl_NewWideIntObj(statePtr->copied));
+	Tcl_ListObjAppendElement(NULL, cmdPtr, digestPtr);
+	if (errorPtr != NULL) {
+		Tcl_ListObjAppendElement(NULL, cmdPtr, errorPtr);
+		Tcl_DecrRefCount(errorPtr);
+	}
+	Copy_Free(statePtr);
+
+	Tcl_Preserve((ClientData) interp);
+	if (!Tcl_InterpDeleted(interp)
+			&& Tcl_EvalObjEx(interp, cmdPtr, TCL_EVAL_GLOBAL) != TCL_OK) {
+		Tcl_BackgroundError(interp);
+	}
+	Tcl_Release((ClientData) interp);
+	Tcl_DecrRefCount(cmdPtr);
+
+	return TCL_OK;
+}
+
+
+static void Copy_TimerProc (ClientData clientData);
+static void Copy_ChannelProc (ClientData clientData, int mask);
+static void Copy_CloseProc (ClientData clientData);
+
+/*
+ * Cancels everything which may drive a background copying
+ * and forgets it in the list of its interpreter.
+ */
+static void
+Copy_DeleteHandlers (
+		CopyState *statePtr
+		)
+{
+	if (statePtr->timer != NULL) {
+		Tcl_DeleteTimerHandler(statePtr->timer);
+		statePtr->timer = NULL;
+	}
+	if (statePtr->listPtr != NULL) {
+		if (statePtr->prevPtr != NULL) {
+			statePtr->prevPtr->nextPtr = statePtr->nextPtr;
+		} else {
+			statePtr->listPtr->firstPtr = statePtr->nextPtr;
+		}
+		if (statePtr->nextPtr != NULL) {
+			statePtr->nextPtr->prevPtr = statePtr->prevPtr;
+		}
+		statePtr->listPtr = NULL;
+	}
+	if (statePtr->inChan != NULL) {
+		Tcl_DeleteChannelHandler(statePtr->inChan,
+				Copy_ChannelProc, (ClientData) statePtr);
+		if (!statePtr->closeChans) {
+			Tcl_DeleteCloseHandler(statePtr->inChan,
+					Copy_CloseProc, (ClientData) statePtr);
+			Tcl_DeleteCloseHandler(statePtr->outChan,
+					Copy_CloseProc, (ClientData) statePtr);
+		}
+	}
+}
+
+/*
+ * Performs one step of a background copying and arranges
+ * for the next one.
+ */
+static void
+Copy_Background (
+		CopyState *statePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	int code, done = 0;
+
+	/* Nobody is left to report to */
+	if (Tcl_InterpDeleted(interp)) {
+		Copy_CloseProc((ClientData) statePtr);
+		return;
+	}
+
+	Tcl_Preserve((ClientData) interp);
+
+	code = Copy_Step(statePtr, &done);
+	if (code != TCL_OK || done) {
+		Copy_DeleteHandlers(statePtr);
+		Copy_RestoreBlocking(statePtr);
+		Copy_Finish(statePtr, code);
+	} else if (statePtr->inChan == NULL) {
+		/*
+		 * Mapped files are always ready, channels tell us
+		 * when they have more data.
+		 */
+		statePtr->timer = Tcl_CreateTimerHandler(0, Copy_TimerProc,
+				(ClientData) statePtr);
+	}
+
+	Tcl_Release((ClientData) interp);
+}
+
+
+/*
+ *
+ */
+static void
+Copy_TimerProc (
+		ClientData clientData
+		)
+{
+	CopyState *statePtr = (CopyState *) clientData;
+
+	statePtr->timer = NULL;
+	Copy_Background(statePtr);
+}
+
+
+/*
+ *
+ */
+static void
+Copy_ChannelProc (
+		ClientData clientData,
+		int        mask
+		)
+{
+	Copy_Background((CopyState *) clientData);
+}
+
+
+/*
+ * Abandons a background copying when either of the channels
+ * involved is closed before it has finished.
+ */
+static void
+Copy_CloseProc (
+		ClientData clientData
+		)
+{
+	CopyState *statePtr = (CopyState *) clientData;
+
+	Copy_DeleteHandlers(statePtr);
+	Copy_RestoreBlocking(statePtr);
+	Copy_Free(statePtr);
+}
+
+
+/*
+ * Abandons the background copyings of an interpreter being deleted.
+ */
+static void
+Copy_DeleteProc (
+		ClientData clientData,
+		Tcl_Interp *interp
+		)
+{
+	CopyList *listPtr = (CopyList *) clientData;
+
+	while (listPtr->firstPtr != NULL) {
+		Copy_CloseProc((ClientData) listPtr->firstPtr);
+	}
+	ckfree((char *) listPtr);
+}
+
+
+/*
+ * Records a background copying in the list of its interpreter.
+ */
+static void
+Copy_Register (
+		CopyState *statePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	CopyList *listPtr;
+
+	listPtr = (CopyList *) Tcl_GetAssocData(interp, COPY_ASSOC, NULL);
+	if (listPtr == NULL) {
+		listPtr = (CopyList *) ckalloc(sizeof(CopyList));
+		listPtr->firstPtr = NULL;
+		Tcl_SetAssocData(interp, COPY_ASSOC, Copy_DeleteProc,
+				(ClientData) listPtr);
+	}
+
+	statePtr->listPtr = listPtr;
+	statePtr->prevPtr = NULL;
+	statePtr->nextPtr = listPtr->firstPtr;
+	if (listPtr->firstPtr != NULL) {
+		listPtr->firstPtr->prevPtr = statePtr;
+	}
+	listPtr->firstPtr = statePtr;
+}
+
+
+#ifndef USE_MMAP_COPY
+/*
+ * Opens the source and destination files as binary channels.
+ */
+static int
+Copy_OpenFiles (
+		CopyState *statePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	Tcl_StatBuf srcStat, dstStat;
+
+	/*
+	 * Opening the destination truncates it, so it must not be
+	 * the source under the same name or under another link
+	 */
+	if (Tcl_FSStat(statePtr->srcPtr, &srcStat) != 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "couldn't open \"",
+				Tcl_GetString(statePtr->srcPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+	if (Tcl_FSEqualPaths(statePtr->srcPtr, statePtr->dstPtr)
+			|| (Tcl_FSStat(statePtr->dstPtr, &dstStat) == 0
+				&& srcStat.st_ino != 0
+				&& srcStat.st_dev == dstStat.st_dev
+				&& srcStat.st_ino == dstStat.st_ino)) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not copy file named \"",
+				Tcl_GetString(statePtr->srcPtr), "\" onto itself", NULL);
+		return TCL_ERROR;
+	}
+
+	statePtr->inChan = Tcl_FSOpenFileChannel(interp, statePtr->srcPtr,
+			"r", 0);
+	if (statePtr->inChan == NULL) { return TCL_ERROR; }
+	statePtr->outChan = Tcl_FSOpenFileChannel(interp, statePtr->dstPtr,
+			"w", 0666);
+	if (statePtr->outChan == NULL) {
+		Tcl_Close(NULL, statePtr->inChan);
+		statePtr->inChan = NULL;
+		return TCL_ERROR;
+	}
+	statePtr->closeChans = 1;
+	/* Only a shrinking source is noticed, not a growing one */
+	statePtr->srcSize = (Tcl_WideInt) srcStat.st_size;
+
+	Tcl_SetChannelOption(NULL, statePtr->inChan, "-translation", "binary");
+	Tcl_SetChannelOption(NULL, statePtr->outChan, "-translation", "binary");
+
+	return TCL_OK;
+}
+#endif /* USE_MMAP_COPY */
+
+
+/*
+ *
+ */
+static int
+Copy_GetChannels (
+		CopyState *statePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	int mode;
+
+	statePtr->inChan = Tcl_GetChannel(interp,
+			Tcl_GetString(statePtr->srcPtr), &mode);
+	if (statePtr->inChan == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not find channel named \"",
+				Tcl_GetString(statePtr->srcPtr), "\"", NULL);
+		return TCL_ERROR;
+	}
+	if ((mode & TCL_READABLE) != TCL_READABLE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "channel \"", Tcl_GetString(statePtr->srcPtr),
+				"\" is not opened for reading", NULL);
+		return TCL_ERROR;
+	}
+
+	statePtr->outChan = Tcl_GetChannel(interp,
+			Tcl_GetString(statePtr->dstPtr), &mode);
+	if (statePtr->outChan == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not find channel named \"",
+				Tcl_GetString(statePtr->dstPtr), "\"", NULL);
+		return TCL_ERROR;
+	}
+	if ((mode & TCL_WRITABLE) != TCL_WRITABLE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "channel \"", Tcl_GetString(statePtr->dstPtr),
+				"\" is not opened for writing", NULL);
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+static int
+Cmd_ParseCopyOptions (
+		Tcl_Interp     *interp,
+		Tcl_Obj *const objv[],
+		int            first,
+		int            last,
+		CopyState      *statePtr
+		)
+{
+	int i, op;
+
+	static const char *options[] = { "-chan", "-file", "-size", "-command",
+		"-thex", "-hex", "-raw", "-192", "-160", "-128", NULL };
+	enum { OP_CHAN, OP_FILE, OP_SIZE, OP_COMMAND,
+		OP_THEX, OP_HEX, OP_RAW, OP_192, OP_160, OP_128 };
+
+	for (i = first; i <= last; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		if (op == OP_SIZE || op == OP_COMMAND) {
+			if (i == last) {
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "option \"",
+						Tcl_GetString(objv[i]), "\" requires an argument",
+						NULL);
+				return TCL_ERROR;
+			}
+			++i;
+		}
+		switch (op) {
+			case OP_CHAN:
+				statePtr->mode = CM_CHAN;
+			break;
+			case OP_FILE:
+				statePtr->mode = CM_FILE;
+			break;
+			case OP_SIZE:
+				if (Tcl_GetIntFromObj(interp, objv[i],
+						&statePtr->bufSize) != TCL_OK) { return TCL_ERROR; }
+				if (statePtr->bufSize <= 0) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad buffer size \"",
+							Tcl_GetString(objv[i]),
+							"\": must be a positive integer", NULL);
+					return TCL_ERROR;
+				}
+			break;
+			case OP_COMMAND:
+				if (statePtr->cmdPtr != NULL) {
+					Tcl_DecrRefCount(statePtr->cmdPtr);
+				}
+				statePtr->cmdPtr = objv[i];
+				Tcl_IncrRefCount(statePtr->cmdPtr);
+			break;
+			case OP_THEX:
+				statePtr->output = DO_THEX;
+			break;
+			case OP_HEX:
+				statePtr->output = DO_HEX;
+			break;
+			case OP_RAW:
+				statePtr->output = DO_RAW;
+			break;
+			case OP_192:
+				statePtr->bitlen = DL_192;
+			break;
+			case OP_160:
+				statePtr->bitlen = DL_160;
+			break;
+			case OP_128:
+				statePtr->bitlen = DL_128;
+			break;
+		}
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Copy_Cmd --
+ *
+ *	Implements the "::tth::copy" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Data is copied from the source to the destination.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Copy_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	CopyState *statePtr;
+	int code, done, src;
+
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 1, objv,
+				"?options? source destination ?options?");
+		return TCL_ERROR;
+	}
+
+	/*
+	 * Options either precede the operands or, as with fcopy,
+	 * follow them when the first argument is not an option.
+	 */
+	if (Tcl_GetString(objv[1])[0] == '-') {
+		src = objc - 2;
+	} else {
+		src = 1;
+	}
+
+	statePtr = (CopyState *) ckalloc(sizeof(CopyState));
+	memset(statePtr, 0, sizeof(CopyState));
+	statePtr->interp  = interp;
+	statePtr->mode    = CM_CHAN;
+	statePtr->bufSize = COPY_BUFSIZE;
+	statePtr->output  = DO_THEX;
+	statePtr->bitlen  = DL_192;
+	statePtr->blocking = -1;
+	statePtr->srcSize = -1;
+	statePtr->srcPtr  = objv[src];
+	statePtr->dstPtr  = objv[src + 1];
+	Tcl_IncrRefCount(statePtr->srcPtr);
+	Tcl_IncrRefCount(statePtr->dstPtr);
+	tt_init(&statePtr->context);
+
+	if (src == 1) {
+		code = Cmd_ParseCopyOptions(interp, objv, 3, objc - 1, statePtr);
+	} else {
+		code = Cmd_ParseCopyOptions(interp, objv, 1, objc - 3, statePtr);
+	}
+	if (code != TCL_OK) {
+		Copy_Free(statePtr);
+		return TCL_ERROR;
+	}
+
+	switch (statePtr->mode) {
+		case CM_CHAN:
+			code = Copy_GetChannels(statePtr);
+		break;
+		case CM_FILE:
+		default:
+#ifdef USE_MMAP_COPY
+			statePtr->mmapPtr = TTH_MmapCopyOpen(interp,
+					statePtr->srcPtr, statePtr->dstPtr);
+			code = statePtr->mmapPtr != NULL ? TCL_OK : TCL_ERROR;
+#else
+			code = Copy_OpenFiles(statePtr);
+#endif
+		break;
+	}
+	if (code != TCL_OK) {
+		Copy_Free(statePtr);
+		return TCL_ERROR;
+	}
+
+	if (statePtr->inChan != NULL) {
+		statePtr->buffer = (byte *) ckalloc(statePtr->bufSize);
+	}
+
+	/*
+	 * A background copying reads the source in non-blocking mode,
+	 * as fcopy does, so a slow pipe or socket does not freeze
+	 * the event loop; a synchronous one reads it in blocking mode
+	 * so it does not spin on a non-blocking channel.
+	 */
+	if (statePtr->cmdPtr != NULL) {
+		Copy_Register(statePtr);
+		if (statePtr->inChan != NULL) {
+			Copy_SetBlocking(statePtr, 0);
+			Tcl_CreateChannelHandler(statePtr->inChan, TCL_READABLE,
+					Copy_ChannelProc, (ClientData) statePtr);
+			if (!statePtr->closeChans) {
+				Tcl_CreateCloseHandler(statePtr->inChan,
+						Copy_CloseProc, (ClientData) statePtr);
+				Tcl_CreateCloseHandler(statePtr->outChan,
+						Copy_CloseProc, (ClientData) statePtr);
+			}
+		} else {
+			statePtr->timer = Tcl_CreateTimerHandler(0, Copy_TimerProc,
+					(ClientData) statePtr);
+		}
+		return TCL_OK;
+	}
+
+	Copy_SetBlocking(statePtr, 1);
+
+	do {
+		done = 0;
+		code = Copy_Step(statePtr, &done);
+	} while (code == TCL_OK && !done);
+
+	Copy_RestoreBlocking(statePtr);
+
+	return Copy_Finish(statePtr, code);
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Copy_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::copy",
+		(Tcl_ObjCmdProc *) Copy_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
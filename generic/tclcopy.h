@@ -0,0 +1,27 @@
+/*
+ * tclcopy.h --
+ *
+ *	This file implements a Tcl command which copies data
+ *	between channels or files calculating TTH on it
+ *	in the same pass.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __TCLCOPY_H
+#define __TCLCOPY_H
+
+#include <tcl.h>
+
+Tcl_Command
+Copy_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLCOPY_H */
@@ -0,0 +1,655 @@
+/*
+ * tcldigest.c --
+ *
+ *	This file implements the "tthdigest" Tcl object type holding
+ *	a digest (192, 160 or 128 bits of it) as raw bytes, and the
+ *	commands converting and comparing digests.
+ *
+ *	Digests returned in THEX and hex formats are objects of this
+ *	type whose string rep is only generated when asked for.
+ *	Any THEX or hex string of a proper length can be converted back
+ *	to this type without loss, and raw digests (byte arrays of 16,
+ *	20 or 24 bytes) are accepted as they are, so digests can be
+ *	compared regardless of their format without any formatting.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tcldigest.h"
+#include "tclpool.h"
+#include "base32.h"
+#include "hex.h"
+
+typedef struct {
+	byte          digest[TIGERSIZE];
+	unsigned char length;       /* in bytes: 24, 20 or 16 */
+	unsigned char form;         /* DIGEST_FORM of the string rep */
+} DigestRep;
+
+static void FreeDigestInternalRep (Tcl_Obj *objPtr);
+static void DupDigestInternalRep (Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+static void UpdateStringOfDigest (Tcl_Obj *objPtr);
+static int  SetDigestFromAny (Tcl_Interp *interp, Tcl_Obj *objPtr);
+
+static Tcl_ObjType digestObjType = {
+	"tthdigest",
+	FreeDigestInternalRep,
+	DupDigestInternalRep,
+	UpdateStringOfDigest,
+	SetDigestFromAny
+};
+
+#define DIGEST_REP(objPtr) \
+	((DigestRep *) (objPtr)->internalRep.otherValuePtr)
+
+static const char base32Digits[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz234567";
+
+/* Lengths of the printable forms of a digest of n bytes */
+#define THEX_LENGTH(n) (((n) * 8 + 4) / 5)
+#define HEX_LENGTH(n)  ((n) * 2)
+
+
+/*
+ *
+ */
+static void
+FreeDigestInternalRep (
+		Tcl_Obj *objPtr
+		)
+{
+	TTH_PoolFree(DIGEST_REP(objPtr), sizeof(DigestRep));
+	objPtr->typePtr = NULL;
+}
+
+
+/*
+ *
+ */
+static void
+DupDigestInternalRep (
+		Tcl_Obj *srcPtr,
+		Tcl_Obj *dupPtr
+		)
+{
+	DigestRep *repPtr;
+
+	repPtr = (DigestRep *) TTH_PoolAlloc(sizeof(DigestRep));
+	memcpy(repPtr, DIGEST_REP(srcPtr), sizeof(DigestRep));
+	dupPtr->internalRep.otherValuePtr = (VOID *) repPtr;
+	dupPtr->typePtr = &digestObjType;
+}
+
+
+/*
+ *
+ */
+static void
+UpdateStringOfDigest (
+		Tcl_Obj *objPtr
+		)
+{
+	DigestRep *repPtr;
+
+	repPtr = DIGEST_REP(objPtr);
+
+	if (repPtr->form == DF_HEX) {
+		objPtr->bytes = ckalloc(HEX_DESTLEN(repPtr->length));
+		to_hex(repPtr->digest, repPtr->length, objPtr->bytes);
+		objPtr->length = HEX_LENGTH(repPtr->length);
+	} else {
+		objPtr->bytes = ckalloc(BASE32_DESTLEN(repPtr->length));
+		to_base32(repPtr->digest, repPtr->length, objPtr->bytes);
+		objPtr->length = THEX_LENGTH(repPtr->length);
+	}
+}
+
+
+/*
+ * Reports a malformed digest pointing at the character
+ * at the given byte offset into its string.
+ */
+static void
+BadDigest (
+		Tcl_Interp  *interp,
+		const char  *str,
+		size_t      pos,
+		int         badBits
+		)
+{
+	char buf[TCL_INTEGER_SPACE];
+	char ch[TCL_UTF_MAX + 1];
+	Tcl_UniChar uc;
+
+	if (interp == NULL) {
+		return;
+	}
+
+	sprintf(buf, "%d", Tcl_NumUtfChars(str, (int) pos));
+	ch[Tcl_UniCharToUtf(Tcl_UtfToUniChar(str + pos, &uc) ? uc : 0, ch)] = '\0';
+
+	Tcl_ResetResult(interp);
+	if (badBits) {
+		Tcl_AppendResult(interp, "bad digest \"", str,
+				"\": non-zero unused bits in character \"", ch,
+				"\" at position ", buf, NULL);
+	} else {
+		Tcl_AppendResult(interp, "bad digest \"", str,
+				"\": invalid character \"", ch,
+				"\" at position ", buf, NULL);
+	}
+}
+
+
+/*
+ * Decodes a digest in THEX or hex format recognizing it by its length.
+ * The only ambiguous length is 32 which is that of both 160-bit
+ * THEX and 128-bit hex forms; hex is tried first, and if neither
+ * fits, the error of the form which fits further is reported.
+ */
+static int
+ParseDigest (
+		Tcl_Interp  *interp,
+		const char  *str,
+		int         len,
+		byte        digest[],
+		int         *lengthPtr,
+		DIGEST_FORM *formPtr
+		)
+{
+	int isHex, isTHEX;
+	size_t hexPos, thexPos;
+	long n;
+
+	isHex  = len == HEX_LENGTH(24) || len == HEX_LENGTH(20)
+			|| len == HEX_LENGTH(16);
+	isTHEX = len == THEX_LENGTH(24) || len == THEX_LENGTH(20)
+			|| len == THEX_LENGTH(16);
+
+	if (!isHex && !isTHEX) {
+		if (interp != NULL) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "expected digest but got \"",
+					str, "\"", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	hexPos = thexPos = 0;
+	if (isHex) {
+		n = from_hex(str, (size_t) len, digest, &hexPos);
+		if (n >= 0) {
+			*lengthPtr = (int) n;
+			*formPtr = DF_HEX;
+			return TCL_OK;
+		}
+	}
+	if (isTHEX) {
+		n = from_base32(str, (size_t) len, digest, &thexPos);
+		if (n >= 0) {
+			*lengthPtr = (int) n;
+			*formPtr = DF_THEX;
+			return TCL_OK;
+		}
+	}
+
+	if (isTHEX && (!isHex || thexPos >= hexPos)) {
+		/* A valid character can only be rejected for its unused bits */
+		BadDigest(interp, str, thexPos, str[thexPos] != '\0'
+				&& strchr(base32Digits, str[thexPos]) != NULL);
+	} else {
+		BadDigest(interp, str, hexPos, 0);
+	}
+	return TCL_ERROR;
+}
+
+
+/*
+ *
+ */
+static int
+SetDigestFromAny (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr
+		)
+{
+	DigestRep *repPtr;
+	byte digest[TIGERSIZE];
+	const char *str;
+	int len;
+	DIGEST_FORM form;
+
+	str = Tcl_GetStringFromObj(objPtr, &len);
+	if (ParseDigest(interp, str, len, digest, &len, &form) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	repPtr = (DigestRep *) TTH_PoolAlloc(sizeof(DigestRep));
+	memcpy(repPtr->digest, digest, len);
+	repPtr->length = (unsigned char) len;
+	repPtr->form = (unsigned char) form;
+
+	if (objPtr->typePtr != NULL && objPtr->typePtr->freeIntRepProc != NULL) {
+		objPtr->typePtr->freeIntRepProc(objPtr);
+	}
+	objPtr->internalRep.otherValuePtr = (VOID *) repPtr;
+	objPtr->typePtr = &digestObjType;
+
+	return TCL_OK;
+}
+
+
+/*
+ * Returns a new digest object whose string rep, when needed,
+ * is the given digest of length bytes in the given form.
+ */
+Tcl_Obj *
+DigestNewObj (
+		const byte  digest[],
+		int         length,
+		DIGEST_FORM form
+		)
+{
+	DigestRep *repPtr;
+	Tcl_Obj *objPtr;
+
+	repPtr = (DigestRep *) TTH_PoolAlloc(sizeof(DigestRep));
+	memcpy(repPtr->digest, digest, length);
+	repPtr->length = (unsigned char) length;
+	repPtr->form = (unsigned char) form;
+
+	objPtr = Tcl_NewObj();
+	Tcl_InvalidateStringRep(objPtr);
+	objPtr->internalRep.otherValuePtr = (VOID *) repPtr;
+	objPtr->typePtr = &digestObjType;
+
+	return objPtr;
+}
+
+
+/*
+ * Checks whether the object is a "raw" digest, that is,
+ * a byte array of a proper length, and retrieves its bytes if it is.
+ */
+static int
+IsRawDigest (
+		Tcl_Obj     *objPtr,
+		const byte  **digestPtr,
+		int         *lengthPtr
+		)
+{
+	static const Tcl_ObjType *byteArrayTypePtr = NULL;
+	const byte *bytesPtr;
+	int len;
+
+	if (byteArrayTypePtr == NULL) {
+		byteArrayTypePtr = Tcl_GetObjType("bytearray");
+	}
+	if (objPtr->typePtr == NULL || objPtr->typePtr != byteArrayTypePtr) {
+		return 0;
+	}
+
+	bytesPtr = Tcl_GetByteArrayFromObj(objPtr, &len);
+	if (len != 24 && len != 20 && len != 16) {
+		return 0;
+	}
+
+	*digestPtr = bytesPtr;
+	*lengthPtr = len;
+	return 1;
+}
+
+
+/*
+ * Retrieves the bytes of a digest given in any format.
+ * Raw digests are used as they are, other objects are converted
+ * to digest objects; the returned pointer is valid as long as
+ * the object is not modified.
+ */
+int
+DigestGetFromObj (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *objPtr,
+		const byte  **digestPtr,
+		int         *lengthPtr
+		)
+{
+	if (objPtr->typePtr != &digestObjType) {
+		if (IsRawDigest(objPtr, digestPtr, lengthPtr)) {
+			return TCL_OK;
+		}
+		if (SetDigestFromAny(interp, objPtr) != TCL_OK) {
+			return TCL_ERROR;
+		}
+	}
+
+	*digestPtr = DIGEST_REP(objPtr)->digest;
+	*lengthPtr = DIGEST_REP(objPtr)->length;
+	return TCL_OK;
+}
+
+
+/*
+ * Retrieves the bytes of a digest given in any format like
+ * DigestGetFromObj() does but leaves the object alone, decoding
+ * a digest string into buf, so going over a whole list of digests
+ * costs no allocations.
+ */
+int
+DigestParseObj (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *objPtr,
+		byte        buf[],
+		const byte  **digestPtr,
+		int         *lengthPtr
+		)
+{
+	const char *str;
+	int len;
+	DIGEST_FORM form;
+
+	if (objPtr->typePtr == &digestObjType) {
+		*digestPtr = DIGEST_REP(objPtr)->digest;
+		*lengthPtr = DIGEST_REP(objPtr)->length;
+		return TCL_OK;
+	}
+	if (IsRawDigest(objPtr, digestPtr, lengthPtr)) {
+		return TCL_OK;
+	}
+
+	str = Tcl_GetStringFromObj(objPtr, &len);
+	if (ParseDigest(interp, str, len, buf, lengthPtr,
+				&form) != TCL_OK) { return TCL_ERROR; }
+	*digestPtr = buf;
+	return TCL_OK;
+}
+
+
+/*
+ * Returns the digest given in any format in the requested one.
+ */
+static Tcl_Obj *
+ConvertDigest (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *objPtr,
+		int         raw,
+		DIGEST_FORM form
+		)
+{
+	byte buf[TIGERSIZE];
+	const byte *digest;
+	int len;
+
+	if (objPtr->typePtr == &digestObjType) {
+		if (!raw && DIGEST_REP(objPtr)->form == form) {
+			return objPtr;
+		}
+	} else if (raw && IsRawDigest(objPtr, &digest, &len)) {
+		return objPtr;
+	}
+
+	if (DigestParseObj(interp, objPtr, buf, &digest, &len) != TCL_OK) {
+		return NULL;
+	}
+
+	if (raw) {
+		return Tcl_NewByteArrayObj(digest, len);
+	}
+	return DigestNewObj(digest, len, form);
+}
+
+
+/*
+ * Orders digests by their bytes, a shorter digest
+ * going before the longer one it is a prefix of.
+ */
+static int
+CompareDigests (
+		Tcl_Interp *interp,
+		Tcl_Obj    *aPtr,
+		Tcl_Obj    *bPtr,
+		int        *resultPtr
+		)
+{
+	const byte *a, *b;
+	int alen, blen, res;
+
+	if (DigestGetFromObj(interp, aPtr, &a, &alen) != TCL_OK
+			|| DigestGetFromObj(interp, bPtr, &b, &blen) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	res = memcmp(a, b, alen < blen ? alen : blen);
+	if (res == 0) {
+		res = alen - blen;
+	}
+	*resultPtr = res < 0 ? -1 : res > 0;
+
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Equal_Cmd --
+ *
+ *	Implements the "::tth::equal" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Arguments are converted to digests.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Equal_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	int res;
+
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "digest1 digest2");
+		return TCL_ERROR;
+	}
+
+	if (CompareDigests(interp, objv[1], objv[2], &res) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(res == 0));
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Compare_Cmd --
+ *
+ *	Implements the "::tth::compare" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Arguments are converted to digests.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Compare_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	int res;
+
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "digest1 digest2");
+		return TCL_ERROR;
+	}
+
+	if (CompareDigests(interp, objv[1], objv[2], &res) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(res));
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Convert_Cmd --
+ *
+ *	Implements the "::tth::convert" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Convert_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *options[] = { "-thex", "-hex", "-raw", "-list", NULL };
+	enum { OP_THEX, OP_HEX, OP_RAW, OP_LIST };
+	Tcl_Obj **elemv, *resultPtr, *digestPtr;
+	int i, op, elemc, raw, list;
+	DIGEST_FORM form;
+	char buf[TCL_INTEGER_SPACE];
+
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?options? digest");
+		return TCL_ERROR;
+	}
+
+	raw  = 0;
+	list = 0;
+	form = DF_THEX;
+	for (i = 1; i < objc - 1; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+					0, &op) != TCL_OK) { return TCL_ERROR; }
+		switch (op) {
+			case OP_THEX:
+				raw = 0;
+				form = DF_THEX;
+			break;
+			case OP_HEX:
+				raw = 0;
+				form = DF_HEX;
+			break;
+			case OP_RAW:
+				raw = 1;
+			break;
+			case OP_LIST:
+				list = 1;
+			break;
+		}
+	}
+
+	if (!list) {
+		digestPtr = ConvertDigest(interp, objv[objc - 1], raw, form);
+		if (digestPtr == NULL) {
+			return TCL_ERROR;
+		}
+		Tcl_SetObjResult(interp, digestPtr);
+		return TCL_OK;
+	}
+
+	if (Tcl_ListObjGetElements(interp, objv[objc - 1],
+				&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+
+	resultPtr = Tcl_NewListObj(elemc, NULL);
+	for (i = 0; i < elemc; ++i) {
+		digestPtr = ConvertDigest(interp, elemv[i], raw, form);
+		if (digestPtr == NULL) {
+			Tcl_DecrRefCount(resultPtr);
+			digestPtr = Tcl_GetObjResult(interp);
+			Tcl_IncrRefCount(digestPtr);
+			sprintf(buf, "%d", i);
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "element ", buf, ": ",
+					Tcl_GetString(digestPtr), NULL);
+			Tcl_DecrRefCount(digestPtr);
+			return TCL_ERROR;
+		}
+		Tcl_ListObjAppendElement(NULL, resultPtr, digestPtr);
+	}
+
+	Tcl_SetObjResult(interp, resultPtr);
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Convert_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::convert",
+		(Tcl_ObjCmdProc *) Convert_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Equal_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::equal",
+		(Tcl_ObjCmdProc *) Equal_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Compare_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::compare",
+		(Tcl_ObjCmdProc *) Compare_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
@@ -0,0 +1,68 @@
+/*
+ * tcldigest.h --
+ *
+ *	This file implements interface for tcldigest.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLDIGEST_H
+#define __TCLDIGEST_H
+
+#include <tcl.h>
+#include "tiger.h"
+
+/*
+ * Printable forms of a digest object.
+ */
+typedef enum {
+	DF_THEX,
+	DF_HEX
+} DIGEST_FORM;
+
+Tcl_Obj *
+DigestNewObj (
+		const byte  digest[],
+		int         length,
+		DIGEST_FORM form
+		);
+
+int
+DigestGetFromObj (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *objPtr,
+		const byte  **digestPtr,
+		int         *lengthPtr
+		);
+
+int
+DigestParseObj (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *objPtr,
+		byte        buf[],
+		const byte  **digestPtr,
+		int         *lengthPtr
+		);
+
+Tcl_Command
+Convert_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+Tcl_Command
+Equal_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+Tcl_Command
+Compare_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLDIGEST_H */
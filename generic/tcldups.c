@@ -0,0 +1,671 @@
+/*
+ * tcldups.c --
+ *
+ *	This file implements the "::tth::duplicates" command finding
+ *	groups of identical files.
+ *
+ *	Candidates are narrowed in stages, each stage only looking
+ *	at the files which are still not known to be unique:
+ *	- files are grouped by size;
+ *	- then by the hashes of their first and last leaves (at most
+ *	  2 KiB read per file), which are their whole trees for files
+ *	  of up to two leaves;
+ *	- then by their Tiger Tree Hashes.
+ *	The hashing stages are run by several threads, each taking
+ *	the next file to hash from a shared counter.
+ *	Files which can not be read are dropped from the candidates
+ *	and reported apart from the groups. A file named more than once,
+ *	by the same path or by hard links, is only a candidate under its
+ *	first name: it is the same data, not a duplicate of it.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "tigertree.h"
+#include "tcldups.h"
+
+#ifndef S_ISREG
+#define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#endif
+
+#define DUPS_BUFSIZE     65536
+#define DUPS_THREADS     4
+#define DUPS_MAXTHREADS  64
+
+typedef struct {
+	Tcl_Obj     *pathPtr;
+	const char  *path;              /* used by the hashing threads */
+	Tcl_WideInt size;
+	dev_t       dev;                /* identity of the file, if ino */
+	ino_t       ino;                /* is not 0 */
+	int         index;              /* position in the list of paths */
+	int         error;              /* errno of a failed read, or 0 */
+	byte        edges[2 * TIGERSIZE];  /* first and last leaves */
+	byte        root[TIGERSIZE];
+} FileInfo;
+
+typedef void (DupsProc) (FileInfo *filePtr, char *buffer);
+
+/*
+ * A hashing stage shared by the threads running it.
+ */
+typedef struct {
+	DupsProc    *proc;
+	FileInfo    **files;
+	int         count;
+	int         next;               /* next file to take */
+	Tcl_Mutex   mutex;
+} DupsPass;
+
+/*
+ * A group of duplicates being reported.
+ */
+typedef struct {
+	int         first;              /* index of the first file */
+	Tcl_Obj     *listPtr;
+} DupsGroup;
+
+
+/*
+ * Reads exactly len bytes from the channel; returns 0 on failure
+ * leaving errno in the file info.
+ */
+static int
+Dups_Read (
+		Tcl_Channel chan,
+		FileInfo    *filePtr,
+		char        *buffer,
+		int         len
+		)
+{
+	int n;
+
+	n = Tcl_Read(chan, buffer, len);
+	if (n == len) {
+		return 1;
+	}
+
+	/* A short read means the file was truncated after it was examined */
+	filePtr->error = n < 0 ? Tcl_GetErrno() : EIO;
+	return 0;
+}
+
+
+/*
+ * Opens the file in a hashing thread.
+ */
+static Tcl_Channel
+Dups_Open (
+		FileInfo *filePtr
+		)
+{
+	Tcl_Obj *pathPtr;
+	Tcl_Channel chan;
+
+	/* Tcl objects may not be shared by threads */
+	pathPtr = Tcl_NewStringObj(filePtr->path, -1);
+	Tcl_IncrRefCount(pathPtr);
+	chan = Tcl_FSOpenFileChannel(NULL, pathPtr, "r", 0);
+	Tcl_DecrRefCount(pathPtr);
+
+	if (chan == NULL) {
+		filePtr->error = Tcl_GetErrno();
+		return NULL;
+	}
+	Tcl_SetChannelOption(NULL, chan, "-translation", "binary");
+
+	return chan;
+}
+
+
+/*
+ * Hashes the first and the last leaves of the file.
+ */
+static void
+Dups_HashEdges (
+		FileInfo *filePtr,
+		char     *buffer
+		)
+{
+	Tcl_Channel chan;
+	Tcl_WideInt last;
+	int len;
+
+	chan = Dups_Open(filePtr);
+	if (chan == NULL) {
+		return;
+	}
+
+	len = filePtr->size < BLOCKSIZE ? (int) filePtr->size : BLOCKSIZE;
+	if (Dups_Read(chan, filePtr, buffer, len)) {
+		tt_hash((const byte *) buffer, len, filePtr->edges);
+		if (filePtr->size > BLOCKSIZE) {
+			last = (filePtr->size - 1) / BLOCKSIZE * BLOCKSIZE;
+			len = (int) (filePtr->size - last);
+			if (Tcl_Seek(chan, last, SEEK_SET) < 0) {
+				filePtr->error = Tcl_GetErrno();
+			} else if (Dups_Read(chan, filePtr, buffer, len)) {
+				tt_hash((const byte *) buffer, len,
+						filePtr->edges + TIGERSIZE);
+			}
+		}
+	}
+
+	Tcl_Close(NULL, chan);
+}
+
+
+/*
+ * Calculates the Tiger Tree Hash of the file.
+ */
+static void
+Dups_HashFile (
+		FileInfo *filePtr,
+		char     *buffer
+		)
+{
+	Tcl_Channel chan;
+	TT_CONTEXT context;
+	int n;
+
+	chan = Dups_Open(filePtr);
+	if (chan == NULL) {
+		return;
+	}
+
+	tt_init(&context);
+	while ((n = Tcl_Read(chan, buffer, DUPS_BUFSIZE)) > 0) {
+		tt_update(&context, (const byte *) buffer, (word32) n);
+	}
+	if (n < 0) {
+		filePtr->error = Tcl_GetErrno();
+	}
+	tt_digest(&context, filePtr->root);
+	tt_free(&context);
+
+	Tcl_Close(NULL, chan);
+}
+
+
+/*
+ * Takes files of the pass and hashes them until there are none left.
+ */
+static void
+Dups_RunPass (
+		DupsPass *passPtr
+		)
+{
+	char *buffer;
+	int i;
+
+	buffer = ckalloc(DUPS_BUFSIZE);
+
+	for (;;) {
+		Tcl_MutexLock(&passPtr->mutex);
+		i = passPtr->next++;
+		Tcl_MutexUnlock(&passPtr->mutex);
+		if (i >= passPtr->count) {
+			break;
+		}
+		passPtr->proc(passPtr->files[i], buffer);
+	}
+
+	ckfree(buffer);
+}
+
+
+/*
+ *
+ */
+static Tcl_ThreadCreateType
+Dups_Thread (
+		ClientData clientData
+		)
+{
+	Dups_RunPass((DupsPass *) clientData);
+	Tcl_ExitThread(0);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+
+/*
+ * Applies the proc to the files using up to the given number
+ * of threads, the current one included.
+ */
+static void
+Dups_Parallel (
+		FileInfo **files,
+		int      count,
+		DupsProc *proc,
+		int      threads
+		)
+{
+	DupsPass pass;
+	Tcl_ThreadId ids[DUPS_MAXTHREADS];
+	int i, n, result;
+
+	pass.proc  = proc;
+	pass.files = files;
+	pass.count = count;
+	pass.next  = 0;
+	pass.mutex = NULL;
+
+	/* Threads are only started while there is work for them */
+	for (n = 0; n < threads - 1 && n < count - 1; ++n) {
+		if (Tcl_CreateThread(&ids[n], Dups_Thread, (ClientData) &pass,
+					TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) != TCL_OK) {
+			break;
+		}
+	}
+
+	Dups_RunPass(&pass);
+
+	for (i = 0; i < n; ++i) {
+		Tcl_JoinThread(ids[i], &result);
+	}
+	Tcl_MutexFinalize(&pass.mutex);
+}
+
+
+/*
+ * Orders files by size, edges, root and position in the list;
+ * edges and roots are zero until they are calculated.
+ */
+static int
+Dups_CompareFiles (
+		const void *a,
+		const void *b
+		)
+{
+	const FileInfo *f1 = *(const FileInfo **) a;
+	const FileInfo *f2 = *(const FileInfo **) b;
+	int res;
+
+	if (f1->size != f2->size) {
+		return f1->size < f2->size ? -1 : 1;
+	}
+	res = memcmp(f1->edges, f2->edges, sizeof(f1->edges));
+	if (res == 0) {
+		res = memcmp(f1->root, f2->root, sizeof(f1->root));
+	}
+	if (res == 0) {
+		res = f1->index - f2->index;
+	}
+
+	return res;
+}
+
+
+/*
+ * Orders files by identity and position in the list.
+ */
+static int
+Dups_CompareIdentities (
+		const void *a,
+		const void *b
+		)
+{
+	const FileInfo *f1 = *(const FileInfo **) a;
+	const FileInfo *f2 = *(const FileInfo **) b;
+
+	if (f1->dev != f2->dev) {
+		return f1->dev < f2->dev ? -1 : 1;
+	}
+	if (f1->ino != f2->ino) {
+		return f1->ino < f2->ino ? -1 : 1;
+	}
+
+	return f1->index - f2->index;
+}
+
+
+/*
+ * Keeps only the first name of each file named more than once;
+ * returns the number of candidates left.
+ */
+static int
+Dups_DropAliases (
+		FileInfo **files,
+		int      count
+		)
+{
+	int i, kept;
+
+	qsort(files, count, sizeof(FileInfo *), Dups_CompareIdentities);
+
+	kept = 0;
+	for (i = 0; i < count; ++i) {
+		if (kept > 0 && files[i]->ino != 0
+				&& files[i]->dev == files[kept - 1]->dev
+				&& files[i]->ino == files[kept - 1]->ino) {
+			continue;
+		}
+		files[kept++] = files[i];
+	}
+
+	return kept;
+}
+
+
+/*
+ * Orders groups of duplicates by the positions of their first files.
+ */
+static int
+Dups_CompareGroups (
+		const void *a,
+		const void *b
+		)
+{
+	return ((const DupsGroup *) a)->first - ((const DupsGroup *) b)->first;
+}
+
+
+/*
+ * Sorts the candidates and keeps those which have the same
+ * size, edges and root as some other candidate; runs of such
+ * files accepted by finalProc are moved to the groups instead.
+ * Returns the number of candidates kept.
+ */
+static int
+Dups_Narrow (
+		FileInfo  **files,
+		int       count,
+		int       (*finalProc) (FileInfo *filePtr),
+		FileInfo  **groups,
+		int       *groupCountPtr
+		)
+{
+	int i, j, k, kept;
+
+	qsort(files, count, sizeof(FileInfo *), Dups_CompareFiles);
+
+	kept = 0;
+	for (i = 0; i < count; i = j) {
+		for (j = i + 1; j < count; ++j) {
+			if (files[j]->size != files[i]->size
+					|| memcmp(files[j]->edges, files[i]->edges,
+						sizeof(files[i]->edges)) != 0
+					|| memcmp(files[j]->root, files[i]->root,
+						sizeof(files[i]->root)) != 0) {
+				break;
+			}
+		}
+		if (j - i < 2) {
+			continue;
+		}
+		if (finalProc(files[i])) {
+			for (k = i; k < j; ++k) {
+				groups[(*groupCountPtr)++] = files[k];
+			}
+			/* Groups are separated by NULLs */
+			groups[(*groupCountPtr)++] = NULL;
+		} else {
+			for (k = i; k < j; ++k) {
+				files[kept++] = files[k];
+			}
+		}
+	}
+
+	return kept;
+}
+
+
+/*
+ * Predicates telling whether a run of candidates
+ * of each stage is a group of duplicates.
+ */
+static int
+Dups_IsEmpty (
+		FileInfo *filePtr
+		)
+{
+	return filePtr->size == 0;
+}
+
+static int
+Dups_IsShort (
+		FileInfo *filePtr
+		)
+{
+	return filePtr->size <= 2 * BLOCKSIZE;
+}
+
+static int
+Dups_IsHashed (
+		FileInfo *filePtr
+		)
+{
+	return 1;
+}
+
+
+/*
+ * Drops the files the pass failed to read from the candidates;
+ * returns the number of candidates left.
+ */
+static int
+Dups_DropErrors (
+		FileInfo **files,
+		int      count
+		)
+{
+	int i, kept;
+
+	kept = 0;
+	for (i = 0; i < count; ++i) {
+		if (files[i]->error == 0) {
+			files[kept++] = files[i];
+		}
+	}
+
+	return kept;
+}
+
+
+/*
+ * Finds the groups of duplicates among the files.
+ */
+static int
+Dups_Find (
+		Tcl_Interp *interp,
+		int        objc,
+		Tcl_Obj    *const objv[],
+		int        threads,
+		Tcl_Obj    *errorVarPtr
+		)
+{
+	FileInfo *infos, **files, **groups;
+	DupsGroup *result;
+	Tcl_StatBuf statBuf;
+	Tcl_Obj *listPtr, *resultPtr, *errorsPtr;
+	int i, infoCount, count, groupCount, resultCount, code;
+
+	infos  = (FileInfo *) ckalloc(sizeof(FileInfo) * (objc + 1));
+	files  = (FileInfo **) ckalloc(sizeof(FileInfo *) * (objc + 1));
+	groups = (FileInfo **) ckalloc(sizeof(FileInfo *) * (2 * objc + 1));
+	memset(infos, 0, sizeof(FileInfo) * (objc + 1));
+	code = TCL_ERROR;
+
+	/* Only regular files are considered */
+	infoCount = 0;
+	count = 0;
+	for (i = 0; i < objc; ++i) {
+		infos[infoCount].pathPtr = objv[i];
+		infos[infoCount].path = Tcl_GetString(objv[i]);
+		infos[infoCount].index = i;
+		if (Tcl_FSStat(objv[i], &statBuf) != 0) {
+			infos[infoCount++].error = Tcl_GetErrno();
+			continue;
+		}
+		if (!S_ISREG(statBuf.st_mode)) {
+			continue;
+		}
+		infos[infoCount].size = (Tcl_WideInt) statBuf.st_size;
+		infos[infoCount].dev  = statBuf.st_dev;
+		infos[infoCount].ino  = statBuf.st_ino;
+		files[count++] = &infos[infoCount++];
+	}
+	count = Dups_DropAliases(files, count);
+
+	groupCount = 0;
+	count = Dups_Narrow(files, count, Dups_IsEmpty, groups, &groupCount);
+
+	Dups_Parallel(files, count, Dups_HashEdges, threads);
+	count = Dups_DropErrors(files, count);
+	count = Dups_Narrow(files, count, Dups_IsShort, groups, &groupCount);
+
+	Dups_Parallel(files, count, Dups_HashFile, threads);
+	count = Dups_DropErrors(files, count);
+	Dups_Narrow(files, count, Dups_IsHashed, groups, &groupCount);
+
+	/* Unreadable files are reported in the order of the list */
+	if (errorVarPtr != NULL) {
+		errorsPtr = Tcl_NewObj();
+		for (i = 0; i < infoCount; ++i) {
+			if (infos[i].error != 0) {
+				Tcl_ListObjAppendElement(NULL, errorsPtr, infos[i].pathPtr);
+				Tcl_ListObjAppendElement(NULL, errorsPtr,
+						Tcl_NewStringObj(Tcl_ErrnoMsg(infos[i].error), -1));
+			}
+		}
+		if (Tcl_ObjSetVar2(interp, errorVarPtr, NULL, errorsPtr,
+					TCL_LEAVE_ERR_MSG) == NULL) {
+			goto done;
+		}
+	}
+
+	/* Groups are reported in the order of their first files */
+	result = (DupsGroup *) ckalloc(sizeof(DupsGroup) * (groupCount / 3 + 1));
+	resultCount = 0;
+	listPtr = NULL;
+	for (i = 0; i < groupCount; ++i) {
+		if (groups[i] == NULL) {
+			result[resultCount++].listPtr = listPtr;
+			listPtr = NULL;
+			continue;
+		}
+		if (listPtr == NULL) {
+			listPtr = Tcl_NewObj();
+			result[resultCount].first = groups[i]->index;
+		}
+		Tcl_ListObjAppendElement(NULL, listPtr, groups[i]->pathPtr);
+	}
+	qsort(result, resultCount, sizeof(DupsGroup), Dups_CompareGroups);
+
+	resultPtr = Tcl_NewListObj(0, NULL);
+	for (i = 0; i < resultCount; ++i) {
+		Tcl_ListObjAppendElement(NULL, resultPtr, result[i].listPtr);
+	}
+	ckfree((char *) result);
+
+	Tcl_SetObjResult(interp, resultPtr);
+	code = TCL_OK;
+
+done:
+	ckfree((char *) groups);
+	ckfree((char *) files);
+	ckfree((char *) infos);
+
+	return code;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Dups_Cmd --
+ *
+ *	Implements the "::tth::duplicates" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	The files are read.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Dups_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *options[] = { "-threads", "-errorvar", NULL };
+	enum { OP_THREADS, OP_ERRORVAR };
+	Tcl_Obj **elemv, *errorVarPtr;
+	int i, op, elemc, threads;
+
+	threads = DUPS_THREADS;
+	errorVarPtr = NULL;
+
+	for (i = 1; i < objc - 1; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		if (i == objc - 2) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "option \"", options[op],
+					"\" requires an argument", NULL);
+			return TCL_ERROR;
+		}
+		++i;
+		switch (op) {
+			case OP_THREADS:
+				if (Tcl_GetIntFromObj(interp, objv[i],
+							&threads) != TCL_OK) { return TCL_ERROR; }
+				if (threads < 1 || threads > DUPS_MAXTHREADS) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad number of threads \"",
+							Tcl_GetString(objv[i]),
+							"\": must be an integer from 1 to 64", NULL);
+					return TCL_ERROR;
+				}
+			break;
+			case OP_ERRORVAR:
+				errorVarPtr = objv[i];
+			break;
+		}
+	}
+
+	if (objc < 2 || i != objc - 1) {
+		Tcl_WrongNumArgs(interp, 1, objv,
+				"?-threads n? ?-errorvar varName? paths");
+		return TCL_ERROR;
+	}
+
+	if (Tcl_ListObjGetElements(interp, objv[objc - 1],
+				&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+
+	return Dups_Find(interp, elemc, elemv, threads, errorVarPtr);
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Dups_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::duplicates",
+		(Tcl_ObjCmdProc *) Dups_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
@@ -0,0 +1,25 @@
+/*
+ * tcldups.h --
+ *
+ *	This file implements interface for tcldups.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLDUPS_H
+#define __TCLDUPS_H
+
+#include <tcl.h>
+
+Tcl_Command
+Dups_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLDUPS_H */
@@ -0,0 +1,527 @@
+/*
+ * tclfilter.c --
+ *
+ *	This file implements the "::tth::filter" command managing
+ *	Bloom filters over digests: compact sets answering whether
+ *	a digest may be in the set, with no false negatives and
+ *	a configurable rate of false positives.
+ *
+ *	Digests are uniformly distributed, so no hashing is done:
+ *	two 64-bit words taken from the first 16 bytes of a digest
+ *	are combined to derive the bit positions (double hashing).
+ *	Since only these bytes are used, digests of any length
+ *	produced for the same data test the same bits.
+ *
+ *	A filter is serialized as a 24-byte header (the magic "TTHF",
+ *	the format version, the number of bits set per digest, two zero
+ *	bytes, the number of bits and of digests added, big-endian
+ *	64-bit each) followed by the bit array, bit i being the bit
+ *	(i mod 8) of the byte (i / 8); the serialized form is therefore
+ *	the same on all platforms.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include <math.h>
+
+#include "tiger.h"
+#include "tcldigest.h"
+#include "tclhandle.h"
+#include "tclfilter.h"
+
+#define FILTER_MAGIC       "TTHF"
+#define FILTER_VERSION     1
+#define FILTER_HEADERSIZE  24
+#define FILTER_MAXHASHES   32
+/* The serialized filter must fit in a single byte array */
+#define FILTER_MAXBYTES    0x7FFF0000
+
+#ifndef M_LN2
+#define M_LN2 0.69314718055994530942
+#endif
+
+typedef struct {
+	word64        bits;      /* size of the bit array, a multiple of 64 */
+	int           hashes;    /* number of bits set per digest */
+	word64        count;     /* number of digests added */
+	unsigned char *array;
+} Filter;
+
+
+/*
+ *
+ */
+static void
+Filter_FreeProc (
+		char *blockPtr
+		)
+{
+	Filter *filterPtr = (Filter *) blockPtr;
+
+	ckfree((char *) filterPtr->array);
+	ckfree(blockPtr);
+}
+
+static const TTH_HandleType Filter_HandleType = {
+	"filter",
+	Filter_FreeProc
+};
+
+
+/*
+ * Reads a big-endian 64-bit word.
+ */
+static word64
+Filter_GetWord (
+		const unsigned char *p
+		)
+{
+	word64 w;
+	int i;
+
+	w = 0;
+	for (i = 0; i < 8; ++i) {
+		w = (w << 8) | p[i];
+	}
+
+	return w;
+}
+
+
+/*
+ *
+ */
+static void
+Filter_PutWord (
+		unsigned char *p,
+		word64        w
+		)
+{
+	int i;
+
+	for (i = 7; i >= 0; --i) {
+		p[i] = (unsigned char) w;
+		w >>= 8;
+	}
+}
+
+
+/*
+ * Sets (if add is non-zero) or tests the bits of the digest.
+ * Returns 1 if all the bits were already set.
+ */
+static int
+Filter_Probe (
+		Filter     *filterPtr,
+		const byte *digest,
+		int        add
+		)
+{
+	word64 h1, h2, bit;
+	unsigned char mask;
+	int i, present;
+
+	h1 = Filter_GetWord(digest);
+	h2 = Filter_GetWord(digest + 8);
+
+	present = 1;
+	for (i = 0; i < filterPtr->hashes; ++i) {
+		bit = (h1 + i * h2) % filterPtr->bits;
+		mask = (unsigned char) (1 << (bit & 7));
+		if (!(filterPtr->array[bit >> 3] & mask)) {
+			if (!add) {
+				return 0;
+			}
+			filterPtr->array[bit >> 3] |= mask;
+			present = 0;
+		}
+	}
+
+	if (add && !present) {
+		++filterPtr->count;
+	}
+
+	return present;
+}
+
+
+/*
+ *
+ */
+static Filter *
+Filter_New (
+		word64 bits,
+		int    hashes
+		)
+{
+	Filter *filterPtr;
+
+	filterPtr = (Filter *) ckalloc(sizeof(Filter));
+	filterPtr->bits = bits;
+	filterPtr->hashes = hashes;
+	filterPtr->count = 0;
+	filterPtr->array = (unsigned char *) ckalloc((unsigned) (bits / 8));
+	memset(filterPtr->array, 0, (size_t) (bits / 8));
+
+	return filterPtr;
+}
+
+
+/*
+ * Retrieves a digest; all the lengths supported are long enough
+ * to provide the 16 bytes used by filters.
+ */
+static int
+Filter_GetKey (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr,
+		byte       buf[],
+		const byte **keyPtr
+		)
+{
+	int len;
+
+	if (DigestParseObj(interp, objPtr, buf, keyPtr, &len) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Implements [filter create ?-capacity n? ?-fprate p?].
+ */
+static int
+Filter_CreateSubcmd (
+		Tcl_Interp     *interp,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	static const char *options[] = { "-capacity", "-fprate", NULL };
+	enum { OP_CAPACITY, OP_FPRATE };
+	int i, op, capacity, hashes;
+	double fprate, bits;
+
+	capacity = 1000000;
+	fprate = 0.01;
+
+	for (i = 2; i < objc; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		if (i == objc - 1) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "option \"", Tcl_GetString(objv[i]),
+					"\" requires an argument", NULL);
+			return TCL_ERROR;
+		}
+		++i;
+		switch (op) {
+			case OP_CAPACITY:
+				if (Tcl_GetIntFromObj(interp, objv[i],
+							&capacity) != TCL_OK) { return TCL_ERROR; }
+				if (capacity < 1) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad capacity \"",
+							Tcl_GetString(objv[i]),
+							"\": must be a positive integer", NULL);
+					return TCL_ERROR;
+				}
+			break;
+			case OP_FPRATE:
+				if (Tcl_GetDoubleFromObj(interp, objv[i],
+							&fprate) != TCL_OK) { return TCL_ERROR; }
+				if (!(fprate > 0.0 && fprate < 1.0)) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad false positive rate \"",
+							Tcl_GetString(objv[i]),
+							"\": must be between 0 and 1", NULL);
+					return TCL_ERROR;
+				}
+			break;
+		}
+	}
+
+	/*
+	 * The optimal size is -n ln p / (ln 2)^2 bits
+	 * with -log2 p bits set per digest.
+	 */
+	bits = -capacity * log(fprate) / (M_LN2 * M_LN2);
+	bits = ceil(bits / 64) * 64;
+	if (bits / 8 > FILTER_MAXBYTES) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "filter too large: decrease capacity "
+				"or increase false positive rate", NULL);
+		return TCL_ERROR;
+	}
+	hashes = (int) (-log(fprate) / M_LN2 + 0.5);
+	if (hashes < 1) {
+		hashes = 1;
+	} else if (hashes > FILTER_MAXHASHES) {
+		hashes = FILTER_MAXHASHES;
+	}
+
+	Tcl_SetObjResult(interp, TTH_NewHandle(interp, &Filter_HandleType,
+				(ClientData) Filter_New((word64) bits, hashes)));
+	return TCL_OK;
+}
+
+
+/*
+ * Returns the serialized form of the filter.
+ */
+static Tcl_Obj *
+Filter_Serialize (
+		Filter *filterPtr
+		)
+{
+	Tcl_Obj *objPtr;
+	unsigned char *p;
+
+	objPtr = Tcl_NewByteArrayObj(NULL, 0);
+	p = Tcl_SetByteArrayLength(objPtr,
+			(int) (FILTER_HEADERSIZE + filterPtr->bits / 8));
+
+	memcpy(p, FILTER_MAGIC, 4);
+	p[4] = FILTER_VERSION;
+	p[5] = (unsigned char) filterPtr->hashes;
+	p[6] = p[7] = 0;
+	Filter_PutWord(p + 8, filterPtr->bits);
+	Filter_PutWord(p + 16, filterPtr->count);
+	memcpy(p + FILTER_HEADERSIZE, filterPtr->array,
+			(size_t) (filterPtr->bits / 8));
+
+	return objPtr;
+}
+
+
+/*
+ * Creates a filter from its serialized form.
+ */
+static Filter *
+Filter_Deserialize (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr
+		)
+{
+	Filter *filterPtr;
+	const unsigned char *p;
+	word64 bits;
+	int len, hashes;
+
+	p = Tcl_GetByteArrayFromObj(objPtr, &len);
+
+	if (len < FILTER_HEADERSIZE || memcmp(p, FILTER_MAGIC, 4) != 0
+			|| p[4] != FILTER_VERSION) {
+		goto badFilter;
+	}
+	hashes = p[5];
+	bits = Filter_GetWord(p + 8);
+	if (hashes < 1 || hashes > FILTER_MAXHASHES
+			|| bits == 0 || bits % 64 != 0 || bits / 8 > FILTER_MAXBYTES
+			|| bits / 8 != (word64) (len - FILTER_HEADERSIZE)) {
+		goto badFilter;
+	}
+
+	filterPtr = Filter_New(bits, hashes);
+	filterPtr->count = Filter_GetWord(p + 16);
+	memcpy(filterPtr->array, p + FILTER_HEADERSIZE, (size_t) (bits / 8));
+
+	return filterPtr;
+
+badFilter:
+	Tcl_ResetResult(interp);
+	Tcl_AppendResult(interp, "not a serialized filter", NULL);
+	return NULL;
+}
+
+
+/*
+ * Returns the statistics of the filter as a dictionary.
+ */
+static Tcl_Obj *
+Filter_Stats (
+		Filter *filterPtr
+		)
+{
+	Tcl_Obj *dictPtr;
+	double fprate;
+
+	/* The expected rate for the number of digests added */
+	fprate = pow(1.0 - exp(-(double) filterPtr->hashes
+				* (double) filterPtr->count / (double) filterPtr->bits),
+			filterPtr->hashes);
+
+	dictPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("entries", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) filterPtr->count));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("bits", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) filterPtr->bits));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("hashes", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewIntObj(filterPtr->hashes));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("bytes", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) (filterPtr->bits / 8)));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("fprate", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewDoubleObj(fprate));
+
+	return dictPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Filter_Cmd --
+ *
+ *	Implements the "::tth::filter" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Filters are created, modified and serialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Filter_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *subcmds[] = { "create", "add", "exists", "stats",
+		"serialize", "deserialize", "destroy", NULL };
+	enum { FLT_CREATE, FLT_ADD, FLT_EXISTS, FLT_STATS,
+		FLT_SERIALIZE, FLT_DESERIALIZE, FLT_DESTROY };
+	Filter *filterPtr;
+	Tcl_Obj **elemv, *resultPtr;
+	int cmd, list, first, elemc, i, n;
+	byte buf[TIGERSIZE];
+	const byte *key;
+
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "subcommand ?arg ...?");
+		return TCL_ERROR;
+	}
+
+	if (Tcl_GetIndexFromObj(interp, objv[1], subcmds, "subcommand",
+			0, &cmd) != TCL_OK) { return TCL_ERROR; }
+
+	switch (cmd) {
+		case FLT_CREATE:
+			return Filter_CreateSubcmd(interp, objc, objv);
+		break;
+
+		case FLT_DESERIALIZE:
+			if (objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "data");
+				return TCL_ERROR;
+			}
+			filterPtr = Filter_Deserialize(interp, objv[2]);
+			if (filterPtr == NULL) {
+				return TCL_ERROR;
+			}
+			Tcl_SetObjResult(interp, TTH_NewHandle(interp,
+					&Filter_HandleType, (ClientData) filterPtr));
+			return TCL_OK;
+		break;
+	}
+
+	/* The rest of subcommands operate on an existing filter */
+
+	list = objc > 2 && strcmp(Tcl_GetString(objv[2]), "-list") == 0;
+	first = list ? 3 : 2;
+
+	if (objc <= first) {
+		Tcl_WrongNumArgs(interp, 2, objv, "?-list? filter ?arg ...?");
+		return TCL_ERROR;
+	}
+	if (TTH_GetHandleFromObj(interp, objv[first], &Filter_HandleType,
+				(ClientData *) &filterPtr) != TCL_OK) { return TCL_ERROR; }
+
+	switch (cmd) {
+		case FLT_ADD:
+		case FLT_EXISTS:
+			if (objc != first + 2) {
+				Tcl_WrongNumArgs(interp, 2, objv, "?-list? filter digest");
+				return TCL_ERROR;
+			}
+			if (!list) {
+				if (Filter_GetKey(interp, objv[first + 1],
+							buf, &key) != TCL_OK) { return TCL_ERROR; }
+				n = Filter_Probe(filterPtr, key, cmd == FLT_ADD);
+				Tcl_SetObjResult(interp,
+						Tcl_NewBooleanObj(cmd == FLT_ADD ? !n : n));
+				return TCL_OK;
+			}
+			if (Tcl_ListObjGetElements(interp, objv[first + 1],
+						&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+			resultPtr = cmd == FLT_EXISTS ? Tcl_NewListObj(elemc, NULL) : NULL;
+			n = 0;
+			for (i = 0; i < elemc; ++i) {
+				if (Filter_GetKey(interp, elemv[i], buf, &key) != TCL_OK) {
+					if (resultPtr != NULL) {
+						Tcl_DecrRefCount(resultPtr);
+					}
+					return TCL_ERROR;
+				}
+				if (cmd == FLT_EXISTS) {
+					Tcl_ListObjAppendElement(NULL, resultPtr,
+							Tcl_NewBooleanObj(Filter_Probe(filterPtr, key, 0)));
+				} else {
+					n += !Filter_Probe(filterPtr, key, 1);
+				}
+			}
+			Tcl_SetObjResult(interp, resultPtr != NULL
+					? resultPtr : Tcl_NewIntObj(n));
+			return TCL_OK;
+		break;
+
+		case FLT_STATS:
+		case FLT_SERIALIZE:
+		case FLT_DESTROY:
+			if (list || objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "filter");
+				return TCL_ERROR;
+			}
+			if (cmd == FLT_DESTROY) {
+				return TTH_DeleteHandle(interp, objv[2], &Filter_HandleType);
+			}
+			Tcl_SetObjResult(interp, cmd == FLT_STATS
+					? Filter_Stats(filterPtr)
+					: Filter_Serialize(filterPtr));
+			return TCL_OK;
+		break;
+	}
+
+	return TCL_ERROR;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Filter_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::filter",
+		(Tcl_ObjCmdProc *) Filter_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
@@ -0,0 +1,25 @@
+/*
+ * tclfilter.h --
+ *
+ *	This file implements interface for tclfilter.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLFILTER_H
+#define __TCLFILTER_H
+
+#include <tcl.h>
+
+Tcl_Command
+Filter_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLFILTER_H */
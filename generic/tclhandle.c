@@ -0,0 +1,397 @@
+/*
+ * tclhandle.c --
+ *
+ *	This file implements handles to objects allocated by the
+ *	commands of this package (hashing contexts etc).
+ *
+ *	Handle records are owned by a per-thread table keyed by name.
+ *	A handle is a Tcl object of the "tthhandle" type caching
+ *	the pointer to the handle record in its internal rep, so using
+ *	a handle costs no lookups; a handle which has lost its internal
+ *	rep (for instance, by being used as a list) is recovered from its
+ *	string rep. The object referred to by a handle is freed explicitly
+ *	or when the interpreter which created it, or its thread, goes away.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "tclhandle.h"
+#include "tclpool.h"
+
+#define HANDLE_ASSOC "tth::handles"
+
+typedef struct HandleRecord HandleRecord;
+
+/*
+ * Handles created by an interpreter.
+ */
+typedef struct {
+	HandleRecord *firstPtr;
+} HandleList;
+
+struct HandleRecord {
+	const TTH_HandleType *typePtr;
+	ClientData    clientData;   /* the object, or NULL once deleted */
+	int           refCount;     /* the registry and the Tcl objects
+	                             * caching us */
+	Tcl_HashEntry *entryPtr;    /* our entry in the registry, or NULL */
+	HandleList    *listPtr;     /* handles of our interpreter, or NULL */
+	HandleRecord  *prevPtr;
+	HandleRecord  *nextPtr;
+	char          name[1];      /* actually longer */
+};
+
+typedef struct {
+	int           initialized;
+	Tcl_HashTable handles;
+	unsigned int  uid;
+} ThreadSpecificData;
+
+static Tcl_ThreadDataKey dataKey;
+
+static void FreeHandleInternalRep (Tcl_Obj *objPtr);
+static void DupHandleInternalRep (Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+static void UpdateStringOfHandle (Tcl_Obj *objPtr);
+static int  SetHandleFromAny (Tcl_Interp *interp, Tcl_Obj *objPtr);
+
+static Tcl_ObjType handleObjType = {
+	"tthhandle",
+	FreeHandleInternalRep,
+	DupHandleInternalRep,
+	UpdateStringOfHandle,
+	SetHandleFromAny
+};
+
+/* Size of a handle record with a name of the given length */
+#define RECORD_SIZE(len) (offsetof(HandleRecord, name) + (len) + 1)
+
+#define HANDLE_RECORD(objPtr) \
+	((HandleRecord *) (objPtr)->internalRep.otherValuePtr)
+
+
+/*
+ * Drops one reference to the handle record.
+ */
+static void
+DropRecord (
+		HandleRecord *recPtr
+		)
+{
+	if (--recPtr->refCount == 0) {
+		TTH_PoolFree(recPtr, RECORD_SIZE(strlen(recPtr->name)));
+	}
+}
+
+
+/*
+ * Frees the object referred to by the handle record
+ * and unregisters the record; Tcl objects still caching it
+ * keep it allocated, but find it deleted.
+ */
+static void
+ReleaseRecord (
+		HandleRecord *recPtr
+		)
+{
+	if (recPtr->entryPtr == NULL) {
+		return;
+	}
+
+	recPtr->typePtr->freeProc((char *) recPtr->clientData);
+	recPtr->clientData = NULL;
+
+	Tcl_DeleteHashEntry(recPtr->entryPtr);
+	recPtr->entryPtr = NULL;
+
+	if (recPtr->listPtr != NULL) {
+		if (recPtr->prevPtr != NULL) {
+			recPtr->prevPtr->nextPtr = recPtr->nextPtr;
+		} else {
+			recPtr->listPtr->firstPtr = recPtr->nextPtr;
+		}
+		if (recPtr->nextPtr != NULL) {
+			recPtr->nextPtr->prevPtr = recPtr->prevPtr;
+		}
+		recPtr->listPtr = NULL;
+	}
+
+	DropRecord(recPtr);
+}
+
+
+/*
+ * Frees the objects created by an interpreter being deleted.
+ */
+static void
+HandleDeleteProc (
+		ClientData clientData,
+		Tcl_Interp *interp
+		)
+{
+	HandleList *listPtr = (HandleList *) clientData;
+
+	while (listPtr->firstPtr != NULL) {
+		ReleaseRecord(listPtr->firstPtr);
+	}
+	ckfree((char *) listPtr);
+}
+
+
+/*
+ *
+ */
+static void
+ThreadExitProc (
+		ClientData clientData
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	Tcl_HashEntry      *entryPtr;
+	Tcl_HashSearch     search;
+
+	tsdPtr = (ThreadSpecificData *) clientData;
+
+	entryPtr = Tcl_FirstHashEntry(&tsdPtr->handles, &search);
+	while (entryPtr != NULL) {
+		ReleaseRecord((HandleRecord *) Tcl_GetHashValue(entryPtr));
+
+		entryPtr = Tcl_FirstHashEntry(&tsdPtr->handles, &search);
+	}
+	Tcl_DeleteHashTable(&tsdPtr->handles);
+
+	tsdPtr->initialized = 0;
+}
+
+
+/*
+ *
+ */
+static ThreadSpecificData *
+GetThreadData (void)
+{
+	ThreadSpecificData *tsdPtr;
+
+	tsdPtr = (ThreadSpecificData *) Tcl_GetThreadData(&dataKey,
+			sizeof(ThreadSpecificData));
+	if (!tsdPtr->initialized) {
+		Tcl_InitHashTable(&tsdPtr->handles, TCL_STRING_KEYS);
+		tsdPtr->uid = 0;
+		tsdPtr->initialized = 1;
+		Tcl_CreateThreadExitHandler(ThreadExitProc, (ClientData) tsdPtr);
+	}
+
+	return tsdPtr;
+}
+
+
+/*
+ *
+ */
+static void
+FreeHandleInternalRep (
+		Tcl_Obj *objPtr
+		)
+{
+	DropRecord(HANDLE_RECORD(objPtr));
+	objPtr->typePtr = NULL;
+}
+
+
+/*
+ *
+ */
+static void
+DupHandleInternalRep (
+		Tcl_Obj *srcPtr,
+		Tcl_Obj *dupPtr
+		)
+{
+	HandleRecord *recPtr;
+
+	recPtr = HANDLE_RECORD(srcPtr);
+	++recPtr->refCount;
+	dupPtr->internalRep.otherValuePtr = (VOID *) recPtr;
+	dupPtr->typePtr = &handleObjType;
+}
+
+
+/*
+ *
+ */
+static void
+UpdateStringOfHandle (
+		Tcl_Obj *objPtr
+		)
+{
+	HandleRecord *recPtr;
+	size_t len;
+
+	recPtr = HANDLE_RECORD(objPtr);
+	len = strlen(recPtr->name);
+	objPtr->bytes = ckalloc(len + 1);
+	memcpy(objPtr->bytes, recPtr->name, len + 1);
+	objPtr->length = (int) len;
+}
+
+
+/*
+ *
+ */
+static int
+SetHandleFromAny (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	Tcl_HashEntry *entryPtr;
+	HandleRecord *recPtr;
+
+	tsdPtr = GetThreadData();
+
+	entryPtr = Tcl_FindHashEntry(&tsdPtr->handles, Tcl_GetString(objPtr));
+	if (entryPtr == NULL) {
+		if (interp != NULL) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "can not find context named \"",
+					Tcl_GetString(objPtr), "\"", NULL);
+		}
+		return TCL_ERROR;
+	}
+	recPtr = (HandleRecord *) Tcl_GetHashValue(entryPtr);
+
+	if (objPtr->typePtr != NULL && objPtr->typePtr->freeIntRepProc != NULL) {
+		objPtr->typePtr->freeIntRepProc(objPtr);
+	}
+	++recPtr->refCount;
+	objPtr->internalRep.otherValuePtr = (VOID *) recPtr;
+	objPtr->typePtr = &handleObjType;
+
+	return TCL_OK;
+}
+
+
+/*
+ * Registers the given object, to be freed when the interpreter
+ * is deleted at the latest, and returns a new handle to it.
+ */
+Tcl_Obj *
+TTH_NewHandle (
+		Tcl_Interp           *interp,
+		const TTH_HandleType *typePtr,
+		ClientData           clientData
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	HandleRecord *recPtr;
+	HandleList *listPtr;
+	Tcl_Obj *objPtr;
+	int new;
+	char name[TCL_INTEGER_SPACE + 16];
+
+	tsdPtr = GetThreadData();
+
+	sprintf(name, "%s%u", typePtr->prefix, tsdPtr->uid);
+	recPtr = (HandleRecord *) TTH_PoolAlloc(RECORD_SIZE(strlen(name)));
+	strcpy(recPtr->name, name);
+	++tsdPtr->uid;
+
+	recPtr->typePtr    = typePtr;
+	recPtr->clientData = clientData;
+	recPtr->refCount   = 2;     /* the registry and objPtr */
+	recPtr->entryPtr   = Tcl_CreateHashEntry(&tsdPtr->handles,
+			recPtr->name, &new);
+	if (new != 1) {
+		Tcl_Panic("handle \"%s\" stomps on existing one", recPtr->name);
+	}
+	Tcl_SetHashValue(recPtr->entryPtr, (ClientData) recPtr);
+
+	listPtr = (HandleList *) Tcl_GetAssocData(interp, HANDLE_ASSOC, NULL);
+	if (listPtr == NULL) {
+		listPtr = (HandleList *) ckalloc(sizeof(HandleList));
+		listPtr->firstPtr = NULL;
+		Tcl_SetAssocData(interp, HANDLE_ASSOC, HandleDeleteProc,
+				(ClientData) listPtr);
+	}
+	recPtr->listPtr = listPtr;
+	recPtr->prevPtr = NULL;
+	recPtr->nextPtr = listPtr->firstPtr;
+	if (listPtr->firstPtr != NULL) {
+		listPtr->firstPtr->prevPtr = recPtr;
+	}
+	listPtr->firstPtr = recPtr;
+
+	objPtr = Tcl_NewObj();
+	Tcl_InvalidateStringRep(objPtr);
+	objPtr->internalRep.otherValuePtr = (VOID *) recPtr;
+	objPtr->typePtr = &handleObjType;
+
+	return objPtr;
+}
+
+
+/*
+ * Retrieves the object referred to by the given handle
+ * which must be of the given type.
+ */
+int
+TTH_GetHandleFromObj (
+		Tcl_Interp           *interp,
+		Tcl_Obj              *objPtr,
+		const TTH_HandleType *typePtr,
+		ClientData           *clientDataPtr
+		)
+{
+	HandleRecord *recPtr;
+
+	if (objPtr->typePtr != &handleObjType
+			&& SetHandleFromAny(interp, objPtr) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	recPtr = HANDLE_RECORD(objPtr);
+	if (recPtr->clientData == NULL || recPtr->typePtr != typePtr) {
+		if (interp != NULL) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "can not find context named \"",
+					Tcl_GetString(objPtr), "\"", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	*clientDataPtr = recPtr->clientData;
+	return TCL_OK;
+}
+
+
+/*
+ * Frees the object referred to by the given handle;
+ * any further attempts to use the handle will fail.
+ */
+int
+TTH_DeleteHandle (
+		Tcl_Interp           *interp,
+		Tcl_Obj              *objPtr,
+		const TTH_HandleType *typePtr
+		)
+{
+	ClientData clientData;
+
+	if (TTH_GetHandleFromObj(interp, objPtr, typePtr,
+				&clientData) != TCL_OK) { return TCL_ERROR; }
+
+	ReleaseRecord(HANDLE_RECORD(objPtr));
+
+	return TCL_OK;
+}
@@ -0,0 +1,52 @@
+/*
+ * tclhandle.h --
+ *
+ *	This file implements interface for tclhandle.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLHANDLE_H
+#define __TCLHANDLE_H
+
+#include <tcl.h>
+
+/*
+ * Describes a kind of objects referred to by handles:
+ * handles are named prefix0, prefix1 and so on, and the object
+ * is freed by calling freeProc on it.
+ */
+typedef struct {
+	const char      *prefix;
+	Tcl_FreeProc    *freeProc;
+} TTH_HandleType;
+
+Tcl_Obj *
+TTH_NewHandle (
+		Tcl_Interp           *interp,
+		const TTH_HandleType *typePtr,
+		ClientData           clientData
+		);
+
+int
+TTH_GetHandleFromObj (
+		Tcl_Interp           *interp,
+		Tcl_Obj              *objPtr,
+		const TTH_HandleType *typePtr,
+		ClientData           *clientDataPtr
+		);
+
+int
+TTH_DeleteHandle (
+		Tcl_Interp           *interp,
+		Tcl_Obj              *objPtr,
+		const TTH_HandleType *typePtr
+		);
+
+#endif /* __TCLHANDLE_H */
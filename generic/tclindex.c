@@ -0,0 +1,1172 @@
+/*
+ * tclindex.c --
+ *
+ *	This file implements the "::tth::index" command managing
+ *	in-memory sets of digests with optional payloads.
+ *
+ *	An index is an open addressing hash table with linear probing
+ *	which keeps the digests (keys) in one contiguous array and
+ *	a byte per slot telling whether the slot is occupied in another;
+ *	digests are uniformly distributed, so their first bytes are used
+ *	as the hash value as they are.  Deletion shifts the following
+ *	entries back instead of leaving tombstones.
+ *
+ *	An index can be saved to a file which is laid out exactly as
+ *	the table is in memory, so loading it amounts to mapping the file
+ *	(where supported); the table is only copied to memory
+ *	when it is first modified.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tiger.h"
+#include "tcldigest.h"
+#include "tclhandle.h"
+#include "tclmmap.h"
+#include "tclindex.h"
+
+/*
+ * Layout of an index file: the header, the slot tags, the keys and,
+ * if any payloads are set, capacity + 1 offsets of the payloads
+ * of the slots into the payload blob which follows them; each part
+ * starts at a multiple of 8 bytes.
+ */
+typedef struct {
+	char          magic[8];
+	unsigned int  version;
+	unsigned int  byteOrder;
+	unsigned int  keyLength;
+	unsigned int  flags;
+	word64        capacity;
+	word64        count;
+	word64        blobLength;
+	char          reserved[16];
+} IndexHeader;
+
+#define INDEX_MAGIC      "TTHINDEX"
+#define INDEX_VERSION    1
+#define INDEX_BYTEORDER  0x01020304
+#define INDEX_PAYLOADS   0x01
+
+#define ALIGN8(x) (((x) + 7) & ~(word64) 7)
+
+/* Minimal capacity of a table; it is kept at most 3/4 full */
+#define INDEX_MINCAPACITY 16
+
+typedef struct {
+	int           keyLength;   /* 24, 20 or 16 */
+	size_t        capacity;    /* number of slots, a power of 2 */
+	size_t        count;       /* number of occupied slots */
+	unsigned char *tags;       /* non-zero for occupied slots */
+	byte          *keys;
+	Tcl_Obj       **payloads;  /* NULL until some payload is set */
+	/*
+	 * A loaded index is "frozen": its tags and keys point into
+	 * the loaded file and its payloads are read from there.
+	 */
+	int           frozen;
+	const word64  *offsets;
+	const char    *blob;
+	word64        blobLength;
+#ifdef USE_MMAP
+	TTH_Mapping   *mapPtr;
+#endif
+	char          *bufferPtr;  /* the loaded file, if not mapped */
+} Index;
+
+
+/*
+ *
+ */
+static void
+Index_FreeStorage (
+		Index *indexPtr
+		)
+{
+	size_t i;
+
+	if (indexPtr->frozen) {
+#ifdef USE_MMAP
+		if (indexPtr->mapPtr != NULL) {
+			TTH_UnmapFile(indexPtr->mapPtr);
+			indexPtr->mapPtr = NULL;
+		}
+#endif
+		if (indexPtr->bufferPtr != NULL) {
+			ckfree(indexPtr->bufferPtr);
+			indexPtr->bufferPtr = NULL;
+		}
+		indexPtr->offsets = NULL;
+		indexPtr->blob = NULL;
+		indexPtr->frozen = 0;
+		return;
+	}
+
+	if (indexPtr->payloads != NULL) {
+		for (i = 0; i < indexPtr->capacity; ++i) {
+			if (indexPtr->payloads[i] != NULL) {
+				Tcl_DecrRefCount(indexPtr->payloads[i]);
+			}
+		}
+		ckfree((char *) indexPtr->payloads);
+		indexPtr->payloads = NULL;
+	}
+	ckfree((char *) indexPtr->tags);
+	ckfree((char *) indexPtr->keys);
+}
+
+
+/*
+ *
+ */
+static void
+Index_FreeProc (
+		char *blockPtr
+		)
+{
+	Index_FreeStorage((Index *) blockPtr);
+	ckfree(blockPtr);
+}
+
+static const TTH_HandleType Index_HandleType = {
+	"index",
+	Index_FreeProc
+};
+
+
+/*
+ * Returns the home slot of the key.
+ */
+static size_t
+Index_Home (
+		const Index *indexPtr,
+		const byte  *key
+		)
+{
+	word64 h;
+
+	memcpy(&h, key, sizeof(h));
+	return (size_t) h & (indexPtr->capacity - 1);
+}
+
+
+/*
+ * Looks the key up; returns 1 if it is found, 0 otherwise.
+ * In either case *slotPtr is set to the slot where the key is
+ * or should be.
+ */
+static int
+Index_Find (
+		const Index *indexPtr,
+		const byte  *key,
+		size_t      *slotPtr
+		)
+{
+	size_t i, mask;
+	int len;
+
+	mask = indexPtr->capacity - 1;
+	len = indexPtr->keyLength;
+
+	for (i = Index_Home(indexPtr, key); indexPtr->tags[i]; i = (i + 1) & mask) {
+		if (memcmp(indexPtr->keys + i * len, key, len) == 0) {
+			*slotPtr = i;
+			return 1;
+		}
+	}
+
+	*slotPtr = i;
+	return 0;
+}
+
+
+/*
+ * Returns the payload stored in the slot as a byte string.
+ */
+static const char *
+Index_PayloadBytes (
+		const Index *indexPtr,
+		size_t      slot,
+		int         *lengthPtr
+		)
+{
+	word64 start, end;
+
+	if (indexPtr->frozen) {
+		if (indexPtr->offsets != NULL) {
+			start = indexPtr->offsets[slot];
+			end   = indexPtr->offsets[slot + 1];
+			if (start <= end && end <= indexPtr->blobLength) {
+				*lengthPtr = (int) (end - start);
+				return indexPtr->blob + start;
+			}
+		}
+	} else if (indexPtr->payloads != NULL && indexPtr->payloads[slot] != NULL) {
+		return Tcl_GetStringFromObj(indexPtr->payloads[slot], lengthPtr);
+	}
+
+	*lengthPtr = 0;
+	return "";
+}
+
+
+/*
+ * Copies a frozen index to memory so that it can be modified.
+ */
+static void
+Index_Thaw (
+		Index *indexPtr
+		)
+{
+	unsigned char *tags;
+	byte *keys;
+	Tcl_Obj **payloads;
+	const char *bytes;
+	size_t i;
+	int len;
+
+	if (!indexPtr->frozen) {
+		return;
+	}
+
+	tags = (unsigned char *) ckalloc(indexPtr->capacity);
+	memcpy(tags, indexPtr->tags, indexPtr->capacity);
+	keys = (byte *) ckalloc(indexPtr->capacity * indexPtr->keyLength);
+	memcpy(keys, indexPtr->keys, indexPtr->capacity * indexPtr->keyLength);
+
+	payloads = NULL;
+	if (indexPtr->offsets != NULL) {
+		payloads = (Tcl_Obj **) ckalloc(indexPtr->capacity * sizeof(Tcl_Obj *));
+		for (i = 0; i < indexPtr->capacity; ++i) {
+			payloads[i] = NULL;
+			if (tags[i]) {
+				bytes = Index_PayloadBytes(indexPtr, i, &len);
+				if (len > 0) {
+					payloads[i] = Tcl_NewStringObj(bytes, len);
+					Tcl_IncrRefCount(payloads[i]);
+				}
+			}
+		}
+	}
+
+	Index_FreeStorage(indexPtr);
+	indexPtr->tags = tags;
+	indexPtr->keys = keys;
+	indexPtr->payloads = payloads;
+}
+
+
+/*
+ * Rehashes the index into a table of the given capacity.
+ */
+static void
+Index_Resize (
+		Index  *indexPtr,
+		size_t capacity
+		)
+{
+	Index old;
+	size_t i, j, mask;
+	int len;
+
+	Index_Thaw(indexPtr);
+
+	old = *indexPtr;
+	len = indexPtr->keyLength;
+
+	indexPtr->capacity = capacity;
+	indexPtr->tags = (unsigned char *) ckalloc(capacity);
+	memset(indexPtr->tags, 0, capacity);
+	indexPtr->keys = (byte *) ckalloc(capacity * len);
+	indexPtr->payloads = NULL;
+	if (old.payloads != NULL) {
+		indexPtr->payloads = (Tcl_Obj **) ckalloc(capacity * sizeof(Tcl_Obj *));
+		memset(indexPtr->payloads, 0, capacity * sizeof(Tcl_Obj *));
+	}
+
+	mask = capacity - 1;
+	for (i = 0; i < old.capacity; ++i) {
+		if (!old.tags[i]) {
+			continue;
+		}
+		for (j = Index_Home(indexPtr, old.keys + i * len);
+				indexPtr->tags[j]; j = (j + 1) & mask)
+			;
+		indexPtr->tags[j] = 1;
+		memcpy(indexPtr->keys + j * len, old.keys + i * len, len);
+		if (old.payloads != NULL) {
+			indexPtr->payloads[j] = old.payloads[i];
+		}
+	}
+
+	ckfree((char *) old.tags);
+	ckfree((char *) old.keys);
+	if (old.payloads != NULL) {
+		ckfree((char *) old.payloads);
+	}
+}
+
+
+/*
+ * Returns the capacity of a table suitable for the given
+ * number of entries.
+ */
+static size_t
+Index_CapacityFor (
+		size_t count
+		)
+{
+	size_t capacity;
+
+	capacity = INDEX_MINCAPACITY;
+	while (capacity / 4 * 3 < count) {
+		capacity *= 2;
+	}
+
+	return capacity;
+}
+
+
+/*
+ * Makes room for the given number of new entries.
+ */
+static void
+Index_Reserve (
+		Index  *indexPtr,
+		size_t more
+		)
+{
+	size_t capacity;
+
+	capacity = Index_CapacityFor(indexPtr->count + more);
+	if (capacity > indexPtr->capacity) {
+		Index_Resize(indexPtr, capacity);
+	} else {
+		Index_Thaw(indexPtr);
+	}
+}
+
+
+/*
+ * Sets the payload of the slot; an empty payload is not stored.
+ */
+static void
+Index_SetPayload (
+		Index   *indexPtr,
+		size_t  slot,
+		Tcl_Obj *payloadPtr
+		)
+{
+	int len;
+
+	if (payloadPtr != NULL) {
+		Tcl_GetStringFromObj(payloadPtr, &len);
+		if (len == 0) {
+			payloadPtr = NULL;
+		}
+	}
+
+	if (indexPtr->payloads == NULL) {
+		if (payloadPtr == NULL) {
+			return;
+		}
+		indexPtr->payloads = (Tcl_Obj **) ckalloc(indexPtr->capacity
+				* sizeof(Tcl_Obj *));
+		memset(indexPtr->payloads, 0, indexPtr->capacity * sizeof(Tcl_Obj *));
+	}
+
+	if (payloadPtr != NULL) {
+		Tcl_IncrRefCount(payloadPtr);
+	}
+	if (indexPtr->payloads[slot] != NULL) {
+		Tcl_DecrRefCount(indexPtr->payloads[slot]);
+	}
+	indexPtr->payloads[slot] = payloadPtr;
+}
+
+
+/*
+ * Inserts the key or replaces the payload of an existing one;
+ * room must have been reserved.  Returns 1 if the key is new.
+ */
+static int
+Index_Insert (
+		Index      *indexPtr,
+		const byte *key,
+		Tcl_Obj    *payloadPtr
+		)
+{
+	size_t slot;
+	int found;
+
+	found = Index_Find(indexPtr, key, &slot);
+	if (!found) {
+		indexPtr->tags[slot] = 1;
+		memcpy(indexPtr->keys + slot * indexPtr->keyLength, key,
+				indexPtr->keyLength);
+		++indexPtr->count;
+	}
+	Index_SetPayload(indexPtr, slot, payloadPtr);
+
+	return !found;
+}
+
+
+/*
+ * Removes the key, if present, shifting back the entries
+ * which follow it.  Returns 1 if the key was found.
+ */
+static int
+Index_Delete (
+		Index      *indexPtr,
+		const byte *key
+		)
+{
+	size_t i, j, k, mask;
+	int len;
+
+	if (!Index_Find(indexPtr, key, &i)) {
+		return 0;
+	}
+
+	Index_Thaw(indexPtr);
+	Index_SetPayload(indexPtr, i, NULL);
+
+	mask = indexPtr->capacity - 1;
+	len = indexPtr->keyLength;
+
+	for (;;) {
+		indexPtr->tags[i] = 0;
+		/* Find an entry which may be moved to the hole at i */
+		for (j = (i + 1) & mask; ; j = (j + 1) & mask) {
+			if (!indexPtr->tags[j]) {
+				--indexPtr->count;
+				return 1;
+			}
+			k = Index_Home(indexPtr, indexPtr->keys + j * len);
+			/* The entry stays if its home is cyclically in (i, j] */
+			if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+				continue;
+			}
+			break;
+		}
+		indexPtr->tags[i] = 1;
+		memcpy(indexPtr->keys + i * len, indexPtr->keys + j * len, len);
+		if (indexPtr->payloads != NULL) {
+			indexPtr->payloads[i] = indexPtr->payloads[j];
+			indexPtr->payloads[j] = NULL;
+		}
+		i = j;
+	}
+}
+
+
+/*
+ * Retrieves the key of the index from a digest given in any format;
+ * longer digests are truncated to the length of the keys.
+ */
+static int
+Index_GetKey (
+		Tcl_Interp *interp,
+		Index      *indexPtr,
+		Tcl_Obj    *objPtr,
+		byte       buf[],
+		const byte **keyPtr
+		)
+{
+	char msg[64];
+	int len;
+
+	if (DigestParseObj(interp, objPtr, buf, keyPtr, &len) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (len < indexPtr->keyLength) {
+		sprintf(msg, "digest of %d bits is too short for a %d-bit index",
+				len * 8, indexPtr->keyLength * 8);
+		Tcl_SetObjResult(interp, Tcl_NewStringObj(msg, -1));
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Creates a new empty index.
+ */
+static Index *
+Index_New (
+		int    keyLength,
+		size_t capacity
+		)
+{
+	Index *indexPtr;
+
+	indexPtr = (Index *) ckalloc(sizeof(Index));
+	memset(indexPtr, 0, sizeof(Index));
+	indexPtr->keyLength = keyLength;
+	indexPtr->capacity = capacity;
+	indexPtr->tags = (unsigned char *) ckalloc(capacity);
+	memset(indexPtr->tags, 0, capacity);
+	indexPtr->keys = (byte *) ckalloc(capacity * keyLength);
+
+	return indexPtr;
+}
+
+
+/*
+ *
+ */
+static int
+Index_WriteBytes (
+		Tcl_Interp  *interp,
+		Tcl_Channel chan,
+		Tcl_Obj     *filePtr,
+		const void  *bytes,
+		word64      len
+		)
+{
+	static const char zeroes[8] = { 0 };
+	const char *p;
+	int chunk;
+
+	p = bytes == NULL ? zeroes : (const char *) bytes;
+	while (len > 0) {
+		chunk = len > 0x40000000 ? 0x40000000 : (int) len;
+		if (Tcl_Write(chan, p, chunk) != chunk) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "error writing \"",
+					Tcl_GetString(filePtr), "\": ",
+					Tcl_PosixError(interp), NULL);
+			return TCL_ERROR;
+		}
+		p += chunk;
+		len -= chunk;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Saves the index to a file.
+ */
+static int
+Index_Save (
+		Tcl_Interp *interp,
+		Index      *indexPtr,
+		Tcl_Obj    *filePtr
+		)
+{
+	IndexHeader header;
+	Tcl_Channel chan;
+	word64 *offsets, pos, tagsLength, keysLength;
+	const char *bytes;
+	size_t i;
+	int len, code;
+
+	/* The file being written may well be the one the index is mapped from */
+	Index_Thaw(indexPtr);
+
+	offsets = NULL;
+	pos = 0;
+	if (indexPtr->payloads != NULL) {
+		offsets = (word64 *) ckalloc((indexPtr->capacity + 1) * sizeof(word64));
+		for (i = 0; i < indexPtr->capacity; ++i) {
+			offsets[i] = pos;
+			Index_PayloadBytes(indexPtr, i, &len);
+			pos += len;
+		}
+		offsets[i] = pos;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version    = INDEX_VERSION;
+	header.byteOrder  = INDEX_BYTEORDER;
+	header.keyLength  = indexPtr->keyLength;
+	header.flags      = offsets != NULL ? INDEX_PAYLOADS : 0;
+	header.capacity   = indexPtr->capacity;
+	header.count      = indexPtr->count;
+	header.blobLength = pos;
+
+	tagsLength = indexPtr->capacity;
+	keysLength = (word64) indexPtr->capacity * indexPtr->keyLength;
+
+	chan = Tcl_FSOpenFileChannel(interp, filePtr, "w", 0666);
+	if (chan == NULL) {
+		if (offsets != NULL) {
+			ckfree((char *) offsets);
+		}
+		return TCL_ERROR;
+	}
+	Tcl_SetChannelOption(NULL, chan, "-translation", "binary");
+
+	code = Index_WriteBytes(interp, chan, filePtr, &header, sizeof(header));
+	if (code == TCL_OK) {
+		code = Index_WriteBytes(interp, chan, filePtr,
+				indexPtr->tags, tagsLength);
+	}
+	if (code == TCL_OK) {
+		code = Index_WriteBytes(interp, chan, filePtr,
+				NULL, ALIGN8(tagsLength) - tagsLength);
+	}
+	if (code == TCL_OK) {
+		code = Index_WriteBytes(interp, chan, filePtr,
+				indexPtr->keys, keysLength);
+	}
+	if (code == TCL_OK) {
+		code = Index_WriteBytes(interp, chan, filePtr,
+				NULL, ALIGN8(keysLength) - keysLength);
+	}
+	if (code == TCL_OK && offsets != NULL) {
+		code = Index_WriteBytes(interp, chan, filePtr, offsets,
+				(indexPtr->capacity + 1) * sizeof(word64));
+		for (i = 0; code == TCL_OK && i < indexPtr->capacity; ++i) {
+			bytes = Index_PayloadBytes(indexPtr, i, &len);
+			code = Index_WriteBytes(interp, chan, filePtr, bytes, len);
+		}
+	}
+
+	if (offsets != NULL) {
+		ckfree((char *) offsets);
+	}
+	if (Tcl_Close(code == TCL_OK ? interp : NULL, chan) != TCL_OK) {
+		code = TCL_ERROR;
+	}
+
+	return code;
+}
+
+
+#ifndef USE_MMAP
+/*
+ * Reads the whole file into memory; used where
+ * mapping files is not supported.
+ */
+static char *
+Index_ReadFile (
+		Tcl_Interp *interp,
+		Tcl_Obj    *filePtr,
+		size_t     *lengthPtr
+		)
+{
+	Tcl_Channel chan;
+	Tcl_WideInt size;
+	char *bufferPtr;
+
+	chan = Tcl_FSOpenFileChannel(interp, filePtr, "r", 0);
+	if (chan == NULL) {
+		return NULL;
+	}
+	Tcl_SetChannelOption(NULL, chan, "-translation", "binary");
+
+	size = Tcl_Seek(chan, 0, SEEK_END);
+	Tcl_Seek(chan, 0, SEEK_SET);
+
+	bufferPtr = ckalloc(size > 0 ? (unsigned) size : 1);
+	if (size < 0 || Tcl_Read(chan, bufferPtr, (int) size) != size) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error reading \"",
+				Tcl_GetString(filePtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		ckfree(bufferPtr);
+		Tcl_Close(NULL, chan);
+		return NULL;
+	}
+	Tcl_Close(NULL, chan);
+
+	*lengthPtr = (size_t) size;
+	return bufferPtr;
+}
+#endif
+
+
+/*
+ * Adds the length of a part of an index file to *sumPtr;
+ * returns 0 if the sum would exceed the length of the file.
+ */
+static int
+Index_AddLength (
+		word64 *sumPtr,
+		word64 length,
+		word64 limit
+		)
+{
+	if (length > limit || *sumPtr > limit - length) {
+		return 0;
+	}
+	*sumPtr += length;
+	return 1;
+}
+
+
+/*
+ * Loads an index saved to a file; the index is frozen.
+ */
+static Index *
+Index_Load (
+		Tcl_Interp *interp,
+		Tcl_Obj    *filePtr
+		)
+{
+	Index *indexPtr;
+	IndexHeader header;
+	const byte *data, *tags;
+	size_t len, i;
+	word64 tagsLength, keysLength, expected, occupied;
+#ifdef USE_MMAP
+	TTH_Mapping *mapPtr;
+#endif
+	char *bufferPtr = NULL;
+
+#ifdef USE_MMAP
+	mapPtr = TTH_MapFile(interp, filePtr, &data, &len);
+	if (mapPtr == NULL) {
+		return NULL;
+	}
+#else
+	bufferPtr = Index_ReadFile(interp, filePtr, &len);
+	if (bufferPtr == NULL) {
+		return NULL;
+	}
+	data = (const byte *) bufferPtr;
+#endif
+
+	if (len < sizeof(header)) {
+		goto badFile;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != INDEX_VERSION) {
+		goto badFile;
+	}
+	if (header.byteOrder != INDEX_BYTEORDER) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "index file \"", Tcl_GetString(filePtr),
+				"\" was saved on a platform with a different byte order",
+				NULL);
+		goto error;
+	}
+	if ((header.keyLength != 24 && header.keyLength != 20
+				&& header.keyLength != 16)
+			|| header.capacity < INDEX_MINCAPACITY
+			|| (header.capacity & (header.capacity - 1)) != 0
+			|| header.count > header.capacity
+			|| header.capacity > (word64) (size_t) -1 / 32) {
+		goto badFile;
+	}
+
+	/*
+	 * The capacity is bounded above, so the lengths of the tags, keys
+	 * and offsets can not wrap; the blob length comes from the file
+	 * as it is, so each part is checked against what is left of it.
+	 */
+	tagsLength = header.capacity;
+	keysLength = header.capacity * header.keyLength;
+	expected = sizeof(header);
+	if (!Index_AddLength(&expected, ALIGN8(tagsLength), len)
+			|| !Index_AddLength(&expected, ALIGN8(keysLength), len)) {
+		goto badFile;
+	}
+	if ((header.flags & INDEX_PAYLOADS)
+			&& (!Index_AddLength(&expected,
+					(header.capacity + 1) * sizeof(word64), len)
+				|| !Index_AddLength(&expected, header.blobLength, len))) {
+		goto badFile;
+	}
+	if (expected != len) {
+		goto badFile;
+	}
+
+	/*
+	 * Lookups stop at the first free slot, so a table fuller than
+	 * the limit, or not as full as it claims, is not trusted.
+	 */
+	tags = data + sizeof(header);
+	occupied = 0;
+	for (i = 0; i < (size_t) header.capacity; ++i) {
+		if (tags[i] != 0) {
+			++occupied;
+		}
+	}
+	if (occupied != header.count || occupied > header.capacity / 4 * 3) {
+		goto badFile;
+	}
+
+	indexPtr = (Index *) ckalloc(sizeof(Index));
+	memset(indexPtr, 0, sizeof(Index));
+	indexPtr->keyLength = header.keyLength;
+	indexPtr->capacity  = (size_t) header.capacity;
+	indexPtr->count     = (size_t) header.count;
+	indexPtr->frozen    = 1;
+	indexPtr->tags = (unsigned char *) data + sizeof(header);
+	indexPtr->keys = (byte *) indexPtr->tags + ALIGN8(tagsLength);
+	if (header.flags & INDEX_PAYLOADS) {
+		indexPtr->offsets = (const word64 *)
+				(indexPtr->keys + ALIGN8(keysLength));
+		indexPtr->blob = (const char *)
+				(indexPtr->offsets + header.capacity + 1);
+		indexPtr->blobLength = header.blobLength;
+	}
+#ifdef USE_MMAP
+	indexPtr->mapPtr = mapPtr;
+#endif
+	indexPtr->bufferPtr = bufferPtr;
+
+	return indexPtr;
+
+badFile:
+	Tcl_ResetResult(interp);
+	Tcl_AppendResult(interp, "file \"", Tcl_GetString(filePtr),
+			"\" is not a valid index file", NULL);
+error:
+#ifdef USE_MMAP
+	TTH_UnmapFile(mapPtr);
+#endif
+	if (bufferPtr != NULL) {
+		ckfree(bufferPtr);
+	}
+	return NULL;
+}
+
+
+/*
+ * Returns the statistics of the index as a dictionary.
+ */
+static Tcl_Obj *
+Index_Stats (
+		Index *indexPtr
+		)
+{
+	Tcl_Obj *dictPtr;
+	Tcl_WideInt bytes;
+
+	bytes = (Tcl_WideInt) indexPtr->capacity * (1 + indexPtr->keyLength);
+	if (indexPtr->payloads != NULL) {
+		bytes += (Tcl_WideInt) indexPtr->capacity * sizeof(Tcl_Obj *);
+	}
+	if (indexPtr->offsets != NULL) {
+		bytes += (Tcl_WideInt) (indexPtr->capacity + 1) * sizeof(word64)
+				+ indexPtr->blobLength;
+	}
+
+	dictPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("entries", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) indexPtr->count));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("capacity", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) indexPtr->capacity));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("keysize", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewIntObj(indexPtr->keyLength));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("load", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewDoubleObj((double) indexPtr->count / indexPtr->capacity));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("bytes", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewWideIntObj(bytes));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("mapped", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewBooleanObj(indexPtr->frozen));
+
+	return dictPtr;
+}
+
+
+/*
+ * Implements [index create ?-192|-160|-128? ?-capacity n?].
+ */
+static int
+Index_CreateSubcmd (
+		Tcl_Interp     *interp,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	static const char *options[] = { "-192", "-160", "-128",
+		"-capacity", NULL };
+	enum { OP_192, OP_160, OP_128, OP_CAPACITY };
+	int i, op, keyLength, capacity;
+
+	keyLength = 24;
+	capacity = 0;
+
+	for (i = 2; i < objc; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		switch (op) {
+			case OP_192:
+				keyLength = 24;
+			break;
+			case OP_160:
+				keyLength = 20;
+			break;
+			case OP_128:
+				keyLength = 16;
+			break;
+			case OP_CAPACITY:
+				if (i == objc - 1) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-capacity\" "
+							"requires an argument", NULL);
+					return TCL_ERROR;
+				}
+				++i;
+				if (Tcl_GetIntFromObj(interp, objv[i],
+							&capacity) != TCL_OK) { return TCL_ERROR; }
+				if (capacity < 0) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad capacity \"",
+							Tcl_GetString(objv[i]),
+							"\": must be a non-negative integer", NULL);
+					return TCL_ERROR;
+				}
+			break;
+		}
+	}
+
+	Tcl_SetObjResult(interp, TTH_NewHandle(interp, &Index_HandleType,
+				(ClientData) Index_New(keyLength,
+					Index_CapacityFor((size_t) capacity))));
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Index_Cmd --
+ *
+ *	Implements the "::tth::index" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Indices are created, modified, saved and loaded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Index_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *subcmds[] = { "create", "insert", "get", "exists",
+		"delete", "size", "stats", "save", "load", "destroy", NULL };
+	enum { IDX_CREATE, IDX_INSERT, IDX_GET, IDX_EXISTS,
+		IDX_DELETE, IDX_SIZE, IDX_STATS, IDX_SAVE, IDX_LOAD, IDX_DESTROY };
+	Index *indexPtr;
+	Tcl_Obj **elemv, **payloadv, *resultPtr;
+	int cmd, list, first, elemc, payloadc, i, n;
+	byte buf[TIGERSIZE];
+	const byte *key;
+	size_t slot;
+	const char *bytes;
+
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "subcommand ?arg ...?");
+		return TCL_ERROR;
+	}
+
+	if (Tcl_GetIndexFromObj(interp, objv[1], subcmds, "subcommand",
+			0, &cmd) != TCL_OK) { return TCL_ERROR; }
+
+	switch (cmd) {
+		case IDX_CREATE:
+			return Index_CreateSubcmd(interp, objc, objv);
+		break;
+
+		case IDX_LOAD:
+			if (objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "fileName");
+				return TCL_ERROR;
+			}
+			indexPtr = Index_Load(interp, objv[2]);
+			if (indexPtr == NULL) {
+				return TCL_ERROR;
+			}
+			Tcl_SetObjResult(interp, TTH_NewHandle(interp,
+					&Index_HandleType, (ClientData) indexPtr));
+			return TCL_OK;
+		break;
+	}
+
+	/* The rest of subcommands operate on an existing index */
+
+	list = objc > 2 && strcmp(Tcl_GetString(objv[2]), "-list") == 0;
+	first = list ? 3 : 2;
+
+	if (objc <= first) {
+		Tcl_WrongNumArgs(interp, 2, objv, "?-list? index ?arg ...?");
+		return TCL_ERROR;
+	}
+	if (TTH_GetHandleFromObj(interp, objv[first], &Index_HandleType,
+				(ClientData *) &indexPtr) != TCL_OK) { return TCL_ERROR; }
+
+	switch (cmd) {
+		case IDX_INSERT:
+			if (objc != first + 2 && objc != first + 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, list
+						? "-list index digests ?payloads?"
+						: "?-list? index digest ?payload?");
+				return TCL_ERROR;
+			}
+			if (!list) {
+				if (Index_GetKey(interp, indexPtr, objv[first + 1],
+							buf, &key) != TCL_OK) { return TCL_ERROR; }
+				Index_Reserve(indexPtr, 1);
+				Tcl_SetObjResult(interp, Tcl_NewBooleanObj(
+							Index_Insert(indexPtr, key,
+								objc == first + 3 ? objv[first + 2] : NULL)));
+				return TCL_OK;
+			}
+			if (Tcl_ListObjGetElements(interp, objv[first + 1],
+						&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+			payloadc = 0;
+			payloadv = NULL;
+			if (objc == first + 3) {
+				if (Tcl_ListObjGetElements(interp, objv[first + 2],
+							&payloadc, &payloadv) != TCL_OK) { return TCL_ERROR; }
+				if (payloadc != elemc) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "lists of digests and payloads "
+							"must be of the same length", NULL);
+					return TCL_ERROR;
+				}
+			}
+			Index_Reserve(indexPtr, (size_t) elemc);
+			n = 0;
+			for (i = 0; i < elemc; ++i) {
+				if (Index_GetKey(interp, indexPtr, elemv[i],
+							buf, &key) != TCL_OK) { return TCL_ERROR; }
+				n += Index_Insert(indexPtr, key,
+						payloadv != NULL ? payloadv[i] : NULL);
+			}
+			Tcl_SetObjResult(interp, Tcl_NewIntObj(n));
+			return TCL_OK;
+		break;
+
+		case IDX_GET:
+			if (list || (objc != 4 && objc != 5)) {
+				Tcl_WrongNumArgs(interp, 2, objv, "index digest ?default?");
+				return TCL_ERROR;
+			}
+			if (Index_GetKey(interp, indexPtr, objv[3],
+						buf, &key) != TCL_OK) { return TCL_ERROR; }
+			if (!Index_Find(indexPtr, key, &slot)) {
+				if (objc == 5) {
+					Tcl_SetObjResult(interp, objv[4]);
+					return TCL_OK;
+				}
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "digest \"", Tcl_GetString(objv[3]),
+						"\" not found in index", NULL);
+				return TCL_ERROR;
+			}
+			if (!indexPtr->frozen && indexPtr->payloads != NULL
+					&& indexPtr->payloads[slot] != NULL) {
+				Tcl_SetObjResult(interp, indexPtr->payloads[slot]);
+			} else {
+				bytes = Index_PayloadBytes(indexPtr, slot, &n);
+				Tcl_SetObjResult(interp, Tcl_NewStringObj(bytes, n));
+			}
+			return TCL_OK;
+		break;
+
+		case IDX_EXISTS:
+		case IDX_DELETE:
+			if (objc != first + 2) {
+				Tcl_WrongNumArgs(interp, 2, objv, "?-list? index digest");
+				return TCL_ERROR;
+			}
+			if (!list) {
+				if (Index_GetKey(interp, indexPtr, objv[first + 1],
+							buf, &key) != TCL_OK) { return TCL_ERROR; }
+				Tcl_SetObjResult(interp, Tcl_NewBooleanObj(cmd == IDX_EXISTS
+							? Index_Find(indexPtr, key, &slot)
+							: Index_Delete(indexPtr, key)));
+				return TCL_OK;
+			}
+			if (Tcl_ListObjGetElements(interp, objv[first + 1],
+						&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+			resultPtr = cmd == IDX_EXISTS ? Tcl_NewListObj(elemc, NULL) : NULL;
+			n = 0;
+			for (i = 0; i < elemc; ++i) {
+				if (Index_GetKey(interp, indexPtr, elemv[i],
+							buf, &key) != TCL_OK) {
+					if (resultPtr != NULL) {
+						Tcl_DecrRefCount(resultPtr);
+					}
+					return TCL_ERROR;
+				}
+				if (cmd == IDX_EXISTS) {
+					Tcl_ListObjAppendElement(NULL, resultPtr,
+							Tcl_NewBooleanObj(Index_Find(indexPtr, key, &slot)));
+				} else {
+					n += Index_Delete(indexPtr, key);
+				}
+			}
+			Tcl_SetObjResult(interp, resultPtr != NULL
+					? resultPtr : Tcl_NewIntObj(n));
+			return TCL_OK;
+		break;
+
+		case IDX_DESTROY:
+			if (list || objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "index");
+				return TCL_ERROR;
+			}
+			return TTH_DeleteHandle(interp, objv[2], &Index_HandleType);
+		break;
+
+		case IDX_SIZE:
+		case IDX_STATS:
+			if (list || objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "index");
+				return TCL_ERROR;
+			}
+			Tcl_SetObjResult(interp, cmd == IDX_SIZE
+					? Tcl_NewWideIntObj((Tcl_WideInt) indexPtr->count)
+					: Index_Stats(indexPtr));
+			return TCL_OK;
+		break;
+
+		case IDX_SAVE:
+			if (list || objc != 4) {
+				Tcl_WrongNumArgs(interp, 2, objv, "index fileName");
+				return TCL_ERROR;
+			}
+			return Index_Save(interp, indexPtr, objv[3]);
+		break;
+	}
+
+	return TCL_ERROR;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Index_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::index",
+		(Tcl_ObjCmdProc *) Index_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
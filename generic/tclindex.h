@@ -0,0 +1,25 @@
+/*
+ * tclindex.h --
+ *
+ *	This file implements interface for tclindex.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLINDEX_H
+#define __TCLINDEX_H
+
+#include <tcl.h>
+
+Tcl_Command
+Index_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLINDEX_H */
@@ -18,6 +18,18 @@
 
 #include "tcltth.h"
 #include "tcltiger.h"
+#include "tclxform.h"
+#include "tclcopy.h"
+#include "tcldigest.h"
+#include "tclindex.h"
+#include "tclfilter.h"
+#include "tclstore.h"
+#include "tcldups.h"
+#include "tclstats.h"
+#include "tclthrottle.h"
+#include "tclpool.h"
+#include "tigertree.h"
+#include "tth.h"
 
 #ifdef BUILD_tth
 #undef TCL_STORAGE_CLASS
@@ -26,6 +38,11 @@
 
 EXTERN int	Tth_Init(Tcl_Interp * interp);
 
+/*
+ * The stubs table of the C API, see tthStubInit.c
+ */
+extern TthStubs tthStubs;
+
 
 /*
  *----------------------------------------------------------------------
@@ -40,7 +57,9 @@ EXTERN int	Tth_Init(Tcl_Interp * interp);
  * Side effects:
  *	- The "tth" package is created.
  *  - Namespace "::tth" is created.
- *  - "tiger" and "tth" commands are created in that namespace.
+ *  - "tiger", "tth", "transform", "copy", "convert", "equal",
+ *    "compare", "index", "filter", "treestore", "duplicates", "stats"
+ *    and "throttle" commands are created in that namespace.
  *
  *----------------------------------------------------------------------
  */
@@ -49,20 +68,37 @@ int
 Tth_Init(Tcl_Interp *interp)
 {
 	/*
-	 * This may work with 8.0, but we are using strictly stubs here,
-	 * which requires 8.1.
+	 * We are using strictly stubs here, and the stacked channel
+	 * transformation relies on the channel driver API of 8.4.
 	 */
-	if (Tcl_InitStubs(interp, "8.1", 0) == NULL) {
+	if (Tcl_InitStubs(interp, "8.4", 0) == NULL) {
 		return TCL_ERROR;
 	}
-	if (Tcl_PkgRequire(interp, "Tcl", "8.1", 0) == NULL) {
+	if (Tcl_PkgRequire(interp, "Tcl", "8.4", 0) == NULL) {
 		return TCL_ERROR;
 	}
 
+	/*
+	 * Contexts are allocated from per-thread pools.
+	 */
+	tt_set_allocator(TTH_PoolAlloc, TTH_PoolFree);
+
 	if (Tiger_CreateCmd(interp) == NULL) { return TCL_ERROR; }
 	if (TTH_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Transform_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Copy_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Convert_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Equal_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Compare_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Index_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Filter_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Store_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Dups_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Stats_CreateCmd(interp) == NULL) { return TCL_ERROR; }
+	if (Throttle_CreateCmd(interp) == NULL) { return TCL_ERROR; }
 
-	if (Tcl_PkgProvide(interp, PACKAGE_NAME, PACKAGE_VERSION) != TCL_OK) {
+	if (Tcl_PkgProvideEx(interp, PACKAGE_NAME, PACKAGE_VERSION,
+				(ClientData) &tthStubs) != TCL_OK) {
 		return TCL_ERROR;
 	}
 
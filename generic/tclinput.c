@@ -0,0 +1,179 @@
+/*
+ * tclinput.c --
+ *
+ *	This file implements various methods of feeding
+ *	input data to a hash calculation.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+
+#include "tigertree.h"
+#include "tclinput.h"
+#include "tclmmap.h"
+#include "tclprobe.h"
+
+
+/*
+ *
+ */
+void
+DigestUpdateTTH (
+		ClientData  clientData,
+		const byte  *bytes,
+		int         len
+		)
+{
+	tt_update((TT_CONTEXT *) clientData, bytes, (word32) len);
+}
+
+
+/*
+ *
+ */
+void
+DigestUpdateTiger (
+		ClientData  clientData,
+		const byte  *bytes,
+		int         len
+		)
+{
+	tiger_update((TIGER_CONTEXT *) clientData, bytes, (word64) len);
+}
+
+
+/*
+ * Reads the data from the given channel from its current position
+ * until end-of-file condition, passing it to updateProc chunk by chunk.
+ * The reads are throttled by throttlePtr (if not NULL) and by the
+ * process-wide limits.
+ */
+int
+DigestUpdateFromChan (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *chanPtr,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr
+		)
+{
+	Tcl_Channel chan;
+	int mode;
+	Tcl_Obj *chunkPtr;
+	byte *dataPtr;
+	int len;
+	Tcl_WideInt offset;
+	const int CHUNKSIZE = 8192;
+
+	chan = Tcl_GetChannel(interp,
+			Tcl_GetString(chanPtr), &mode);
+	if (chan == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not find channel named \"",
+				Tcl_GetString(chanPtr), "\"", NULL);
+		return TCL_ERROR;
+	}
+	if ((mode & TCL_READABLE) != TCL_READABLE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "channel \"", Tcl_GetString(chanPtr),
+				"\" is not opened for reading", NULL);
+		return TCL_ERROR;
+	}
+
+	chunkPtr = Tcl_NewObj();
+	Tcl_IncrRefCount(chunkPtr);
+
+	offset = 0;
+	while (! Tcl_Eof(chan)) {
+		len = Tcl_ReadChars(chan, chunkPtr, CHUNKSIZE, 0);
+		if (len == -1) {
+			Tcl_DecrRefCount(chunkPtr);
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "failed to read from channel \"",
+					Tcl_GetString(chanPtr), "\"", NULL);
+			return TCL_ERROR;
+		}
+		dataPtr = Tcl_GetByteArrayFromObj(chunkPtr, &len);
+		TTH_ThrottleIo(throttlePtr, len);
+		TTH_PROBE3(io__chunk, "chan", offset, len);
+		updateProc(clientData, dataPtr, len);
+		offset += len;
+	}
+
+	Tcl_DecrRefCount(chunkPtr);
+
+	return TCL_OK;
+}
+
+
+/*
+ * Reads the named file, passing its data to updateProc chunk
+ * by chunk. Unless FE_STREAM is requested, regular files are read
+ * by the platform code (if there is one) using the given engine
+ * or the one it finds the most suitable; other files, and those
+ * the platform code fails to map or read, are read through
+ * a channel. The engine actually used is stored at usedPtr.
+ * The reads are throttled as by DigestUpdateFromChan().
+ */
+int
+DigestUpdateFromFile (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		FILE_ENGINE      engine,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr,
+		FILE_ENGINE      *usedPtr
+		)
+{
+	Tcl_Channel chan;
+	char *buffer;
+	int len, code;
+	Tcl_WideInt offset;
+	const int CHUNKSIZE = 65536;
+
+#ifdef USE_MMAP
+	if (engine != FE_STREAM) {
+		code = TTH_UpdateFromFile(interp, filePtr, engine,
+				updateProc, clientData, throttlePtr, usedPtr);
+		if (code != TCL_CONTINUE) {
+			return code;
+		}
+	}
+#endif
+
+	*usedPtr = FE_STREAM;
+
+	chan = Tcl_FSOpenFileChannel(interp, filePtr, "r", 0);
+	if (chan == NULL) {
+		return TCL_ERROR;
+	}
+	Tcl_SetChannelOption(NULL, chan, "-translation", "binary");
+
+	buffer = ckalloc(CHUNKSIZE);
+	code = TCL_OK;
+	offset = 0;
+	while ((len = Tcl_Read(chan, buffer, CHUNKSIZE)) > 0) {
+		TTH_ThrottleIo(throttlePtr, len);
+		TTH_PROBE3(io__chunk, "chan", offset, len);
+		updateProc(clientData, (const byte *) buffer, len);
+		offset += len;
+	}
+	if (len < 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error reading \"", Tcl_GetString(filePtr),
+				"\": ", Tcl_PosixError(interp), NULL);
+		code = TCL_ERROR;
+	}
+	ckfree(buffer);
+	Tcl_Close(NULL, chan);
+
+	return code;
+}
@@ -0,0 +1,79 @@
+/*
+ * tclinput.h --
+ *
+ *	This file implements interface for tclinput.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLINPUT_H
+#define __TCLINPUT_H
+
+#include <tcl.h>
+#include "tiger.h"
+#include "tclthrottle.h"
+
+/*
+ * Procedure fed with successive chunks of the data being hashed;
+ * clientData is the context of a particular hash algorithm.
+ */
+typedef void (DigestUpdateProc) (
+		ClientData  clientData,
+		const byte  *bytes,
+		int         len
+		);
+
+/*
+ * Update procedures for TT_CONTEXT and TIGER_CONTEXT.
+ */
+void
+DigestUpdateTTH (
+		ClientData  clientData,
+		const byte  *bytes,
+		int         len
+		);
+
+void
+DigestUpdateTiger (
+		ClientData  clientData,
+		const byte  *bytes,
+		int         len
+		);
+
+int
+DigestUpdateFromChan (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *chanPtr,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr
+		);
+
+/*
+ * Ways of reading a file being hashed (see DigestUpdateFromFile()).
+ */
+typedef enum {
+	FE_AUTO,      /* chosen according to the file */
+	FE_MMAP,      /* the file is mapped */
+	FE_READ,      /* the file is read using large buffers */
+	FE_STREAM     /* the file is read through a Tcl channel */
+} FILE_ENGINE;
+
+int
+DigestUpdateFromFile (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		FILE_ENGINE      engine,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr,
+		FILE_ENGINE      *usedPtr
+		);
+
+#endif /* __TCLINPUT_H */
@@ -22,14 +22,93 @@
 #define USE_MMAP 1
 
 #include <tcl.h>
+#include "tigertree.h"
+#include "tclinput.h"
 
 int
-TTH_GetDigestUsingMmap (
+TTH_UpdateUsingMmap (
 		Tcl_Interp   *interp,
 		Tcl_Obj      *filePtr,
-		byte         digest[]
+		DigestUpdateProc *updateProc,
+		ClientData   clientData,
+		TTH_Throttle *throttlePtr
 		);
 
+/*
+ * Reading of a regular file using the given engine (FE_MMAP, FE_READ
+ * or FE_AUTO to choose one); returns TCL_CONTINUE if the file is not
+ * a regular file or is empty, so it should be streamed. When the I/O
+ * is throttled, mapped files are not read ahead beyond what the
+ * throttle has let through.
+ */
+
+int
+TTH_UpdateFromFile (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		FILE_ENGINE      engine,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr,
+		FILE_ENGINE      *usedPtr
+		);
+
+/*
+ * Read-only mapping of a whole file; the data stays valid
+ * until the mapping is released.
+ */
+
+typedef struct TTH_Mapping TTH_Mapping;
+
+TTH_Mapping *
+TTH_MapFile (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *filePtr,
+		const byte   **dataPtr,
+		size_t       *lengthPtr
+		);
+
+void
+TTH_UnmapFile (
+		TTH_Mapping  *mapPtr
+		);
+
+#ifdef HAVE_MMAP
+
+/*
+ * Copying of a file to another file, hashing the data being copied;
+ * the source file is mapped window by window and each window is
+ * written directly from the mapping.
+ */
+
+#define USE_MMAP_COPY 1
+
+typedef struct TTH_MmapCopy TTH_MmapCopy;
+
+TTH_MmapCopy *
+TTH_MmapCopyOpen (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *srcPtr,
+		Tcl_Obj      *dstPtr
+		);
+
+int
+TTH_MmapCopyStep (
+		Tcl_Interp   *interp,
+		TTH_MmapCopy *copyPtr,
+		TT_CONTEXT   *contextPtr,
+		size_t       window,
+		Tcl_WideInt  *copiedPtr,
+		int          *donePtr
+		);
+
+void
+TTH_MmapCopyClose (
+		TTH_MmapCopy *copyPtr
+		);
+
+#endif /* HAVE_MMAP */
+
 #else
 
 #undef USE_MMAP
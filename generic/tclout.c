@@ -17,11 +17,12 @@
 #include <string.h>
 
 #include "tclout.h"
-#include "base32.h"
+#include "tcldigest.h"
 
 
 /*
- *
+ * Returns the digest in THEX format; the string
+ * is only generated when it is asked for.
  */
 Tcl_Obj *
 DigestToTHEX (
@@ -29,13 +30,7 @@ DigestToTHEX (
 		DIGEST_BITLEN  bitlen
 		)
 {
-	char TTX[BASE32_DESTLEN(TIGERSIZE)];
-	int bytelen;
-
-	bytelen = bitlen / 8;
-
-	to_base32(digest, bytelen, TTX);
-	return Tcl_NewStringObj(TTX, -1);
+	return DigestNewObj(digest, bitlen / 8, DF_THEX);
 }
 
 
@@ -52,24 +47,89 @@ DigestToRaw (
 }
 
 
+/*
+ * Returns the digest as a string of hex digits;
+ * the string is only generated when it is asked for.
+ */
 Tcl_Obj *
 DigestToHex (
 		byte           digest[],
 		DIGEST_BITLEN  bitlen
 		)
 {
-	static const char alph[] = "0123456789abcdef";
-	int si, di;
-	int bytelen;
-	char hex[TIGERSIZE * 2];
+	return DigestNewObj(digest, bitlen / 8, DF_HEX);
+}
+
+
 
-	bytelen = bitlen / 8;
+/*
+ *
+ */
+void
+DigestLevelInit (
+		DIGEST_LEVEL  *levelPtr
+		)
+{
+	levelPtr->nodes  = NULL;
+	levelPtr->length = 0;
+	levelPtr->room   = 0;
+}
+
+
+/*
+ *
+ */
+void
+DigestLevelAppend (
+		void          *clientData,
+		const byte    *node
+		)
+{
+	DIGEST_LEVEL *levelPtr = (DIGEST_LEVEL *) clientData;
 
-	for (si = di = 0; si < bytelen; ++si, ++di) {
-		hex[di]   = alph[digest[si] >> 4];
-		hex[++di] = alph[digest[si] & 0x0F];
+	if (levelPtr->length == levelPtr->room) {
+		if (levelPtr->nodes == NULL) {
+			levelPtr->room  = 32 * TIGERSIZE;
+			levelPtr->nodes = (byte *) ckalloc(levelPtr->room);
+		} else {
+			levelPtr->room *= 2;
+			levelPtr->nodes = (byte *) ckrealloc((char *) levelPtr->nodes,
+					levelPtr->room);
+		}
 	}
+	memcpy(levelPtr->nodes + levelPtr->length, node, TIGERSIZE);
+	levelPtr->length += TIGERSIZE;
+}
+
+
+/*
+ * Returns the accumulated nodes concatenated in a byte array
+ * and empties the level.
+ */
+Tcl_Obj *
+DigestLevelToObj (
+		DIGEST_LEVEL  *levelPtr
+		)
+{
+	Tcl_Obj *objPtr;
 
-	return Tcl_NewStringObj(hex, bytelen * 2);
+	objPtr = Tcl_NewByteArrayObj(levelPtr->nodes, (int) levelPtr->length);
+	DigestLevelFree(levelPtr);
+
+	return objPtr;
 }
 
+
+/*
+ *
+ */
+void
+DigestLevelFree (
+		DIGEST_LEVEL  *levelPtr
+		)
+{
+	if (levelPtr->nodes != NULL) {
+		ckfree((char *) levelPtr->nodes);
+	}
+	DigestLevelInit(levelPtr);
+}
@@ -42,5 +42,36 @@ DigestToHex (
 		DIGEST_BITLEN  bitlen
 		);
 
+/*
+ * Accumulates the nodes of one level of a hash tree;
+ * DigestLevelAppend() is suitable as a tt_level_proc.
+ */
+typedef struct {
+	byte   *nodes;
+	size_t length;
+	size_t room;
+} DIGEST_LEVEL;
+
+void
+DigestLevelInit (
+		DIGEST_LEVEL  *levelPtr
+		);
+
+void
+DigestLevelAppend (
+		void          *clientData,
+		const byte    *node
+		);
+
+Tcl_Obj *
+DigestLevelToObj (
+		DIGEST_LEVEL  *levelPtr
+		);
+
+void
+DigestLevelFree (
+		DIGEST_LEVEL  *levelPtr
+		);
+
 #endif /* __TCLOUT_H */
 
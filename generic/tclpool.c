@@ -0,0 +1,189 @@
+/*
+ * tclpool.c --
+ *
+ *	This file implements a per-thread pool allocator for the small
+ *	fixed-size objects this package allocates in large numbers
+ *	(hashing contexts, their partial leaves and node stacks).
+ *
+ *	Objects are carved out of slabs, without any per-object header,
+ *	and freed objects are kept on per-size free lists for reuse;
+ *	the size of an object must therefore be passed when freeing it.
+ *	An object must be freed by the same thread which allocated it.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+
+#include "tclpool.h"
+
+/* Sizes are rounded up to multiples of POOL_QUANTUM */
+#define POOL_QUANTUM  16
+/* Objects larger than this are ckalloc'ed directly */
+#define POOL_MAXSIZE  512
+#define POOL_CLASSES  (POOL_MAXSIZE / POOL_QUANTUM)
+/* Size of a slab, in bytes */
+#define POOL_SLABSIZE 16384
+
+typedef struct FreeObject {
+	struct FreeObject *nextPtr;
+} FreeObject;
+
+typedef struct Slab {
+	struct Slab *nextPtr;
+} Slab;
+
+typedef struct {
+	int        initialized;
+	FreeObject *freeLists[POOL_CLASSES];
+	Slab       *slabs;
+	long       live;          /* number of objects allocated */
+} ThreadSpecificData;
+
+static Tcl_ThreadDataKey dataKey;
+
+/* Slab header, rounded up to keep the objects aligned */
+#define SLAB_HEADER \
+	((sizeof(Slab) + POOL_QUANTUM - 1) / POOL_QUANTUM * POOL_QUANTUM)
+
+
+/*
+ * Frees the slabs of the thread unless some objects are still
+ * in use, in which case the slabs are left alone.
+ */
+static void
+ThreadExitProc (
+		ClientData clientData
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	Slab *slabPtr, *nextPtr;
+
+	tsdPtr = (ThreadSpecificData *) clientData;
+	if (tsdPtr->live != 0) {
+		return;
+	}
+
+	for (slabPtr = tsdPtr->slabs; slabPtr != NULL; slabPtr = nextPtr) {
+		nextPtr = slabPtr->nextPtr;
+		ckfree((char *) slabPtr);
+	}
+	tsdPtr->slabs = NULL;
+	tsdPtr->initialized = 0;
+}
+
+
+/*
+ *
+ */
+static ThreadSpecificData *
+GetThreadData (void)
+{
+	ThreadSpecificData *tsdPtr;
+	int i;
+
+	tsdPtr = (ThreadSpecificData *) Tcl_GetThreadData(&dataKey,
+			sizeof(ThreadSpecificData));
+	if (!tsdPtr->initialized) {
+		for (i = 0; i < POOL_CLASSES; ++i) {
+			tsdPtr->freeLists[i] = NULL;
+		}
+		tsdPtr->slabs = NULL;
+		tsdPtr->live = 0;
+		tsdPtr->initialized = 1;
+		Tcl_CreateThreadExitHandler(ThreadExitProc, (ClientData) tsdPtr);
+	}
+
+	return tsdPtr;
+}
+
+
+/*
+ * Carves a new slab into objects of the given size class
+ * and puts them on the free list of that class.
+ */
+static void
+NewSlab (
+		ThreadSpecificData *tsdPtr,
+		int                sizeClass
+		)
+{
+	Slab *slabPtr;
+	char *objPtr, *endPtr;
+	size_t size;
+
+	size = (size_t) (sizeClass + 1) * POOL_QUANTUM;
+
+	slabPtr = (Slab *) ckalloc(POOL_SLABSIZE);
+	slabPtr->nextPtr = tsdPtr->slabs;
+	tsdPtr->slabs = slabPtr;
+
+	objPtr = (char *) slabPtr + SLAB_HEADER;
+	endPtr = (char *) slabPtr + POOL_SLABSIZE;
+	for (; objPtr + size <= endPtr; objPtr += size) {
+		((FreeObject *) objPtr)->nextPtr = tsdPtr->freeLists[sizeClass];
+		tsdPtr->freeLists[sizeClass] = (FreeObject *) objPtr;
+	}
+}
+
+
+/*
+ * Allocates an object of the given size; never returns NULL.
+ */
+void *
+TTH_PoolAlloc (
+		size_t size
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	FreeObject *objPtr;
+	int sizeClass;
+
+	if (size > POOL_MAXSIZE || size == 0) {
+		return (void *) ckalloc((unsigned) size);
+	}
+
+	tsdPtr = GetThreadData();
+	sizeClass = (int) ((size - 1) / POOL_QUANTUM);
+
+	if (tsdPtr->freeLists[sizeClass] == NULL) {
+		NewSlab(tsdPtr, sizeClass);
+	}
+	objPtr = tsdPtr->freeLists[sizeClass];
+	tsdPtr->freeLists[sizeClass] = objPtr->nextPtr;
+	++tsdPtr->live;
+
+	return (void *) objPtr;
+}
+
+
+/*
+ * Returns an object of the given size to the pool.
+ */
+void
+TTH_PoolFree (
+		void   *ptr,
+		size_t size
+		)
+{
+	ThreadSpecificData *tsdPtr;
+	int sizeClass;
+
+	if (size > POOL_MAXSIZE || size == 0) {
+		ckfree((char *) ptr);
+		return;
+	}
+
+	tsdPtr = GetThreadData();
+	sizeClass = (int) ((size - 1) / POOL_QUANTUM);
+
+	((FreeObject *) ptr)->nextPtr = tsdPtr->freeLists[sizeClass];
+	tsdPtr->freeLists[sizeClass] = (FreeObject *) ptr;
+	--tsdPtr->live;
+}
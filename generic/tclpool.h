@@ -0,0 +1,32 @@
+/*
+ * tclpool.h --
+ *
+ *	This file implements interface for tclpool.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLPOOL_H
+#define __TCLPOOL_H
+
+#include <tcl.h>
+#include <stddef.h>
+
+void *
+TTH_PoolAlloc (
+		size_t size
+		);
+
+void
+TTH_PoolFree (
+		void   *ptr,
+		size_t size
+		);
+
+#endif /* __TCLPOOL_H */
@@ -0,0 +1,59 @@
+/*
+ * tclprobe.h --
+ *
+ *	Static (USDT) probes for perf, bpftrace and SystemTap.
+ *
+ *	The probes are compiled in only if TTH_PROBES is defined
+ *	(see --enable-probes of the configure script), in which case
+ *	<sys/sdt.h> is required; otherwise they expand to nothing,
+ *	and their arguments are not evaluated.
+ *	Each probe is a single no-op instruction unless a tracer is
+ *	attached to it.
+ *
+ *	All the probes are of the provider "tth":
+ *
+ *	digest__start(cmd, mode)
+ *	digest__done(cmd, mode, bytes)
+ *		Fired around the calculation of digests by [tth digest]
+ *		and [tiger] (cmd is "tth" or "tiger"); mode is the name
+ *		of the input mode as reported by [tth::stats] and bytes
+ *		is the number of bytes hashed. digest__done is not fired
+ *		if the call fails.
+ *
+ *	io__chunk(source, offset, length)
+ *		Fired for each window mapped or chunk read from a channel
+ *		or file before it is hashed; source is "chan", "mmap"
+ *		or "read" and offset is that of the chunk in the input.
+ *
+ *	context__create(cmd, context)
+ *	context__destroy(cmd, context, bytes)
+ *		Fired when a context of [tth init] or [tiger init]
+ *		is created and freed; bytes is the number of bytes
+ *		it has been fed.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLPROBE_H
+#define __TCLPROBE_H
+
+#ifdef TTH_PROBES
+
+#include <sys/sdt.h>
+
+#define TTH_PROBE2(name, a, b)        DTRACE_PROBE2(tth, name, a, b)
+#define TTH_PROBE3(name, a, b, c)     DTRACE_PROBE3(tth, name, a, b, c)
+
+#else
+
+#define TTH_PROBE2(name, a, b)
+#define TTH_PROBE3(name, a, b, c)
+
+#endif /* TTH_PROBES */
+
+#endif /* __TCLPROBE_H */
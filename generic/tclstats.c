@@ -0,0 +1,710 @@
+/*
+ * tclstats.c --
+ *
+ *	This file implements the "::tth::stats" command reporting
+ *	what the hashing commands have been doing.
+ *
+ *	The counters are kept per interpreter and for the whole process.
+ *	For each input mode they hold the number of calls, the bytes
+ *	hashed, the leaves and inner nodes of the trees computed, the
+ *	wall clock and thread CPU time spent, and a histogram of the
+ *	latencies of calls with power-of-two buckets, from 1 microsecond
+ *	to 2^24 microseconds (about 17 seconds) and the rest.
+ *
+ *	Accounting is on the path of every hashing call, so it is kept
+ *	cheap: the per-interpreter counters are only touched by the
+ *	interpreter's thread and are reached through the clientData of
+ *	the commands, which keep them alive along with the contexts
+ *	counted in them; the process-wide ones are kept per thread,
+ *	each set under its own, uncontended, mutex, and are only summed
+ *	when read. The thread CPU time costs a system call to sample,
+ *	so it is only measured for calls hashing much data.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "tclstats.h"
+
+#define STATS_ASSOC     "tth::stats"
+#define STATS_BUCKETS   26
+/* Size of a leaf of the hash tree, in bytes */
+#define STATS_LEAFSIZE  1024
+/* Calls hashing less data than this do not measure the CPU time */
+#define STATS_CPUMIN    (64 * 1024)
+
+typedef struct {
+	Tcl_WideUInt calls;
+	Tcl_WideUInt bytes;
+	Tcl_WideUInt leaves;
+	Tcl_WideUInt nodes;     /* inner nodes */
+	Tcl_WideUInt wall;      /* in microseconds */
+	Tcl_WideUInt cpu;       /* in microseconds */
+	Tcl_WideUInt latency[STATS_BUCKETS];
+} ModeStats;
+
+typedef struct {
+	ModeStats   modes[TS_NMODES];
+	Tcl_WideInt contexts;   /* contexts currently open */
+} Stats;
+
+/*
+ * Share of the process-wide counters of one thread.
+ */
+typedef struct ThreadStats {
+	ModeStats          modes[TS_NMODES];
+	Tcl_Mutex          lock;
+	struct ThreadStats *nextPtr;
+} ThreadStats;
+
+static const char *modeNames[] = { "string", "strings", "concat",
+	"chan", "mmap", "file", "context" };
+
+/*
+ * The process-wide counters are the sum of those of the threads
+ * in the list and those of the threads which have exited.
+ */
+static ThreadStats *threadStatsList;
+static Stats processStats;
+TCL_DECLARE_MUTEX(statsMutex)
+
+static Tcl_ThreadDataKey statsKey;
+
+
+/*
+ * Returns the CPU time consumed by the calling thread so far,
+ * in microseconds.
+ */
+static Tcl_WideInt
+Stats_CpuTime (void)
+{
+#if defined(_WIN32)
+	FILETIME created, exited, kernel, user;
+
+	if (!GetThreadTimes(GetCurrentThread(),
+				&created, &exited, &kernel, &user)) { return 0; }
+
+	return (Tcl_WideInt)
+		((((Tcl_WideUInt) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+		+ (((Tcl_WideUInt) user.dwHighDateTime << 32) | user.dwLowDateTime))
+		/ 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) { return 0; }
+
+	return (Tcl_WideInt) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return (Tcl_WideInt) clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/*
+ * Returns the reading of a monotonic clock, in nanoseconds,
+ * or of the wall clock where there is none.
+ */
+Tcl_WideUInt
+TTH_StatsClock (void)
+{
+#if defined(_WIN32)
+	static double nsPerCount = 0.0;
+	LARGE_INTEGER count, freq;
+
+	/* The frequency is fixed at boot */
+	if (nsPerCount == 0.0) {
+		QueryPerformanceFrequency(&freq);
+		nsPerCount = 1e9 / (double) freq.QuadPart;
+	}
+	QueryPerformanceCounter(&count);
+
+	return (Tcl_WideUInt) ((double) count.QuadPart * nsPerCount);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (Tcl_WideUInt) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	Tcl_Time now;
+
+	Tcl_GetTime(&now);
+
+	return (Tcl_WideUInt) now.sec * 1000000000 + now.usec * 1000;
+#endif
+}
+
+
+/*
+ * Stores the numbers of major (requiring I/O) and minor page faults
+ * of the calling thread, or of the process where the system does not
+ * account for threads; both are zero where they are not available.
+ */
+void
+TTH_StatsFaults (
+		Tcl_WideUInt *majorPtr,
+		Tcl_WideUInt *minorPtr
+		)
+{
+#if defined(_WIN32)
+	*majorPtr = 0;
+	*minorPtr = 0;
+#else
+	struct rusage usage;
+	int who = RUSAGE_SELF;
+
+#ifdef RUSAGE_THREAD
+	who = RUSAGE_THREAD;
+#endif
+	if (getrusage(who, &usage) != 0) {
+		*majorPtr = 0;
+		*minorPtr = 0;
+		return;
+	}
+	*majorPtr = (Tcl_WideUInt) usage.ru_majflt;
+	*minorPtr = (Tcl_WideUInt) usage.ru_minflt;
+#endif
+}
+
+
+/*
+ * Starts measuring a call about to hash the given number of bytes,
+ * or -1 if it is not known in advance, as when reading channels.
+ */
+void
+TTH_StatsStart (
+		TTH_StatsTimer *timerPtr,
+		Tcl_WideInt    bytes
+		)
+{
+	timerPtr->wall = TTH_StatsClock();
+	if (bytes < 0 || bytes >= STATS_CPUMIN) {
+		timerPtr->cpu = Stats_CpuTime();
+	} else {
+		timerPtr->cpu = -1;
+	}
+}
+
+
+/*
+ * Returns the name of the mode as used in the result of the command.
+ */
+const char *
+TTH_StatsModeName (
+		TTH_STATS_MODE mode
+		)
+{
+	return modeNames[mode];
+}
+
+
+/*
+ * Returns the number of leaves of the tree of a message
+ * of the given length; the empty message has a single leaf.
+ */
+Tcl_WideUInt
+TTH_StatsLeaves (
+		Tcl_WideUInt bytes
+		)
+{
+	return bytes == 0 ? 1 : (bytes + STATS_LEAFSIZE - 1) / STATS_LEAFSIZE;
+}
+
+
+/*
+ * Returns the histogram bucket of a latency: the bucket i holds
+ * latencies of up to 2^i microseconds.
+ */
+static int
+Stats_Bucket (
+		Tcl_WideUInt micros
+		)
+{
+	int i;
+
+	for (i = 0; i < STATS_BUCKETS - 1; ++i) {
+		if (micros <= ((Tcl_WideUInt) 1 << i)) { return i; }
+	}
+
+	return STATS_BUCKETS - 1;
+}
+
+
+/*
+ *
+ */
+static void
+Stats_Merge (
+		ModeStats       *toPtr,
+		const ModeStats *fromPtr
+		)
+{
+	int i;
+
+	toPtr->calls  += fromPtr->calls;
+	toPtr->bytes  += fromPtr->bytes;
+	toPtr->leaves += fromPtr->leaves;
+	toPtr->nodes  += fromPtr->nodes;
+	toPtr->wall   += fromPtr->wall;
+	toPtr->cpu    += fromPtr->cpu;
+	for (i = 0; i < STATS_BUCKETS; ++i) {
+		toPtr->latency[i] += fromPtr->latency[i];
+	}
+}
+
+
+/*
+ * Folds the counters of an exiting thread into the process-wide
+ * ones and forgets them.
+ */
+static void
+Stats_ThreadExit (
+		ClientData clientData
+		)
+{
+	ThreadStats *tsPtr = (ThreadStats *) clientData;
+	ThreadStats **linkPtr;
+	int i;
+
+	Tcl_MutexLock(&statsMutex);
+	for (linkPtr = &threadStatsList; *linkPtr != NULL;
+			linkPtr = &(*linkPtr)->nextPtr) {
+		if (*linkPtr == tsPtr) {
+			*linkPtr = tsPtr->nextPtr;
+			break;
+		}
+	}
+	for (i = 0; i < TS_NMODES; ++i) {
+		Stats_Merge(&processStats.modes[i], &tsPtr->modes[i]);
+	}
+	Tcl_MutexUnlock(&statsMutex);
+
+	Tcl_MutexFinalize(&tsPtr->lock);
+	ckfree((char *) tsPtr);
+}
+
+
+/*
+ * Returns the share of the process-wide counters
+ * of the calling thread.
+ */
+static ThreadStats *
+Stats_GetThreadStats (void)
+{
+	ThreadStats **tsdPtr, *tsPtr;
+
+	tsdPtr = (ThreadStats **) Tcl_GetThreadData(&statsKey,
+			sizeof(ThreadStats *));
+	if (*tsdPtr != NULL) { return *tsdPtr; }
+
+	tsPtr = (ThreadStats *) ckalloc(sizeof(ThreadStats));
+	memset(tsPtr, 0, sizeof(ThreadStats));
+	Tcl_MutexLock(&statsMutex);
+	tsPtr->nextPtr = threadStatsList;
+	threadStatsList = tsPtr;
+	Tcl_MutexUnlock(&statsMutex);
+	Tcl_CreateThreadExitHandler(Stats_ThreadExit, (ClientData) tsPtr);
+
+	*tsdPtr = tsPtr;
+	return tsPtr;
+}
+
+
+/*
+ *
+ */
+static void
+Stats_Add (
+		ModeStats    *modePtr,
+		Tcl_WideUInt bytes,
+		Tcl_WideUInt leaves,
+		Tcl_WideUInt nodes,
+		Tcl_WideUInt wall,
+		Tcl_WideUInt cpu,
+		int          bucket
+		)
+{
+	++modePtr->calls;
+	modePtr->bytes  += bytes;
+	modePtr->leaves += leaves;
+	modePtr->nodes  += nodes;
+	modePtr->wall   += wall;
+	modePtr->cpu    += cpu;
+	++modePtr->latency[bucket];
+}
+
+
+/*
+ * Accounts for a call hashing the given number of bytes
+ * in the given mode, which has taken the time since the timer
+ * was started and has completed the given number of digests
+ * of trees having the given number of leaves in total.
+ * The statsData is the token of the counters of the interpreter
+ * returned by TTH_StatsAcquire(), or NULL.
+ */
+void
+TTH_StatsRecord (
+		ClientData           statsData,
+		TTH_STATS_MODE       mode,
+		const TTH_StatsTimer *timerPtr,
+		Tcl_WideUInt         bytes,
+		Tcl_WideUInt         leaves,
+		Tcl_WideUInt         digests
+		)
+{
+	Stats *statsPtr = (Stats *) statsData;
+	ThreadStats *tsPtr;
+	Tcl_WideUInt wall, nodes;
+	Tcl_WideInt cpu;
+	int bucket;
+
+	wall = (TTH_StatsClock() - timerPtr->wall) / 1000;
+	cpu = 0;
+	if (timerPtr->cpu != -1) {
+		cpu = Stats_CpuTime() - timerPtr->cpu;
+		if (cpu < 0) { cpu = 0; }
+	}
+	bucket = Stats_Bucket(wall);
+	/* A tree of n leaves has n - 1 inner nodes */
+	nodes = leaves > digests ? leaves - digests : 0;
+
+	if (statsPtr != NULL) {
+		Stats_Add(&statsPtr->modes[mode], bytes, leaves, nodes,
+				wall, cpu, bucket);
+	}
+
+	tsPtr = Stats_GetThreadStats();
+	Tcl_MutexLock(&tsPtr->lock);
+	Stats_Add(&tsPtr->modes[mode], bytes, leaves, nodes,
+			wall, cpu, bucket);
+	Tcl_MutexUnlock(&tsPtr->lock);
+}
+
+
+/*
+ *
+ */
+static void
+Stats_DeleteProc (
+		ClientData clientData,
+		Tcl_Interp *interp
+		)
+{
+	Tcl_EventuallyFree(clientData, TCL_DYNAMIC);
+}
+
+
+/*
+ * Returns the token of the counters of the interpreter, creating
+ * them if needed, for the commands to keep in their clientData;
+ * it stays valid until passed to TTH_StatsRelease().
+ */
+ClientData
+TTH_StatsAcquire (
+		Tcl_Interp *interp
+		)
+{
+	Stats *statsPtr;
+
+	statsPtr = (Stats *) Tcl_GetAssocData(interp, STATS_ASSOC, NULL);
+	if (statsPtr == NULL) {
+		statsPtr = (Stats *) ckalloc(sizeof(Stats));
+		memset(statsPtr, 0, sizeof(Stats));
+		Tcl_SetAssocData(interp, STATS_ASSOC, Stats_DeleteProc,
+				(ClientData) statsPtr);
+	}
+	Tcl_Preserve((ClientData) statsPtr);
+
+	return (ClientData) statsPtr;
+}
+
+
+/*
+ * Suits as the delete procedure of the commands.
+ */
+void
+TTH_StatsRelease (
+		ClientData statsData
+		)
+{
+	Tcl_Release(statsData);
+}
+
+
+/*
+ * Accounts for a context being created with the counters given
+ * by the token returned by TTH_StatsAcquire(); returns the token
+ * to be passed to TTH_StatsCloseContext() when it is freed.
+ */
+ClientData
+TTH_StatsOpenContext (
+		ClientData statsData
+		)
+{
+	Stats *statsPtr = (Stats *) statsData;
+
+	if (statsPtr != NULL) {
+		Tcl_Preserve((ClientData) statsPtr);
+		++statsPtr->contexts;
+	}
+
+	Tcl_MutexLock(&statsMutex);
+	++processStats.contexts;
+	Tcl_MutexUnlock(&statsMutex);
+
+	return (ClientData) statsPtr;
+}
+
+
+/*
+ *
+ */
+void
+TTH_StatsCloseContext (
+		ClientData statsData
+		)
+{
+	Stats *statsPtr = (Stats *) statsData;
+
+	if (statsPtr != NULL) {
+		--statsPtr->contexts;
+		Tcl_Release((ClientData) statsPtr);
+	}
+
+	Tcl_MutexLock(&statsMutex);
+	--processStats.contexts;
+	Tcl_MutexUnlock(&statsMutex);
+}
+
+
+/*
+ * Clears the counters, except the number of open contexts.
+ */
+static void
+Stats_Reset (
+		Stats *statsPtr
+		)
+{
+	memset(statsPtr->modes, 0, sizeof(statsPtr->modes));
+}
+
+
+/*
+ * Sums the process-wide counters over the threads, optionally
+ * clearing them; the caller holds statsMutex.
+ */
+static void
+Stats_Collect (
+		Stats *statsPtr,
+		int   reset
+		)
+{
+	ThreadStats *tsPtr;
+	int i;
+
+	*statsPtr = processStats;
+	if (reset) {
+		Stats_Reset(&processStats);
+	}
+	for (tsPtr = threadStatsList; tsPtr != NULL; tsPtr = tsPtr->nextPtr) {
+		Tcl_MutexLock(&tsPtr->lock);
+		for (i = 0; i < TS_NMODES; ++i) {
+			Stats_Merge(&statsPtr->modes[i], &tsPtr->modes[i]);
+		}
+		if (reset) {
+			memset(tsPtr->modes, 0, sizeof(tsPtr->modes));
+		}
+		Tcl_MutexUnlock(&tsPtr->lock);
+	}
+}
+
+
+/*
+ *
+ */
+static void
+Stats_AppendWide (
+		Tcl_Obj      *dictPtr,
+		const char   *key,
+		Tcl_WideUInt value
+		)
+{
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj(key, -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj((Tcl_WideInt) value));
+}
+
+
+/*
+ * Returns the dictionary of counters of a single mode.
+ */
+static Tcl_Obj *
+Stats_ModeToObj (
+		const ModeStats *modePtr
+		)
+{
+	Tcl_Obj *resultPtr, *histPtr;
+	char bound[TCL_INTEGER_SPACE];
+	int i;
+
+	resultPtr = Tcl_NewObj();
+	Stats_AppendWide(resultPtr, "calls", modePtr->calls);
+	Stats_AppendWide(resultPtr, "bytes", modePtr->bytes);
+	Stats_AppendWide(resultPtr, "leaves", modePtr->leaves);
+	Stats_AppendWide(resultPtr, "nodes", modePtr->nodes);
+	Stats_AppendWide(resultPtr, "wall", modePtr->wall);
+	Stats_AppendWide(resultPtr, "cpu", modePtr->cpu);
+
+	histPtr = Tcl_NewObj();
+	for (i = 0; i < STATS_BUCKETS - 1; ++i) {
+		sprintf(bound, "%ld", 1L << i);
+		Stats_AppendWide(histPtr, bound, modePtr->latency[i]);
+	}
+	Stats_AppendWide(histPtr, "inf", modePtr->latency[i]);
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("latency", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr, histPtr);
+
+	return resultPtr;
+}
+
+
+/*
+ * Returns the dictionary of all the counters: the totals over
+ * all modes, the number of open contexts and the key "modes"
+ * holding the dictionary of counters of each mode.
+ */
+static Tcl_Obj *
+Stats_ToObj (
+		const Stats *statsPtr
+		)
+{
+	Tcl_Obj *resultPtr, *modesPtr;
+	ModeStats total;
+	const ModeStats *modePtr;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	modesPtr = Tcl_NewObj();
+	for (i = 0; i < TS_NMODES; ++i) {
+		modePtr = &statsPtr->modes[i];
+		total.calls  += modePtr->calls;
+		total.bytes  += modePtr->bytes;
+		total.leaves += modePtr->leaves;
+		total.nodes  += modePtr->nodes;
+		total.wall   += modePtr->wall;
+		total.cpu    += modePtr->cpu;
+		Tcl_ListObjAppendElement(NULL, modesPtr,
+				Tcl_NewStringObj(modeNames[i], -1));
+		Tcl_ListObjAppendElement(NULL, modesPtr, Stats_ModeToObj(modePtr));
+	}
+
+	resultPtr = Tcl_NewObj();
+	Stats_AppendWide(resultPtr, "calls", total.calls);
+	Stats_AppendWide(resultPtr, "bytes", total.bytes);
+	Stats_AppendWide(resultPtr, "leaves", total.leaves);
+	Stats_AppendWide(resultPtr, "nodes", total.nodes);
+	Stats_AppendWide(resultPtr, "wall", total.wall);
+	Stats_AppendWide(resultPtr, "cpu", total.cpu);
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("contexts", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewWideIntObj(statsPtr->contexts));
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("modes", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr, modesPtr);
+
+	return resultPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Stats_Cmd --
+ *
+ *	Implements the "::tth::stats" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	The counters are cleared if requested.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Stats_Cmd(
+	ClientData clientData,  /* per-interpreter counters */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *options[] = { "-process", "-reset", NULL };
+	enum { OP_PROCESS, OP_RESET };
+	Stats *statsPtr = (Stats *) clientData;
+	Stats collected;
+	int i, op, process, reset;
+
+	process = 0;
+	reset   = 0;
+
+	for (i = 1; i < objc; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		switch (op) {
+			case OP_PROCESS:
+				process = 1;
+			break;
+			case OP_RESET:
+				reset = 1;
+			break;
+		}
+	}
+
+	if (process) {
+		Tcl_MutexLock(&statsMutex);
+		Stats_Collect(&collected, reset);
+		Tcl_MutexUnlock(&statsMutex);
+		Tcl_SetObjResult(interp, Stats_ToObj(&collected));
+	} else {
+		Tcl_SetObjResult(interp, Stats_ToObj(statsPtr));
+		if (reset) {
+			Stats_Reset(statsPtr);
+		}
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Stats_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::stats",
+		(Tcl_ObjCmdProc *) Stats_Cmd,
+		TTH_StatsAcquire(interp), TTH_StatsRelease);
+}
@@ -0,0 +1,102 @@
+/*
+ * tclstats.h --
+ *
+ *	This file implements interface for tclstats.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLSTATS_H
+#define __TCLSTATS_H
+
+#include <tcl.h>
+
+/*
+ * Input modes the hashing statistics are kept for.
+ */
+typedef enum {
+	TS_STRING,    /* -string */
+	TS_STRINGS,   /* -strings */
+	TS_CONCAT,    /* -concat */
+	TS_CHAN,      /* -chan */
+	TS_MMAP,      /* -mmap */
+	TS_FILE,      /* -file */
+	TS_CONTEXT,   /* update and digest of contexts */
+	TS_NMODES
+} TTH_STATS_MODE;
+
+/*
+ * Start of a measured operation.
+ */
+typedef struct {
+	Tcl_WideUInt wall;    /* TTH_StatsClock() */
+	Tcl_WideInt  cpu;     /* thread CPU time, in microseconds, or -1 */
+} TTH_StatsTimer;
+
+ClientData
+TTH_StatsAcquire (
+		Tcl_Interp *interp
+		);
+
+void
+TTH_StatsRelease (
+		ClientData statsData
+		);
+
+void
+TTH_StatsStart (
+		TTH_StatsTimer *timerPtr,
+		Tcl_WideInt    bytes
+		);
+
+void
+TTH_StatsRecord (
+		ClientData           statsData,
+		TTH_STATS_MODE       mode,
+		const TTH_StatsTimer *timerPtr,
+		Tcl_WideUInt         bytes,
+		Tcl_WideUInt         leaves,
+		Tcl_WideUInt         digests
+		);
+
+Tcl_WideUInt
+TTH_StatsClock (void);
+
+void
+TTH_StatsFaults (
+		Tcl_WideUInt *majorPtr,
+		Tcl_WideUInt *minorPtr
+		);
+
+const char *
+TTH_StatsModeName (
+		TTH_STATS_MODE mode
+		);
+
+Tcl_WideUInt
+TTH_StatsLeaves (
+		Tcl_WideUInt bytes
+		);
+
+ClientData
+TTH_StatsOpenContext (
+		ClientData statsData
+		);
+
+void
+TTH_StatsCloseContext (
+		ClientData statsData
+		);
+
+Tcl_Command
+Stats_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLSTATS_H */
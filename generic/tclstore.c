@@ -0,0 +1,770 @@
+/*
+ * tclstore.c --
+ *
+ *	This file implements the "::tth::treestore" command managing
+ *	tree stores: files keeping a level of the hash tree of each
+ *	of many files, keyed by their roots, so that the tree of a file
+ *	can be served without rereading or rehashing the file.
+ *
+ *	A store is an append-only file: a header followed by records,
+ *	each being a record header (the root, the level and the length
+ *	of the nodes) followed by the nodes padded to 8 bytes.  Records
+ *	are indexed when the store is opened; the store is then mapped
+ *	(where supported) and the nodes are served from the mapping.
+ *	A later record for the same root supersedes the earlier one.
+ *	An incomplete trailing record (as left by a crash) is ignored
+ *	and overwritten by the next record added.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tiger.h"
+#include "tigertree.h"
+#include "tcldigest.h"
+#include "tclhandle.h"
+#include "tclmmap.h"
+#include "tclstore.h"
+
+typedef struct {
+	char          magic[8];
+	unsigned int  version;
+	unsigned int  byteOrder;
+} StoreHeader;
+
+typedef struct {
+	byte          root[TIGERSIZE];
+	unsigned int  level;
+	unsigned int  length;   /* of the nodes, a multiple of TIGERSIZE */
+} RecordHeader;
+
+#define STORE_MAGIC      "TTHTREES"
+#define STORE_VERSION    1
+#define STORE_BYTEORDER  0x01020304
+
+#define ALIGN8(x) (((x) + 7) & ~(Tcl_WideInt) 7)
+
+/* Keys of the record table are roots, in ints */
+#define STORE_KEYINTS    (TIGERSIZE / sizeof(int))
+
+typedef struct {
+	Tcl_WideInt   offset;   /* of the nodes in the file */
+	unsigned int  level;
+	unsigned int  length;
+} Record;
+
+typedef struct {
+	Tcl_Obj       *pathPtr;
+	Tcl_Channel   chan;     /* records are written through it */
+	Tcl_WideInt   end;      /* end of the last complete record */
+	Tcl_HashTable records;
+#ifdef USE_MMAP
+	TTH_Mapping   *mapPtr;
+	const byte    *data;
+	size_t        length;   /* of the mapped part */
+#else
+	byte          *buffer;  /* nodes read last */
+	unsigned int  room;
+#endif
+} Store;
+
+
+/*
+ *
+ */
+static void
+Store_FreeProc (
+		char *blockPtr
+		)
+{
+	Store *storePtr = (Store *) blockPtr;
+	Tcl_HashEntry *entryPtr;
+	Tcl_HashSearch search;
+
+	for (entryPtr = Tcl_FirstHashEntry(&storePtr->records, &search);
+			entryPtr != NULL; entryPtr = Tcl_NextHashEntry(&search)) {
+		ckfree((char *) Tcl_GetHashValue(entryPtr));
+	}
+	Tcl_DeleteHashTable(&storePtr->records);
+
+#ifdef USE_MMAP
+	if (storePtr->mapPtr != NULL) {
+		TTH_UnmapFile(storePtr->mapPtr);
+	}
+#else
+	if (storePtr->buffer != NULL) {
+		ckfree((char *) storePtr->buffer);
+	}
+#endif
+	Tcl_Close(NULL, storePtr->chan);
+	Tcl_DecrRefCount(storePtr->pathPtr);
+	ckfree(blockPtr);
+}
+
+static const TTH_HandleType Store_HandleType = {
+	"treestore",
+	Store_FreeProc
+};
+
+
+/*
+ * Makes the record of the root current.
+ */
+static void
+Store_SetRecord (
+		Store        *storePtr,
+		const byte   root[],
+		Tcl_WideInt  offset,
+		unsigned int level,
+		unsigned int length
+		)
+{
+	int key[STORE_KEYINTS];
+	Tcl_HashEntry *entryPtr;
+	Record *recPtr;
+	int isNew;
+
+	memcpy(key, root, TIGERSIZE);
+	entryPtr = Tcl_CreateHashEntry(&storePtr->records, (char *) key, &isNew);
+	if (isNew) {
+		recPtr = (Record *) ckalloc(sizeof(Record));
+		Tcl_SetHashValue(entryPtr, (ClientData) recPtr);
+	} else {
+		recPtr = (Record *) Tcl_GetHashValue(entryPtr);
+	}
+	recPtr->offset = offset;
+	recPtr->level  = level;
+	recPtr->length = length;
+}
+
+
+/*
+ * Reads the records of the store; sets storePtr->end to the end
+ * of the last complete one.
+ */
+static int
+Store_Scan (
+		Tcl_Interp  *interp,
+		Store       *storePtr,
+		Tcl_WideInt size
+		)
+{
+	StoreHeader header;
+	RecordHeader rec;
+	Tcl_WideInt pos, next;
+
+	if (size == 0) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+		header.version   = STORE_VERSION;
+		header.byteOrder = STORE_BYTEORDER;
+		if (Tcl_Write(storePtr->chan, (const char *) &header,
+					sizeof(header)) != sizeof(header)
+				|| Tcl_Flush(storePtr->chan) != TCL_OK) {
+			goto ioError;
+		}
+		storePtr->end = sizeof(header);
+		return TCL_OK;
+	}
+
+	if (Tcl_Read(storePtr->chan, (char *) &header,
+				sizeof(header)) != sizeof(header)
+			|| memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != STORE_VERSION) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "file \"", Tcl_GetString(storePtr->pathPtr),
+				"\" is not a tree store", NULL);
+		return TCL_ERROR;
+	}
+	if (header.byteOrder != STORE_BYTEORDER) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "tree store \"",
+				Tcl_GetString(storePtr->pathPtr),
+				"\" was created on a platform with a different byte order",
+				NULL);
+		return TCL_ERROR;
+	}
+
+	pos = sizeof(header);
+	while (pos + (Tcl_WideInt) sizeof(rec) <= size) {
+		if (Tcl_Seek(storePtr->chan, pos, SEEK_SET) < 0
+				|| Tcl_Read(storePtr->chan, (char *) &rec,
+					sizeof(rec)) != sizeof(rec)) {
+			goto ioError;
+		}
+		next = pos + sizeof(rec) + ALIGN8((Tcl_WideInt) rec.length);
+		if (next > size || rec.length % TIGERSIZE != 0 || rec.level > 63) {
+			break;
+		}
+		Store_SetRecord(storePtr, rec.root, pos + sizeof(rec),
+				rec.level, rec.length);
+		pos = next;
+	}
+	storePtr->end = pos;
+
+	return TCL_OK;
+
+ioError:
+	Tcl_ResetResult(interp);
+	Tcl_AppendResult(interp, "error accessing \"",
+			Tcl_GetString(storePtr->pathPtr), "\": ",
+			Tcl_PosixError(interp), NULL);
+	return TCL_ERROR;
+}
+
+
+/*
+ * Opens the store, creating it if needed.
+ */
+static Store *
+Store_Open (
+		Tcl_Interp *interp,
+		Tcl_Obj    *pathPtr
+		)
+{
+	Store *storePtr;
+	Tcl_Channel chan;
+	Tcl_WideInt size;
+
+	chan = Tcl_FSOpenFileChannel(interp, pathPtr, "RDWR CREAT", 0666);
+	if (chan == NULL) {
+		return NULL;
+	}
+	Tcl_SetChannelOption(NULL, chan, "-translation", "binary");
+
+	storePtr = (Store *) ckalloc(sizeof(Store));
+	memset(storePtr, 0, sizeof(Store));
+	storePtr->pathPtr = pathPtr;
+	Tcl_IncrRefCount(pathPtr);
+	storePtr->chan = chan;
+	Tcl_InitHashTable(&storePtr->records, STORE_KEYINTS);
+
+	size = Tcl_Seek(chan, 0, SEEK_END);
+	if (size < 0 || Tcl_Seek(chan, 0, SEEK_SET) < 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error accessing \"",
+				Tcl_GetString(pathPtr), "\": ", Tcl_PosixError(interp), NULL);
+		Store_FreeProc((char *) storePtr);
+		return NULL;
+	}
+	if (Store_Scan(interp, storePtr, size) != TCL_OK) {
+		Store_FreeProc((char *) storePtr);
+		return NULL;
+	}
+
+	return storePtr;
+}
+
+
+/*
+ * Appends a record to the store.
+ */
+static int
+Store_Put (
+		Tcl_Interp   *interp,
+		Store        *storePtr,
+		const byte   root[],
+		unsigned int level,
+		const byte   *nodes,
+		unsigned int length
+		)
+{
+	static const char zeroes[8] = { 0 };
+	RecordHeader rec;
+	Tcl_WideInt offset;
+	int pad;
+
+	memcpy(rec.root, root, TIGERSIZE);
+	rec.level  = level;
+	rec.length = length;
+	offset = storePtr->end + sizeof(rec);
+	pad = (int) (ALIGN8((Tcl_WideInt) length) - length);
+
+	if (Tcl_Seek(storePtr->chan, storePtr->end, SEEK_SET) < 0
+			|| Tcl_Write(storePtr->chan, (const char *) &rec,
+				sizeof(rec)) != sizeof(rec)
+			|| Tcl_Write(storePtr->chan, (const char *) nodes,
+				(int) length) != (int) length
+			|| Tcl_Write(storePtr->chan, zeroes, pad) != pad
+			|| Tcl_Flush(storePtr->chan) != TCL_OK) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error writing \"",
+				Tcl_GetString(storePtr->pathPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+
+	storePtr->end = offset + length + pad;
+	Store_SetRecord(storePtr, root, offset, level, length);
+
+	return TCL_OK;
+}
+
+
+/*
+ * Returns the nodes of the record; they stay valid until
+ * the store is next accessed.
+ */
+static const byte *
+Store_GetNodes (
+		Tcl_Interp *interp,
+		Store      *storePtr,
+		Record     *recPtr
+		)
+{
+#ifdef USE_MMAP
+	if ((Tcl_WideInt) storePtr->length < recPtr->offset + recPtr->length) {
+		/* The record was added after the store was mapped */
+		if (storePtr->mapPtr != NULL) {
+			TTH_UnmapFile(storePtr->mapPtr);
+		}
+		storePtr->length = 0;
+		storePtr->mapPtr = TTH_MapFile(interp, storePtr->pathPtr,
+				&storePtr->data, &storePtr->length);
+		if (storePtr->mapPtr == NULL) {
+			return NULL;
+		}
+	}
+
+	return storePtr->data + recPtr->offset;
+#else
+	if (storePtr->room < recPtr->length) {
+		storePtr->buffer = (byte *) ckrealloc((char *) storePtr->buffer,
+				recPtr->length);
+		storePtr->room = recPtr->length;
+	}
+	if (Tcl_Seek(storePtr->chan, recPtr->offset, SEEK_SET) < 0
+			|| Tcl_Read(storePtr->chan, (char *) storePtr->buffer,
+				(int) recPtr->length) != (int) recPtr->length) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error reading \"",
+				Tcl_GetString(storePtr->pathPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return NULL;
+	}
+
+	return storePtr->buffer;
+#endif
+}
+
+
+/*
+ * Finds the record of the root given as a 192-bit digest in any
+ * format; *recPtrPtr is set to NULL if the store has none.
+ */
+static int
+Store_Find (
+		Tcl_Interp *interp,
+		Store      *storePtr,
+		Tcl_Obj    *rootPtr,
+		Record     **recPtrPtr
+		)
+{
+	int key[STORE_KEYINTS];
+	byte buf[TIGERSIZE];
+	const byte *root;
+	Tcl_HashEntry *entryPtr;
+	int len;
+
+	if (DigestParseObj(interp, rootPtr, buf, &root, &len) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (len != TIGERSIZE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "root must be a 192-bit digest", NULL);
+		return TCL_ERROR;
+	}
+
+	memcpy(key, root, TIGERSIZE);
+	entryPtr = Tcl_FindHashEntry(&storePtr->records, (char *) key);
+	*recPtrPtr = entryPtr != NULL ? (Record *) Tcl_GetHashValue(entryPtr) : NULL;
+
+	return TCL_OK;
+}
+
+
+/*
+ * Retrieves the nodes of the tree of the root.
+ */
+static int
+Store_GetTree (
+		Tcl_Interp *interp,
+		Store      *storePtr,
+		Tcl_Obj    *rootPtr,
+		Record     **recPtrPtr,
+		const byte **nodesPtr
+		)
+{
+	if (Store_Find(interp, storePtr, rootPtr, recPtrPtr) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (*recPtrPtr == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "no tree for \"",
+				Tcl_GetString(rootPtr), "\" in store", NULL);
+		return TCL_ERROR;
+	}
+	if (nodesPtr != NULL) {
+		*nodesPtr = Store_GetNodes(interp, storePtr, *recPtrPtr);
+		if (*nodesPtr == NULL) {
+			return TCL_ERROR;
+		}
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Parses a tree level, an integer from 0 to 63.
+ */
+static int
+Store_GetLevelFromObj (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr,
+		int        *levelPtr
+		)
+{
+	if (Tcl_GetIntFromObj(interp, objPtr, levelPtr) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (*levelPtr < 0 || *levelPtr > 63) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "bad tree level \"", Tcl_GetString(objPtr),
+				"\": must be an integer from 0 to 63", NULL);
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Replaces count nodes of a level by the nodes of the next level,
+ * returns their number. The last node of an odd count is promoted
+ * as is, just like tt_digest() does.
+ */
+static unsigned int
+Store_Compose (
+		byte         *nodes,
+		unsigned int count
+		)
+{
+	word64 scratch[(1+NODESIZE+7)/8];
+	unsigned int i;
+
+	((byte *) scratch)[0] = 1;
+	for (i = 0; 2 * i + 1 < count; i++) {
+		memcpy((byte *) scratch + 1, nodes + 2 * i * TIGERSIZE, NODESIZE);
+		tiger(scratch, (word64) (NODESIZE+1), (word64 *) (nodes + i * TIGERSIZE));
+		tiger_to_canonical(nodes + i * TIGERSIZE);
+	}
+	if (count % 2 != 0) {
+		memmove(nodes + i * TIGERSIZE, nodes + (count - 1) * TIGERSIZE,
+				TIGERSIZE);
+		i++;
+	}
+
+	return i;
+}
+
+
+/*
+ * Retrieves the nodes of the requested level of the tree of the root,
+ * the stored level if levelPtr is NULL. Levels above the stored one
+ * are composed from the stored nodes into *objPtrPtr, which then holds
+ * a reference the caller must release; it is NULL if the nodes come
+ * straight from the store.
+ */
+static int
+Store_GetLevel (
+		Tcl_Interp   *interp,
+		Store        *storePtr,
+		Tcl_Obj      *rootPtr,
+		Tcl_Obj      *levelPtr,
+		const byte   **nodesPtr,
+		unsigned int *lengthPtr,
+		Tcl_Obj      **objPtrPtr
+		)
+{
+	Record *recPtr;
+	const byte *nodes;
+	byte *buf;
+	unsigned int count;
+	int level;
+	char stored[TCL_INTEGER_SPACE];
+
+	*objPtrPtr = NULL;
+	if (levelPtr != NULL && Store_GetLevelFromObj(interp, levelPtr,
+				&level) != TCL_OK) { return TCL_ERROR; }
+	if (Store_GetTree(interp, storePtr, rootPtr,
+				&recPtr, &nodes) != TCL_OK) { return TCL_ERROR; }
+	if (levelPtr == NULL || (unsigned int) level == recPtr->level) {
+		*nodesPtr = nodes;
+		*lengthPtr = recPtr->length;
+		return TCL_OK;
+	}
+	if ((unsigned int) level < recPtr->level) {
+		sprintf(stored, "%u", recPtr->level);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "tree of \"", Tcl_GetString(rootPtr),
+				"\" is stored at level ", stored, ": can not retrieve level ",
+				Tcl_GetString(levelPtr), NULL);
+		return TCL_ERROR;
+	}
+
+	*objPtrPtr = Tcl_NewByteArrayObj(nodes, (int) recPtr->length);
+	Tcl_IncrRefCount(*objPtrPtr);
+	buf = Tcl_GetByteArrayFromObj(*objPtrPtr, NULL);
+	count = recPtr->length / TIGERSIZE;
+	for (level -= recPtr->level; level > 0 && count > 1; level--) {
+		count = Store_Compose(buf, count);
+	}
+	Tcl_SetByteArrayLength(*objPtrPtr, (int) (count * TIGERSIZE));
+	*nodesPtr = Tcl_GetByteArrayFromObj(*objPtrPtr, NULL);
+	*lengthPtr = count * TIGERSIZE;
+
+	return TCL_OK;
+}
+
+
+/*
+ * Implements [treestore put store root level nodes].
+ */
+static int
+Store_PutSubcmd (
+		Tcl_Interp     *interp,
+		Store          *storePtr,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	byte buf[TIGERSIZE];
+	const byte *root, *nodes;
+	int len, level;
+
+	if (objc != 6) {
+		Tcl_WrongNumArgs(interp, 2, objv, "store root level nodes");
+		return TCL_ERROR;
+	}
+
+	if (DigestParseObj(interp, objv[3], buf, &root, &len) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (len != TIGERSIZE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "root must be a 192-bit digest", NULL);
+		return TCL_ERROR;
+	}
+	if (Store_GetLevelFromObj(interp, objv[4], &level) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	nodes = Tcl_GetByteArrayFromObj(objv[5], &len);
+	if (len == 0 || len % TIGERSIZE != 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "nodes must be a non-empty sequence "
+				"of 24-byte tree nodes", NULL);
+		return TCL_ERROR;
+	}
+
+	return Store_Put(interp, storePtr, root, (unsigned int) level,
+			nodes, (unsigned int) len);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Store_Cmd --
+ *
+ *	Implements the "::tth::treestore" command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Tree stores are opened, added to and closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Store_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *subcmds[] = { "open", "put", "get", "write",
+		"exists", "level", "roots", "close", NULL };
+	enum { ST_OPEN, ST_PUT, ST_GET, ST_WRITE,
+		ST_EXISTS, ST_LEVEL, ST_ROOTS, ST_CLOSE };
+	Store *storePtr;
+	Record *recPtr;
+	const byte *nodes;
+	Tcl_Channel chan;
+	Tcl_HashEntry *entryPtr;
+	Tcl_HashSearch search;
+	Tcl_Obj *resultPtr;
+	unsigned int length;
+	int cmd, mode;
+
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "subcommand ?arg ...?");
+		return TCL_ERROR;
+	}
+
+	if (Tcl_GetIndexFromObj(interp, objv[1], subcmds, "subcommand",
+			0, &cmd) != TCL_OK) { return TCL_ERROR; }
+
+	if (cmd == ST_OPEN) {
+		if (objc != 3) {
+			Tcl_WrongNumArgs(interp, 2, objv, "fileName");
+			return TCL_ERROR;
+		}
+		storePtr = Store_Open(interp, objv[2]);
+		if (storePtr == NULL) {
+			return TCL_ERROR;
+		}
+		Tcl_SetObjResult(interp, TTH_NewHandle(interp,
+				&Store_HandleType, (ClientData) storePtr));
+		return TCL_OK;
+	}
+
+	/* The rest of subcommands operate on an open store */
+
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 2, objv, "store ?arg ...?");
+		return TCL_ERROR;
+	}
+	if (TTH_GetHandleFromObj(interp, objv[2], &Store_HandleType,
+				(ClientData *) &storePtr) != TCL_OK) { return TCL_ERROR; }
+
+	switch (cmd) {
+		case ST_PUT:
+			return Store_PutSubcmd(interp, storePtr, objc, objv);
+		break;
+
+		case ST_EXISTS:
+			if (objc != 4) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store root");
+				return TCL_ERROR;
+			}
+			if (Store_Find(interp, storePtr, objv[3],
+						&recPtr) != TCL_OK) { return TCL_ERROR; }
+			Tcl_SetObjResult(interp, Tcl_NewBooleanObj(recPtr != NULL));
+			return TCL_OK;
+		break;
+
+		case ST_LEVEL:
+			if (objc != 4) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store root");
+				return TCL_ERROR;
+			}
+			if (Store_GetTree(interp, storePtr, objv[3],
+						&recPtr, NULL) != TCL_OK) { return TCL_ERROR; }
+			Tcl_SetObjResult(interp, Tcl_NewIntObj((int) recPtr->level));
+			return TCL_OK;
+		break;
+
+		case ST_GET:
+			if (objc != 4 && objc != 5) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store root ?level?");
+				return TCL_ERROR;
+			}
+			if (Store_GetLevel(interp, storePtr, objv[3],
+						objc == 5 ? objv[4] : NULL,
+						&nodes, &length, &resultPtr) != TCL_OK) { return TCL_ERROR; }
+			if (resultPtr == NULL) {
+				Tcl_SetObjResult(interp,
+						Tcl_NewByteArrayObj(nodes, (int) length));
+			} else {
+				Tcl_SetObjResult(interp, resultPtr);
+				Tcl_DecrRefCount(resultPtr);
+			}
+			return TCL_OK;
+		break;
+
+		case ST_WRITE:
+			if (objc != 5 && objc != 6) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store root ?level? channelId");
+				return TCL_ERROR;
+			}
+			chan = Tcl_GetChannel(interp, Tcl_GetString(objv[objc-1]), &mode);
+			if (chan == NULL) {
+				return TCL_ERROR;
+			}
+			if (!(mode & TCL_WRITABLE)) {
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "channel \"", Tcl_GetString(objv[objc-1]),
+						"\" wasn't opened for writing", NULL);
+				return TCL_ERROR;
+			}
+			if (Store_GetLevel(interp, storePtr, objv[3],
+						objc == 6 ? objv[4] : NULL,
+						&nodes, &length, &resultPtr) != TCL_OK) { return TCL_ERROR; }
+			mode = Tcl_Write(chan, (const char *) nodes, (int) length);
+			if (resultPtr != NULL) {
+				Tcl_DecrRefCount(resultPtr);
+			}
+			if (mode != (int) length) {
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "error writing \"",
+						Tcl_GetString(objv[objc-1]), "\": ",
+						Tcl_PosixError(interp), NULL);
+				return TCL_ERROR;
+			}
+			return TCL_OK;
+		break;
+
+		case ST_ROOTS:
+			if (objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store");
+				return TCL_ERROR;
+			}
+			resultPtr = Tcl_NewObj();
+			for (entryPtr = Tcl_FirstHashEntry(&storePtr->records, &search);
+					entryPtr != NULL; entryPtr = Tcl_NextHashEntry(&search)) {
+				Tcl_ListObjAppendElement(NULL, resultPtr, DigestNewObj(
+							(const byte *) Tcl_GetHashKey(&storePtr->records,
+								entryPtr), TIGERSIZE, DF_THEX));
+			}
+			Tcl_SetObjResult(interp, resultPtr);
+			return TCL_OK;
+		break;
+
+		case ST_CLOSE:
+			if (objc != 3) {
+				Tcl_WrongNumArgs(interp, 2, objv, "store");
+				return TCL_ERROR;
+			}
+			return TTH_DeleteHandle(interp, objv[2], &Store_HandleType);
+		break;
+	}
+
+	return TCL_ERROR;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Store_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::treestore",
+		(Tcl_ObjCmdProc *) Store_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
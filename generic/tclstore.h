@@ -0,0 +1,25 @@
+/*
+ * tclstore.h --
+ *
+ *	This file implements interface for tclstore.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLSTORE_H
+#define __TCLSTORE_H
+
+#include <tcl.h>
+
+Tcl_Command
+Store_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLSTORE_H */
@@ -0,0 +1,281 @@
+/*
+ * tclthrottle.c --
+ *
+ *	This file implements the token buckets limiting the I/O of the
+ *	file and channel digest paths, and the "::tth::throttle" command
+ *	setting the process-wide limits.
+ *
+ *	A bucket holds up to THROTTLE_BURST seconds' worth of tokens.
+ *	An operation takes its tokens at once and may leave the bucket
+ *	in debt; the caller then sleeps until the debt is paid off, so
+ *	chunks larger than the bucket are fine and concurrent jobs
+ *	sharing the process-wide bucket add up to its rate. The limits
+ *	may be changed at any time: running jobs see the new ones at
+ *	their next chunk.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include "tclthrottle.h"
+#include "tclstats.h"
+
+/* Seconds of I/O a bucket may save up */
+#define THROTTLE_BURST  0.1
+
+#define THROTTLE_MB     (1024.0 * 1024.0)
+
+/* Longest single sleep, in seconds, well within the int of Tcl_Sleep() */
+#define THROTTLE_MAXSLEEP 60.0
+
+static TTH_Throttle processThrottle;
+TCL_DECLARE_MUTEX(throttleMutex)
+
+
+/*
+ *
+ */
+void
+TTH_ThrottleInit (
+		TTH_Throttle *throttlePtr,
+		double       bandwidth,
+		double       iops
+		)
+{
+	throttlePtr->rate  = bandwidth * THROTTLE_MB;
+	throttlePtr->iops  = iops;
+	throttlePtr->bytes = throttlePtr->rate * THROTTLE_BURST;
+	throttlePtr->ops   = throttlePtr->iops * THROTTLE_BURST;
+	throttlePtr->last  = TTH_StatsClock();
+}
+
+
+/*
+ * Refills the bucket and takes the tokens of an operation;
+ * returns the time to wait for the debt to be paid off, in seconds.
+ */
+static double
+Throttle_Charge (
+		TTH_Throttle *throttlePtr,
+		Tcl_WideUInt now,
+		Tcl_WideUInt len
+		)
+{
+	double elapsed, wait, w;
+
+	if (throttlePtr->rate <= 0 && throttlePtr->iops <= 0) {
+		return 0;
+	}
+
+	elapsed = now > throttlePtr->last
+		? (double) (now - throttlePtr->last) / 1e9 : 0;
+	throttlePtr->last = now;
+
+	wait = 0;
+	if (throttlePtr->rate > 0) {
+		throttlePtr->bytes += elapsed * throttlePtr->rate;
+		if (throttlePtr->bytes > throttlePtr->rate * THROTTLE_BURST) {
+			throttlePtr->bytes = throttlePtr->rate * THROTTLE_BURST;
+		}
+		throttlePtr->bytes -= (double) len;
+		if (throttlePtr->bytes < 0) {
+			wait = -throttlePtr->bytes / throttlePtr->rate;
+		}
+	}
+	if (throttlePtr->iops > 0) {
+		throttlePtr->ops += elapsed * throttlePtr->iops;
+		if (throttlePtr->ops > throttlePtr->iops * THROTTLE_BURST) {
+			throttlePtr->ops = throttlePtr->iops * THROTTLE_BURST;
+		}
+		throttlePtr->ops -= 1;
+		if (throttlePtr->ops < 0) {
+			w = -throttlePtr->ops / throttlePtr->iops;
+			if (w > wait) {
+				wait = w;
+			}
+		}
+	}
+
+	return wait;
+}
+
+
+/*
+ *
+ */
+int
+TTH_ThrottleActive (
+		const TTH_Throttle *throttlePtr
+		)
+{
+	int active;
+
+	if (throttlePtr != NULL
+			&& (throttlePtr->rate > 0 || throttlePtr->iops > 0)) {
+		return 1;
+	}
+
+	Tcl_MutexLock(&throttleMutex);
+	active = processThrottle.rate > 0 || processThrottle.iops > 0;
+	Tcl_MutexUnlock(&throttleMutex);
+
+	return active;
+}
+
+
+/*
+ *
+ */
+void
+TTH_ThrottleIo (
+		TTH_Throttle *throttlePtr,
+		Tcl_WideUInt len
+		)
+{
+	Tcl_WideUInt now;
+	double wait, w, slice;
+
+	now = TTH_StatsClock();
+
+	Tcl_MutexLock(&throttleMutex);
+	wait = Throttle_Charge(&processThrottle, now, len);
+	Tcl_MutexUnlock(&throttleMutex);
+
+	if (throttlePtr != NULL) {
+		w = Throttle_Charge(throttlePtr, now, len);
+		if (w > wait) {
+			wait = w;
+		}
+	}
+
+	/*
+	 * Tiny limits give waits of years, which would overflow
+	 * the milliseconds of a single Tcl_Sleep()
+	 */
+	while (wait > 0) {
+		slice = wait < THROTTLE_MAXSLEEP ? wait : THROTTLE_MAXSLEEP;
+		Tcl_Sleep((int) (slice * 1000 + 0.5));
+		wait -= slice;
+	}
+}
+
+
+/*
+ *
+ */
+int
+TTH_GetThrottleLimitFromObj (
+		Tcl_Interp *interp,
+		const char *option,
+		Tcl_Obj    *objPtr,
+		double     *limitPtr
+		)
+{
+	if (Tcl_GetDoubleFromObj(NULL, objPtr, limitPtr) != TCL_OK
+			|| *limitPtr < 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "bad value \"", Tcl_GetString(objPtr),
+				"\" for option \"", option, "\": must be"
+				" a non-negative number", NULL);
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Throttle_Cmd --
+ *
+ *	Implements the "::tth::throttle" command: with options, sets
+ *	the process-wide limits; returns a dictionary of the limits
+ *	in effect.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	Changes the limits of all the jobs running in the process.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Throttle_Cmd(
+	ClientData clientData,  /* not used */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	static const char *options[] = { "-bandwidth", "-iops", NULL };
+	enum { OP_BANDWIDTH, OP_IOPS };
+	double bandwidth, iops;
+	int i, op;
+	Tcl_Obj *resultPtr;
+
+	Tcl_MutexLock(&throttleMutex);
+	bandwidth = processThrottle.rate / THROTTLE_MB;
+	iops = processThrottle.iops;
+	Tcl_MutexUnlock(&throttleMutex);
+
+	for (i = 1; i < objc; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		if (i == objc - 1) {
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "option \"", options[op],
+					"\" requires an argument", NULL);
+			return TCL_ERROR;
+		}
+		switch (op) {
+			case OP_BANDWIDTH:
+				if (TTH_GetThrottleLimitFromObj(interp, options[op],
+						objv[++i], &bandwidth) != TCL_OK) { return TCL_ERROR; }
+			break;
+			case OP_IOPS:
+				if (TTH_GetThrottleLimitFromObj(interp, options[op],
+						objv[++i], &iops) != TCL_OK) { return TCL_ERROR; }
+			break;
+		}
+	}
+
+	if (objc > 1) {
+		Tcl_MutexLock(&throttleMutex);
+		TTH_ThrottleInit(&processThrottle, bandwidth, iops);
+		Tcl_MutexUnlock(&throttleMutex);
+	}
+
+	resultPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("bandwidth", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr, Tcl_NewDoubleObj(bandwidth));
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("iops", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr, Tcl_NewDoubleObj(iops));
+	Tcl_SetObjResult(interp, resultPtr);
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Throttle_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::throttle",
+		(Tcl_ObjCmdProc *) Throttle_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
@@ -0,0 +1,77 @@
+/*
+ * tclthrottle.h --
+ *
+ *	This file implements interface for tclthrottle.c
+ *	to other parts of the library.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TCLTHROTTLE_H
+#define __TCLTHROTTLE_H
+
+#include <tcl.h>
+
+/*
+ * Token bucket limiting the bandwidth and the rate of I/O operations
+ * of a job; a limit of 0 means no limit. The process-wide bucket
+ * set by the "::tth::throttle" command applies to every job as well.
+ */
+typedef struct {
+	double       rate;     /* bytes per second */
+	double       iops;     /* operations per second */
+	double       bytes;    /* tokens, may be negative (a debt) */
+	double       ops;
+	Tcl_WideUInt last;     /* TTH_StatsClock() of the last refill */
+} TTH_Throttle;
+
+void
+TTH_ThrottleInit (
+		TTH_Throttle *throttlePtr,
+		double       bandwidth,
+		double       iops
+		);
+
+/*
+ * Tells whether the I/O of a job with the given throttle (or NULL)
+ * is limited at all.
+ */
+int
+TTH_ThrottleActive (
+		const TTH_Throttle *throttlePtr
+		);
+
+/*
+ * Accounts for one I/O operation of len bytes, waiting as long as
+ * needed to keep within the limits of the job (unless throttlePtr
+ * is NULL) and of the process.
+ */
+void
+TTH_ThrottleIo (
+		TTH_Throttle *throttlePtr,
+		Tcl_WideUInt len
+		);
+
+/*
+ * Parses a bandwidth (in megabytes per second) or a rate
+ * of I/O operations given to the named option.
+ */
+int
+TTH_GetThrottleLimitFromObj (
+		Tcl_Interp *interp,
+		const char *option,
+		Tcl_Obj    *objPtr,
+		double     *limitPtr
+		);
+
+Tcl_Command
+Throttle_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLTHROTTLE_H */
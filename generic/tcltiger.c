@@ -17,9 +17,14 @@
 
 #include "tiger.h"
 #include "tclout.h"
+#include "tclinput.h"
+#include "tclmmap.h"
+#include "tclhandle.h"
+#include "tclpool.h"
+#include "tclstats.h"
+#include "tclprobe.h"
 #include "tcltiger.h"
 
-
 /*
  *
  */
@@ -28,6 +33,81 @@ typedef enum {
 	DO_RAW       /* -raw */
 } DIGEST_OUTPUT;
 
+typedef enum {
+	DM_CONTEXT,   /* -context, default */
+	DM_STRING,    /* -string */
+	DM_STRINGS,   /* -strings, -list */
+	DM_CHAN,      /* -chan */
+	DM_MMAP       /* -mmap */
+} DIGEST_MODE;
+
+#ifdef TTH_PROBES
+/*
+ * Statistics modes of the digest modes, in the order of DIGEST_MODE;
+ * [tiger] does not keep statistics, these only name the modes
+ * for the probes.
+ */
+static const TTH_STATS_MODE statsModes[] = { TS_CONTEXT, TS_STRING,
+	TS_STRINGS, TS_CHAN, TS_MMAP };
+#endif
+
+
+/*
+ *
+ */
+static void
+Tiger_FreeContextProc (
+		char *blockPtr
+		)
+{
+	TTH_PROBE3(context__destroy, "tiger", blockPtr,
+			((TIGER_CONTEXT *) blockPtr)->length);
+	TTH_PoolFree(blockPtr, sizeof(TIGER_CONTEXT));
+}
+
+static const TTH_HandleType Tiger_ContextType = {
+	"tiger",
+	Tiger_FreeContextProc
+};
+
+
+/*
+ *
+ */
+static Tcl_Obj *
+Tiger_CreateContext (
+		Tcl_Interp *interp
+		)
+{
+	TIGER_CONTEXT *contextPtr;
+
+	contextPtr = (TIGER_CONTEXT *) TTH_PoolAlloc(sizeof(TIGER_CONTEXT));
+	tiger_init(contextPtr);
+	TTH_PROBE2(context__create, "tiger", contextPtr);
+
+	return TTH_NewHandle(interp, &Tiger_ContextType, (ClientData) contextPtr);
+}
+
+
+/*
+ *
+ */
+static Tcl_Obj *
+Cmd_FormatDigest (
+		byte          digest[],
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	switch (output) {
+		case DO_RAW:
+			return DigestToRaw(digest, bitlen);
+		case DO_HEX:
+		default:
+			return DigestToHex(digest, bitlen);
+	}
+}
+
 
 /*
  *
@@ -37,6 +117,9 @@ Cmd_ParseDigestOptions (
 		Tcl_Interp     *interp,
 		Tcl_Obj *const objv[],
 		int            objc,
+		int            first,
+		int            modes,
+		DIGEST_MODE    *modePtr,
 		DIGEST_OUTPUT  *outputPtr,
 		DIGEST_BITLEN  *bitlenPtr
 		)
@@ -44,19 +127,32 @@ Cmd_ParseDigestOptions (
 	int i, op;
 
 	static const char *options[] = { "-hex", "-raw",
-		"-192", "-160", "-128", NULL };
-	typedef enum { OP_HEX, OP_RAW, OP_192, OP_160, OP_128 } OPTION;
+		"-192", "-160", "-128", "-strings",
+		"-context", "-string", "-chan",
+#ifdef USE_MMAP
+		"-mmap",
+#endif
+		NULL };
+	static const char *plainOptions[] = { "-hex", "-raw",
+		"-192", "-160", "-128", "-list", NULL };
+	enum { OP_HEX, OP_RAW, OP_192, OP_160, OP_128, OP_LIST,
+		OP_CONTEXT, OP_STRING, OP_CHAN,
+#ifdef USE_MMAP
+		OP_MMAP
+#endif
+		};
 
-	/* Options start from index 1 and the last object is always a "value": */
-	const int first = 1;
-	int       last  = objc - 2;
+	/* Options start from index first and the last object is always a "value": */
+	int last = objc - 2;
 
 	/* Defaults */
+	*modePtr   = DM_CONTEXT;
 	*outputPtr = DO_HEX;
 	*bitlenPtr = DL_192;
 
 	for (i = first; i <= last; ++i) {
-		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+		if (Tcl_GetIndexFromObj(interp, objv[i],
+				modes ? options : plainOptions, "option",
 				0, &op) != TCL_OK) { return TCL_ERROR; }
 		switch (op) {
 			case OP_HEX:
@@ -74,6 +170,23 @@ Cmd_ParseDigestOptions (
 			case OP_128:
 				*bitlenPtr = DL_128;
 			break;
+			case OP_LIST:
+				*modePtr = DM_STRINGS;
+			break;
+			case OP_CONTEXT:
+				*modePtr = DM_CONTEXT;
+			break;
+			case OP_STRING:
+				*modePtr = DM_STRING;
+			break;
+			case OP_CHAN:
+				*modePtr = DM_CHAN;
+			break;
+#ifdef USE_MMAP
+			case OP_MMAP:
+				*modePtr = DM_MMAP;
+			break;
+#endif
 		}
 	}
 
@@ -82,18 +195,159 @@ Cmd_ParseDigestOptions (
 
 
 /*
+ * Calculates digests of each element of the given list
+ * and returns the list of them.
+ */
+static int
+Tiger_GetDigestsFromList (
+		Tcl_Interp    *interp,
+		Tcl_Obj       *listPtr,
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	Tcl_Obj **elemv, *resultPtr;
+	int elemc, i, len;
+	unsigned char *dataPtr;
+	byte digest[TIGERSIZE];
+	word64 bytes;
+
+	if (Tcl_ListObjGetElements(interp, listPtr,
+				&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+
+	TTH_PROBE2(digest__start, "tiger", TTH_StatsModeName(TS_STRINGS));
+	resultPtr = Tcl_NewListObj(0, NULL);
+	bytes = 0;
+
+	for (i = 0; i < elemc; ++i) {
+		dataPtr = Tcl_GetByteArrayFromObj(elemv[i], &len);
+		tiger((word64 *) dataPtr, (word64) len, (word64 *) digest);
+		tiger_to_canonical(digest);
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+				Cmd_FormatDigest(digest, output, bitlen));
+		bytes += len;
+	}
+
+	Tcl_SetObjResult(interp, resultPtr);
+	TTH_PROBE3(digest__done, "tiger", TTH_StatsModeName(TS_STRINGS), bytes);
+
+	return TCL_OK;
+}
+
+
+/*
+ * Implements [tiger digest ?options? ?mode? source].
+ */
+static int
+Tiger_Digest (
+		Tcl_Interp     *interp,
+		Tcl_Obj *const objv[],
+		int            objc
+		)
+{
+	DIGEST_MODE   dmode;
+	DIGEST_OUTPUT dout;
+	DIGEST_BITLEN dbitlen;
+	Tcl_Obj       *dataPtr;
+	TIGER_CONTEXT context, *contextPtr;
+	byte          *bytesPtr;
+	int           len, code;
+	word64        digest[3];
+
+	if (Cmd_ParseDigestOptions(interp, objv, objc, 2, 1,
+				&dmode, &dout, &dbitlen) != TCL_OK) { return TCL_ERROR; }
+
+	dataPtr = objv[objc - 1];
+	code = TCL_OK;
+
+	if (dmode != DM_STRINGS) {
+		TTH_PROBE2(digest__start, "tiger",
+				TTH_StatsModeName(statsModes[dmode]));
+	}
+
+	switch (dmode) {
+		case DM_CONTEXT:
+			if (TTH_GetHandleFromObj(interp, dataPtr, &Tiger_ContextType,
+						(ClientData *) &contextPtr) != TCL_OK) { return TCL_ERROR; }
+		break;
+		case DM_STRING:
+			contextPtr = &context;
+			tiger_init(contextPtr);
+			bytesPtr = Tcl_GetByteArrayFromObj(dataPtr, &len);
+			tiger_update(contextPtr, bytesPtr, (word64) len);
+		break;
+		case DM_STRINGS:
+			return Tiger_GetDigestsFromList(interp, dataPtr, dout, dbitlen);
+		break;
+		case DM_CHAN:
+			contextPtr = &context;
+			tiger_init(contextPtr);
+			code = DigestUpdateFromChan(interp, dataPtr,
+					DigestUpdateTiger, contextPtr, NULL);
+		break;
+#ifdef USE_MMAP
+		case DM_MMAP:
+			contextPtr = &context;
+			tiger_init(contextPtr);
+			code = TTH_UpdateUsingMmap(interp, dataPtr,
+					DigestUpdateTiger, contextPtr, NULL);
+		break;
+#endif
+		default:
+			return TCL_ERROR;
+	}
+	if (code != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	TTH_PROBE3(digest__done, "tiger", TTH_StatsModeName(statsModes[dmode]),
+			contextPtr->length);
+	tiger_final(contextPtr, digest);
+	tiger_to_canonical((byte *) digest);
+
+	if (dmode == DM_CONTEXT) {
+		TTH_DeleteHandle(interp, dataPtr, &Tiger_ContextType);
+	}
+
+	Tcl_SetObjResult(interp, Cmd_FormatDigest((byte *) digest, dout, dbitlen));
+
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tiger_Cmd --
  *
+ *	Implements the Tcl "tiger" command placed in the "::tth" namespace.
+ *	When its first argument is exactly one of "init", "update" or
+ *	"digest", it is treated as a subcommand; otherwise the command
+ *	digests its last argument.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
  */
+
 static int
 Tiger_Cmd(
-	ClientData clientData,  /* pointer to a TTH_State object */
+	ClientData clientData,  /* not used */
 	Tcl_Interp *interp,     /* Current interpreter */
 	int objc,               /* Number of arguments */
 	Tcl_Obj *const objv[]   /* Argument strings */
 	)
 {
-	int len;
+	static const char *subcmds[] = { "init", "update", "digest", NULL };
+	enum { TIGER_INIT, TIGER_UPDATE, TIGER_DIGEST };
+	TIGER_CONTEXT *contextPtr;
+	int i, len;
 	unsigned char *dataPtr;
+	DIGEST_MODE   dmode;
 	DIGEST_OUTPUT dout;
 	DIGEST_BITLEN dbitlen;
 	byte digest[TIGERSIZE];
@@ -105,23 +359,61 @@ Tiger_Cmd(
 		return TCL_ERROR;
 	}
 
-	if (Cmd_ParseDigestOptions(interp, objv, objc,
-				&dout, &dbitlen) != TCL_OK) { return TCL_ERROR; }
+	if (Tcl_GetIndexFromObj(NULL, objv[1], subcmds, "subcommand",
+			TCL_EXACT, &i) == TCL_OK) {
+		switch (i) {
+			case TIGER_INIT:
+				if (objc != 2) {
+					Tcl_WrongNumArgs(interp, 2, objv, NULL);
+					return TCL_ERROR;
+				}
+				Tcl_SetObjResult(interp, Tiger_CreateContext(interp));
+				return TCL_OK;
+			break;
+
+			case TIGER_UPDATE:
+				if (objc < 4) {
+					Tcl_WrongNumArgs(interp, 2, objv,
+							"tigerContext bitstring ?bitstring ...?");
+					return TCL_ERROR;
+				}
+				if (TTH_GetHandleFromObj(interp, objv[2], &Tiger_ContextType,
+							(ClientData *) &contextPtr) != TCL_OK) {
+					return TCL_ERROR;
+				}
+				for (i = 3; i < objc; ++i) {
+					dataPtr = Tcl_GetByteArrayFromObj(objv[i], &len);
+					tiger_update(contextPtr, dataPtr, (word64) len);
+				}
+				return TCL_OK;
+			break;
 
+			case TIGER_DIGEST:
+				if (objc < 3) {
+					Tcl_WrongNumArgs(interp, 2, objv,
+							"?options? source");
+					return TCL_ERROR;
+				}
+				return Tiger_Digest(interp, objv, objc);
+			break;
+		}
+	}
+
+	if (Cmd_ParseDigestOptions(interp, objv, objc, 1, 0,
+				&dmode, &dout, &dbitlen) != TCL_OK) { return TCL_ERROR; }
+
+	if (dmode == DM_STRINGS) {
+		return Tiger_GetDigestsFromList(interp, objv[objc - 1],
+				dout, dbitlen);
+	}
+
+	TTH_PROBE2(digest__start, "tiger", TTH_StatsModeName(TS_STRING));
 	dataPtr = Tcl_GetByteArrayFromObj(objv[objc - 1], &len);
 	tiger((word64 *) dataPtr, (word64) len, (word64 *) digest);
 	tiger_to_canonical(digest);
+	TTH_PROBE3(digest__done, "tiger", TTH_StatsModeName(TS_STRING), len);
 
-	switch (dout) {
-		case DO_RAW:
-			Tcl_SetObjResult(interp,
-				DigestToRaw(digest, dbitlen));
-		break;
-		case DO_HEX:
-			Tcl_SetObjResult(interp,
-				DigestToHex(digest, dbitlen));
-		break;
-	}
+	Tcl_SetObjResult(interp, Cmd_FormatDigest(digest, dout, dbitlen));
 
 	return TCL_OK;
 }
@@ -139,4 +431,3 @@ Tiger_CreateCmd (
 		(Tcl_ObjCmdProc *) Tiger_Cmd,
 		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
 }
-
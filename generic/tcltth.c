@@ -20,40 +20,84 @@
 
 #include "tigertree.h"
 #include "tclout.h"
+#include "tclinput.h"
 #include "tclmmap.h"
+#include "tclclient.h"
+#include "tclhandle.h"
+#include "tclpool.h"
+#include "tclstats.h"
+#include "tclprobe.h"
 #include "tcltth.h"
 
 /*
- * Per-interpreter data storage accociated with the ::tth::tth Tcl command.
+ * TTH context along with the optional extra results
+ * calculated in the same pass over the data (see -multi).
  */
 typedef struct {
-	Tcl_HashTable contexts;
-	unsigned int uid;
-} TTH_State;
+	TT_CONTEXT    context;
+	TIGER_CONTEXT *flatPtr;    /* flat Tiger Hash, or NULL */
+	DIGEST_LEVEL  *levelPtr;   /* collected tree level, or NULL */
+	Tcl_WideUInt  bytes;       /* bytes hashed so far */
+	ClientData    statsData;   /* see TTH_StatsOpenContext() */
+} TTH_Context;
+
+typedef enum {
+	DO_THEX,       /* -thex, default  */
+	DO_HEX,        /* -hex */
+	DO_RAW         /* -raw */
+} DIGEST_OUTPUT;
 
 
 /*
- *
+ * Initializes the context; multi requests the flat Tiger Hash
+ * to be calculated alongside, non-negative level requests that level
+ * of the hash tree to be collected.
  */
 static void
-TTH_CleanupState (
-		ClientData clientData
+TTH_InitContext (
+		TTH_Context *ctxPtr,
+		int         multi,
+		int         level
 		)
 {
-	TTH_State      *statePtr;
-	Tcl_HashEntry  *entryPtr;
-	Tcl_HashSearch search;
-
-	statePtr = (TTH_State *) clientData;
-
-	entryPtr = Tcl_FirstHashEntry(&statePtr->contexts, &search);
-	while (entryPtr != NULL) {
-		ckfree((char *) Tcl_GetHashValue(entryPtr));
+	tt_init(&ctxPtr->context);
+	ctxPtr->flatPtr   = NULL;
+	ctxPtr->levelPtr  = NULL;
+	ctxPtr->bytes     = 0;
+	ctxPtr->statsData = NULL;
 
-		entryPtr = Tcl_FirstHashEntry(&statePtr->contexts, &search);
+	if (multi) {
+		ctxPtr->flatPtr = (TIGER_CONTEXT *) TTH_PoolAlloc(sizeof(TIGER_CONTEXT));
+		tiger_init(ctxPtr->flatPtr);
+		tt_set_flat(&ctxPtr->context, ctxPtr->flatPtr);
 	}
+	if (level >= 0) {
+		ctxPtr->levelPtr = (DIGEST_LEVEL *) TTH_PoolAlloc(sizeof(DIGEST_LEVEL));
+		DigestLevelInit(ctxPtr->levelPtr);
+		tt_set_level(&ctxPtr->context, level,
+				DigestLevelAppend, ctxPtr->levelPtr);
+	}
+}
 
-	ckfree((char *) statePtr);
+
+/*
+ *
+ */
+static void
+TTH_FreeContext (
+		TTH_Context *ctxPtr
+		)
+{
+	tt_free(&ctxPtr->context);
+	if (ctxPtr->flatPtr != NULL) {
+		TTH_PoolFree(ctxPtr->flatPtr, sizeof(TIGER_CONTEXT));
+		ctxPtr->flatPtr = NULL;
+	}
+	if (ctxPtr->levelPtr != NULL) {
+		DigestLevelFree(ctxPtr->levelPtr);
+		TTH_PoolFree(ctxPtr->levelPtr, sizeof(DIGEST_LEVEL));
+		ctxPtr->levelPtr = NULL;
+	}
 }
 
 
@@ -61,117 +105,268 @@ TTH_CleanupState (
  *
  */
 static Tcl_Obj *
-TTH_CreateContext (
-		TTH_State *statePtr
+Cmd_FormatDigest (
+		byte          digest[],
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	switch (output) {
+		case DO_HEX:
+			return DigestToHex(digest, bitlen);
+		case DO_RAW:
+			return DigestToRaw(digest, bitlen);
+		case DO_THEX:
+		default:
+			return DigestToTHEX(digest, bitlen);
+	}
+}
+
+
+/*
+ * Finalizes the context and returns the result: the formatted
+ * digest or, for a -multi context, a dictionary of results.
+ * Frees the extras of the context.
+ */
+static Tcl_Obj *
+TTH_FinishContext (
+		TTH_Context   *ctxPtr,
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
 		)
 {
-	char token[3 + 10 + 1];
-	Tcl_HashEntry *entryPtr;
-	int new;
-	TT_CONTEXT *contextPtr;
+	byte digest[TIGERSIZE];
+	word64 flat[3];
+	Tcl_Obj *resultPtr;
 
-	sprintf(token, "tth%u", statePtr->uid);
-	++statePtr->uid;
+	tt_digest(&ctxPtr->context, digest);
 
-	entryPtr = Tcl_CreateHashEntry(&statePtr->contexts, token, &new);
-	if (new != 1) {
-		Tcl_Panic("TTH context \"%s\" stomps on existing one", token);
+	if (ctxPtr->flatPtr == NULL && ctxPtr->levelPtr == NULL) {
+		return Cmd_FormatDigest(digest, output, bitlen);
 	}
 
-	contextPtr = (TT_CONTEXT *) ckalloc(sizeof(TT_CONTEXT));
-	Tcl_SetHashValue(entryPtr, (ClientData)contextPtr);
-	tt_init(contextPtr);
+	resultPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, resultPtr, Tcl_NewStringObj("tth", -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Cmd_FormatDigest(digest, output, bitlen));
+	if (ctxPtr->flatPtr != NULL) {
+		tiger_final(ctxPtr->flatPtr, flat);
+		tiger_to_canonical((byte *) flat);
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+				Tcl_NewStringObj("tiger", -1));
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+				Cmd_FormatDigest((byte *) flat, output, bitlen));
+	}
+	if (ctxPtr->levelPtr != NULL) {
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+				Tcl_NewStringObj("level", -1));
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+				DigestLevelToObj(ctxPtr->levelPtr));
+	}
 
-	return Tcl_NewStringObj(token, -1);
+	TTH_FreeContext(ctxPtr);
+
+	return resultPtr;
 }
 
 
 /*
  *
  */
-static int
-TTH_FindContext (
-		Tcl_Interp    *interp,
-		TTH_State     *statePtr,
-		Tcl_Obj       *tokenPtr,
-		Tcl_HashEntry **entryPtr
+static void
+TTH_FreeContextProc (
+		char *blockPtr
 		)
 {
-	*entryPtr = Tcl_FindHashEntry(&statePtr->contexts,
-			Tcl_GetString(tokenPtr));
-	if (*entryPtr == NULL) {
-		Tcl_ResetResult(interp);
-		Tcl_AppendResult(interp, "can not find context named \"",
-				Tcl_GetString(tokenPtr), "\"", NULL);
-		return TCL_ERROR;
-	} else
-		return TCL_OK;
+	TTH_Context *ctxPtr = (TTH_Context *) blockPtr;
+
+	TTH_PROBE3(context__destroy, "tth", ctxPtr, ctxPtr->bytes);
+	TTH_FreeContext(ctxPtr);
+	TTH_StatsCloseContext(ctxPtr->statsData);
+	TTH_PoolFree(blockPtr, sizeof(TTH_Context));
 }
 
+static const TTH_HandleType TTH_ContextType = {
+	"tth",
+	TTH_FreeContextProc
+};
+
 
 /*
  *
  */
-static int
-TTH_UpdateContext (
+static Tcl_Obj *
+TTH_CreateContext (
 		Tcl_Interp *interp,
-		TTH_State  *statePtr,
-		Tcl_Obj    *tokenPtr,
-		Tcl_Obj    *dataPtr 
+		ClientData statsData,
+		int        multi,
+		int        level
 		)
 {
-	Tcl_HashEntry *entryPtr;
-	TT_CONTEXT    *contextPtr;
-	byte          *bytesPtr;
-	int           len;
+	TTH_Context *ctxPtr;
+
+	ctxPtr = (TTH_Context *) TTH_PoolAlloc(sizeof(TTH_Context));
+	TTH_InitContext(ctxPtr, multi, level);
+	ctxPtr->statsData = TTH_StatsOpenContext(statsData);
+	TTH_PROBE2(context__create, "tth", ctxPtr);
 
-	if(TTH_FindContext(interp, statePtr, tokenPtr,
-				&entryPtr) != TCL_OK) { return TCL_ERROR; }
+	return TTH_NewHandle(interp, &TTH_ContextType, (ClientData) ctxPtr);
+}
 
-	contextPtr = (TT_CONTEXT *) Tcl_GetHashValue(entryPtr);
+
+/*
+ *
+ */
+static void
+TTH_UpdateFromString (
+		Tcl_Obj     *dataPtr,
+		TTH_Context *ctxPtr
+		)
+{
+	unsigned char *bytesPtr;
+	int len;
 
 	bytesPtr = Tcl_GetByteArrayFromObj(dataPtr, &len);
-	tt_update(contextPtr, bytesPtr, len);
+	tt_update(&ctxPtr->context, bytesPtr, len);
+	ctxPtr->bytes += len;
+}
 
-	return TCL_OK;
+
+/*
+ * Update procedure for the digests of channels and files
+ * keeping count of the bytes hashed.
+ */
+static void
+TTH_UpdateProc (
+		ClientData clientData,
+		const byte *bytes,
+		int        len
+		)
+{
+	TTH_Context *ctxPtr = (TTH_Context *) clientData;
+
+	tt_update(&ctxPtr->context, bytes, (word32) len);
+	ctxPtr->bytes += len;
 }
 
-
+
 /*
- *
+ * Timings of a digest calculated with -profile, in nanoseconds.
+ */
+typedef struct {
+	TTH_Context  *ctxPtr;
+	TT_PROFILE   tree;      /* time spent composing inner nodes */
+	Tcl_WideUInt hash;      /* time spent hashing, composition included */
+	Tcl_WideUInt start;     /* clock when the digest was started */
+	Tcl_WideUInt io;        /* time spent reading the data and hashing it */
+	Tcl_WideUInt majflt;    /* page faults when the digest was started */
+	Tcl_WideUInt minflt;
+} TTH_Profile;
+
+static word64
+TTH_ProfileClock (void)
+{
+	return (word64) TTH_StatsClock();
+}
+
+
+/*
+ * Update procedure of TTH_UpdateProc() accounting for the time spent
+ * hashing, so the rest of the time spent reading is known to be I/O.
  */
 static void
-TTH_DeleteContext (
-		Tcl_HashEntry *entryPtr
+TTH_ProfileUpdateProc (
+		ClientData clientData,
+		const byte *bytes,
+		int        len
 		)
 {
-	TT_CONTEXT *contextPtr;
+	TTH_Profile *profPtr = (TTH_Profile *) clientData;
+	Tcl_WideUInt start;
+
+	start = TTH_StatsClock();
+	TTH_UpdateProc((ClientData) profPtr->ctxPtr, bytes, len);
+	profPtr->hash += TTH_StatsClock() - start;
+}
 
-	contextPtr = (TT_CONTEXT *) Tcl_GetHashValue(entryPtr);
-	ckfree((char *) contextPtr);
 
-	Tcl_DeleteHashEntry(entryPtr);
+/*
+ *
+ */
+static void
+TTH_ProfileStart (
+		TTH_Profile *profPtr,
+		TTH_Context *ctxPtr
+		)
+{
+	profPtr->ctxPtr = ctxPtr;
+	profPtr->tree.clock = TTH_ProfileClock;
+	profPtr->tree.compose = 0;
+	profPtr->hash = 0;
+	profPtr->io = 0;
+	TTH_StatsFaults(&profPtr->majflt, &profPtr->minflt);
+	tt_set_profile(&ctxPtr->context, &profPtr->tree);
+	profPtr->start = TTH_StatsClock();
 }
 
 
-
 /*
  *
  */
 static void
-TTH_GetDigestFromString (
-		Tcl_Obj *dataPtr,
-		byte    digest[]
+Cmd_AppendPair (
+		Tcl_Obj    *dictPtr,
+		const char *key,
+		Tcl_Obj    *valuePtr
 		)
 {
-	TT_CONTEXT context;
-	unsigned char *bytesPtr;
-	int len;
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj(key, -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr, valuePtr);
+}
 
-	tt_init(&context);
-	bytesPtr = Tcl_GetByteArrayFromObj(dataPtr, &len);
-	tt_update(&context, bytesPtr, len);
-	tt_digest(&context, digest);
+
+/*
+ * Returns the dictionary of the breakdown of the time spent
+ * on the digest, in microseconds, the throughput and the ways
+ * the data were read and hashed.
+ */
+static Tcl_Obj *
+TTH_ProfileToObj (
+		TTH_Profile *profPtr,
+		Tcl_WideUInt bytes,
+		const char   *engine
+		)
+{
+	Tcl_WideUInt total, io, leaf, tcl, majflt, minflt;
+	double mbps;
+	Tcl_Obj *resultPtr;
+
+	total = TTH_StatsClock() - profPtr->start;
+	TTH_StatsFaults(&majflt, &minflt);
+	io   = profPtr->io > profPtr->hash ? profPtr->io - profPtr->hash : 0;
+	leaf = profPtr->hash > profPtr->tree.compose
+		? profPtr->hash - profPtr->tree.compose : 0;
+	tcl  = total > io + profPtr->hash ? total - io - profPtr->hash : 0;
+	/* bytes per microsecond are megabytes per second */
+	mbps = total == 0 ? 0.0 : (double) bytes * 1e3 / (double) total;
+
+	resultPtr = Tcl_NewObj();
+	Cmd_AppendPair(resultPtr, "time", Tcl_NewDoubleObj(total / 1e3));
+	Cmd_AppendPair(resultPtr, "io", Tcl_NewDoubleObj(io / 1e3));
+	Cmd_AppendPair(resultPtr, "leaf", Tcl_NewDoubleObj(leaf / 1e3));
+	Cmd_AppendPair(resultPtr, "compose",
+			Tcl_NewDoubleObj(profPtr->tree.compose / 1e3));
+	Cmd_AppendPair(resultPtr, "tcl", Tcl_NewDoubleObj(tcl / 1e3));
+	Cmd_AppendPair(resultPtr, "bytes", Tcl_NewWideIntObj((Tcl_WideInt) bytes));
+	Cmd_AppendPair(resultPtr, "mbps", Tcl_NewDoubleObj(mbps));
+	Cmd_AppendPair(resultPtr, "majflt",
+			Tcl_NewWideIntObj((Tcl_WideInt) (majflt - profPtr->majflt)));
+	Cmd_AppendPair(resultPtr, "minflt",
+			Tcl_NewWideIntObj((Tcl_WideInt) (minflt - profPtr->minflt)));
+	Cmd_AppendPair(resultPtr, "engine", Tcl_NewStringObj(engine, -1));
+	Cmd_AppendPair(resultPtr, "kernel", Tcl_NewStringObj(tiger_kernel, -1));
+
+	return resultPtr;
 }
 
 
@@ -179,81 +374,193 @@ TTH_GetDigestFromString (
  *
  */
 static int
-TTH_GetDigestFromContext (
-		Tcl_Interp   *interp,
-		TTH_State    *statePtr,
-		Tcl_Obj      *tokenPtr,
-		byte         digest[]
+TTH_UpdateContext (
+		Tcl_Interp     *interp,
+		ClientData     statsData,
+		Tcl_Obj        *tokenPtr,
+		int            objc,
+		Tcl_Obj *const objv[]
 		)
 {
-	Tcl_HashEntry *entryPtr;
-	TT_CONTEXT *contextPtr;
+	TTH_Context   *ctxPtr;
+	TTH_StatsTimer timer;
+	Tcl_WideUInt  bytes;
+	Tcl_WideInt   len;
+	int           i, n;
 
-	if (TTH_FindContext(interp, statePtr, tokenPtr,
-				&entryPtr) != TCL_OK) { return TCL_ERROR; }
+	if (TTH_GetHandleFromObj(interp, tokenPtr, &TTH_ContextType,
+				(ClientData *) &ctxPtr) != TCL_OK) { return TCL_ERROR; }
 
-	contextPtr = (TT_CONTEXT *) Tcl_GetHashValue(entryPtr);
-	tt_digest(contextPtr, digest);
+	len = 0;
+	for (i = 0; i < objc; ++i) {
+		Tcl_GetByteArrayFromObj(objv[i], &n);
+		len += n;
+	}
 
-	TTH_DeleteContext(entryPtr);
+	TTH_StatsStart(&timer, len);
+	bytes = ctxPtr->bytes;
+	for (i = 0; i < objc; ++i) {
+		TTH_UpdateFromString(objv[i], ctxPtr);
+	}
+	TTH_StatsRecord(statsData, TS_CONTEXT, &timer,
+			ctxPtr->bytes - bytes, 0, 0);
 
 	return TCL_OK;
 }
 
 
 /*
- *
+ * Updates the context with the concatenation of the elements
+ * of the given list without actually concatenating them.
  */
 static int
-TTH_GetDigestFromChan (
-		Tcl_Interp   *interp,
-		Tcl_Obj      *chanPtr,
-		byte         digest[]
+TTH_UpdateFromList (
+		Tcl_Interp  *interp,
+		Tcl_Obj     *listPtr,
+		TTH_Context *ctxPtr
 		)
 {
-	Tcl_Channel chan;
-	int mode;
-	TT_CONTEXT context;
-	Tcl_Obj *chunkPtr;
-	byte *dataPtr;
-	int len;
-	const int CHUNKSIZE = 8192;
+	Tcl_Obj **elemv;
+	int elemc, i, len;
+	TT_IOVEC staticIov[16], *iovPtr;
 
-	chan = Tcl_GetChannel(interp,
-			Tcl_GetString(chanPtr), &mode);
-	if (chan == NULL) {
-		Tcl_ResetResult(interp);
-		Tcl_AppendResult(interp, "can not find channel named \"",
-				Tcl_GetString(chanPtr), "\"", NULL);
-		return TCL_ERROR;
+	if (Tcl_ListObjGetElements(interp, listPtr,
+				&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+
+	if (elemc <= (int) (sizeof(staticIov) / sizeof(staticIov[0]))) {
+		iovPtr = staticIov;
+	} else {
+		iovPtr = (TT_IOVEC *) ckalloc(elemc * sizeof(TT_IOVEC));
 	}
-	if ((mode & TCL_READABLE) != TCL_READABLE) {
-		Tcl_ResetResult(interp);
-		Tcl_AppendResult(interp, "channel \"", Tcl_GetString(chanPtr),
-				"\" is not opened for reading", NULL);
-		return TCL_ERROR;
+
+	for (i = 0; i < elemc; ++i) {
+		iovPtr[i].base = Tcl_GetByteArrayFromObj(elemv[i], &len);
+		iovPtr[i].len  = (word32) len;
+		ctxPtr->bytes += len;
 	}
+	tt_updatev(&ctxPtr->context, iovPtr, elemc);
 
-	tt_init(&context);
+	if (iovPtr != staticIov) {
+		ckfree((char *) iovPtr);
+	}
 
-	chunkPtr = Tcl_NewObj();
-	Tcl_IncrRefCount(chunkPtr);
+	return TCL_OK;
+}
 
-	while (! Tcl_Eof(chan)) {
-		len = Tcl_ReadChars(chan, chunkPtr, CHUNKSIZE, 0);
-		if (len == -1) {
-			Tcl_ResetResult(interp);
-			Tcl_AppendResult(interp, "failed to read from channel \"",
-					Tcl_GetString(chanPtr), "\"", NULL);
-			return TCL_ERROR;
+
+/*
+ * Calculates the digest of a string in one go.
+ */
+static Tcl_Obj *
+TTH_GetDigestFromString (
+		Tcl_Obj       *dataPtr,
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	byte *bytesPtr;
+	int len;
+	byte digest[TIGERSIZE];
+
+	bytesPtr = Tcl_GetByteArrayFromObj(dataPtr, &len);
+	tt_hash(bytesPtr, len, digest);
+
+	return Cmd_FormatDigest(digest, output, bitlen);
+}
+
+
+/*
+ * Calculates digests of each element of the given list
+ * and returns the list of them.
+ */
+static int
+TTH_GetDigestsFromList (
+		Tcl_Interp    *interp,
+		ClientData    statsData,
+		Tcl_Obj       *listPtr,
+		int           multi,
+		int           level,
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	Tcl_Obj **elemv, *resultPtr;
+	int elemc, i, len;
+	TTH_Context context;
+	TTH_StatsTimer timer;
+	Tcl_WideUInt bytes, leaves;
+
+	if (Tcl_ListObjGetElements(interp, listPtr,
+				&elemc, &elemv) != TCL_OK) { return TCL_ERROR; }
+
+	bytes = 0;
+	for (i = 0; i < elemc; ++i) {
+		Tcl_GetByteArrayFromObj(elemv[i], &len);
+		bytes += len;
+	}
+
+	TTH_StatsStart(&timer, (Tcl_WideInt) bytes);
+	bytes  = 0;
+	leaves = 0;
+	resultPtr = Tcl_NewListObj(0, NULL);
+
+	for (i = 0; i < elemc; ++i) {
+		if (multi) {
+			TTH_InitContext(&context, multi, level);
+			TTH_UpdateFromString(elemv[i], &context);
+			Tcl_ListObjAppendElement(NULL, resultPtr,
+					TTH_FinishContext(&context, output, bitlen));
+		} else {
+			Tcl_ListObjAppendElement(NULL, resultPtr,
+					TTH_GetDigestFromString(elemv[i], output, bitlen));
 		}
-		dataPtr = Tcl_GetByteArrayFromObj(chunkPtr, &len);
-		tt_update(&context, dataPtr, len);
+		Tcl_GetByteArrayFromObj(elemv[i], &len);
+		bytes  += len;
+		leaves += TTH_StatsLeaves(len);
+	}
+
+	Tcl_SetObjResult(interp, resultPtr);
+	TTH_StatsRecord(statsData, TS_STRINGS, &timer, bytes, leaves, elemc);
+	TTH_PROBE3(digest__done, "tth", TTH_StatsModeName(TS_STRINGS), bytes);
+
+	return TCL_OK;
+}
+
+
+/*
+ * Finalizes the named context and deletes it.
+ */
+static int
+TTH_GetDigestFromContext (
+		Tcl_Interp    *interp,
+		ClientData    statsData,
+		Tcl_Obj       *tokenPtr,
+		int           multi,
+		DIGEST_OUTPUT output,
+		DIGEST_BITLEN bitlen
+		)
+{
+	TTH_Context *ctxPtr;
+	TTH_StatsTimer timer;
+
+	if (TTH_GetHandleFromObj(interp, tokenPtr, &TTH_ContextType,
+				(ClientData *) &ctxPtr) != TCL_OK) { return TCL_ERROR; }
+	if (multi && ctxPtr->flatPtr == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "context \"", Tcl_GetString(tokenPtr),
+				"\" was not created with -multi", NULL);
+		return TCL_ERROR;
 	}
 
-	tt_digest(&context, digest);
+	/* Only the remaining inner nodes are hashed here */
+	TTH_StatsStart(&timer, 0);
+	Tcl_SetObjResult(interp, TTH_FinishContext(ctxPtr, output, bitlen));
+	TTH_StatsRecord(statsData, TS_CONTEXT, &timer, 0,
+			TTH_StatsLeaves(ctxPtr->bytes), 1);
+	TTH_PROBE3(digest__done, "tth", TTH_StatsModeName(TS_CONTEXT),
+			ctxPtr->bytes);
 
-	Tcl_DecrRefCount(chunkPtr);
+	TTH_DeleteHandle(interp, tokenPtr, &TTH_ContextType);
 
 	return TCL_OK;
 }
@@ -265,15 +572,46 @@ TTH_GetDigestFromChan (
 typedef enum {
 	DM_CONTEXT,   /* -context, default */
 	DM_STRING,    /* -string */
+	DM_STRINGS,   /* -strings */
+	DM_CONCAT,    /* -concat */
 	DM_CHAN,      /* -chan */
-	DM_MMAP       /* -mmap */
+	DM_MMAP,      /* -mmap */
+	DM_FILE       /* -file */
 } DIGEST_MODE;
 
-typedef enum {
-	DO_THEX,       /* -thex, default  */
-	DO_HEX,        /* -hex */
-	DO_RAW         /* -raw */
-} DIGEST_OUTPUT;
+/*
+ * Names of the file engines, in the order of FILE_ENGINE.
+ */
+static const char *engineNames[] = { "auto", "mmap", "read", "stream", NULL };
+
+/*
+ * Statistics modes of the digest modes, in the order of DIGEST_MODE.
+ */
+static const TTH_STATS_MODE statsModes[] = { TS_CONTEXT, TS_STRING,
+	TS_STRINGS, TS_CONCAT, TS_CHAN, TS_MMAP, TS_FILE };
+
+
+/*
+ * Parses the -level option argument.
+ */
+static int
+Cmd_GetLevelFromObj (
+		Tcl_Interp *interp,
+		Tcl_Obj    *objPtr,
+		int        *levelPtr
+		)
+{
+	if (Tcl_GetIntFromObj(interp, objPtr, levelPtr) != TCL_OK) {
+		return TCL_ERROR;
+	}
+	if (*levelPtr < 0 || *levelPtr > 63) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "bad tree level \"", Tcl_GetString(objPtr),
+				"\": must be an integer from 0 to 63", NULL);
+		return TCL_ERROR;
+	}
+	return TCL_OK;
+}
 
 
 /*
@@ -286,21 +624,42 @@ Cmd_ParseDigestOptions (
 		int            objc,
 		DIGEST_MODE    *modePtr,
 		DIGEST_OUTPUT  *outputPtr,
-		DIGEST_BITLEN  *bitlenPtr
+		DIGEST_BITLEN  *bitlenPtr,
+		int            *multiPtr,
+		int            *levelPtr,
+		FILE_ENGINE    *enginePtr,
+		int            *profilePtr,
+		Tcl_Obj        **engineVarPtr,
+		Tcl_Obj        **daemonPtr,
+		double         *bandwidthPtr,
+		double         *iopsPtr
 		)
 {
-	int i, op;
+	int i, op, engine;
 
-	static const char *options[] = { "-context", "-string", "-chan",
+	static const char *options[] = { "-context", "-string", "-strings",
+		"-concat", "-chan",
 #ifdef USE_MMAP
 		"-mmap",
 #endif
-		"-thex", "-hex", "-raw", "-192", "-160", "-128", NULL };
-	typedef enum { OP_CONTEXT, OP_STRING, OP_CHAN,
+		"-file", "-thex", "-hex", "-raw", "-192", "-160", "-128",
+		"-multi", "-level", "-engine", "-enginevar", "-profile",
+		"-bandwidth", "-iops",
+#ifdef USE_DAEMON
+		"-daemon",
+#endif
+		NULL };
+	enum { OP_CONTEXT, OP_STRING, OP_STRINGS, OP_CONCAT, OP_CHAN,
 #ifdef USE_MMAP
 		OP_MMAP,
 #endif
-		OP_THEX, OP_HEX, OP_RAW, OP_192, OP_160, OP_128 } OPTION;
+		OP_FILE, OP_THEX, OP_HEX, OP_RAW, OP_192, OP_160, OP_128,
+		OP_MULTI, OP_LEVEL, OP_ENGINE, OP_ENGINEVAR, OP_PROFILE,
+		OP_BANDWIDTH, OP_IOPS,
+#ifdef USE_DAEMON
+		OP_DAEMON
+#endif
+	};
 
 	/* Options start from index 2 and the last object is always a "value": */
 	const int first = 2;
@@ -310,6 +669,14 @@ Cmd_ParseDigestOptions (
 	*modePtr   = DM_CONTEXT;
 	*outputPtr = DO_THEX;
 	*bitlenPtr = 192;
+	*multiPtr  = 0;
+	*levelPtr  = -1;
+	*enginePtr = FE_AUTO;
+	*profilePtr = 0;
+	*engineVarPtr = NULL;
+	*daemonPtr = NULL;
+	*bandwidthPtr = 0;
+	*iopsPtr = 0;
 
 	for (i = first; i <= last; ++i) {
 		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
@@ -321,6 +688,12 @@ Cmd_ParseDigestOptions (
 			case OP_STRING:
 				*modePtr = DM_STRING;
 			break;
+			case OP_STRINGS:
+				*modePtr = DM_STRINGS;
+			break;
+			case OP_CONCAT:
+				*modePtr = DM_CONCAT;
+			break;
 			case OP_CHAN:
 				*modePtr = DM_CHAN;
 			break;
@@ -329,6 +702,9 @@ Cmd_ParseDigestOptions (
 				*modePtr = DM_MMAP;
 			break;
 #endif
+			case OP_FILE:
+				*modePtr = DM_FILE;
+			break;
 			case OP_THEX:
 				*outputPtr = DO_THEX;
 			break;
@@ -347,6 +723,111 @@ Cmd_ParseDigestOptions (
 			case OP_128:
 				*bitlenPtr = 128;
 			break;
+			case OP_MULTI:
+				*multiPtr = 1;
+			break;
+			case OP_LEVEL:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-level\" requires"
+							" an argument", NULL);
+					return TCL_ERROR;
+				}
+				if (Cmd_GetLevelFromObj(interp, objv[++i],
+						levelPtr) != TCL_OK) { return TCL_ERROR; }
+				*multiPtr = 1;
+			break;
+			case OP_ENGINE:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-engine\" requires"
+							" an argument", NULL);
+					return TCL_ERROR;
+				}
+				if (Tcl_GetIndexFromObj(interp, objv[++i], engineNames,
+						"engine", 0, &engine) != TCL_OK) { return TCL_ERROR; }
+				*enginePtr = (FILE_ENGINE) engine;
+			break;
+			case OP_ENGINEVAR:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-enginevar\" requires"
+							" an argument", NULL);
+					return TCL_ERROR;
+				}
+				*engineVarPtr = objv[++i];
+			break;
+			case OP_PROFILE:
+				*profilePtr = 1;
+			break;
+			case OP_BANDWIDTH:
+			case OP_IOPS:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"", options[op],
+							"\" requires an argument", NULL);
+					return TCL_ERROR;
+				}
+				if (TTH_GetThrottleLimitFromObj(interp, options[op], objv[++i],
+						op == OP_BANDWIDTH ? bandwidthPtr : iopsPtr)
+						!= TCL_OK) { return TCL_ERROR; }
+			break;
+#ifdef USE_DAEMON
+			case OP_DAEMON:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-daemon\" requires"
+							" an argument", NULL);
+					return TCL_ERROR;
+				}
+				*daemonPtr = objv[++i];
+			break;
+#endif
+		}
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Parses options of the "init" subcommand.
+ */
+static int
+Cmd_ParseInitOptions (
+		Tcl_Interp     *interp,
+		Tcl_Obj *const objv[],
+		int            objc,
+		int            *multiPtr,
+		int            *levelPtr
+		)
+{
+	int i, op;
+
+	static const char *options[] = { "-multi", "-level", NULL };
+	enum { OP_MULTI, OP_LEVEL };
+
+	*multiPtr = 0;
+	*levelPtr = -1;
+
+	for (i = 2; i < objc; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		switch (op) {
+			case OP_MULTI:
+				*multiPtr = 1;
+			break;
+			case OP_LEVEL:
+				if (i == objc - 1) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-level\" requires"
+							" an argument", NULL);
+					return TCL_ERROR;
+				}
+				if (Cmd_GetLevelFromObj(interp, objv[++i],
+						levelPtr) != TCL_OK) { return TCL_ERROR; }
+				*multiPtr = 1;
+			break;
 		}
 	}
 
@@ -373,7 +854,7 @@ Cmd_ParseDigestOptions (
 
 static int
 TTH_Cmd(
-	ClientData clientData,  /* pointer to a TTH_State object */
+	ClientData clientData,  /* counters of tth::stats */
 	Tcl_Interp *interp,     /* Current interpreter */
 	int objc,               /* Number of arguments */
 	Tcl_Obj *const objv[]   /* Argument strings */
@@ -382,12 +863,27 @@ TTH_Cmd(
 	static const char *options[] = { "init", "update", "digest", NULL };
 	typedef enum { TTH_INIT, TTH_UPDATE, TTH_DIGEST } TTH_Option;
 	int i;
-	TTH_State *statePtr;
 	Tcl_Obj *dataPtr;
 	DIGEST_MODE   dmode;
 	DIGEST_OUTPUT dout;
 	DIGEST_BITLEN dbitlen;
+	int multi, level, code, profile;
+	FILE_ENGINE engine, used;
+	TTH_Context context;
+	TTH_Throttle throttle;
+	double bandwidth, iops;
+	TTH_StatsTimer timer;
+	TTH_Profile prof;
+	DigestUpdateProc *updateProc;
+	ClientData updateData;
+	Tcl_WideUInt start;
+	Tcl_Obj *resultPtr, *digestPtr, *daemonPtr, *engineVarPtr;
+	const char *source;
+	int len;
+#ifdef USE_DAEMON
 	byte digest[TIGERSIZE];
+	Tcl_WideInt size;
+#endif
 
 	if (objc == 1) {
 		Tcl_WrongNumArgs(interp, 1, objv,
@@ -398,26 +894,23 @@ TTH_Cmd(
 	if (Tcl_GetIndexFromObj(interp, objv[1], options, "option",
 			0, &i) != TCL_OK) { return TCL_ERROR; }
 
-	statePtr = (TTH_State *) clientData;
-
 	switch ((TTH_Option)i) {
 		case TTH_INIT:
-			if (objc != 2) {
-				Tcl_WrongNumArgs(interp, 2, objv, NULL);
-				return TCL_ERROR;
-			}
-			Tcl_SetObjResult(interp, TTH_CreateContext(statePtr));
+			if (Cmd_ParseInitOptions(interp, objv, objc,
+						&multi, &level) != TCL_OK) { return TCL_ERROR; }
+			Tcl_SetObjResult(interp,
+					TTH_CreateContext(interp, clientData, multi, level));
 			return TCL_OK;
 		break;
 
 		case TTH_UPDATE:
-			if (objc != 4) {
+			if (objc < 4) {
 				Tcl_WrongNumArgs(interp, 2, objv,
-						"tthContext sourceString");
+						"tthContext sourceString ?sourceString ...?");
 				return TCL_ERROR;
 			}
-			if (TTH_UpdateContext(interp, statePtr, objv[2],
-						objv[3]) != TCL_OK) { return TCL_ERROR; }
+			if (TTH_UpdateContext(interp, clientData, objv[2],
+						objc - 3, objv + 3) != TCL_OK) { return TCL_ERROR; }
 			Tcl_ResetResult(interp);
 			return TCL_OK;
 		break;
@@ -429,41 +922,157 @@ TTH_Cmd(
 				return TCL_ERROR;
 			}
 			if (Cmd_ParseDigestOptions(interp, objv, objc,
-						&dmode, &dout, &dbitlen) != TCL_OK) { return TCL_ERROR; }
+						&dmode, &dout, &dbitlen,
+						&multi, &level, &engine,
+						&profile, &engineVarPtr, &daemonPtr,
+						&bandwidth, &iops) != TCL_OK) { return TCL_ERROR; }
 			dataPtr = objv[objc - 1];
+			if (engineVarPtr != NULL && dmode != DM_FILE) {
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "option \"-enginevar\" can only"
+						" be used with -file", NULL);
+				return TCL_ERROR;
+			}
+#ifdef USE_DAEMON
+			if (daemonPtr != NULL) {
+				/*
+				 * The daemon only serves plain digests of files,
+				 * reading them under its own limits
+				 */
+				if (dmode != DM_FILE || multi || profile
+						|| bandwidth != 0 || iops != 0) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"-daemon\" can only"
+							" be used with -file and without -multi,"
+							" -level, -profile, -bandwidth or -iops", NULL);
+					return TCL_ERROR;
+				}
+				if (TTH_DigestFromDaemon(interp, daemonPtr, dataPtr,
+						digest, &size) != TCL_OK) { return TCL_ERROR; }
+				if (engineVarPtr != NULL && Tcl_ObjSetVar2(interp,
+						engineVarPtr, NULL, Tcl_NewStringObj("daemon", -1),
+						TCL_LEAVE_ERR_MSG) == NULL) { return TCL_ERROR; }
+				Tcl_SetObjResult(interp,
+						Cmd_FormatDigest(digest, dout, dbitlen));
+				return TCL_OK;
+			}
+#endif
+			if (profile && (dmode == DM_CONTEXT || dmode == DM_STRINGS)) {
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "option \"-profile\" can not be"
+						" used with -context or -strings", NULL);
+				return TCL_ERROR;
+			}
+			TTH_PROBE2(digest__start, "tth",
+					TTH_StatsModeName(statsModes[dmode]));
+			if (dmode == DM_CONTEXT) {
+				return TTH_GetDigestFromContext(interp, clientData,
+						dataPtr, multi, dout, dbitlen);
+			}
+			if (dmode == DM_STRINGS) {
+				return TTH_GetDigestsFromList(interp, clientData,
+						dataPtr, multi, level, dout, dbitlen);
+			}
+			if (dmode == DM_STRING) {
+				Tcl_GetByteArrayFromObj(dataPtr, &len);
+				TTH_StatsStart(&timer, len);
+			} else {
+				TTH_StatsStart(&timer, -1);
+			}
+			if (dmode == DM_STRING && !multi && !profile) {
+				Tcl_SetObjResult(interp,
+						TTH_GetDigestFromString(dataPtr, dout, dbitlen));
+				TTH_StatsRecord(clientData, TS_STRING, &timer,
+						len, TTH_StatsLeaves(len), 1);
+				TTH_PROBE3(digest__done, "tth",
+						TTH_StatsModeName(TS_STRING), len);
+				return TCL_OK;
+			}
+			TTH_InitContext(&context, multi, level);
+			updateProc = TTH_UpdateProc;
+			updateData = (ClientData) &context;
+			start = 0;
+			if (profile) {
+				TTH_ProfileStart(&prof, &context);
+				updateProc = TTH_ProfileUpdateProc;
+				updateData = (ClientData) &prof;
+				start = TTH_StatsClock();
+			}
+			TTH_ThrottleInit(&throttle, bandwidth, iops);
+			code = TCL_OK;
+			source = "memory";
 			switch (dmode) {
-				case DM_CONTEXT:
-					if (TTH_GetDigestFromContext(interp, statePtr, dataPtr,
-								digest) != TCL_OK) { return TCL_ERROR; }
-				break;
 				case DM_STRING:
-					TTH_GetDigestFromString(dataPtr, digest);
+					TTH_UpdateFromString(dataPtr, &context);
+				break;
+				case DM_CONCAT:
+					code = TTH_UpdateFromList(interp, dataPtr, &context);
 				break;
 				case DM_CHAN:
-					if (TTH_GetDigestFromChan(interp, dataPtr,
-								digest) != TCL_OK) { return TCL_ERROR; }
+					code = DigestUpdateFromChan(interp, dataPtr,
+							updateProc, updateData, &throttle);
+					source = "stream";
 				break;
 #ifdef USE_MMAP
 				case DM_MMAP:
-					if (TTH_GetDigestUsingMmap(interp, dataPtr,
-								digest) != TCL_OK) { return TCL_ERROR; }
+					code = TTH_UpdateUsingMmap(interp, dataPtr,
+							updateProc, updateData, &throttle);
+					source = "mmap";
 				break;
 #endif
-			}
-			switch (dout) {
-				case DO_THEX:
-					Tcl_SetObjResult(interp,
-							DigestToTHEX(digest, dbitlen));
-				break;
-				case DO_HEX:
-					Tcl_SetObjResult(interp,
-							DigestToHex(digest, dbitlen));
+				case DM_FILE:
+					code = DigestUpdateFromFile(interp, dataPtr, engine,
+							updateProc, updateData, &throttle, &used);
 				break;
-				case DO_RAW:
-					Tcl_SetObjResult(interp,
-							DigestToRaw(digest, dbitlen));
+				default:
 				break;
 			}
+			if (code != TCL_OK) {
+				TTH_FreeContext(&context);
+				return TCL_ERROR;
+			}
+			if (dmode == DM_FILE) {
+				source = engineNames[used];
+			}
+			if (profile) {
+				prof.io = TTH_StatsClock() - start;
+				if (dmode == DM_STRING || dmode == DM_CONCAT) {
+					/* The data are in memory: it was all hashing */
+					prof.hash = prof.io;
+				}
+				start = TTH_StatsClock();
+			}
+			resultPtr = TTH_FinishContext(&context, dout, dbitlen);
+			if (profile) {
+				prof.hash += TTH_StatsClock() - start;
+			}
+			TTH_StatsRecord(clientData, statsModes[dmode], &timer,
+					context.bytes, TTH_StatsLeaves(context.bytes), 1);
+			TTH_PROBE3(digest__done, "tth",
+					TTH_StatsModeName(statsModes[dmode]), context.bytes);
+			if (engineVarPtr != NULL && Tcl_ObjSetVar2(interp,
+					engineVarPtr, NULL,
+					Tcl_NewStringObj(engineNames[used], -1),
+					TCL_LEAVE_ERR_MSG) == NULL) {
+				Tcl_DecrRefCount(resultPtr);
+				return TCL_ERROR;
+			}
+			if (dmode == DM_FILE && multi) {
+				Tcl_ListObjAppendElement(NULL, resultPtr,
+						Tcl_NewStringObj("engine", -1));
+				Tcl_ListObjAppendElement(NULL, resultPtr,
+						Tcl_NewStringObj(engineNames[used], -1));
+			}
+			if (profile) {
+				if (!multi) {
+					digestPtr = resultPtr;
+					resultPtr = Tcl_NewObj();
+					Cmd_AppendPair(resultPtr, "tth", digestPtr);
+				}
+				Cmd_AppendPair(resultPtr, "profile",
+						TTH_ProfileToObj(&prof, context.bytes, source));
+			}
+			Tcl_SetObjResult(interp, resultPtr);
 			return TCL_OK;
 		break;
 	}
@@ -480,14 +1089,7 @@ TTH_CreateCmd (
 		Tcl_Interp *interp
 		)
 {
-	TTH_State *statePtr;
-
-	statePtr = (TTH_State *) ckalloc(sizeof(TTH_State));
-	Tcl_InitHashTable(&statePtr->contexts, TCL_STRING_KEYS);
-	statePtr->uid = 0;
-
 	return Tcl_CreateObjCommand(interp, "::tth::tth",
 		(Tcl_ObjCmdProc *) TTH_Cmd,
-		(ClientData) statePtr, (Tcl_CmdDeleteProc *) TTH_CleanupState);
+		TTH_StatsAcquire(interp), TTH_StatsRelease);
 }
-
@@ -0,0 +1,598 @@
+/*
+ * tclxform.c --
+ *
+ *	This file implements a stacked channel transformation
+ *	calculating TTH on the data passing through a channel.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include <tcl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "tigertree.h"
+#include "tclout.h"
+#include "tclxform.h"
+
+
+/*
+ *
+ */
+typedef enum {
+	DO_THEX,       /* -thex, default  */
+	DO_HEX,        /* -hex */
+	DO_RAW         /* -raw */
+} DIGEST_OUTPUT;
+
+/*
+ * Per-channel state of the transformation.
+ */
+typedef struct {
+	Tcl_Channel   self;       /* the transformation itself */
+	Tcl_Channel   parent;     /* the channel below us */
+	Tcl_Interp    *interp;    /* interpreter to run the callback in */
+	Tcl_Obj       *cmdPtr;    /* callback command prefix, or NULL */
+	int           direction;  /* TCL_READABLE or TCL_WRITABLE */
+	DIGEST_OUTPUT output;
+	DIGEST_BITLEN bitlen;
+	int           wantLevel;  /* whether a tree level is collected */
+	Tcl_WideInt   hashed;     /* number of bytes hashed so far */
+	TT_CONTEXT    context;
+	DIGEST_LEVEL  level;
+} TransformState;
+
+
+static int  TransformCloseProc (ClientData instanceData,
+		Tcl_Interp *interp);
+static int  TransformInputProc (ClientData instanceData,
+		char *buf, int toRead, int *errorCodePtr);
+static int  TransformOutputProc (ClientData instanceData,
+		const char *buf, int toWrite, int *errorCodePtr);
+static int  TransformGetOptionProc (ClientData instanceData,
+		Tcl_Interp *interp, const char *optionName, Tcl_DString *dsPtr);
+static int  TransformSetOptionProc (ClientData instanceData,
+		Tcl_Interp *interp, const char *optionName, const char *value);
+static void TransformWatchProc (ClientData instanceData, int mask);
+static int  TransformGetHandleProc (ClientData instanceData,
+		int direction, ClientData *handlePtr);
+static int  TransformBlockModeProc (ClientData instanceData, int mode);
+static int  TransformHandlerProc (ClientData instanceData,
+		int interestMask);
+
+static Tcl_ChannelType transformChannelType = {
+	"tth",                   /* typeName */
+	TCL_CHANNEL_VERSION_2,   /* version */
+	TransformCloseProc,      /* closeProc */
+	TransformInputProc,      /* inputProc */
+	TransformOutputProc,     /* outputProc */
+	NULL,                    /* seekProc */
+	TransformSetOptionProc,  /* setOptionProc */
+	TransformGetOptionProc,  /* getOptionProc */
+	TransformWatchProc,      /* watchProc */
+	TransformGetHandleProc,  /* getHandleProc */
+	NULL,                    /* close2Proc */
+	TransformBlockModeProc,  /* blockModeProc */
+	NULL,                    /* flushProc */
+	TransformHandlerProc,    /* handlerProc */
+	NULL,                    /* wideSeekProc */
+	NULL,                    /* threadActionProc */
+	NULL                     /* truncateProc */
+};
+
+
+/*
+ *
+ */
+static Tcl_Obj *
+Transform_FormatDigest (
+		TransformState *statePtr,
+		byte           digest[]
+		)
+{
+	switch (statePtr->output) {
+		case DO_HEX:
+			return DigestToHex(digest, statePtr->bitlen);
+		case DO_RAW:
+			return DigestToRaw(digest, statePtr->bitlen);
+		case DO_THEX:
+		default:
+			return DigestToTHEX(digest, statePtr->bitlen);
+	}
+}
+
+
+/*
+ * Finalizes the digest and passes it to the callback, if any,
+ * as a dictionary.
+ */
+static void
+Transform_Finish (
+		TransformState *statePtr
+		)
+{
+	Tcl_Interp *interp = statePtr->interp;
+	byte digest[TIGERSIZE];
+	Tcl_Obj *dictPtr, *cmdPtr;
+
+	tt_digest(&statePtr->context, digest);
+
+	if (statePtr->cmdPtr == NULL || Tcl_InterpDeleted(interp)) {
+		return;
+	}
+
+	dictPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("digest", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Transform_FormatDigest(statePtr, digest));
+	Tcl_ListObjAppendElement(NULL, dictPtr, Tcl_NewStringObj("size", -1));
+	Tcl_ListObjAppendElement(NULL, dictPtr,
+			Tcl_NewWideIntObj(statePtr->hashed));
+	if (statePtr->wantLevel) {
+		Tcl_ListObjAppendElement(NULL, dictPtr,
+				Tcl_NewStringObj("level", -1));
+		Tcl_ListObjAppendElement(NULL, dictPtr,
+				DigestLevelToObj(&statePtr->level));
+	}
+
+	cmdPtr = Tcl_DuplicateObj(statePtr->cmdPtr);
+	Tcl_IncrRefCount(cmdPtr);
+	Tcl_ListObjAppendElement(NULL, cmdPtr, dictPtr);
+
+	Tcl_Preserve((ClientData) interp);
+	if (Tcl_EvalObjEx(interp, cmdPtr, TCL_EVAL_GLOBAL) != TCL_OK) {
+		Tcl_BackgroundError(interp);
+	}
+	Tcl_Release((ClientData) interp);
+
+	Tcl_DecrRefCount(cmdPtr);
+}
+
+
+/*
+ * Called both when the transformation is popped off its channel
+ * and when the whole channel stack is closed.
+ */
+static int
+TransformCloseProc (
+		ClientData instanceData,
+		Tcl_Interp *interp
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+
+	Transform_Finish(statePtr);
+
+	DigestLevelFree(&statePtr->level);
+	if (statePtr->cmdPtr != NULL) {
+		Tcl_DecrRefCount(statePtr->cmdPtr);
+	}
+	Tcl_Release((ClientData) statePtr->interp);
+	ckfree((char *) statePtr);
+
+	return 0;
+}
+
+
+/*
+ *
+ */
+static int
+TransformInputProc (
+		ClientData instanceData,
+		char       *buf,
+		int        toRead,
+		int        *errorCodePtr
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+	int got;
+
+	got = Tcl_ReadRaw(statePtr->parent, buf, toRead);
+	if (got < 0) {
+		*errorCodePtr = Tcl_GetErrno();
+		return -1;
+	}
+	if (got == 0 && Tcl_InputBlocked(statePtr->parent)) {
+		/* Not an EOF, just no data available yet */
+		*errorCodePtr = EAGAIN;
+		return -1;
+	}
+
+	if (statePtr->direction == TCL_READABLE) {
+		tt_update(&statePtr->context, (byte *) buf, got);
+		statePtr->hashed += got;
+	}
+
+	return got;
+}
+
+
+/*
+ *
+ */
+static int
+TransformOutputProc (
+		ClientData instanceData,
+		const char *buf,
+		int        toWrite,
+		int        *errorCodePtr
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+	int written;
+
+	written = Tcl_WriteRaw(statePtr->parent, buf, toWrite);
+	if (written < 0) {
+		*errorCodePtr = Tcl_GetErrno();
+		return -1;
+	}
+
+	if (statePtr->direction == TCL_WRITABLE) {
+		tt_update(&statePtr->context, (const byte *) buf, written);
+		statePtr->hashed += written;
+	}
+
+	return written;
+}
+
+
+/*
+ * Handles the read-only options -digest and -hashed, which report
+ * the digest of the data seen so far and its length;
+ * other options are delegated to the parent channel.
+ */
+static int
+TransformGetOptionProc (
+		ClientData  instanceData,
+		Tcl_Interp  *interp,
+		const char  *optionName,
+		Tcl_DString *dsPtr
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+	Tcl_DriverGetOptionProc *getOptionProc;
+	TT_CONTEXT snapshot;
+	byte digest[TIGERSIZE];
+	Tcl_Obj *objPtr;
+	int all;
+
+	all = optionName == NULL;
+
+	if (all || strcmp(optionName, "-digest") == 0) {
+		tt_copy(&snapshot, &statePtr->context);
+		tt_digest(&snapshot, digest);
+		objPtr = Transform_FormatDigest(statePtr, digest);
+		Tcl_IncrRefCount(objPtr);
+		if (all) {
+			Tcl_DStringAppendElement(dsPtr, "-digest");
+			Tcl_DStringAppendElement(dsPtr, Tcl_GetString(objPtr));
+		} else {
+			Tcl_DStringAppend(dsPtr, Tcl_GetString(objPtr), -1);
+		}
+		Tcl_DecrRefCount(objPtr);
+		if (!all) { return TCL_OK; }
+	}
+	if (all || strcmp(optionName, "-hashed") == 0) {
+		objPtr = Tcl_NewWideIntObj(statePtr->hashed);
+		Tcl_IncrRefCount(objPtr);
+		if (all) {
+			Tcl_DStringAppendElement(dsPtr, "-hashed");
+			Tcl_DStringAppendElement(dsPtr, Tcl_GetString(objPtr));
+		} else {
+			Tcl_DStringAppend(dsPtr, Tcl_GetString(objPtr), -1);
+		}
+		Tcl_DecrRefCount(objPtr);
+		if (!all) { return TCL_OK; }
+	}
+
+	getOptionProc = Tcl_ChannelGetOptionProc(
+			Tcl_GetChannelType(statePtr->parent));
+	if (getOptionProc != NULL) {
+		return getOptionProc(Tcl_GetChannelInstanceData(statePtr->parent),
+				interp, optionName, dsPtr);
+	}
+	if (all) {
+		return TCL_OK;
+	}
+	return Tcl_BadChannelOption(interp, optionName, "digest hashed");
+}
+
+
+/*
+ *
+ */
+static int
+TransformSetOptionProc (
+		ClientData instanceData,
+		Tcl_Interp *interp,
+		const char *optionName,
+		const char *value
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+	Tcl_DriverSetOptionProc *setOptionProc;
+
+	if (strcmp(optionName, "-digest") == 0
+			|| strcmp(optionName, "-hashed") == 0) {
+		if (interp != NULL) {
+			Tcl_AppendResult(interp, "option \"", optionName,
+					"\" is read-only", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	setOptionProc = Tcl_ChannelSetOptionProc(
+			Tcl_GetChannelType(statePtr->parent));
+	if (setOptionProc != NULL) {
+		return setOptionProc(Tcl_GetChannelInstanceData(statePtr->parent),
+				interp, optionName, value);
+	}
+	return Tcl_BadChannelOption(interp, optionName, "");
+}
+
+
+/*
+ *
+ */
+static void
+TransformWatchProc (
+		ClientData instanceData,
+		int        mask
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+	Tcl_DriverWatchProc *watchProc;
+
+	watchProc = Tcl_ChannelWatchProc(Tcl_GetChannelType(statePtr->parent));
+	watchProc(Tcl_GetChannelInstanceData(statePtr->parent), mask);
+}
+
+
+/*
+ *
+ */
+static int
+TransformGetHandleProc (
+		ClientData instanceData,
+		int        direction,
+		ClientData *handlePtr
+		)
+{
+	TransformState *statePtr = (TransformState *) instanceData;
+
+	return Tcl_GetChannelHandle(statePtr->parent, direction, handlePtr);
+}
+
+
+/*
+ * Blocking mode is propagated down the stack by the generic layer.
+ */
+static int
+TransformBlockModeProc (
+		ClientData instanceData,
+		int        mode
+		)
+{
+	return 0;
+}
+
+
+/*
+ *
+ */
+static int
+TransformHandlerProc (
+		ClientData instanceData,
+		int        interestMask
+		)
+{
+	return interestMask;
+}
+
+
+/*
+ *
+ */
+static int
+Cmd_ParseTransformOptions (
+		Tcl_Interp     *interp,
+		Tcl_Obj *const objv[],
+		int            objc,
+		TransformState *statePtr
+		)
+{
+	int i, op, level;
+
+	static const char *options[] = { "-command", "-direction", "-level",
+		"-thex", "-hex", "-raw", "-192", "-160", "-128", NULL };
+	enum { OP_COMMAND, OP_DIRECTION, OP_LEVEL,
+		OP_THEX, OP_HEX, OP_RAW, OP_192, OP_160, OP_128 };
+
+	static const char *directions[] = { "read", "write", NULL };
+
+	/* Options start from index 1 and the last object is always a channel: */
+	const int first = 1;
+	int       last  = objc - 2;
+
+	for (i = first; i <= last; ++i) {
+		if (Tcl_GetIndexFromObj(interp, objv[i], options, "option",
+				0, &op) != TCL_OK) { return TCL_ERROR; }
+		switch (op) {
+			case OP_COMMAND:
+			case OP_DIRECTION:
+			case OP_LEVEL:
+				if (i == last) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "option \"",
+							Tcl_GetString(objv[i]), "\" requires an argument",
+							NULL);
+					return TCL_ERROR;
+				}
+				++i;
+			break;
+		}
+		switch (op) {
+			case OP_COMMAND:
+				if (statePtr->cmdPtr != NULL) {
+					Tcl_DecrRefCount(statePtr->cmdPtr);
+				}
+				statePtr->cmdPtr = objv[i];
+				Tcl_IncrRefCount(statePtr->cmdPtr);
+			break;
+			case OP_DIRECTION:
+				if (Tcl_GetIndexFromObj(interp, objv[i], directions,
+						"direction", 0, &op) != TCL_OK) { return TCL_ERROR; }
+				statePtr->direction = op == 0 ? TCL_READABLE : TCL_WRITABLE;
+			break;
+			case OP_LEVEL:
+				if (Tcl_GetIntFromObj(interp, objv[i],
+						&level) != TCL_OK) { return TCL_ERROR; }
+				if (level < 0 || level > 63) {
+					Tcl_ResetResult(interp);
+					Tcl_AppendResult(interp, "bad tree level \"",
+							Tcl_GetString(objv[i]),
+							"\": must be an integer from 0 to 63", NULL);
+					return TCL_ERROR;
+				}
+				statePtr->wantLevel = 1;
+				tt_set_level(&statePtr->context, level,
+						DigestLevelAppend, &statePtr->level);
+			break;
+			case OP_THEX:
+				statePtr->output = DO_THEX;
+			break;
+			case OP_HEX:
+				statePtr->output = DO_HEX;
+			break;
+			case OP_RAW:
+				statePtr->output = DO_RAW;
+			break;
+			case OP_192:
+				statePtr->bitlen = DL_192;
+			break;
+			case OP_160:
+				statePtr->bitlen = DL_160;
+			break;
+			case OP_128:
+				statePtr->bitlen = DL_128;
+			break;
+		}
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Transform_Cmd --
+ *
+ *	Implements the "::tth::transform" command which stacks
+ *	a hashing transformation onto an existing channel.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side effects:
+ *	The channel gets a new top layer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Transform_Cmd(
+	ClientData clientData,  /* unused */
+	Tcl_Interp *interp,     /* Current interpreter */
+	int objc,               /* Number of arguments */
+	Tcl_Obj *const objv[]   /* Argument strings */
+	)
+{
+	TransformState *statePtr;
+	Tcl_Channel chan;
+	int mode;
+
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?options? channel");
+		return TCL_ERROR;
+	}
+
+	chan = Tcl_GetChannel(interp, Tcl_GetString(objv[objc - 1]), &mode);
+	if (chan == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not find channel named \"",
+				Tcl_GetString(objv[objc - 1]), "\"", NULL);
+		return TCL_ERROR;
+	}
+
+	statePtr = (TransformState *) ckalloc(sizeof(TransformState));
+	statePtr->parent    = chan;
+	statePtr->interp    = interp;
+	statePtr->cmdPtr    = NULL;
+	statePtr->direction = (mode & TCL_READABLE) ? TCL_READABLE : TCL_WRITABLE;
+	statePtr->output    = DO_THEX;
+	statePtr->bitlen    = DL_192;
+	statePtr->wantLevel = 0;
+	statePtr->hashed    = 0;
+	tt_init(&statePtr->context);
+	DigestLevelInit(&statePtr->level);
+
+	if (Cmd_ParseTransformOptions(interp, objv, objc,
+				statePtr) != TCL_OK) {
+		if (statePtr->cmdPtr != NULL) {
+			Tcl_DecrRefCount(statePtr->cmdPtr);
+		}
+		ckfree((char *) statePtr);
+		return TCL_ERROR;
+	}
+
+	if ((mode & statePtr->direction) == 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "channel \"", Tcl_GetString(objv[objc - 1]),
+				"\" is not opened for ",
+				statePtr->direction == TCL_READABLE ? "reading" : "writing",
+				NULL);
+		if (statePtr->cmdPtr != NULL) {
+			Tcl_DecrRefCount(statePtr->cmdPtr);
+		}
+		ckfree((char *) statePtr);
+		return TCL_ERROR;
+	}
+
+	Tcl_Preserve((ClientData) interp);
+	statePtr->self = Tcl_StackChannel(interp, &transformChannelType,
+			(ClientData) statePtr, mode, chan);
+	if (statePtr->self == NULL) {
+		Tcl_Release((ClientData) interp);
+		if (statePtr->cmdPtr != NULL) {
+			Tcl_DecrRefCount(statePtr->cmdPtr);
+		}
+		ckfree((char *) statePtr);
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp,
+			Tcl_NewStringObj(Tcl_GetChannelName(statePtr->self), -1));
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+Tcl_Command
+Transform_CreateCmd (
+		Tcl_Interp *interp
+		)
+{
+	return Tcl_CreateObjCommand(interp, "::tth::transform",
+		(Tcl_ObjCmdProc *) Transform_Cmd,
+		(ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+}
@@ -0,0 +1,26 @@
+/*
+ * tclxform.h --
+ *
+ *	This file implements a stacked channel transformation
+ *	calculating TTH on the data passing through a channel.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __TCLXFORM_H
+#define __TCLXFORM_H
+
+#include <tcl.h>
+
+Tcl_Command
+Transform_CreateCmd (
+		Tcl_Interp *interp
+		);
+
+#endif /* __TCLXFORM_H */
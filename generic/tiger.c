@@ -2,6 +2,7 @@
  * $Id$
  */
 
+#include <string.h>
 #include "tiger.h"
 #include "sboxes.h"
 
@@ -23,6 +24,12 @@
 /* Must be at least three.                             */
 #define PASSES 3
 
+#ifdef OPTIMIZE_FOR_ALPHA
+const char tiger_kernel[] = "c-alpha";
+#else
+const char tiger_kernel[] = "c";
+#endif
+
 #define t1 (table)
 #define t2 (table+256)
 #define t3 (table+256*2)
@@ -202,6 +209,99 @@ void tiger(word64 *str, word64 length, word64 res[3])
   tiger_compress(((word64*)temp), res);
 }
 
+/* Streaming interface: the same hash as computed by tiger()
+ * on the concatenation of all the data passed to tiger_update(),
+ * using a constant amount of memory. */
+
+void tiger_init(TIGER_CONTEXT *ctx)
+{
+  ctx->state[0]=LL(0x0123456789ABCDEF);
+  ctx->state[1]=LL(0xFEDCBA9876543210);
+  ctx->state[2]=LL(0xF096A5B4C3B2E187);
+  ctx->length=0;
+}
+
+static void tiger_block(TIGER_CONTEXT *ctx, const byte *block)
+{
+#ifdef BIG_ENDIAN
+  unsigned char temp[64];
+  int j;
+
+  for(j=0; j<64; j++)
+    temp[j^7] = block[j];
+  tiger_compress(((word64*)temp), ctx->state);
+#else
+  tiger_compress(((word64*)block), ctx->state);
+#endif
+}
+
+void tiger_update(TIGER_CONTEXT *ctx, const byte *data, word64 len)
+{
+  unsigned carry = (unsigned) (ctx->length & 63);
+  unsigned left;
+
+  ctx->length += len;
+
+  if (carry)
+    {
+      /* Try to complete the carried block */
+      left = 64 - carry;
+      if (len < left)
+        {
+          memcpy(ctx->buffer + carry, data, (size_t) len);
+          return;
+        }
+      memcpy(ctx->buffer + carry, data, left);
+      tiger_block(ctx, ctx->buffer);
+      data += left;
+      len -= left;
+    }
+
+  for(; len >= 64; len -= 64, data += 64)
+    tiger_block(ctx, data);
+
+  if (len)
+    memcpy(ctx->buffer, data, (size_t) len);
+}
+
+void tiger_final(TIGER_CONTEXT *ctx, word64 res[3])
+{
+  unsigned char *temp = ctx->buffer;
+  word64 j = ctx->length & 63;
+
+#ifdef BIG_ENDIAN
+  unsigned char block[64];
+
+  for(j=0; j<(ctx->length & 63); j++)
+    block[j^7] = temp[j];
+  temp = block;
+  temp[j^7] = 0x01;
+  j++;
+  for(; j&7; j++)
+    temp[j^7] = 0;
+#else
+  temp[j++] = 0x01;
+  for(; j&7; j++)
+    temp[j] = 0;
+#endif
+  if(j>56)
+    {
+      for(; j<64; j++)
+	temp[j] = 0;
+      tiger_compress(((word64*)temp), ctx->state);
+      j=0;
+    }
+
+  for(; j<56; j++)
+    temp[j] = 0;
+  ((word64*)(&(temp[56])))[0] = ctx->length<<3;
+  tiger_compress(((word64*)temp), ctx->state);
+
+  res[0] = ctx->state[0];
+  res[1] = ctx->state[1];
+  res[2] = ctx->state[2];
+}
+
 /* Implementation copied without change from the
  * original tigertree.c where it was called
  * tt_endian().
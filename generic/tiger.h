@@ -39,6 +39,22 @@ typedef unsigned char byte;
 
 void tiger(word64 *str, word64 length, word64 res[3]);
 
+/* name of the implementation of the compression function compiled in */
+extern const char tiger_kernel[];
+
+/* State of an incremental Tiger Hash calculation;
+ * tiger_final() produces the same result as tiger() would
+ * on all the data passed to tiger_update() */
+typedef struct tiger_context {
+  word64 state[3];              /* intermediate hash value */
+  word64 length;                /* total bytes hashed */
+  unsigned char buffer[64];     /* carry of an incomplete 64-byte block */
+} TIGER_CONTEXT;
+
+void tiger_init(TIGER_CONTEXT *ctx);
+void tiger_update(TIGER_CONTEXT *ctx, const byte *data, word64 len);
+void tiger_final(TIGER_CONTEXT *ctx, word64 res[3]);
+
 /* Endianness of the three wide ints produced by tiger()
  * is platform-dependent, but in Tcl extension we want
  * to produce results irrelevant to the platform's endianness
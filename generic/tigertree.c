@@ -20,17 +20,17 @@
  *    (1) allocate a TT_CONTEXT in your own code;
  *    (2) tt_init(ttctx);
  *    (3) tt_update(ttctx, buffer, length); as many times as necessary
+ *        (or tt_updatev(ttctx, iov, iovcnt); for scattered data)
  *    (4) tt_digest(ttctx,resultptr);
+ *    (5) or tt_free(ttctx); to abandon the context before (4)
  *
  * NOTE: The TigerTree hash value cannot be calculated using a
  * constant amount of memory; rather, the memory required grows
  * with the (binary log of the) size of input. (Roughly, one more 
  * interim value must be remembered for each doubling of the 
- * input size.) This code reserves a counter and stack for input 
- * up to about 2^72 bytes in length. PASSING IN LONGER INPUT WILL 
- * LEAD TO A BUFFER OVERRUN AND UNDEFINED RESULTS. Of course,
- * that would be over 4.7 trillion gigabytes of data, so problems
- * are unlikely in practice anytime soon. :)
+ * input size.) The stack of interim values is allocated on demand
+ * and grows as needed, as does the state of an incomplete leaf,
+ * so tt_digest() or tt_free() must be called to release them.
  *
  * Requires the tiger() function as defined in the reference
  * implementation provided by the creators of the Tiger
@@ -42,61 +42,209 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "tigertree.h"
 
+/* Fails to compile if the context of a 64-bit build grows past
+ * 72 bytes (see tigertree.h) */
+typedef char tt_context_size_check
+  [(sizeof(void *) != 8 || sizeof(TT_CONTEXT) <= 72) ? 1 : -1];
+
+static void *tt_default_alloc(size_t size)
+{
+  void *ptr = malloc(size);
+  if (ptr == NULL)
+    abort();
+  return ptr;
+}
+
+static void tt_default_free(void *ptr, size_t size)
+{
+  free(ptr);
+}
+
+static tt_alloc_proc *tt_alloc = tt_default_alloc;
+static tt_free_proc *tt_release = tt_default_free;
+
+/* Use the given procedures to allocate and free the memory of all
+ * contexts; should be called before any context is created.
+ * allocProc must not return NULL. */
+void tt_set_allocator(tt_alloc_proc *allocProc, tt_free_proc *freeProc)
+{
+  tt_alloc = allocProc;
+  tt_release = freeProc;
+}
+
+/* the allocator of the given context */
+#define TT_ALLOC(ctx, size) \
+  ((ctx)->heap ? tt_default_alloc(size) : tt_alloc(size))
+#define TT_RELEASE(ctx, ptr, size) \
+  ((ctx)->heap ? tt_default_free((ptr), (size)) : tt_release((ptr), (size)))
+
 /* Initialize the tigertree context */
 void tt_init(TT_CONTEXT *ctx)
 {
   ctx->count = 0;
-  ctx->leaf[0] = 0; // flag for leaf  calculation -- never changed
-  ctx->node[0] = 1; // flag for inner node calculation -- never changed
-  ctx->block = ctx->leaf + 1 ; // working area for blocks
-  ctx->index = 0;   // partial block pointer/block length
-  ctx->top = ctx->nodes;
+  ctx->leaf = NULL;
+  ctx->nodes = NULL;
+  ctx->depth = 0;
+  ctx->room = 0;
+  ctx->level = 0;
+  ctx->heap = 0;
+  ctx->levelProc = NULL;
+  ctx->levelData = NULL;
+  ctx->flat = NULL;
+  ctx->profile = NULL;
+}
+
+/* Release the memory held by the context; it must be
+ * initialized again to be used after that */
+void tt_free(TT_CONTEXT *ctx)
+{
+  if (ctx->leaf != NULL) {
+    TT_RELEASE(ctx, ctx->leaf, sizeof(TIGER_CONTEXT));
+    ctx->leaf = NULL;
+  }
+  if (ctx->nodes != NULL) {
+    TT_RELEASE(ctx, ctx->nodes, ctx->room * TIGERSIZE);
+    ctx->nodes = NULL;
+  }
+  ctx->depth = 0;
+  ctx->room = 0;
+}
+
+/* Make the context allocate its memory with malloc() rather than
+ * with the procedures set by tt_set_allocator(), so it may be
+ * handed from one thread to another; must be called right
+ * after tt_init(). */
+void tt_set_heap(TT_CONTEXT *ctx)
+{
+  ctx->heap = 1;
+}
+
+/* Arrange for the nodes of the given tree level to be passed
+ * to proc as they are completed. The last node of the level,
+ * which may cover less than 2^level blocks, is passed by tt_digest. */
+void tt_set_level(TT_CONTEXT *ctx, int level,
+		tt_level_proc *proc, void *clientData)
+{
+  ctx->level = level;
+  ctx->levelProc = proc;
+  ctx->levelData = clientData;
+}
+
+/* Arrange for all the data passed to tt_update() to also be
+ * passed to tiger_update() on the given Tiger context, so the flat
+ * Tiger Hash of the data is calculated in the same pass. */
+void tt_set_flat(TT_CONTEXT *ctx, TIGER_CONTEXT *flat)
+{
+  ctx->flat = flat;
+}
+
+/* Arrange for the time spent composing inner nodes to be added
+ * to profile->compose; the clock is read once per run of
+ * compositions, not per node. */
+void tt_set_profile(TT_CONTEXT *ctx, TT_PROFILE *profile)
+{
+  ctx->profile = profile;
 }
 
+#define TT_TOP(ctx) ((ctx)->nodes + ((ctx)->depth - 1) * TIGERSIZE)
+
 static void tt_compose(TT_CONTEXT *ctx) {
-  byte *node = ctx->top - NODESIZE;
-  memmove((ctx->node)+1,node,NODESIZE); // copy to scratch area
-  tiger((word64*)(ctx->node),(word64)(NODESIZE+1),(word64*)(ctx->top)); // combine two nodes
-  tiger_to_canonical((byte *)ctx->top);
-  memmove(node,ctx->top,TIGERSIZE);           // move up result
-  ctx->top -= TIGERSIZE;                      // update top ptr
+  word64 scratch[(1+NODESIZE+7)/8];           // node scratch space
+  byte *node = ctx->nodes + (ctx->depth - 2) * TIGERSIZE;
+
+  ((byte *)scratch)[0] = 1; // flag for inner node calculation
+  memcpy((byte *)scratch + 1, node, NODESIZE);  // copy to scratch area
+  tiger(scratch, (word64)(NODESIZE+1), (word64*)node); // combine two nodes
+  tiger_to_canonical(node);
+  --ctx->depth;                               // update top
 }
 
-static void tt_block(TT_CONTEXT *ctx)
+/* push the hash of a completed block */
+static void tt_push(TT_CONTEXT *ctx, const byte *hash)
 {
-  word64 b;
+  word64 b, start = 0;
+  int height = 0;
+  unsigned int room;
+  unsigned char *nodes;
+
+  if (ctx->depth == ctx->room) {
+    room = ctx->room ? 2 * ctx->room : STACKROOM;
+    nodes = (unsigned char *) TT_ALLOC(ctx, room * TIGERSIZE);
+    if (ctx->nodes != NULL) {
+      memcpy(nodes, ctx->nodes, ctx->depth * TIGERSIZE);
+      TT_RELEASE(ctx, ctx->nodes, ctx->room * TIGERSIZE);
+    }
+    ctx->nodes = nodes;
+    ctx->room = room;
+  }
 
-  tiger((word64*)ctx->leaf,(word64)ctx->index+1,(word64*)ctx->top);
-  tiger_to_canonical((byte *)ctx->top);
-  ctx->top += TIGERSIZE;
+  memcpy(ctx->nodes + ctx->depth * TIGERSIZE, hash, TIGERSIZE);
+  ++ctx->depth;
   ++ctx->count;
+  if (ctx->levelProc != NULL && ctx->level == 0)
+    ctx->levelProc(ctx->levelData, TT_TOP(ctx));
   b = ctx->count;
+  if ((b & 1) == 0 && ctx->profile != NULL)
+    start = ctx->profile->clock();
   while(b == ((b >> 1)<<1)) { // while evenly divisible by 2...
     tt_compose(ctx);
     b = b >> 1;
+    if (ctx->levelProc != NULL && ++height == ctx->level)
+      ctx->levelProc(ctx->levelData, TT_TOP(ctx));
   }
+  if ((ctx->count & 1) == 0 && ctx->profile != NULL)
+    ctx->profile->compose += ctx->profile->clock() - start;
+}
+
+/* hash a complete block of data in one go */
+static void tt_block(TT_CONTEXT *ctx, const byte *buffer, word32 len)
+{
+  word64 leaf[(1+BLOCKSIZE+7)/8];
+  word64 hash[3];
+
+  ((byte *)leaf)[0] = 0; // flag for leaf calculation
+  if (len)
+    memcpy((byte *)leaf + 1, buffer, len);
+  tiger(leaf, (word64)len+1, hash);
+  tiger_to_canonical((byte *)hash);
+  tt_push(ctx, (byte *)hash);
+}
+
+/* complete the leaf in progress */
+static void tt_leaf_done(TT_CONTEXT *ctx)
+{
+  word64 hash[3];
+
+  tiger_final(ctx->leaf, hash);
+  tiger_to_canonical((byte *)hash);
+  TT_RELEASE(ctx, ctx->leaf, sizeof(TIGER_CONTEXT));
+  ctx->leaf = NULL;
+  tt_push(ctx, (byte *)hash);
 }
 
 void tt_update(TT_CONTEXT *ctx, const byte *buffer, word32 len)
 {
+  static const byte leafFlag = 0;
+
+  if (ctx->flat != NULL)
+    tiger_update(ctx->flat, buffer, len);
 
-  if (ctx->index)
+  if (ctx->leaf != NULL)
   { /* Try to fill partial block */
-	  unsigned left = BLOCKSIZE - ctx->index;
+	  unsigned left = BLOCKSIZE - (unsigned) (ctx->leaf->length - 1);
 	  if (len < left)
 		{
-		memcpy(ctx->block + ctx->index, buffer, len);
-		ctx->index += len;
+		tiger_update(ctx->leaf, buffer, len);
 		return; /* Finished */
 		}
 	  else
 		{
-		memcpy(ctx->block + ctx->index, buffer, left);
-		ctx->index = BLOCKSIZE;
-		tt_block(ctx);
+		tiger_update(ctx->leaf, buffer, left);
+		tt_leaf_done(ctx);
 		buffer += left;
 		len -= left;
 		}
@@ -104,47 +252,116 @@ void tt_update(TT_CONTEXT *ctx, const byte *buffer, word32 len)
 
   while (len >= BLOCKSIZE)
 	{
-	memcpy(ctx->block, buffer, BLOCKSIZE);
-	ctx->index = BLOCKSIZE;
-	tt_block(ctx);
+	tt_block(ctx, buffer, BLOCKSIZE);
 	buffer += BLOCKSIZE;
 	len -= BLOCKSIZE;
 	}
-  if ((ctx->index = len))     /* This assignment is intended */
+  if (len)
 	{
-	/* Buffer leftovers */
-	memcpy(ctx->block, buffer, len);
+	/* Start a leaf with the leftovers */
+	ctx->leaf = (TIGER_CONTEXT *) TT_ALLOC(ctx, sizeof(TIGER_CONTEXT));
+	tiger_init(ctx->leaf);
+	tiger_update(ctx->leaf, &leafFlag, 1);
+	tiger_update(ctx->leaf, buffer, len);
 	}
 }
 
+// same as calling tt_update() on each fragment in turn: the data is
+// hashed as the concatenation of the fragments, leaves spanning
+// fragment boundaries being assembled in the context
+void tt_updatev(TT_CONTEXT *ctx, const TT_IOVEC *iov, int iovcnt)
+{
+  int i;
+
+  for (i = 0; i < iovcnt; ++i) {
+    if (iov[i].len > 0)
+      tt_update(ctx, iov[i].base, iov[i].len);
+  }
+}
+
 // no need to call this directly; tt_digest calls it for you
 static void tt_final(TT_CONTEXT *ctx)
 {
-  // do last partial block, unless index is 1 (empty leaf)
-  // AND we're past the first block
-  if((ctx->index>0)||(ctx->top==ctx->nodes))
-    tt_block(ctx);
+  // do last partial block, or the empty leaf
+  // if there were no blocks at all
+  if (ctx->leaf != NULL)
+    tt_leaf_done(ctx);
+  else if (ctx->count == 0)
+    tt_block(ctx, NULL, 0);
 }
 
+// pass the node covering the trailing incomplete group of blocks
+// (if any) to the level receiver
+static void tt_final_level(TT_CONTEXT *ctx)
+{
+  word64 rest;
+
+  if (ctx->levelProc == NULL || ctx->level == 0 || ctx->level > 63)
+    return;
+  // one stack entry per bit set in count: those below the level
+  // make up the incomplete subtree on top of the stack
+  rest = ctx->count & ((((word64)1) << ctx->level) - 1);
+  if (rest == 0)
+    return;
+  while ((rest &= rest - 1) != 0)
+    tt_compose(ctx);
+  ctx->levelProc(ctx->levelData, TT_TOP(ctx));
+}
+
+// the context is freed afterwards
 void tt_digest(TT_CONTEXT *ctx, byte *s)
 {
+  word64 start = 0;
+
   tt_final(ctx);
-  while( (ctx->top-TIGERSIZE) > ctx->nodes ) {
+  if (ctx->profile != NULL)
+    start = ctx->profile->clock();
+  tt_final_level(ctx);
+  while (ctx->depth > 1) {
     tt_compose(ctx);
   }
+  if (ctx->profile != NULL)
+    ctx->profile->compose += ctx->profile->clock() - start;
   memcpy(s,ctx->nodes,TIGERSIZE);
+  tt_free(ctx);
 }
 
-// this code untested; use at own risk
-void tt_copy(TT_CONTEXT *dest, TT_CONTEXT *src)
+// one-shot digest of a message; a message fitting in a single block
+// is its own leaf and so is hashed directly, without setting up a context
+void tt_hash(const byte *buffer, word32 len, byte *s)
 {
-  int i;
-  dest->count = src->count;
-  for(i=0; i < BLOCKSIZE; i++)
-    dest->block[i] = src->block[i];
-  dest->index = src->index;
-  for(i=0; i < STACKSIZE; i++)
-    dest->nodes[i] = src->nodes[i];
-  dest->top = src->top;
+  TT_CONTEXT ctx;
+  word64 leaf[(1+BLOCKSIZE+7)/8];
+
+  if (len <= BLOCKSIZE) {
+    ((byte *)leaf)[0] = 0;
+    if (len)
+      memcpy((byte *)leaf + 1, buffer, len);
+    tiger(leaf, (word64)len+1, (word64*)s);
+    tiger_to_canonical(s);
+    return;
+  }
+
+  tt_init(&ctx);
+  tt_update(&ctx, buffer, len);
+  tt_digest(&ctx, s);
 }
 
+// the copy does not inherit the level receiver, flat Tiger and profile of src,
+// but does allocate its memory the way src does
+void tt_copy(TT_CONTEXT *dest, TT_CONTEXT *src)
+{
+  memcpy(dest, src, sizeof(TT_CONTEXT));
+  if (src->leaf != NULL) {
+    dest->leaf = (TIGER_CONTEXT *) TT_ALLOC(src, sizeof(TIGER_CONTEXT));
+    memcpy(dest->leaf, src->leaf, sizeof(TIGER_CONTEXT));
+  }
+  if (src->nodes != NULL) {
+    dest->nodes = (unsigned char *) TT_ALLOC(src, src->room * TIGERSIZE);
+    memcpy(dest->nodes, src->nodes, src->depth * TIGERSIZE);
+  }
+  dest->levelProc = NULL;
+  dest->levelData = NULL;
+  dest->flat = NULL;
+  dest->profile = NULL;
+}
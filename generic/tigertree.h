@@ -14,6 +14,11 @@
  *
  * $Id$
  */
+
+#ifndef __TIGERTREE_H
+#define __TIGERTREE_H
+
+#include <stddef.h>
 #include "tiger.h"
 
 /* size of each block independently tiger-hashed, not counting leaf 0x00 prefix */
@@ -22,23 +27,65 @@
 /* size of input to each non-leaf hash-tree node, not counting node 0x01 prefix */
 #define NODESIZE (TIGERSIZE*2)
 
-/* default size of interim values stack, in TIGERSIZE
- * blocks. If this overflows (as it will for input
- * longer than 2^64 in size), havoc may ensue. */
-#define STACKSIZE TIGERSIZE*56
+/* initial size of interim values stack, in TIGERSIZE
+ * blocks; the stack is allocated with the first completed
+ * block and then grows by doubling as needed */
+#define STACKROOM 4
+
+/* procedure receiving, in left-to-right order, the nodes of one level
+ * of the hash tree as they are completed; level 0 are the leaf hashes,
+ * level n nodes cover 2^n blocks */
+typedef void (tt_level_proc)(void *clientData, const byte *node);
 
+/* allocator used for the partial leaf and the node stack,
+ * see tt_set_allocator(); free gets the size of the freed block */
+typedef void *(tt_alloc_proc)(size_t size);
+typedef void (tt_free_proc)(void *ptr, size_t size);
+
+/* A context only holds what is actually needed: the partial leaf is
+ * hashed on the fly and exists only while a leaf is incomplete,
+ * the node stack holds one node per set bit of the block count.
+ * The context itself is 72 bytes on 64-bit systems (checked in
+ * tigertree.c), so it fits the small size classes of pool allocators. */
 typedef struct tt_context {
   word64 count;                   /* total blocks processed */
-  unsigned char leaf[1+BLOCKSIZE]; /* leaf in progress */
-  unsigned char *block;            /* leaf data */
-  unsigned char node[1+NODESIZE]; /* node scratch space */
-  int index;                      /* index into block */
-  unsigned char *top;             /* top (next empty) stack slot */
-  unsigned char nodes[STACKSIZE]; /* stack of interim node values */
+  TIGER_CONTEXT *leaf;            /* leaf in progress, or NULL */
+  unsigned char *nodes;           /* stack of interim node values, or NULL */
+  unsigned int depth;             /* nodes on the stack */
+  unsigned int room;              /* capacity of the stack, in nodes */
+  int level;                      /* tree level reported to levelProc */
+  int heap;                       /* see tt_set_heap() */
+  tt_level_proc *levelProc;       /* receiver of level nodes, or NULL */
+  void *levelData;                /* client data for levelProc */
+  TIGER_CONTEXT *flat;            /* flat Tiger fed the same data, or NULL */
+  struct tt_profile *profile;     /* see tt_set_profile(), or NULL */
 } TT_CONTEXT;
 
+/* accounting of the time spent composing inner nodes;
+ * clock is any monotonic clock, compose accumulates its ticks */
+typedef struct tt_profile {
+  word64 (*clock)(void);
+  word64 compose;
+} TT_PROFILE;
+
+/* one fragment of the data passed to tt_updatev() */
+typedef struct tt_iovec {
+  const byte *base;               /* start of the fragment */
+  word32 len;                     /* its length, in bytes */
+} TT_IOVEC;
+
 void tt_init(TT_CONTEXT *ctx);
 void tt_update(TT_CONTEXT *ctx, const byte *buffer, word32 len);
+void tt_updatev(TT_CONTEXT *ctx, const TT_IOVEC *iov, int iovcnt);
 void tt_digest(TT_CONTEXT *ctx, byte *hash);
+void tt_free(TT_CONTEXT *ctx);
 void tt_copy(TT_CONTEXT *dest, TT_CONTEXT *src);
+void tt_hash(const byte *buffer, word32 len, byte *hash);
+void tt_set_level(TT_CONTEXT *ctx, int level,
+		tt_level_proc *proc, void *clientData);
+void tt_set_flat(TT_CONTEXT *ctx, TIGER_CONTEXT *flat);
+void tt_set_profile(TT_CONTEXT *ctx, TT_PROFILE *profile);
+void tt_set_allocator(tt_alloc_proc *allocProc, tt_free_proc *freeProc);
+void tt_set_heap(TT_CONTEXT *ctx);
 
+#endif /* __TIGERTREE_H */
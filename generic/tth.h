@@ -0,0 +1,93 @@
+/*
+ * tth.h --
+ *
+ *	Public C interface of the "tth" package, exported to other
+ *	extensions through a stubs table.
+ *
+ *	A native caller is built with -DUSE_TTH_STUBS, links against
+ *	the tthstub library and calls Tth_InitStubs() from its own
+ *	*_Init() procedure (after Tcl_InitStubs()):
+ *
+ *		if (Tth_InitStubs(interp, "0.1", 0) == NULL) {
+ *			return TCL_ERROR;
+ *		}
+ *
+ *	All digests are TTH_DIGESTSIZE bytes long, in the canonical
+ *	(big-endian) byte order used by the Tcl commands.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+#ifndef __TTH_H
+#define __TTH_H
+
+#include <tcl.h>
+
+#ifdef BUILD_tth
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLEXPORT
+#endif /* BUILD_tth */
+
+#define TTH_VERSION "0.1"
+
+/*
+ * Size of a Tiger or TTH digest, and of its base32 representation
+ * including the terminating null byte.
+ */
+#define TTH_DIGESTSIZE  24
+#define TTH_BASE32SIZE  40
+
+/*
+ * Contexts of streaming Tiger and TTH calculations. They are
+ * created by Tth_TigerInit() and Tth_TreeInit() and freed when
+ * their digest is taken (or by Tth_TreeFree()); a context must not
+ * be used by several threads at once, but may be handed from one
+ * thread to another.
+ */
+typedef struct Tth_TigerContext_ Tth_TigerContext;
+typedef struct Tth_TreeContext_  Tth_TreeContext;
+
+/*
+ * Receiver of the nodes of one level of a hash tree (see
+ * Tth_TreeSetLevel()); it is called with each node, left to right,
+ * as soon as the node is known.
+ */
+typedef void (Tth_LevelProc) (
+		ClientData          clientData,
+		const unsigned char *node
+		);
+
+/*
+ * Ways of reading a file being hashed (the -engine option
+ * of [tth digest -file]).
+ */
+typedef enum {
+	TTH_ENGINE_AUTO,
+	TTH_ENGINE_MMAP,
+	TTH_ENGINE_READ,
+	TTH_ENGINE_STREAM
+} Tth_FileEngine;
+
+#include "tthDecls.h"
+
+#ifdef USE_TTH_STUBS
+const char *
+Tth_InitStubs (
+		Tcl_Interp *interp,
+		const char *version,
+		int        exact
+		);
+#else
+#define Tth_InitStubs(interp, version, exact) \
+	Tcl_PkgRequire(interp, "tth", version, exact)
+#endif
+
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLIMPORT
+
+#endif /* __TTH_H */
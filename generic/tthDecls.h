@@ -0,0 +1,223 @@
+/*
+ * tthDecls.h --
+ *
+ *	Declarations of functions in the platform independent public
+ *	tth API, and the stubs table through which they are exported.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef _TTHDECLS
+#define _TTHDECLS
+
+/*
+ * WARNING: This file is automatically generated by the tools/genStubs.tcl
+ * script of the Tcl distribution from generic/tth.decls. Any modifications
+ * to the function declarations below should be made in that file.
+ */
+
+/* !BEGIN!: Do not edit below this line. */
+
+/*
+ * Exported function declarations:
+ */
+
+#ifndef Tth_Tiger_TCL_DECLARED
+#define Tth_Tiger_TCL_DECLARED
+/* 0 */
+EXTERN void		Tth_Tiger(const unsigned char *bytes, Tcl_WideUInt len,
+				unsigned char *digest);
+#endif
+#ifndef Tth_TigerInit_TCL_DECLARED
+#define Tth_TigerInit_TCL_DECLARED
+/* 1 */
+EXTERN Tth_TigerContext *	Tth_TigerInit(void);
+#endif
+#ifndef Tth_TigerUpdate_TCL_DECLARED
+#define Tth_TigerUpdate_TCL_DECLARED
+/* 2 */
+EXTERN void		Tth_TigerUpdate(Tth_TigerContext *ctxPtr,
+				const unsigned char *bytes, Tcl_WideUInt len);
+#endif
+#ifndef Tth_TigerDigest_TCL_DECLARED
+#define Tth_TigerDigest_TCL_DECLARED
+/* 3 */
+EXTERN void		Tth_TigerDigest(Tth_TigerContext *ctxPtr,
+				unsigned char *digest);
+#endif
+#ifndef Tth_TreeInit_TCL_DECLARED
+#define Tth_TreeInit_TCL_DECLARED
+/* 4 */
+EXTERN Tth_TreeContext *	Tth_TreeInit(void);
+#endif
+#ifndef Tth_TreeSetLevel_TCL_DECLARED
+#define Tth_TreeSetLevel_TCL_DECLARED
+/* 5 */
+EXTERN void		Tth_TreeSetLevel(Tth_TreeContext *ctxPtr, int level,
+				Tth_LevelProc *proc, ClientData clientData);
+#endif
+#ifndef Tth_TreeUpdate_TCL_DECLARED
+#define Tth_TreeUpdate_TCL_DECLARED
+/* 6 */
+EXTERN void		Tth_TreeUpdate(Tth_TreeContext *ctxPtr,
+				const unsigned char *bytes, Tcl_WideUInt len);
+#endif
+#ifndef Tth_TreeDigest_TCL_DECLARED
+#define Tth_TreeDigest_TCL_DECLARED
+/* 7 */
+EXTERN void		Tth_TreeDigest(Tth_TreeContext *ctxPtr,
+				unsigned char *digest);
+#endif
+#ifndef Tth_TreeFree_TCL_DECLARED
+#define Tth_TreeFree_TCL_DECLARED
+/* 8 */
+EXTERN void		Tth_TreeFree(Tth_TreeContext *ctxPtr);
+#endif
+#ifndef Tth_TreeHash_TCL_DECLARED
+#define Tth_TreeHash_TCL_DECLARED
+/* 9 */
+EXTERN void		Tth_TreeHash(const unsigned char *bytes, Tcl_WideUInt len,
+				unsigned char *digest);
+#endif
+#ifndef Tth_TreeHashBatch_TCL_DECLARED
+#define Tth_TreeHashBatch_TCL_DECLARED
+/* 10 */
+EXTERN void		Tth_TreeHashBatch(int count,
+				const unsigned char *const *bytesv, const Tcl_WideUInt *lenv,
+				unsigned char *digests);
+#endif
+#ifndef Tth_TreeHashFile_TCL_DECLARED
+#define Tth_TreeHashFile_TCL_DECLARED
+/* 11 */
+EXTERN int		Tth_TreeHashFile(Tcl_Interp *interp, const char *fileName,
+				Tth_FileEngine engine, unsigned char *digest,
+				Tth_FileEngine *usedPtr);
+#endif
+#ifndef Tth_TreeHashChannel_TCL_DECLARED
+#define Tth_TreeHashChannel_TCL_DECLARED
+/* 12 */
+EXTERN int		Tth_TreeHashChannel(Tcl_Interp *interp, Tcl_Channel chan,
+				unsigned char *digest);
+#endif
+#ifndef Tth_DigestToBase32_TCL_DECLARED
+#define Tth_DigestToBase32_TCL_DECLARED
+/* 13 */
+EXTERN char *	Tth_DigestToBase32(const unsigned char *digest,
+				char *buffer);
+#endif
+
+typedef struct TthStubs {
+    int magic;
+    struct TthStubHooks *hooks;
+
+    void (*tth_Tiger) (const unsigned char *bytes, Tcl_WideUInt len,
+		unsigned char *digest); /* 0 */
+    Tth_TigerContext * (*tth_TigerInit) (void); /* 1 */
+    void (*tth_TigerUpdate) (Tth_TigerContext *ctxPtr,
+		const unsigned char *bytes, Tcl_WideUInt len); /* 2 */
+    void (*tth_TigerDigest) (Tth_TigerContext *ctxPtr,
+		unsigned char *digest); /* 3 */
+    Tth_TreeContext * (*tth_TreeInit) (void); /* 4 */
+    void (*tth_TreeSetLevel) (Tth_TreeContext *ctxPtr, int level,
+		Tth_LevelProc *proc, ClientData clientData); /* 5 */
+    void (*tth_TreeUpdate) (Tth_TreeContext *ctxPtr,
+		const unsigned char *bytes, Tcl_WideUInt len); /* 6 */
+    void (*tth_TreeDigest) (Tth_TreeContext *ctxPtr,
+		unsigned char *digest); /* 7 */
+    void (*tth_TreeFree) (Tth_TreeContext *ctxPtr); /* 8 */
+    void (*tth_TreeHash) (const unsigned char *bytes, Tcl_WideUInt len,
+		unsigned char *digest); /* 9 */
+    void (*tth_TreeHashBatch) (int count,
+		const unsigned char *const *bytesv, const Tcl_WideUInt *lenv,
+		unsigned char *digests); /* 10 */
+    int (*tth_TreeHashFile) (Tcl_Interp *interp, const char *fileName,
+		Tth_FileEngine engine, unsigned char *digest,
+		Tth_FileEngine *usedPtr); /* 11 */
+    int (*tth_TreeHashChannel) (Tcl_Interp *interp, Tcl_Channel chan,
+		unsigned char *digest); /* 12 */
+    char * (*tth_DigestToBase32) (const unsigned char *digest,
+		char *buffer); /* 13 */
+} TthStubs;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern TthStubs *tthStubsPtr;
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(USE_TTH_STUBS) && !defined(USE_TTH_STUB_PROCS)
+
+/*
+ * Inline function declarations:
+ */
+
+#ifndef Tth_Tiger
+#define Tth_Tiger \
+	(tthStubsPtr->tth_Tiger) /* 0 */
+#endif
+#ifndef Tth_TigerInit
+#define Tth_TigerInit \
+	(tthStubsPtr->tth_TigerInit) /* 1 */
+#endif
+#ifndef Tth_TigerUpdate
+#define Tth_TigerUpdate \
+	(tthStubsPtr->tth_TigerUpdate) /* 2 */
+#endif
+#ifndef Tth_TigerDigest
+#define Tth_TigerDigest \
+	(tthStubsPtr->tth_TigerDigest) /* 3 */
+#endif
+#ifndef Tth_TreeInit
+#define Tth_TreeInit \
+	(tthStubsPtr->tth_TreeInit) /* 4 */
+#endif
+#ifndef Tth_TreeSetLevel
+#define Tth_TreeSetLevel \
+	(tthStubsPtr->tth_TreeSetLevel) /* 5 */
+#endif
+#ifndef Tth_TreeUpdate
+#define Tth_TreeUpdate \
+	(tthStubsPtr->tth_TreeUpdate) /* 6 */
+#endif
+#ifndef Tth_TreeDigest
+#define Tth_TreeDigest \
+	(tthStubsPtr->tth_TreeDigest) /* 7 */
+#endif
+#ifndef Tth_TreeFree
+#define Tth_TreeFree \
+	(tthStubsPtr->tth_TreeFree) /* 8 */
+#endif
+#ifndef Tth_TreeHash
+#define Tth_TreeHash \
+	(tthStubsPtr->tth_TreeHash) /* 9 */
+#endif
+#ifndef Tth_TreeHashBatch
+#define Tth_TreeHashBatch \
+	(tthStubsPtr->tth_TreeHashBatch) /* 10 */
+#endif
+#ifndef Tth_TreeHashFile
+#define Tth_TreeHashFile \
+	(tthStubsPtr->tth_TreeHashFile) /* 11 */
+#endif
+#ifndef Tth_TreeHashChannel
+#define Tth_TreeHashChannel \
+	(tthStubsPtr->tth_TreeHashChannel) /* 12 */
+#endif
+#ifndef Tth_DigestToBase32
+#define Tth_DigestToBase32 \
+	(tthStubsPtr->tth_DigestToBase32) /* 13 */
+#endif
+
+#endif /* defined(USE_TTH_STUBS) && !defined(USE_TTH_STUB_PROCS) */
+
+/* !END!: Do not edit above this line. */
+
+#endif /* _TTHDECLS */
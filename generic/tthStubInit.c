@@ -0,0 +1,47 @@
+/*
+ * tthStubInit.c --
+ *
+ *	This file contains the initializers for the tth stubs table.
+ *	It is compiled into the tth library itself; its address is
+ *	passed to Tcl_PkgProvideEx() by Tth_Init().
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include "tth.h"
+
+/*
+ * WARNING: The contents of this file is automatically generated by the
+ * tools/genStubs.tcl script of the Tcl distribution from generic/tth.decls.
+ * Any modifications to the function declarations below should be made
+ * in that file.
+ */
+
+/* !BEGIN!: Do not edit below this line. */
+
+TthStubs tthStubs = {
+    TCL_STUB_MAGIC,
+    NULL,
+    Tth_Tiger, /* 0 */
+    Tth_TigerInit, /* 1 */
+    Tth_TigerUpdate, /* 2 */
+    Tth_TigerDigest, /* 3 */
+    Tth_TreeInit, /* 4 */
+    Tth_TreeSetLevel, /* 5 */
+    Tth_TreeUpdate, /* 6 */
+    Tth_TreeDigest, /* 7 */
+    Tth_TreeFree, /* 8 */
+    Tth_TreeHash, /* 9 */
+    Tth_TreeHashBatch, /* 10 */
+    Tth_TreeHashFile, /* 11 */
+    Tth_TreeHashChannel, /* 12 */
+    Tth_DigestToBase32, /* 13 */
+};
+
+/* !END!: Do not edit above this line. */
@@ -0,0 +1,74 @@
+/*
+ * tthStubLib.c --
+ *
+ *	Stub object that will be statically linked into extensions
+ *	that want to access the C API of the "tth" package.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef USE_TCL_STUBS
+#define USE_TCL_STUBS
+#endif
+#ifndef USE_TTH_STUBS
+#define USE_TTH_STUBS
+#endif
+
+#include "tth.h"
+
+TthStubs *tthStubsPtr = NULL;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tth_InitStubs --
+ *
+ *	Requires the "tth" package and loads its stubs table.
+ *	Must be called by extensions using the tth C API before
+ *	any of its functions.
+ *
+ * Results:
+ *	The actual version of the package, or NULL if it can not be
+ *	loaded or does not export a stubs table, in which case an
+ *	error message is left in the interpreter.
+ *
+ * Side effects:
+ *	Sets tthStubsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+Tth_InitStubs (
+		Tcl_Interp *interp,
+		const char *version,
+		int        exact
+		)
+{
+	const char *actualVersion;
+	ClientData clientData = NULL;
+
+	actualVersion = Tcl_PkgRequireEx(interp, "tth", version, exact,
+			&clientData);
+	if (actualVersion == NULL) {
+		return NULL;
+	}
+
+	tthStubsPtr = (TthStubs *) clientData;
+	if (tthStubsPtr == NULL || tthStubsPtr->magic != TCL_STUB_MAGIC) {
+		tthStubsPtr = NULL;
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "this implementation of tth "
+				"does not support stubs", NULL);
+		return NULL;
+	}
+
+	return actualVersion;
+}
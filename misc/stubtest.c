@@ -0,0 +1,204 @@
+/*
+ * stubtest.c --
+ *
+ *	A minimal extension using the C API of the "tth" package through
+ *	its stubs table, as any other extension would: it is built with
+ *	USE_TTH_STUBS, links against the tthstub library and calls
+ *	Tth_InitStubs(). The test suite (tests/stubs.test) compares what
+ *	its commands return with the results of [tth digest].
+ *
+ *	tthstubtest::hash string
+ *		The base32 TTH of the string, by Tth_TreeHash().
+ *	tthstubtest::hashfile fileName engine
+ *		The base32 TTH of the file and the name of the engine used,
+ *		by Tth_TreeHashFile().
+ *	tthstubtest::handoff string
+ *		The base32 TTH of the string, by a streaming context created
+ *		and finished in the calling thread but updated in another one.
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#ifndef USE_TTH_STUBS
+#define USE_TTH_STUBS
+#endif
+
+#include <tcl.h>
+#include "tth.h"
+
+static const char *engineNames[] = { "auto", "mmap", "read", "stream",
+	NULL };
+
+/*
+ * Work handed to the updating thread.
+ */
+typedef struct {
+	Tth_TreeContext     *ctxPtr;
+	const unsigned char *bytes;
+	int                 len;
+} Handoff;
+
+
+/*
+ *
+ */
+static int
+Hash_Cmd (
+		ClientData     clientData,
+		Tcl_Interp     *interp,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	unsigned char *bytes, digest[TTH_DIGESTSIZE];
+	char base32[TTH_BASE32SIZE];
+	int len;
+
+	if (objc != 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "string");
+		return TCL_ERROR;
+	}
+
+	bytes = Tcl_GetByteArrayFromObj(objv[1], &len);
+	Tth_TreeHash(bytes, (Tcl_WideUInt) len, digest);
+	Tcl_SetObjResult(interp,
+			Tcl_NewStringObj(Tth_DigestToBase32(digest, base32), -1));
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+static int
+HashFile_Cmd (
+		ClientData     clientData,
+		Tcl_Interp     *interp,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	unsigned char digest[TTH_DIGESTSIZE];
+	char base32[TTH_BASE32SIZE];
+	Tth_FileEngine used;
+	Tcl_Obj *resultPtr;
+	int engine;
+
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "fileName engine");
+		return TCL_ERROR;
+	}
+	if (Tcl_GetIndexFromObj(interp, objv[2], engineNames, "engine",
+			0, &engine) != TCL_OK) { return TCL_ERROR; }
+
+	if (Tth_TreeHashFile(interp, Tcl_GetString(objv[1]),
+			(Tth_FileEngine) engine, digest, &used) != TCL_OK) {
+		return TCL_ERROR;
+	}
+
+	resultPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj(Tth_DigestToBase32(digest, base32), -1));
+	Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj(engineNames[used], -1));
+	Tcl_SetObjResult(interp, resultPtr);
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+static Tcl_ThreadCreateType
+Handoff_ThreadProc (
+		ClientData clientData
+		)
+{
+	Handoff *handoffPtr = (Handoff *) clientData;
+
+	Tth_TreeUpdate(handoffPtr->ctxPtr, handoffPtr->bytes,
+			(Tcl_WideUInt) handoffPtr->len);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+
+/*
+ *
+ */
+static int
+Handoff_Cmd (
+		ClientData     clientData,
+		Tcl_Interp     *interp,
+		int            objc,
+		Tcl_Obj *const objv[]
+		)
+{
+	unsigned char digest[TTH_DIGESTSIZE];
+	char base32[TTH_BASE32SIZE];
+	Handoff handoff;
+#ifdef TCL_THREADS
+	Tcl_ThreadId thread;
+	int result;
+#endif
+
+	if (objc != 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "string");
+		return TCL_ERROR;
+	}
+
+	handoff.ctxPtr = Tth_TreeInit();
+	handoff.bytes  = Tcl_GetByteArrayFromObj(objv[1], &handoff.len);
+
+#ifdef TCL_THREADS
+	if (Tcl_CreateThread(&thread, Handoff_ThreadProc, (ClientData) &handoff,
+			TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) != TCL_OK) {
+		Tth_TreeFree(handoff.ctxPtr);
+		Tcl_SetResult(interp, "can not create thread", TCL_STATIC);
+		return TCL_ERROR;
+	}
+	Tcl_JoinThread(thread, &result);
+#else
+	Handoff_ThreadProc((ClientData) &handoff);
+#endif
+
+	Tth_TreeDigest(handoff.ctxPtr, digest);
+	Tcl_SetObjResult(interp,
+			Tcl_NewStringObj(Tth_DigestToBase32(digest, base32), -1));
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+int
+Tthstubtest_Init (
+		Tcl_Interp *interp
+		)
+{
+	if (Tcl_InitStubs(interp, "8.4", 0) == NULL) {
+		return TCL_ERROR;
+	}
+	if (Tth_InitStubs(interp, TTH_VERSION, 0) == NULL) {
+		return TCL_ERROR;
+	}
+
+	Tcl_CreateObjCommand(interp, "::tthstubtest::hash",
+			Hash_Cmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "::tthstubtest::hashfile",
+			HashFile_Cmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "::tthstubtest::handoff",
+			Handoff_Cmd, NULL, NULL);
+
+	return Tcl_PkgProvide(interp, "tthstubtest", TTH_VERSION);
+}
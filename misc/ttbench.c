@@ -0,0 +1,332 @@
+/*
+ * ttbench.c --
+ *
+ *	Microbenchmark of the hashing kernels: the Tiger compression
+ *	function, tiger() on the input sizes TTH uses (a 49-byte inner
+ *	node, a 1025-byte leaf) and a large one, tt_update() throughput
+ *	at various update sizes, node composition and the base32/hex
+ *	encoders.
+ *
+ *	Each benchmark is first calibrated to run for about -time
+ *	milliseconds per repetition, then run -warmup times unrecorded
+ *	and -reps times recorded; the median, 99th percentile and
+ *	minimum time per operation are reported, along with throughput
+ *	and, where the time-stamp counter is available, cycles per byte.
+ *
+ *	Usage: ttbench ?-json? ?-reps n? ?-warmup n? ?-time ms? ?pattern ...?
+ *
+ *	Only the benchmarks whose names contain one of the patterns
+ *	are run. Build and run it with "make bench" (BENCHFLAGS are
+ *	passed to it).
+ *
+ * $Id$
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "tigertree.h"
+#include "base32.h"
+#include "hex.h"
+
+/* Not declared in tiger.h: the library only calls it via tiger(). */
+void tiger_compress(word64 *str, word64 state[3]);
+
+#define MAXREPS 1000
+#define BIGSIZE (64 * 1024)
+#define STREAMSIZE (1024 * 1024)
+
+typedef struct bench {
+  const char *name;
+  double (*proc)(struct bench *b, long iters);  /* returns elapsed ns */
+  word32 arg;                   /* benchmark-specific size */
+  double bytes;                 /* bytes processed per iteration */
+} BENCH;
+
+static byte *data;              /* STREAMSIZE bytes of input */
+static volatile word64 sink;    /* keeps results alive */
+static double tscPerNs;         /* 0 if there is no usable TSC */
+
+/* monotonic clock, in nanoseconds */
+static word64 now(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (word64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (word64)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static word64 rdtsc(void)
+{
+  unsigned int lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((word64)hi << 32) | lo;
+}
+
+/* measure the TSC rate against the monotonic clock over ~50 ms */
+static void calibrate_tsc(void)
+{
+  word64 t0, c0, t1, c1;
+
+  t0 = now();
+  c0 = rdtsc();
+  do {
+    t1 = now();
+  } while (t1 - t0 < 50000000);
+  c1 = rdtsc();
+  tscPerNs = (double)(c1 - c0) / (double)(t1 - t0);
+}
+#else
+static void calibrate_tsc(void)
+{
+  tscPerNs = 0;
+}
+#endif
+
+static double bench_compress(BENCH *b, long iters)
+{
+  word64 state[3] = {0, 0, 0};
+  word64 *block = (word64 *)data;
+  word64 start = now();
+  long i;
+
+  for (i = 0; i < iters; i++)
+    tiger_compress(block + (i & 63) * 8, state);
+  sink += state[0];
+  return (double)(now() - start);
+}
+
+static double bench_tiger(BENCH *b, long iters)
+{
+  word64 res[3];
+  word64 start = now();
+  long i;
+
+  for (i = 0; i < iters; i++) {
+    tiger((word64 *)data, (word64)b->arg, res);
+    sink += res[0];
+  }
+  return (double)(now() - start);
+}
+
+static double bench_update(BENCH *b, long iters)
+{
+  TT_CONTEXT ctx;
+  byte hash[TIGERSIZE];
+  word64 start = now();
+  word32 off, len;
+  long i;
+
+  for (i = 0; i < iters; i++) {
+    tt_init(&ctx);
+    /* the last update gets what is left when the step does not divide
+     * the stream, so exactly STREAMSIZE bytes are hashed */
+    for (off = 0; off < STREAMSIZE; off += len) {
+      len = STREAMSIZE - off < b->arg ? STREAMSIZE - off : b->arg;
+      tt_update(&ctx, data + off, len);
+    }
+    tt_digest(&ctx, hash);
+    tt_free(&ctx);
+    sink += hash[0];
+  }
+  return (double)(now() - start);
+}
+
+/* only the compositions are timed, through the profiling hook */
+static double bench_compose(BENCH *b, long iters)
+{
+  TT_CONTEXT ctx;
+  TT_PROFILE profile;
+  byte hash[TIGERSIZE];
+  long i;
+
+  profile.clock = now;
+  profile.compose = 0;
+  for (i = 0; i < iters; i++) {
+    tt_init(&ctx);
+    tt_set_profile(&ctx, &profile);
+    tt_update(&ctx, data, b->arg * BLOCKSIZE);
+    tt_digest(&ctx, hash);
+    tt_free(&ctx);
+    sink += hash[0];
+  }
+  return (double)profile.compose;
+}
+
+static double bench_base32(BENCH *b, long iters)
+{
+  char out[BASE32_DESTLEN(TIGERSIZE)];
+  word64 start = now();
+  long i;
+
+  for (i = 0; i < iters; i++) {
+    to_base32(data + (i & 63), TIGERSIZE, out);
+    sink += out[0];
+  }
+  return (double)(now() - start);
+}
+
+static double bench_hex(BENCH *b, long iters)
+{
+  char out[HEX_DESTLEN(TIGERSIZE)];
+  word64 start = now();
+  long i;
+
+  for (i = 0; i < iters; i++) {
+    to_hex(data + (i & 63), TIGERSIZE, out);
+    sink += out[0];
+  }
+  return (double)(now() - start);
+}
+
+/* the composition of a tree of n leaves takes n-1 inner nodes */
+#define NODES(leaves) ((double)((leaves) - 1) * (NODESIZE + 1))
+
+static BENCH benches[] = {
+  {"compress",        bench_compress, 64,         64},
+  {"tiger-49",        bench_tiger,    49,         49},
+  {"tiger-1025",      bench_tiger,    1025,       1025},
+  {"tiger-64k",       bench_tiger,    BIGSIZE,    BIGSIZE},
+  {"tt_update-1",     bench_update,   1,          STREAMSIZE},
+  {"tt_update-64",    bench_update,   64,         STREAMSIZE},
+  {"tt_update-1000",  bench_update,   1000,       STREAMSIZE},
+  {"tt_update-1024",  bench_update,   1024,       STREAMSIZE},
+  {"tt_update-64k",   bench_update,   BIGSIZE,    STREAMSIZE},
+  {"tt_update-1m",    bench_update,   STREAMSIZE, STREAMSIZE},
+  {"compose",         bench_compose,  1024,       NODES(1024)},
+  {"base32",          bench_base32,   TIGERSIZE,  TIGERSIZE},
+  {"hex",             bench_hex,      TIGERSIZE,  TIGERSIZE},
+  {NULL}
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static int selected(const char *name, char **patterns, int npatterns)
+{
+  int i;
+
+  if (npatterns == 0)
+    return 1;
+  for (i = 0; i < npatterns; i++)
+    if (strstr(name, patterns[i]) != NULL)
+      return 1;
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s ?-json? ?-reps n? ?-warmup n? ?-time ms? "
+      "?pattern ...?\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int json = 0, reps = 31, warmup = 3, ms = 10;
+  char **patterns;
+  int npatterns = 0, first = 1;
+  double samples[MAXREPS];
+  BENCH *b;
+  int i;
+
+  patterns = (char **)malloc(argc * sizeof(char *));
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-json")) {
+      json = 1;
+    } else if (!strcmp(argv[i], "-reps") && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-warmup") && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-time") && i + 1 < argc) {
+      ms = atoi(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+    } else {
+      patterns[npatterns++] = argv[i];
+    }
+  }
+  if (reps < 1 || reps > MAXREPS || warmup < 0 || ms < 1)
+    usage(argv[0]);
+
+  data = (byte *)malloc(STREAMSIZE);
+  for (i = 0; i < STREAMSIZE; i++)
+    data[i] = (byte)(i * 131 + (i >> 8));
+  calibrate_tsc();
+
+  if (json) {
+    printf("{\"kernel\": \"%s\", \"reps\": %d, \"warmup\": %d, "
+	"\"tsc_ghz\": %.3f, \"results\": [", tiger_kernel, reps, warmup,
+	tscPerNs);
+  } else {
+    printf("kernel %s, %d reps after %d warmups, TSC %.3f GHz\n",
+	tiger_kernel, reps, warmup, tscPerNs);
+    printf("%-16s %10s %12s %12s %12s %10s %8s\n", "benchmark", "bytes/op",
+	"median ns", "p99 ns", "min ns", "MB/s", "cyc/B");
+  }
+
+  for (b = benches; b->name != NULL; b++) {
+    long iters = 1;
+    double median, p99, cpb;
+
+    if (!selected(b->name, patterns, npatterns))
+      continue;
+
+    /* grow the iteration count until a repetition takes long enough */
+    while (b->proc(b, iters) < ms * 1e6 && iters < (1L << 30))
+      iters *= 2;
+    for (i = 0; i < warmup; i++)
+      b->proc(b, iters);
+    for (i = 0; i < reps; i++)
+      samples[i] = b->proc(b, iters) / iters;
+
+    qsort(samples, reps, sizeof(double), cmp_double);
+    median = reps & 1 ? samples[reps / 2]
+	: (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+    p99 = samples[(reps * 99 + 99) / 100 - 1];
+    cpb = median * tscPerNs / b->bytes;
+
+    if (json) {
+      printf("%s\n  {\"name\": \"%s\", \"bytes\": %.0f, \"iters\": %ld, "
+	  "\"median_ns\": %.2f, \"p99_ns\": %.2f, \"min_ns\": %.2f, "
+	  "\"mbps\": %.2f, ", first ? "" : ",", b->name, b->bytes, iters,
+	  median, p99, samples[0], b->bytes * 1e3 / median);
+      if (tscPerNs > 0)
+	printf("\"cpb\": %.3f}", cpb);
+      else
+	printf("\"cpb\": null}");
+    } else {
+      printf("%-16s %10.0f %12.2f %12.2f %12.2f %10.2f ", b->name, b->bytes,
+	  median, p99, samples[0], b->bytes * 1e3 / median);
+      if (tscPerNs > 0)
+	printf("%8.2f\n", cpb);
+      else
+	printf("%8s\n", "-");
+    }
+    first = 0;
+    fflush(stdout);
+  }
+
+  if (json)
+    printf("\n]}\n");
+  free(data);
+  free(patterns);
+  return 0;
+}
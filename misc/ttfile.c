@@ -0,0 +1,305 @@
+/*
+ * ttfile.c --
+ *
+ *	Hashing of files by the stand-alone tools, see ttfile.h.
+ *
+ *	Small files and files mostly in the page cache are mapped; larger
+ *	cold ones are read with pread() and dropped from the cache behind
+ *	the reads, so hashing a big tree does not evict everything else.
+ *	Pipes, devices and empty files are read with read().
+ *
+ *	Reads can be throttled by a token bucket shared by the threads,
+ *	as those of [tth digest] are by tclthrottle.c; a mapped file is
+ *	then not read ahead, each chunk being prefetched once the bucket
+ *	lets it through.
+ *
+ *	A mapped file truncated while being hashed raises SIGBUS; once
+ *	ttf_guard() is called, the faulting thread jumps back to
+ *	ttf_hash(), which fails with EIO, instead of the process dying.
+ *
+ * $Id$
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "ttfile.h"
+
+#define SMALLFILE (4 * 1024 * 1024)     /* always mapped */
+#define BUFSIZE   (1024 * 1024)         /* read size, and chunk of mappings */
+#define PROBES    64                    /* pages sampled by is_cached() */
+#define BURST     0.1                   /* seconds of I/O a bucket saves up */
+#define MB        (1024.0 * 1024.0)
+
+static int guarded;                     /* set by ttf_guard() */
+static __thread sigjmp_buf *guardEnv;   /* set while hashing a mapping */
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void ttf_throttle_init(TTF_THROTTLE *t)
+{
+  memset(t, 0, sizeof(TTF_THROTTLE));
+  pthread_mutex_init(&t->lock, NULL);
+  t->last = now();
+}
+
+void ttf_throttle_set(TTF_THROTTLE *t, double mbps, double iops)
+{
+  pthread_mutex_lock(&t->lock);
+  t->rate = mbps * MB;
+  t->iops = iops;
+  t->bytes = t->rate * BURST;
+  t->ops = t->iops * BURST;
+  t->last = now();
+  pthread_mutex_unlock(&t->lock);
+}
+
+void ttf_throttle_get(TTF_THROTTLE *t, double *mbps, double *iops)
+{
+  pthread_mutex_lock(&t->lock);
+  *mbps = t->rate / MB;
+  *iops = t->iops;
+  pthread_mutex_unlock(&t->lock);
+}
+
+static int throttled(TTF_THROTTLE *t)
+{
+  int active;
+
+  if (t == NULL)
+    return 0;
+  pthread_mutex_lock(&t->lock);
+  active = t->rate > 0 || t->iops > 0;
+  pthread_mutex_unlock(&t->lock);
+  return active;
+}
+
+/* takes the tokens of a read of len bytes, then sleeps until the
+ * debt of the bucket is paid off */
+static void throttle(TTF_THROTTLE *t, size_t len)
+{
+  double time, wait = 0, w;
+  struct timespec ts;
+
+  if (t == NULL)
+    return;
+  pthread_mutex_lock(&t->lock);
+  time = now();
+  if (t->rate > 0) {
+    t->bytes += (time - t->last) * t->rate;
+    if (t->bytes > t->rate * BURST)
+      t->bytes = t->rate * BURST;
+    t->bytes -= len;
+    if (t->bytes < 0)
+      wait = -t->bytes / t->rate;
+  }
+  if (t->iops > 0) {
+    t->ops += (time - t->last) * t->iops;
+    if (t->ops > t->iops * BURST)
+      t->ops = t->iops * BURST;
+    t->ops -= 1;
+    if (t->ops < 0 && (w = -t->ops / t->iops) > wait)
+      wait = w;
+  }
+  t->last = time;
+  pthread_mutex_unlock(&t->lock);
+
+  if (wait > 0) {
+    ts.tv_sec = (time_t)wait;
+    ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+      ;
+  }
+}
+
+static void on_sigbus(int sig)
+{
+  if (guardEnv != NULL)
+    siglongjmp(*guardEnv, 1);
+  /* not ours: die of the fault once the handler returns */
+  signal(sig, SIG_DFL);
+}
+
+int ttf_guard(void)
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sigbus;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGBUS, &sa, NULL) == -1)
+    return -1;
+  guarded = 1;
+  return 0;
+}
+
+/* whether most of the mapped file is in the page cache */
+static int is_cached(void *addr, size_t length)
+{
+  long pagesize = sysconf(_SC_PAGESIZE);
+  size_t pages = (length + pagesize - 1) / pagesize, step, i;
+  unsigned char vec;
+  int probes = 0, cached = 0;
+
+  step = pages / PROBES ? pages / PROBES : 1;
+  for (i = 0; i < pages; i += step) {
+    ++probes;
+    if (mincore((char *)addr + i * pagesize, pagesize, (void *)&vec) == 0
+	&& (vec & 1))
+      ++cached;
+  }
+  return cached * 2 >= probes;
+}
+
+static int hash_stream(int fd, TTF_THROTTLE *t, TT_CONTEXT *ctx)
+{
+  byte *buf = (byte *)malloc(BUFSIZE);
+  ssize_t n;
+
+  while ((n = read(fd, buf, BUFSIZE)) != 0) {
+    if (n == -1) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    throttle(t, n);
+    tt_update(ctx, buf, (word32)n);
+  }
+  free(buf);
+  return n == -1 ? -1 : 0;
+}
+
+static int hash_read(int fd, off_t size, int drop, TTF_THROTTLE *t,
+    TT_CONTEXT *ctx)
+{
+  byte *buf = (byte *)malloc(BUFSIZE);
+  off_t offset = 0;
+  ssize_t n;
+
+  if (!throttled(t))
+    posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+  while ((n = pread(fd, buf, BUFSIZE, offset)) != 0) {
+    if (n == -1) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    throttle(t, n);
+    tt_update(ctx, buf, (word32)n);
+    if (drop)
+      posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+    offset += n;
+  }
+  free(buf);
+  return n == -1 ? -1 : 0;
+}
+
+static int hash_map(byte *addr, size_t size, TTF_THROTTLE *t,
+    TT_CONTEXT *ctx)
+{
+  sigjmp_buf env;
+  size_t offset, len;
+  int slow;
+
+  if (sigsetjmp(env, 1) != 0) {
+    /* the file was truncated behind the mapping */
+    guardEnv = NULL;
+    errno = EIO;
+    return -1;
+  }
+  if (guarded)
+    guardEnv = &env;
+
+  slow = throttled(t);
+  madvise(addr, size, slow ? MADV_RANDOM : MADV_SEQUENTIAL);
+  for (offset = 0; offset < size; offset += len) {
+    len = size - offset < BUFSIZE ? size - offset : BUFSIZE;
+    if (slow) {
+      throttle(t, len);
+      madvise(addr + offset, len, MADV_WILLNEED);
+    }
+    tt_update(ctx, addr + offset, (word32)len);
+  }
+  guardEnv = NULL;
+  return 0;
+}
+
+int ttf_hash(const char *name, const TTF_OPTIONS *opts, byte *hash)
+{
+  TT_CONTEXT ctx;
+  struct stat st;
+  void *addr = MAP_FAILED;
+  int fd, code, drop = opts->nocache, cold = 0, saved;
+
+  if (!strcmp(name, "-"))
+    fd = 0;
+  else if ((fd = open(name, O_RDONLY)) == -1)
+    return -1;
+  if (fstat(fd, &st) == -1) {
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    close(fd);
+    errno = EISDIR;
+    return -1;
+  }
+
+  tt_init(&ctx);
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    code = hash_stream(fd, opts->throttle, &ctx);
+  } else {
+    if (opts->engine != TTF_READ && !opts->nocache
+	&& (size_t)st.st_size == st.st_size)
+      addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED && opts->engine == TTF_AUTO
+	&& st.st_size > SMALLFILE && !is_cached(addr, st.st_size)) {
+      munmap(addr, st.st_size);
+      addr = MAP_FAILED;
+      drop = 1;
+    }
+    if (addr != MAP_FAILED) {
+      code = hash_map((byte *)addr, st.st_size, opts->throttle, &ctx);
+      saved = errno;
+      munmap(addr, st.st_size);
+      errno = saved;
+    } else {
+      cold = opts->coldProc != NULL;
+      if (cold)
+	opts->coldProc(opts->coldData, st.st_dev, 1);
+      code = hash_read(fd, st.st_size, drop, opts->throttle, &ctx);
+      saved = errno;
+      if (cold)
+	opts->coldProc(opts->coldData, st.st_dev, 0);
+      errno = saved;
+    }
+  }
+
+  saved = errno;
+  if (fd != 0)
+    close(fd);
+  if (code == -1) {
+    tt_free(&ctx);
+    errno = saved;
+    return -1;
+  }
+  tt_digest(&ctx, hash);
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * ttfile.h --
+ *
+ *	Hashing of files by the stand-alone tools (tthsum, tthd),
+ *	reading them the way the "auto" engine of [tth digest -file]
+ *	does (see unix/posix_mmap.c), without Tcl.
+ *
+ * $Id$
+ */
+#ifndef __TTFILE_H
+#define __TTFILE_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include "tigertree.h"
+
+typedef enum {
+  TTF_AUTO,             /* map small and cached files, read cold ones */
+  TTF_MMAP,             /* map regular files */
+  TTF_READ              /* read with pread() */
+} TTF_ENGINE;
+
+/* Called around the reading of a cold file with pread(), e.g. to limit
+ * the number of files read at once from a device; enter is 1 before
+ * the reading and 0 after it. */
+typedef void (ttf_cold_proc)(void *clientData, dev_t dev, int enter);
+
+/* Token bucket limiting the bandwidth (bytes per second) and the
+ * rate of reads of all the threads sharing it; a limit of 0 means no
+ * limit, and both may be changed with ttf_throttle_set() at any time. */
+typedef struct ttf_throttle {
+  pthread_mutex_t lock;
+  double rate, iops;
+  double bytes, ops;            /* tokens, may be negative (a debt) */
+  double last;                  /* time of the last refill, in seconds */
+} TTF_THROTTLE;
+
+typedef struct ttf_options {
+  TTF_ENGINE engine;
+  int nocache;                  /* drop every file from the page cache */
+  ttf_cold_proc *coldProc;      /* or NULL */
+  void *coldData;
+  TTF_THROTTLE *throttle;       /* or NULL */
+} TTF_OPTIONS;
+
+void ttf_throttle_init(TTF_THROTTLE *t);
+void ttf_throttle_set(TTF_THROTTLE *t, double mbps, double iops);
+void ttf_throttle_get(TTF_THROTTLE *t, double *mbps, double *iops);
+
+/* Makes ttf_hash() fail with EIO rather than the process die of
+ * SIGBUS when a mapped file is truncated while being hashed, by
+ * installing a handler of SIGBUS; returns 0, or -1 with errno set. */
+int ttf_guard(void);
+
+/* Hashes the named file ("-" is standard input); returns 0, or -1
+ * with errno set. */
+int ttf_hash(const char *name, const TTF_OPTIONS *opts, byte *hash);
+
+#endif /* __TTFILE_H */
@@ -0,0 +1,877 @@
+/*
+ * tthd.c --
+ *
+ *	Local hashing daemon: accepts requests for Tiger Tree Hashes of
+ *	files over a Unix domain socket, so that many clients (the
+ *	"-daemon" option of [tth digest], scripts, shell tools) share
+ *	one scheduler and one cache of digests instead of each one
+ *	reading the same files again.
+ *
+ *	- Digests are cached by device, inode, size and modification
+ *	  time; with -cache the cache is kept in a file and survives
+ *	  restarts.
+ *	- Requests for a file being hashed are attached to the job
+ *	  already running (or queued) instead of starting another one.
+ *	- A pool of -jobs threads hashes the files; cold files read
+ *	  with pread() (see ttfile.c) take one of -perdev slots of their
+ *	  device, and workers prefer jobs on devices with a free slot,
+ *	  so several disks are read at once but each one sequentially.
+ *	- The reads of all the workers can be limited in bandwidth and
+ *	  rate with -bwlimit and -iops, and the limits changed at run
+ *	  time with the THROTTLE request.
+ *
+ *	The protocol is line-based; replies on a connection come in the
+ *	order of its requests:
+ *
+ *	    DIGEST /absolute/path   ->  OK <thex> <size> | ERR <message>
+ *	    STATS                   ->  OK requests N hashed N hits N
+ *	                                coalesced N errors N queued N
+ *	    THROTTLE [MBPS IOPS]    ->  OK bwlimit MBPS iops IOPS
+ *
+ *	Usage: tthd [-socket PATH] [-cache FILE] [-jobs N] [-perdev N]
+ *	            [-bwlimit MBPS] [-iops N]
+ *
+ *	The daemon runs in the foreground until SIGINT or SIGTERM.
+ *	Build it with "make tthd".
+ *
+ * $Id$
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ttfile.h"
+#include "base32.h"
+
+#define MAXJOBS   256
+#define MAXLINE   8192
+#define MAXDEVS   64
+#define THEXSIZE  BASE32_DESTLEN(TIGERSIZE)
+
+/* what identifies a version of a file */
+typedef struct key {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t sec;
+  long nsec;
+} KEY;
+
+typedef struct entry {
+  KEY key;
+  byte digest[TIGERSIZE];
+  struct entry *next;
+} ENTRY;
+
+typedef struct job {
+  KEY key;
+  char *path;
+  int running, done;
+  int queued;                   /* in the queue (main thread only) */
+  int error;                    /* errno of a failure, or 0 */
+  byte digest[TIGERSIZE];
+  int refs;                     /* replies waiting for the job */
+  struct job *next;             /* in the queue, then in the done list */
+} JOB;
+
+typedef struct reply {
+  JOB *job;                     /* or NULL if text is set */
+  char *text;
+  struct reply *next;
+} REPLY;
+
+typedef struct conn {
+  int fd;
+  char in[MAXLINE];
+  size_t inlen;
+  char *out;
+  size_t outlen, outroom;
+  REPLY *head, *tail;
+  struct conn *next;
+} CONN;
+
+typedef struct device {
+  dev_t dev;
+  int cold;                     /* files being read with pread() */
+} DEVICE;
+
+static const char *prog = "tthd";
+static TTF_OPTIONS fileOptions = { TTF_AUTO, 0, NULL, NULL, NULL };
+static TTF_THROTTLE throttle;
+static int perdev = 1;
+
+/* shared with the workers, under lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t devCond = PTHREAD_COND_INITIALIZER;
+static JOB *queue;              /* queued and running jobs */
+static DEVICE devices[MAXDEVS];
+static int ndevices;
+static ENTRY **buckets;
+static size_t nbuckets, nentries;
+static FILE *cacheFile;
+static int quit;
+static volatile sig_atomic_t stop;
+static unsigned long nrequests, nhashed, nhits, ncoalesced, nerrors;
+
+static int wakeFds[2];          /* self-pipe of the main loop */
+static CONN *conns;
+
+static void usage(int code)
+{
+  fprintf(code ? stderr : stdout,
+"Usage: %s [OPTION]...\n"
+"Serve Tiger Tree Hash (TTH) digests of files over a Unix domain socket.\n"
+"\n"
+"  -socket PATH   listen on PATH (default: $XDG_RUNTIME_DIR/tthd.sock,\n"
+"                 or /tmp/tthd-UID.sock)\n"
+"  -cache FILE    keep the digests in FILE across restarts\n"
+"  -jobs N        hash N files at a time (default: number of CPUs)\n"
+"  -perdev N      read at most N cold files at a time from a device\n"
+"                 (default: 1)\n"
+"  -engine NAME   read files using auto, mmap or read (default: auto)\n"
+"  -bwlimit MBPS  read at most MBPS megabytes per second in all\n"
+"  -iops N        issue at most N reads per second in all\n"
+"  -h             display this help and exit\n", prog);
+  exit(code);
+}
+
+static void *xmalloc(size_t size)
+{
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    perror(prog);
+    exit(2);
+  }
+  return p;
+}
+
+static void wake(void)
+{
+  char c = 0;
+
+  while (write(wakeFds[1], &c, 1) == -1 && errno == EINTR)
+    ;
+}
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+  wake();
+}
+
+/* the cache of digests */
+
+static int key_equal(const KEY *a, const KEY *b)
+{
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+    && a->sec == b->sec && a->nsec == b->nsec;
+}
+
+static size_t key_hash(const KEY *key)
+{
+  return (size_t)(key->ino * 31 + key->dev);
+}
+
+static ENTRY *cache_find(const KEY *key)
+{
+  ENTRY *e;
+
+  for (e = buckets[key_hash(key) % nbuckets]; e != NULL; e = e->next)
+    if (e->key.dev == key->dev && e->key.ino == key->ino)
+      return e;
+  return NULL;
+}
+
+static void cache_put(const KEY *key, const byte *digest)
+{
+  ENTRY *e = cache_find(key), **newb, *next;
+  size_t i, n;
+
+  if (e == NULL) {
+    if (nentries >= nbuckets) {
+      n = 2 * nbuckets;
+      newb = (ENTRY **)calloc(n, sizeof(ENTRY *));
+      if (newb != NULL) {
+	for (i = 0; i < nbuckets; i++)
+	  for (e = buckets[i]; e != NULL; e = next) {
+	    next = e->next;
+	    e->next = newb[key_hash(&e->key) % n];
+	    newb[key_hash(&e->key) % n] = e;
+	  }
+	free(buckets);
+	buckets = newb;
+	nbuckets = n;
+      }
+    }
+    e = (ENTRY *)xmalloc(sizeof(ENTRY));
+    e->next = buckets[key_hash(key) % nbuckets];
+    buckets[key_hash(key) % nbuckets] = e;
+    nentries++;
+  }
+  e->key = *key;
+  memcpy(e->digest, digest, TIGERSIZE);
+}
+
+/* a digest is valid as long as the file keeps its size and mtime */
+static int cache_get(const KEY *key, byte *digest)
+{
+  ENTRY *e = cache_find(key);
+
+  if (e == NULL || !key_equal(&e->key, key))
+    return 0;
+  memcpy(digest, e->digest, TIGERSIZE);
+  return 1;
+}
+
+static void cache_write(FILE *f, const KEY *key, const byte *digest)
+{
+  char thex[THEXSIZE];
+
+  to_base32(digest, TIGERSIZE, thex);
+  fprintf(f, "%llu %llu %lld %lld %ld %s\n", (unsigned long long)key->dev,
+      (unsigned long long)key->ino, (long long)key->size,
+      (long long)key->sec, key->nsec, thex);
+}
+
+/* loads the cache file, one "dev ino size sec nsec thex" line per
+ * digest, later lines replacing earlier ones; the file is rewritten
+ * without the replaced lines and kept open for appending */
+static void cache_load(const char *name)
+{
+  FILE *f;
+  KEY key;
+  unsigned long long dev, ino;
+  long long size, sec;
+  char thex[THEXSIZE + 1], *tmp;
+  byte digest[TIGERSIZE];
+  size_t lines = 0, i, bad;
+  ENTRY *e;
+
+  if ((f = fopen(name, "r")) != NULL) {
+    while (fscanf(f, "%llu %llu %lld %lld %ld %40s", &dev, &ino, &size,
+	&sec, &key.nsec, thex) == 6) {
+      lines++;
+      if (strlen(thex) != THEXSIZE - 1
+	  || from_base32(thex, THEXSIZE - 1, digest, &bad) != TIGERSIZE)
+	continue;
+      key.dev = (dev_t)dev;
+      key.ino = (ino_t)ino;
+      key.size = (off_t)size;
+      key.sec = (time_t)sec;
+      cache_put(&key, digest);
+    }
+    fclose(f);
+  }
+
+  if (lines > nentries) {
+    tmp = (char *)xmalloc(strlen(name) + 5);
+    sprintf(tmp, "%s.tmp", name);
+    if ((f = fopen(tmp, "w")) != NULL) {
+      for (i = 0; i < nbuckets; i++)
+	for (e = buckets[i]; e != NULL; e = e->next)
+	  cache_write(f, &e->key, e->digest);
+      if (fclose(f) == 0)
+	rename(tmp, name);
+      else
+	unlink(tmp);
+    }
+    free(tmp);
+  }
+
+  if ((cacheFile = fopen(name, "a")) == NULL) {
+    fprintf(stderr, "%s: %s: %s\n", prog, name, strerror(errno));
+    exit(1);
+  }
+}
+
+/* the scheduler */
+
+static DEVICE *find_device(dev_t dev)
+{
+  int i;
+
+  for (i = 0; i < ndevices; i++)
+    if (devices[i].dev == dev)
+      return &devices[i];
+  if (ndevices == MAXDEVS)
+    return NULL;
+  devices[ndevices].dev = dev;
+  devices[ndevices].cold = 0;
+  return &devices[ndevices++];
+}
+
+/* called by ttf_hash() around the reading of a cold file */
+static void cold_proc(void *clientData, dev_t dev, int enter)
+{
+  DEVICE *d;
+
+  (void)clientData;
+  pthread_mutex_lock(&lock);
+  d = find_device(dev);
+  if (d != NULL) {
+    if (enter) {
+      while (d->cold >= perdev)
+	pthread_cond_wait(&devCond, &lock);
+      d->cold++;
+    } else {
+      d->cold--;
+      pthread_cond_broadcast(&devCond);
+    }
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+/* picks the first queued job whose device has a free slot, or else
+ * the first queued job */
+static JOB *next_job(void)
+{
+  JOB *job, *first = NULL;
+  DEVICE *d;
+
+  for (job = queue; job != NULL; job = job->next) {
+    if (job->running)
+      continue;
+    if (first == NULL)
+      first = job;
+    d = find_device(job->key.dev);
+    if (d == NULL || d->cold < perdev)
+      return job;
+  }
+  return first;
+}
+
+static void *worker(void *arg)
+{
+  JOB *job;
+  struct stat st;
+  int code;
+
+  (void)arg;
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (!quit && (job = next_job()) == NULL)
+      pthread_cond_wait(&jobCond, &lock);
+    if (quit)
+      break;
+    job->running = 1;
+    pthread_mutex_unlock(&lock);
+
+    code = ttf_hash(job->path, &fileOptions, job->digest);
+    job->error = code == -1 ? errno : 0;
+    /* a file changed while it was hashed is not cached */
+    if (code == 0 && (stat(job->path, &st) == -1
+	|| st.st_size != job->key.size || st.st_mtim.tv_sec != job->key.sec
+	|| st.st_mtim.tv_nsec != job->key.nsec))
+      code = -1;
+
+    pthread_mutex_lock(&lock);
+    if (job->error) {
+      nerrors++;
+    } else {
+      nhashed++;
+      if (code == 0) {
+	cache_put(&job->key, job->digest);
+	if (cacheFile != NULL) {
+	  cache_write(cacheFile, &job->key, job->digest);
+	  fflush(cacheFile);
+	}
+      }
+    }
+    job->done = 1;
+    wake();
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+/* connections, run by the main thread */
+
+static void append_out(CONN *c, const char *text)
+{
+  size_t len = strlen(text);
+
+  if (c->outlen + len > c->outroom) {
+    c->outroom = 2 * (c->outlen + len);
+    c->out = (char *)realloc(c->out, c->outroom);
+    if (c->out == NULL) {
+      perror(prog);
+      exit(2);
+    }
+  }
+  memcpy(c->out + c->outlen, text, len);
+  c->outlen += len;
+}
+
+static void add_reply(CONN *c, JOB *job, const char *text)
+{
+  REPLY *r = (REPLY *)xmalloc(sizeof(REPLY));
+
+  r->job = job;
+  r->text = text != NULL ? strdup(text) : NULL;
+  r->next = NULL;
+  if (job != NULL)
+    job->refs++;
+  if (c->tail != NULL)
+    c->tail->next = r;
+  else
+    c->head = r;
+  c->tail = r;
+}
+
+static void unref_job(JOB *job)
+{
+  if (--job->refs == 0 && !job->queued) {
+    free(job->path);
+    free(job);
+  }
+}
+
+static void format_job(JOB *job, char *line, size_t size)
+{
+  char thex[THEXSIZE];
+
+  if (job->error) {
+    snprintf(line, size, "ERR %s\n", strerror(job->error));
+  } else {
+    to_base32(job->digest, TIGERSIZE, thex);
+    snprintf(line, size, "OK %s %lld\n", thex, (long long)job->key.size);
+  }
+}
+
+/* moves the replies which are ready to the output buffer */
+static void flush_replies(CONN *c)
+{
+  REPLY *r;
+  char line[128];
+  int done;
+
+  while ((r = c->head) != NULL) {
+    if (r->job != NULL) {
+      pthread_mutex_lock(&lock);
+      done = r->job->done;
+      pthread_mutex_unlock(&lock);
+      if (!done)
+	break;
+      format_job(r->job, line, sizeof(line));
+      append_out(c, line);
+      unref_job(r->job);
+    } else {
+      append_out(c, r->text);
+      free(r->text);
+    }
+    c->head = r->next;
+    if (c->head == NULL)
+      c->tail = NULL;
+    free(r);
+  }
+}
+
+static void request_digest(CONN *c, const char *path)
+{
+  struct stat st;
+  KEY key;
+  JOB *job, **pp;
+  byte digest[TIGERSIZE];
+  char line[128], thex[THEXSIZE];
+
+  if (path[0] != '/') {
+    add_reply(c, NULL, "ERR path must be absolute\n");
+    return;
+  }
+  if (stat(path, &st) == -1) {
+    snprintf(line, sizeof(line), "ERR %s\n", strerror(errno));
+    add_reply(c, NULL, line);
+    pthread_mutex_lock(&lock);
+    nerrors++;
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    add_reply(c, NULL, S_ISDIR(st.st_mode) ? "ERR Is a directory\n"
+	: "ERR not a regular file\n");
+    return;
+  }
+  key.dev = st.st_dev;
+  key.ino = st.st_ino;
+  key.size = st.st_size;
+  key.sec = st.st_mtim.tv_sec;
+  key.nsec = st.st_mtim.tv_nsec;
+
+  pthread_mutex_lock(&lock);
+  if (cache_get(&key, digest)) {
+    nhits++;
+    pthread_mutex_unlock(&lock);
+    to_base32(digest, TIGERSIZE, thex);
+    snprintf(line, sizeof(line), "OK %s %lld\n", thex, (long long)key.size);
+    add_reply(c, NULL, line);
+    return;
+  }
+  for (job = queue; job != NULL; job = job->next)
+    if (key_equal(&job->key, &key))
+      break;
+  if (job != NULL) {
+    ncoalesced++;
+  } else {
+    job = (JOB *)xmalloc(sizeof(JOB));
+    memset(job, 0, sizeof(JOB));
+    job->key = key;
+    job->path = strdup(path);
+    job->queued = 1;
+    for (pp = &queue; *pp != NULL; pp = &(*pp)->next)
+      ;
+    *pp = job;
+    pthread_cond_signal(&jobCond);
+  }
+  pthread_mutex_unlock(&lock);
+  add_reply(c, job, NULL);
+}
+
+static void request_stats(CONN *c)
+{
+  char line[256];
+  unsigned long queued = 0;
+  JOB *job;
+
+  pthread_mutex_lock(&lock);
+  for (job = queue; job != NULL; job = job->next)
+    if (!job->done)
+      queued++;
+  snprintf(line, sizeof(line), "OK requests %lu hashed %lu hits %lu "
+      "coalesced %lu errors %lu queued %lu\n", nrequests, nhashed, nhits,
+      ncoalesced, nerrors, queued);
+  pthread_mutex_unlock(&lock);
+  add_reply(c, NULL, line);
+}
+
+/* with arguments, sets the limits of the workers' reads */
+static void request_throttle(CONN *c, const char *args)
+{
+  char line[128];
+  double mbps, iops;
+  int n = 0;
+
+  if (*args != '\0') {
+    if (sscanf(args, "%lf %lf%n", &mbps, &iops, &n) != 2 || args[n] != '\0'
+	|| mbps < 0 || iops < 0) {
+      add_reply(c, NULL, "ERR usage: THROTTLE ?MBPS IOPS?\n");
+      return;
+    }
+    ttf_throttle_set(&throttle, mbps, iops);
+  }
+  ttf_throttle_get(&throttle, &mbps, &iops);
+  snprintf(line, sizeof(line), "OK bwlimit %g iops %g\n", mbps, iops);
+  add_reply(c, NULL, line);
+}
+
+static void handle_line(CONN *c, char *line)
+{
+  size_t len = strlen(line);
+
+  if (len > 0 && line[len - 1] == '\r')
+    line[--len] = '\0';
+  if (!strncmp(line, "DIGEST ", 7)) {
+    pthread_mutex_lock(&lock);
+    nrequests++;
+    pthread_mutex_unlock(&lock);
+    request_digest(c, line + 7);
+  } else if (!strcmp(line, "STATS")) {
+    request_stats(c);
+  } else if (!strcmp(line, "THROTTLE")) {
+    request_throttle(c, "");
+  } else if (!strncmp(line, "THROTTLE ", 9)) {
+    request_throttle(c, line + 9);
+  } else {
+    add_reply(c, NULL, "ERR unknown command\n");
+  }
+}
+
+/* reads from the connection; returns -1 when it should be closed */
+static int read_conn(CONN *c)
+{
+  ssize_t n;
+  char *nl;
+
+  n = read(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen);
+  if (n == -1)
+    return errno == EINTR || errno == EAGAIN ? 0 : -1;
+  if (n == 0)
+    return -1;
+  c->inlen += n;
+  while ((nl = (char *)memchr(c->in, '\n', c->inlen)) != NULL) {
+    *nl = '\0';
+    handle_line(c, c->in);
+    c->inlen -= nl + 1 - c->in;
+    memmove(c->in, nl + 1, c->inlen);
+  }
+  if (c->inlen == sizeof(c->in)) {
+    c->inlen = 0;
+    add_reply(c, NULL, "ERR line too long\n");
+  }
+  return 0;
+}
+
+static int write_conn(CONN *c)
+{
+  ssize_t n;
+
+  n = write(c->fd, c->out, c->outlen);
+  if (n == -1)
+    return errno == EINTR || errno == EAGAIN ? 0 : -1;
+  c->outlen -= n;
+  memmove(c->out, c->out + n, c->outlen);
+  return 0;
+}
+
+static void close_conn(CONN *c)
+{
+  CONN **pp;
+  REPLY *r;
+
+  for (pp = &conns; *pp != c; pp = &(*pp)->next)
+    ;
+  *pp = c->next;
+  while ((r = c->head) != NULL) {
+    c->head = r->next;
+    if (r->job != NULL)
+      unref_job(r->job);
+    free(r->text);
+    free(r);
+  }
+  close(c->fd);
+  free(c->out);
+  free(c);
+}
+
+/* removes the finished jobs from the queue; their replies hold them */
+static void reap_jobs(void)
+{
+  JOB **pp, *job;
+
+  pthread_mutex_lock(&lock);
+  for (pp = &queue; (job = *pp) != NULL; ) {
+    if (job->done) {
+      *pp = job->next;
+      job->queued = 0;
+      if (job->refs == 0) {
+	free(job->path);
+	free(job);
+      }
+    } else {
+      pp = &job->next;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+static int open_socket(const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+  mode_t mask;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: %s: socket path too long\n", prog, path);
+    exit(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    perror(prog);
+    exit(1);
+  }
+  /* only a socket may be replaced, never a file of the user */
+  if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+    fprintf(stderr, "%s: %s: exists and is not a socket\n", prog, path);
+    exit(1);
+  }
+  /* a socket left by a daemon which is gone is removed */
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "%s: %s: a daemon is already listening\n", prog, path);
+    exit(1);
+  }
+  if (errno == ECONNREFUSED && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  mask = umask(077);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+      || listen(fd, 64) == -1) {
+    fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+    exit(1);
+  }
+  umask(mask);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tids[MAXJOBS];
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *socketPath = NULL, *cachePath = NULL, *dir;
+  char defaultPath[256];
+  struct pollfd *fds = NULL;
+  size_t nfds, room = 0;
+  struct sigaction sa;
+  int listenFd, fd, i;
+  double mbps = 0, iops = 0;
+  CONN *c, *next;
+  char buf[256];
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+      usage(0);
+    if (i + 1 == argc)
+      usage(1);
+    if (!strcmp(argv[i], "-socket"))
+      socketPath = argv[++i];
+    else if (!strcmp(argv[i], "-cache"))
+      cachePath = argv[++i];
+    else if (!strcmp(argv[i], "-jobs"))
+      jobs = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-perdev"))
+      perdev = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-bwlimit"))
+      mbps = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-iops"))
+      iops = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-engine")) {
+      i++;
+      if (!strcmp(argv[i], "auto"))
+	fileOptions.engine = TTF_AUTO;
+      else if (!strcmp(argv[i], "mmap"))
+	fileOptions.engine = TTF_MMAP;
+      else if (!strcmp(argv[i], "read"))
+	fileOptions.engine = TTF_READ;
+      else
+	usage(1);
+    } else
+      usage(1);
+  }
+  if (jobs < 1)
+    jobs = 1;
+  if (jobs > MAXJOBS)
+    jobs = MAXJOBS;
+  if (perdev < 1)
+    perdev = 1;
+  if (socketPath == NULL) {
+    if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL && *dir)
+      snprintf(defaultPath, sizeof(defaultPath), "%s/tthd.sock", dir);
+    else
+      snprintf(defaultPath, sizeof(defaultPath), "/tmp/tthd-%lu.sock",
+	  (unsigned long)getuid());
+    socketPath = defaultPath;
+  }
+  fileOptions.coldProc = cold_proc;
+  ttf_throttle_init(&throttle);
+  ttf_throttle_set(&throttle, mbps < 0 ? 0 : mbps, iops < 0 ? 0 : iops);
+  fileOptions.throttle = &throttle;
+  /* a file truncated under a mapping fails its request, not the daemon */
+  if (ttf_guard() == -1) {
+    perror(prog);
+    return 1;
+  }
+
+  nbuckets = 1024;
+  buckets = (ENTRY **)calloc(nbuckets, sizeof(ENTRY *));
+  if (cachePath != NULL)
+    cache_load(cachePath);
+
+  if (pipe(wakeFds) == -1) {
+    perror(prog);
+    return 1;
+  }
+  fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  listenFd = open_socket(socketPath);
+  for (i = 0; i < jobs; i++)
+    pthread_create(&tids[i], NULL, worker, NULL);
+
+  while (!stop) {
+    nfds = 2;
+    for (c = conns; c != NULL; c = c->next)
+      nfds++;
+    if (nfds > room) {
+      room = 2 * nfds;
+      fds = (struct pollfd *)realloc(fds, room * sizeof(struct pollfd));
+    }
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFds[0];
+    fds[1].events = POLLIN;
+    nfds = 2;
+    for (c = conns; c != NULL; c = c->next, nfds++) {
+      fds[nfds].fd = c->fd;
+      fds[nfds].events = POLLIN | (c->outlen ? POLLOUT : 0);
+    }
+    if (poll(fds, nfds, -1) == -1) {
+      if (errno == EINTR)
+	continue;
+      perror(prog);
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+      while (read(wakeFds[0], buf, sizeof(buf)) > 0)
+	;
+    /* the connections in fds come first in the list, new ones after */
+    nfds = 2;
+    for (c = conns; c != NULL; c = next, nfds++) {
+      next = c->next;
+      if ((fds[nfds].revents & (POLLIN | POLLHUP | POLLERR))
+	  && read_conn(c) == -1) {
+	close_conn(c);
+	continue;
+      }
+      flush_replies(c);
+      if (c->outlen && write_conn(c) == -1)
+	close_conn(c);
+    }
+    reap_jobs();
+    if (fds[0].revents & POLLIN) {
+      while ((fd = accept(listenFd, NULL, NULL)) != -1) {
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	c = (CONN *)xmalloc(sizeof(CONN));
+	memset(c, 0, sizeof(CONN));
+	c->fd = fd;
+	c->next = conns;
+	conns = c;
+      }
+    }
+  }
+
+  pthread_mutex_lock(&lock);
+  quit = 1;
+  pthread_cond_broadcast(&jobCond);
+  pthread_mutex_unlock(&lock);
+  for (i = 0; i < jobs; i++)
+    pthread_join(tids[i], NULL);
+  unlink(socketPath);
+  if (cacheFile != NULL)
+    fclose(cacheFile);
+  return 0;
+}
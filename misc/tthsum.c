@@ -0,0 +1,445 @@
+/*
+ * tthsum.c --
+ *
+ *	Command-line tool computing and checking Tiger Tree Hashes of
+ *	files, in the manner of sha256sum, without Tcl.
+ *
+ *	Files are hashed in parallel by a pool of threads and the results
+ *	are printed in the order of the arguments. Regular files are read
+ *	the way [tth digest -file] does it (see ttfile.c); --nocache drops
+ *	the pages of every file.
+ *
+ *	Usage: tthsum [OPTION]... [FILE]...
+ *	       tthsum --check [OPTION]... [FILE]...
+ *
+ *	See usage() below for the options. Build it with "make tthsum".
+ *
+ * $Id$
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "ttfile.h"
+#include "base32.h"
+#include "hex.h"
+
+#define MAXJOBS   256
+
+#define THEXLEN   (BASE32_DESTLEN(TIGERSIZE) - 1)
+#define HEXLEN    (HEX_DESTLEN(TIGERSIZE) - 1)
+
+typedef enum { F_THEX, F_HEX } FORMAT;
+
+typedef struct item {
+  char *name;
+  char *expected;               /* --check: the digest listed, or NULL */
+  FORMAT format;
+  char digest[HEX_DESTLEN(TIGERSIZE)];
+  int error;                    /* errno of a failure, or 0 */
+  int done;
+} ITEM;
+
+static const char *prog = "tthsum";
+static TTF_OPTIONS fileOptions = { TTF_AUTO, 0, NULL, NULL, NULL };
+static TTF_THROTTLE throttle;
+static FORMAT format = F_THEX;
+static int recursive = 0, quiet = 0, status = 0, warn = 0;
+
+static ITEM *items;
+static size_t nitems, room;
+static size_t next;             /* next item to hash */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+
+static void usage(int code)
+{
+  FILE *out = code ? stderr : stdout;
+
+  fprintf(out,
+"Usage: %s [OPTION]... [FILE]...\n"
+"Print or check Tiger Tree Hash (TTH) digests.\n"
+"With no FILE, or when FILE is -, read standard input.\n"
+"\n"
+"  -c, --check          read digests from the FILEs and check them\n"
+"  -r, --recursive      hash the files in directories, recursively\n"
+"  -j, --jobs=N         hash N files at a time (default: number of CPUs)\n"
+"      --thex           print base32 (THEX) digests (the default)\n"
+"      --hex            print hex digests\n"
+"      --engine=NAME    read files using auto, mmap or read (default: auto)\n"
+"      --nocache        drop the files from the page cache after hashing\n"
+"      --bwlimit=MBPS   read at most MBPS megabytes per second in all\n"
+"      --iops=N         issue at most N reads per second in all\n"
+"\n"
+"The following options are useful only when verifying digests:\n"
+"      --quiet          don't print OK for each successfully verified file\n"
+"      --status         don't output anything, status code shows success\n"
+"  -w, --warn           warn about improperly formatted digest lines\n"
+"\n"
+"  -h, --help           display this help and exit\n", prog);
+  exit(code);
+}
+
+static ITEM *add_item(const char *name)
+{
+  ITEM *item;
+
+  if (nitems == room) {
+    room = room ? 2 * room : 64;
+    items = (ITEM *)realloc(items, room * sizeof(ITEM));
+    if (items == NULL) {
+      perror(prog);
+      exit(2);
+    }
+  }
+  item = &items[nitems++];
+  memset(item, 0, sizeof(ITEM));
+  item->name = strdup(name);
+  item->format = format;
+  return item;
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* adds the files of a directory tree, sorted; symlinks to
+ * directories are not followed, special files are skipped */
+static void add_tree(const char *dir)
+{
+  DIR *d;
+  struct dirent *ent;
+  struct stat st;
+  char **names = NULL, *path;
+  size_t n = 0, nroom = 0, i;
+
+  if ((d = opendir(dir)) == NULL) {
+    add_item(dir)->error = errno;
+    return;
+  }
+  while ((ent = readdir(d)) != NULL) {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+      continue;
+    if (n == nroom) {
+      nroom = nroom ? 2 * nroom : 16;
+      names = (char **)realloc(names, nroom * sizeof(char *));
+    }
+    names[n++] = strdup(ent->d_name);
+  }
+  closedir(d);
+  qsort(names, n, sizeof(char *), cmp_names);
+
+  for (i = 0; i < n; i++) {
+    path = (char *)malloc(strlen(dir) + strlen(names[i]) + 2);
+    sprintf(path, "%s%s%s", dir,
+	dir[strlen(dir) - 1] == '/' ? "" : "/", names[i]);
+    if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+      add_tree(path);
+    else if (stat(path, &st) == 0 && !S_ISREG(st.st_mode))
+      ;
+    else
+      add_item(path);
+    free(path);
+    free(names[i]);
+  }
+  free(names);
+}
+
+static void add_arg(const char *name)
+{
+  struct stat st;
+
+  if (recursive && strcmp(name, "-") && stat(name, &st) == 0
+      && S_ISDIR(st.st_mode))
+    add_tree(name);
+  else
+    add_item(name);
+}
+
+static void hash_item(ITEM *item)
+{
+  byte hash[TIGERSIZE];
+
+  if (item->error)
+    return;
+  if (ttf_hash(item->name, &fileOptions, hash) == -1) {
+    item->error = errno;
+    return;
+  }
+  if (item->format == F_HEX)
+    to_hex(hash, TIGERSIZE, item->digest);
+  else
+    to_base32(hash, TIGERSIZE, item->digest);
+}
+
+static void *worker(void *arg)
+{
+  size_t i;
+
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    i = next++;
+    pthread_mutex_unlock(&lock);
+    if (i >= nitems)
+      break;
+    /* stdin is hashed by the main thread, in turn */
+    if (strcmp(items[i].name, "-"))
+      hash_item(&items[i]);
+    pthread_mutex_lock(&lock);
+    items[i].done = 1;
+    pthread_cond_broadcast(&doneCond);
+    pthread_mutex_unlock(&lock);
+  }
+  return NULL;
+}
+
+static void wait_item(ITEM *item)
+{
+  pthread_mutex_lock(&lock);
+  while (!item->done)
+    pthread_cond_wait(&doneCond, &lock);
+  pthread_mutex_unlock(&lock);
+  if (!strcmp(item->name, "-"))
+    hash_item(item);
+}
+
+/* prints the name as sha256sum does: a name containing a backslash
+ * or a newline is escaped and the line is prefixed with a backslash */
+static void print_line(const char *digest, const char *name)
+{
+  const char *p;
+
+  if (strpbrk(name, "\\\n") == NULL) {
+    printf("%s  %s\n", digest, name);
+    return;
+  }
+  printf("\\%s  ", digest);
+  for (p = name; *p; p++) {
+    if (*p == '\\')
+      fputs("\\\\", stdout);
+    else if (*p == '\n')
+      fputs("\\n", stdout);
+    else
+      putchar(*p);
+  }
+  putchar('\n');
+}
+
+/* parses a line of a digest list; returns 0 if it is malformed */
+static int parse_line(char *line, char **digestPtr, char **namePtr)
+{
+  size_t len = strlen(line), dlen;
+  int escaped = 0;
+  char *p, *q;
+
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    line[--len] = '\0';
+  if (*line == '\\') {
+    escaped = 1;
+    line++;
+  }
+  dlen = strcspn(line, " ");
+  if ((dlen != THEXLEN && dlen != HEXLEN) || line[dlen] != ' '
+      || (line[dlen + 1] != ' ' && line[dlen + 1] != '*')
+      || line[dlen + 2] == '\0')
+    return 0;
+  line[dlen] = '\0';
+  *digestPtr = line;
+  *namePtr = line + dlen + 2;
+  if (escaped) {
+    for (p = q = *namePtr; *p; p++, q++) {
+      if (*p == '\\' && p[1] == 'n') {
+	*q = '\n';
+	p++;
+      } else if (*p == '\\' && p[1] == '\\') {
+	*q = '\\';
+	p++;
+      } else {
+	*q = *p;
+      }
+    }
+    *q = '\0';
+  }
+  return 1;
+}
+
+static int read_list(const char *list)
+{
+  FILE *in;
+  char *line = NULL, *digest, *name;
+  size_t size = 0;
+  long lineno = 0, bad = 0, good = 0;
+  ITEM *item;
+
+  in = strcmp(list, "-") ? fopen(list, "r") : stdin;
+  if (in == NULL) {
+    fprintf(stderr, "%s: %s: %s\n", prog, list, strerror(errno));
+    return -1;
+  }
+  while (getline(&line, &size, in) != -1) {
+    lineno++;
+    if (!parse_line(line, &digest, &name)) {
+      bad++;
+      if (warn)
+	fprintf(stderr, "%s: %s: %ld: improperly formatted TTH checksum "
+	    "line\n", prog, list, lineno);
+      continue;
+    }
+    item = add_item(name);
+    item->expected = strdup(digest);
+    item->format = strlen(digest) == HEXLEN ? F_HEX : F_THEX;
+    good++;
+  }
+  free(line);
+  if (in != stdin)
+    fclose(in);
+  if (good == 0) {
+    fprintf(stderr, "%s: %s: no properly formatted TTH checksum lines "
+	"found\n", prog, list);
+    return -1;
+  }
+  if (bad && !status)
+    fprintf(stderr, "%s: WARNING: %ld line%s improperly formatted\n", prog,
+	bad, bad > 1 ? "s are" : " is");
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tids[MAXJOBS];
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int check = 0, code = 0, i, nthreads;
+  long failed = 0, unread = 0;
+  char **args;
+  int nargs = 0, opts = 1;
+  double mbps = 0, iops = 0;
+  size_t k;
+
+  args = (char **)malloc((argc + 1) * sizeof(char *));
+  for (i = 1; i < argc; i++) {
+    const char *a = argv[i];
+
+    if (!opts || a[0] != '-' || !strcmp(a, "-")) {
+      args[nargs++] = argv[i];
+    } else if (!strcmp(a, "--")) {
+      opts = 0;
+    } else if (!strcmp(a, "-c") || !strcmp(a, "--check")) {
+      check = 1;
+    } else if (!strcmp(a, "-r") || !strcmp(a, "--recursive")) {
+      recursive = 1;
+    } else if (!strcmp(a, "-j") && i + 1 < argc) {
+      jobs = atol(argv[++i]);
+    } else if (!strncmp(a, "-j", 2) && a[2] != '\0') {
+      jobs = atol(a + 2);
+    } else if (!strncmp(a, "--jobs=", 7)) {
+      jobs = atol(a + 7);
+    } else if (!strcmp(a, "--thex")) {
+      format = F_THEX;
+    } else if (!strcmp(a, "--hex")) {
+      format = F_HEX;
+    } else if (!strcmp(a, "--engine=auto")) {
+      fileOptions.engine = TTF_AUTO;
+    } else if (!strcmp(a, "--engine=mmap")) {
+      fileOptions.engine = TTF_MMAP;
+    } else if (!strcmp(a, "--engine=read")) {
+      fileOptions.engine = TTF_READ;
+    } else if (!strcmp(a, "--nocache")) {
+      fileOptions.nocache = 1;
+    } else if (!strncmp(a, "--bwlimit=", 10)) {
+      mbps = atof(a + 10);
+    } else if (!strncmp(a, "--iops=", 7)) {
+      iops = atof(a + 7);
+    } else if (!strcmp(a, "--quiet")) {
+      quiet = 1;
+    } else if (!strcmp(a, "--status")) {
+      status = 1;
+    } else if (!strcmp(a, "-w") || !strcmp(a, "--warn")) {
+      warn = 1;
+    } else if (!strcmp(a, "-h") || !strcmp(a, "--help")) {
+      usage(0);
+    } else {
+      fprintf(stderr, "%s: invalid option -- '%s'\n", prog, a);
+      usage(1);
+    }
+  }
+  if (jobs < 1)
+    jobs = 1;
+  if (jobs > MAXJOBS)
+    jobs = MAXJOBS;
+  if (nargs == 0)
+    args[nargs++] = "-";
+  if (mbps > 0 || iops > 0) {
+    ttf_throttle_init(&throttle);
+    ttf_throttle_set(&throttle, mbps, iops);
+    fileOptions.throttle = &throttle;
+  }
+
+  for (i = 0; i < nargs; i++) {
+    if (check) {
+      if (read_list(args[i]) == -1)
+	code = 1;
+    } else {
+      add_arg(args[i]);
+    }
+  }
+
+  nthreads = nitems < (size_t)jobs ? (int)nitems : (int)jobs;
+  for (i = 0; i < nthreads; i++)
+    pthread_create(&tids[i], NULL, worker, NULL);
+
+  for (k = 0; k < nitems; k++) {
+    ITEM *item = &items[k];
+
+    wait_item(item);
+    if (item->error) {
+      fprintf(stderr, "%s: %s: %s\n", prog, item->name,
+	  strerror(item->error));
+      if (check) {
+	unread++;
+	if (!status)
+	  printf("%s: FAILED open or read\n", item->name);
+      }
+      code = 1;
+    } else if (!check) {
+      print_line(item->digest, item->name);
+    } else if (strcasecmp(item->digest, item->expected)) {
+      failed++;
+      code = 1;
+      if (!status)
+	printf("%s: FAILED\n", item->name);
+    } else if (!quiet && !status) {
+      printf("%s: OK\n", item->name);
+    }
+    fflush(stdout);
+  }
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join(tids[i], NULL);
+
+  if (!status) {
+    if (unread)
+      fprintf(stderr, "%s: WARNING: %ld listed file%s could not be read\n",
+	  prog, unread, unread > 1 ? "s" : "");
+    if (failed)
+      fprintf(stderr, "%s: WARNING: %ld computed checksum%s did NOT match\n",
+	  prog, failed, failed > 1 ? "s" : "");
+  }
+
+  for (k = 0; k < nitems; k++) {
+    free(items[k].name);
+    free(items[k].expected);
+  }
+  free(items);
+  free(args);
+  return code;
+}
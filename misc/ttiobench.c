@@ -0,0 +1,480 @@
+/*
+ * ttiobench.c --
+ *
+ *	Cold- and warm-cache benchmark of the ways the library reads files,
+ *	for tuning the chunk and window sizes of the I/O engines:
+ *
+ *	  chan    read() with a buffer of the given size, like -chan and
+ *	          the "stream" engine (CHUNKSIZE in tclinput.c);
+ *	  read    pread() after POSIX_FADV_SEQUENTIAL, dropping the pages
+ *	          behind the reads from a cold cache, like the "read"
+ *	          engine of -file (ENGINE_BUFSIZE in posix_mmap.c);
+ *	  mmap    one mapping of the whole file after MADV_SEQUENTIAL,
+ *	          hashed in chunks of the given size, like the "mmap"
+ *	          engine of -file;
+ *	  window  a mapping per window of the given size, like -mmap
+ *	          (which maps a page at a time).
+ *
+ *	Each engine is run with each of the sizes and thread counts; with
+ *	n threads, n files are hashed concurrently and the aggregate MB/s
+ *	is reported. Before a cold run the files are evicted from the page
+ *	cache with POSIX_FADV_DONTNEED, which needs no privileges but only
+ *	works on file systems backed by a disk (not tmpfs); the share of
+ *	the files still resident afterwards is reported.
+ *
+ *	Usage: ttiobench ?-json? ?-dir path? ?-size n? ?-reps n?
+ *	                 ?-engines list? ?-buffers list? ?-windows list?
+ *	                 ?-threads list? ?-cache list? ?-keep?
+ *
+ *	Lists are comma-separated; sizes take a k, m or g suffix. The
+ *	scratch files (-size bytes each, one per thread) are created in
+ *	-dir, the current directory by default, and removed afterwards
+ *	unless -keep is given. Build and run it with "make bench-io"
+ *	(IOBENCHFLAGS are passed to it).
+ *
+ * $Id$
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "tigertree.h"
+
+#define MAXLIST 16
+
+typedef enum { E_CHAN, E_READ, E_MMAP, E_WINDOW, E_NENGINES } ENGINE;
+
+static const char *engineNames[] = { "chan", "read", "mmap", "window" };
+
+typedef struct {
+  long n;
+  long items[MAXLIST];
+} LIST;
+
+typedef struct job {
+  ENGINE engine;
+  size_t param;
+  int cold;
+  const char *name;
+  int error;
+} JOB;
+
+static long pagesize;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long parse_size(const char *s)
+{
+  char *end;
+  long n = strtol(s, &end, 10);
+
+  switch (*end) {
+  case 'k': case 'K': n <<= 10; end++; break;
+  case 'm': case 'M': n <<= 20; end++; break;
+  case 'g': case 'G': n <<= 30; end++; break;
+  }
+  return *end == '\0' && n >= 0 ? n : -1;
+}
+
+/* parses a comma-separated list of sizes, or of names from names[] */
+static int parse_list(const char *s, LIST *list, const char **names, int nnames)
+{
+  char buf[256], *tok, *save;
+  int i;
+
+  strncpy(buf, s, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = '\0';
+  list->n = 0;
+  for (tok = strtok_r(buf, ",", &save); tok != NULL;
+      tok = strtok_r(NULL, ",", &save)) {
+    if (list->n == MAXLIST)
+      return -1;
+    if (names == NULL) {
+      if ((list->items[list->n] = parse_size(tok)) <= 0)
+	return -1;
+    } else {
+      for (i = 0; i < nnames && strcmp(tok, names[i]); i++)
+	;
+      if (i == nnames)
+	return -1;
+      list->items[list->n] = i;
+    }
+    list->n++;
+  }
+  return list->n > 0 ? 0 : -1;
+}
+
+static const char *format_size(long n, char *buf)
+{
+  if (n % (1 << 20) == 0)
+    sprintf(buf, "%ldm", n >> 20);
+  else if (n % (1 << 10) == 0)
+    sprintf(buf, "%ldk", n >> 10);
+  else
+    sprintf(buf, "%ld", n);
+  return buf;
+}
+
+static int make_file(const char *name, long size)
+{
+  byte block[65536];
+  struct stat st;
+  long left;
+  int fd, i;
+
+  if (stat(name, &st) == 0 && st.st_size == size)
+    return 0;
+  for (i = 0; i < (int)sizeof(block); i++)
+    block[i] = (byte)(i * 131 + (i >> 8) * 7);
+  fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    return -1;
+  for (left = size; left > 0; left -= sizeof(block)) {
+    if (write(fd, block, left < (long)sizeof(block) ? left
+	  : (long)sizeof(block)) == -1) {
+      close(fd);
+      return -1;
+    }
+  }
+  /* dirty pages can not be dropped */
+  fsync(fd);
+  close(fd);
+  return 0;
+}
+
+/* drops the file from the page cache (cold) or reads it in (warm);
+ * returns the share of its pages resident afterwards */
+static double prepare_file(const char *name, int cold)
+{
+  struct stat st;
+  unsigned char *vec;
+  size_t pages, i, resident = 0;
+  void *addr;
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+    if (fd != -1)
+      close(fd);
+    return 0;
+  }
+  if (cold) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  } else {
+    byte buf[65536];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+      ;
+  }
+
+  pages = (st.st_size + pagesize - 1) / pagesize;
+  addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  vec = (unsigned char *)malloc(pages);
+  if (addr != MAP_FAILED && mincore(addr, st.st_size, (void *)vec) == 0) {
+    for (i = 0; i < pages; i++)
+      resident += vec[i] & 1;
+  }
+  if (addr != MAP_FAILED)
+    munmap(addr, st.st_size);
+  free(vec);
+  close(fd);
+  return (double)resident / pages;
+}
+
+static int hash_chan(int fd, size_t bufsize, TT_CONTEXT *ctx)
+{
+  byte *buf = (byte *)malloc(bufsize);
+  ssize_t n;
+
+  while ((n = read(fd, buf, bufsize)) > 0)
+    tt_update(ctx, buf, (word32)n);
+  free(buf);
+  return n == -1 ? -1 : 0;
+}
+
+static int hash_read(int fd, size_t bufsize, int cold, TT_CONTEXT *ctx)
+{
+  byte *buf = (byte *)malloc(bufsize);
+  off_t offset = 0;
+  ssize_t n;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  while ((n = pread(fd, buf, bufsize, offset)) > 0) {
+    tt_update(ctx, buf, (word32)n);
+    if (cold)
+      posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+    offset += n;
+  }
+  free(buf);
+  return n == -1 ? -1 : 0;
+}
+
+static int hash_mmap(int fd, off_t size, size_t chunk, TT_CONTEXT *ctx)
+{
+  byte *addr;
+  off_t offset;
+  size_t len;
+
+  addr = (byte *)mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    return -1;
+  madvise(addr, size, MADV_SEQUENTIAL);
+  for (offset = 0; offset < size; offset += len) {
+    len = size - offset < (off_t)chunk ? size - offset : chunk;
+    tt_update(ctx, addr + offset, (word32)len);
+  }
+  munmap(addr, size);
+  return 0;
+}
+
+static int hash_window(int fd, off_t size, size_t window, TT_CONTEXT *ctx)
+{
+  byte *addr;
+  off_t offset;
+  size_t len;
+
+  window -= window % pagesize;
+  if (window == 0)
+    window = pagesize;
+  for (offset = 0; offset < size; offset += len) {
+    len = size - offset < (off_t)window ? size - offset : window;
+    addr = (byte *)mmap(0, len, PROT_READ, MAP_SHARED, fd, offset);
+    if (addr == MAP_FAILED)
+      return -1;
+    tt_update(ctx, addr, (word32)len);
+    munmap(addr, len);
+  }
+  return 0;
+}
+
+static void *run_job(void *arg)
+{
+  JOB *job = (JOB *)arg;
+  TT_CONTEXT ctx;
+  byte hash[TIGERSIZE];
+  struct stat st;
+  int fd, code = -1;
+
+  fd = open(job->name, O_RDONLY);
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    job->error = errno;
+    return NULL;
+  }
+  tt_init(&ctx);
+  switch (job->engine) {
+  case E_CHAN:
+    code = hash_chan(fd, job->param, &ctx);
+    break;
+  case E_READ:
+    code = hash_read(fd, job->param, job->cold, &ctx);
+    break;
+  case E_MMAP:
+    code = hash_mmap(fd, st.st_size, job->param, &ctx);
+    break;
+  case E_WINDOW:
+    code = hash_window(fd, st.st_size, job->param, &ctx);
+    break;
+  default:
+    break;
+  }
+  tt_digest(&ctx, hash);
+  tt_free(&ctx);
+  job->error = code == -1 ? errno : 0;
+  close(fd);
+  return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s ?-json? ?-dir path? ?-size n? ?-reps n? "
+      "?-engines list? ?-buffers list? ?-windows list? ?-threads list? "
+      "?-cache list? ?-keep?\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  static const char *cacheNames[] = { "warm", "cold" };
+  const char *dir = ".";
+  long size = 64 << 20;
+  int json = 0, keep = 0, reps = 3;
+  LIST engines, buffers, windows, threads, caches;
+  char (*names)[1024];
+  JOB jobs[64];
+  pthread_t tids[64];
+  double samples[101], mbps, resident, maxResident = 0;
+  int e, p, t, c, r, i, first = 1, maxThreads = 0;
+  char sbuf[32];
+
+  parse_list("chan,read,mmap,window", &engines, engineNames, E_NENGINES);
+  parse_list("8k,64k,256k,1m", &buffers, NULL, 0);
+  parse_list("4k,64k,1m,16m", &windows, NULL, 0);
+  parse_list("1,2,4", &threads, NULL, 0);
+  parse_list("cold,warm", &caches, cacheNames, 2);
+
+  for (i = 1; i < argc; i++) {
+    const char *opt = argv[i], *val = i + 1 < argc ? argv[i + 1] : NULL;
+    int bad = 0;
+
+    if (!strcmp(opt, "-json")) {
+      json = 1;
+      continue;
+    } else if (!strcmp(opt, "-keep")) {
+      keep = 1;
+      continue;
+    } else if (val == NULL) {
+      usage(argv[0]);
+    } else if (!strcmp(opt, "-dir")) {
+      dir = val;
+    } else if (!strcmp(opt, "-size")) {
+      bad = (size = parse_size(val)) <= 0;
+    } else if (!strcmp(opt, "-reps")) {
+      reps = atoi(val);
+      bad = reps < 1 || reps > 101;
+    } else if (!strcmp(opt, "-engines")) {
+      bad = parse_list(val, &engines, engineNames, E_NENGINES);
+    } else if (!strcmp(opt, "-buffers")) {
+      bad = parse_list(val, &buffers, NULL, 0);
+    } else if (!strcmp(opt, "-windows")) {
+      bad = parse_list(val, &windows, NULL, 0);
+    } else if (!strcmp(opt, "-threads")) {
+      bad = parse_list(val, &threads, NULL, 0);
+    } else if (!strcmp(opt, "-cache")) {
+      bad = parse_list(val, &caches, cacheNames, 2);
+    } else {
+      bad = 1;
+    }
+    if (bad)
+      usage(argv[0]);
+    i++;
+  }
+  for (t = 0; t < threads.n; t++) {
+    if (threads.items[t] > 64)
+      usage(argv[0]);
+    if (threads.items[t] > maxThreads)
+      maxThreads = threads.items[t];
+  }
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  names = malloc(maxThreads * sizeof(*names));
+  for (i = 0; i < maxThreads; i++) {
+    snprintf(names[i], sizeof(names[i]), "%s/ttiobench-%d.dat", dir, i);
+    if (make_file(names[i], size) == -1) {
+      fprintf(stderr, "can not create \"%s\": %s\n", names[i],
+	  strerror(errno));
+      return 1;
+    }
+  }
+
+  if (json) {
+    printf("{\"size\": %ld, \"reps\": %d, \"results\": [", size, reps);
+  } else {
+    printf("MB/s hashing %s files, median of %d runs\n",
+	format_size(size, sbuf), reps);
+    printf("%-8s %8s", "engine", "size");
+    for (t = 0; t < threads.n; t++)
+      for (c = 0; c < caches.n; c++) {
+	sprintf(sbuf, "%ldT %s", threads.items[t],
+	    cacheNames[caches.items[c]]);
+	printf(" %10s", sbuf);
+      }
+    printf("\n");
+  }
+
+  for (e = 0; e < engines.n; e++) {
+    ENGINE engine = (ENGINE)engines.items[e];
+    LIST *params = engine == E_WINDOW ? &windows : &buffers;
+
+    for (p = 0; p < params->n; p++) {
+      if (!json)
+	printf("%-8s %8s", engineNames[engine],
+	    format_size(params->items[p], sbuf));
+      for (t = 0; t < threads.n; t++) {
+	int n = threads.items[t];
+
+	for (c = 0; c < caches.n; c++) {
+	  int cold = caches.items[c];
+	  double start;
+
+	  resident = 0;
+	  for (r = 0; r < reps; r++) {
+	    for (i = 0; i < n; i++) {
+	      resident += prepare_file(names[i], cold) / n / reps;
+	      jobs[i].engine = engine;
+	      jobs[i].param = params->items[p];
+	      jobs[i].cold = cold;
+	      jobs[i].name = names[i];
+	      jobs[i].error = 0;
+	    }
+	    start = now();
+	    for (i = 0; i < n; i++)
+	      pthread_create(&tids[i], NULL, run_job, &jobs[i]);
+	    for (i = 0; i < n; i++)
+	      pthread_join(tids[i], NULL);
+	    samples[r] = (double)size * n / 1e6 / (now() - start);
+	    for (i = 0; i < n; i++) {
+	      if (jobs[i].error) {
+		fprintf(stderr, "\n%s failed on \"%s\": %s\n",
+		    engineNames[engine], names[i], strerror(jobs[i].error));
+		return 1;
+	      }
+	    }
+	  }
+	  qsort(samples, reps, sizeof(double), cmp_double);
+	  mbps = reps & 1 ? samples[reps / 2]
+	      : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+	  if (cold && resident > maxResident)
+	    maxResident = resident;
+
+	  if (json) {
+	    printf("%s\n  {\"engine\": \"%s\", \"size\": %ld, \"threads\": %d, "
+		"\"cache\": \"%s\", \"mbps\": %.2f, \"resident\": %.3f}",
+		first ? "" : ",", engineNames[engine], params->items[p], n,
+		cacheNames[cold], mbps, resident);
+	    first = 0;
+	  } else {
+	    printf(" %10.1f", mbps);
+	  }
+	  fflush(stdout);
+	}
+      }
+      if (!json)
+	printf("\n");
+    }
+  }
+
+  if (json)
+    printf("\n]}\n");
+  if (maxResident > 0.05)
+    fprintf(stderr, "warning: up to %.0f%% of the files stayed cached after "
+	"eviction (tmpfs?), cold figures are not cold\n", maxResident * 100);
+
+  if (!keep)
+    for (i = 0; i < maxThreads; i++)
+      unlink(names[i]);
+  free(names);
+  return 0;
+}
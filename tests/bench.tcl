@@ -0,0 +1,359 @@
+# bench.tcl --
+#
+# End-to-end benchmark of the hashing commands: [tth digest] of strings,
+# channels, mapped files, files and contexts and [tiger] over inputs of
+# various sizes, and the per-call overhead of hashing many small messages
+# one by one, in a batch or through a context.
+#
+# The input files are generated in a scratch directory and hashed with
+# a warm page cache. Every measurement is the median of -reps runs, each
+# of which repeats the call until it takes at least -mintime microseconds
+# as measured by [clock microseconds].
+#
+# The results are compared against a baseline (bench.baseline next to
+# this script by default): a call that got slower by more than -tolerance
+# percent is reported as a regression, and the script exits with status 1
+# if there are any. -save writes the results as the new baseline instead.
+# Baselines are only comparable on the same machine and build.
+#
+# Usage: tclsh bench.tcl ?-sizes list? ?-reps n? ?-mintime us? ?-messages n?
+#                        ?-memlimit size? ?-dir path? ?-keep?
+#                        ?-baseline file? ?-tolerance percent? ?-save?
+#
+# Sizes are given in bytes with an optional k, m or g suffix (binary
+# multiples), separated by spaces or commas, e.g. -sizes 0,1k,1m,4g;
+# inputs larger than -memlimit are not hashed as strings.
+#
+# Run it with "make bench-tcl", passing the options in TCLBENCHFLAGS.
+#
+# $Id$
+
+package require Tcl 8.5
+package require tth
+
+namespace eval bench {
+	variable opts
+	array set opts [list \
+		-sizes     {0 1k 64k 1m 16m 128m} \
+		-reps      5 \
+		-mintime   100000 \
+		-messages  1000 \
+		-memlimit  256m \
+		-dir       [file join [expr {[info exists ::env(TMPDIR)]
+			? $::env(TMPDIR) : "/tmp"}] tthbench-[pid]] \
+		-keep      0 \
+		-baseline  [file join [file dirname [file normalize [info script]]] \
+			bench.baseline] \
+		-tolerance 25 \
+		-save      0 \
+	]
+
+	variable data      ;# the input of the current measurement, in memory
+	variable path      ;# the input of the current measurement, on disk
+	variable messages  ;# list of small messages
+	variable results {}
+
+	variable haveMmap [expr {![catch {::tth::tth digest -mmap [info script]}]}]
+}
+
+# Parses a size with an optional binary suffix.
+proc bench::parseSize {spec} {
+	if {![regexp -nocase {^(\d+)([kmg]?)$} $spec -> n unit]} {
+		return -code error "bad size \"$spec\""
+	}
+	set shift [dict get {"" 0 k 10 m 20 g 30} [string tolower $unit]]
+	expr {wide($n) << $shift}
+}
+
+proc bench::formatSize {size} {
+	foreach {unit shift} {g 30 m 20 k 10} {
+		if {$size > 0 && $size % (1 << $shift) == 0} {
+			return [expr {$size >> $shift}]$unit
+		}
+	}
+	return $size
+}
+
+proc bench::parseArgs {argv} {
+	variable opts
+	set flags {-keep -save}
+	while {[llength $argv]} {
+		set argv [lassign $argv opt]
+		if {![info exists opts($opt)]} {
+			return -code error "bad option \"$opt\": must be\
+				[join [lsort [array names opts]] {, }]"
+		}
+		if {$opt in $flags} {
+			set opts($opt) 1
+		} elseif {[llength $argv] == 0} {
+			return -code error "option \"$opt\" requires an argument"
+		} else {
+			set argv [lassign $argv opts($opt)]
+		}
+	}
+	set opts(-sizes) [string map {, " "} $opts(-sizes)]
+	set opts(-memlimit) [parseSize $opts(-memlimit)]
+}
+
+# Writes a file of the given size from a pseudo-random 1 MiB block,
+# unless it already exists.
+proc bench::makeInput {size} {
+	variable opts
+	set name [file join $opts(-dir) input-[formatSize $size]]
+	if {[file exists $name] && [file size $name] == $size} {
+		return $name
+	}
+	expr {srand(1)}
+	set bytes {}
+	for {set i 0} {$i < 65536} {incr i} {
+		lappend bytes [expr {int(rand() * 256)}]
+	}
+	set block [string repeat [binary format c* $bytes] 16]
+
+	set fd [open $name w]
+	fconfigure $fd -translation binary
+	set left $size
+	while {$left > 0} {
+		set n [expr {min($left, [string length $block])}]
+		puts -nonewline $fd [string range $block 0 [expr {$n - 1}]]
+		incr left -$n
+	}
+	close $fd
+	return $name
+}
+
+proc bench::readInput {name} {
+	set fd [open $name]
+	fconfigure $fd -translation binary
+	set res [read $fd]
+	close $fd
+	return $res
+}
+
+# Runs the script n times, returns the elapsed time in microseconds.
+proc bench::run {script n} {
+	set lambda [list n [string map [list @SCRIPT@ $script] {
+		set start [clock microseconds]
+		for {set i 0} {$i < $n} {incr i} {
+			@SCRIPT@
+		}
+		expr {[clock microseconds] - $start}
+	}] ::bench]
+	apply $lambda $n
+}
+
+# Returns the median time of one run of the script, in microseconds.
+proc bench::measure {script} {
+	variable opts
+	set n 1
+	while {[set t [run $script $n]] < $opts(-mintime) && $n < (1 << 24)} {
+		set n [expr {$n * 2}]
+	}
+	set samples {}
+	for {set i 0} {$i < $opts(-reps)} {incr i} {
+		lappend samples [expr {double([run $script $n]) / $n}]
+	}
+	set samples [lsort -real $samples]
+	set mid [expr {[llength $samples] / 2}]
+	if {[llength $samples] % 2} {
+		return [lindex $samples $mid]
+	}
+	expr {([lindex $samples $mid-1] + [lindex $samples $mid]) / 2}
+}
+
+proc bench::record {key usec} {
+	variable results
+	dict set results $key $usec
+	return $usec
+}
+
+# Hashing of whole inputs; returns the table rows.
+proc bench::throughput {} {
+	variable opts
+	variable data
+	variable path
+	variable haveMmap
+
+	set modes {
+		string  {::tth::tth digest -string $::bench::data}
+		chan    {
+			set fd [open $::bench::path]
+			fconfigure $fd -translation binary
+			::tth::tth digest -chan $fd
+			close $fd
+		}
+		mmap    {::tth::tth digest -mmap $::bench::path}
+		file    {::tth::tth digest -file $::bench::path}
+		context {
+			set fd [open $::bench::path]
+			fconfigure $fd -translation binary
+			set ctx [::tth::tth init]
+			while {![eof $fd]} {
+				::tth::tth update $ctx [read $fd 65536]
+			}
+			::tth::tth digest $ctx
+			close $fd
+		}
+		tiger   {::tth::tiger $::bench::data}
+		tiger-chan {
+			set fd [open $::bench::path]
+			fconfigure $fd -translation binary
+			::tth::tiger digest -chan $fd
+			close $fd
+		}
+	}
+
+	set rows {}
+	foreach spec $opts(-sizes) {
+		set size [parseSize $spec]
+		set path [makeInput $size]
+		if {$size <= $opts(-memlimit)} {
+			set data [readInput $path]
+		} else {
+			set data ""
+		}
+		foreach {mode script} $modes {
+			if {$mode in {string tiger} && $size > $opts(-memlimit)} continue
+			if {$mode eq "mmap" && !$haveMmap} continue
+			set usec [record [list throughput $mode [formatSize $size]] \
+				[measure $script]]
+			lappend rows [list $mode [formatSize $size] $usec \
+				[expr {$usec > 0 ? $size / $usec : 0}]]
+		}
+		set data ""
+		if {!$opts(-keep)} {
+			file delete $path
+		}
+	}
+	return $rows
+}
+
+# Hashing of many small messages; returns the table rows.
+proc bench::overhead {} {
+	variable opts
+	variable messages
+
+	set patterns {
+		single  {
+			foreach msg $::bench::messages {
+				::tth::tth digest -string $msg
+			}
+		}
+		batch   {::tth::tth digest -strings $::bench::messages}
+		context {
+			set ctx [::tth::tth init]
+			foreach msg $::bench::messages {
+				::tth::tth update $ctx $msg
+			}
+			::tth::tth digest $ctx
+		}
+		tiger   {
+			foreach msg $::bench::messages {
+				::tth::tiger $msg
+			}
+		}
+		tiger-list {::tth::tiger -list $::bench::messages}
+	}
+
+	set rows {}
+	foreach size {0 64 1k} {
+		set len [parseSize $size]
+		set messages {}
+		for {set i 0} {$i < $opts(-messages)} {incr i} {
+			lappend messages [string range [string repeat $i $len] 0 $len-1]
+		}
+		foreach {pattern script} $patterns {
+			set usec [expr {[measure $script] / $opts(-messages)}]
+			record [list overhead $pattern $size] $usec
+			lappend rows [list $pattern $size $usec \
+				[expr {$usec > 0 ? 1e6 / $usec : 0}]]
+		}
+	}
+	return $rows
+}
+
+# Prints a table with the change of the time per call against the
+# baseline; returns the number of regressions.
+proc bench::report {title header rows kind baseline} {
+	variable opts
+	puts "\n$title"
+	puts [format "%-12s %8s %14s %14s %10s" {*}$header baseline change]
+	set regressions 0
+	foreach row $rows {
+		lassign $row name size usec rate
+		set key [list $kind $name $size]
+		if {[dict exists $baseline $key] && [dict get $baseline $key] > 0} {
+			set base [dict get $baseline $key]
+			set change [expr {($usec - $base) * 100.0 / $base}]
+			set note [format "%+.1f%%" $change]
+			if {$change > $opts(-tolerance)} {
+				append note " REGRESSION"
+				incr regressions
+			}
+			set base [format %.2f $base]
+		} else {
+			set base -
+			set note new
+		}
+		puts [format "%-12s %8s %14.2f %14.2f %10s %s" \
+			$name $size $usec $rate $base $note]
+	}
+	return $regressions
+}
+
+proc bench::loadBaseline {} {
+	variable opts
+	if {![file exists $opts(-baseline)]} {
+		return {}
+	}
+	set fd [open $opts(-baseline)]
+	set res {}
+	foreach line [split [read $fd] \n] {
+		if {[string match #* $line] || [string trim $line] eq ""} continue
+		dict set res [lrange $line 0 2] [lindex $line 3]
+	}
+	close $fd
+	return $res
+}
+
+proc bench::saveBaseline {} {
+	variable opts
+	variable results
+	set fd [open $opts(-baseline) w]
+	puts $fd "# Baseline of tests/bench.tcl: kind name size microseconds-per-call"
+	puts $fd "# [info hostname], $::tcl_platform(os) $::tcl_platform(machine),\
+		Tcl [info patchlevel], [clock format [clock seconds] -format %Y-%m-%d]"
+	dict for {key usec} $results {
+		puts $fd [concat $key [format %.3f $usec]]
+	}
+	close $fd
+}
+
+proc bench::main {argv} {
+	variable opts
+	parseArgs $argv
+	file mkdir $opts(-dir)
+
+	set baseline [loadBaseline]
+	puts "tth [package present tth], Tcl [info patchlevel],\
+		$::tcl_platform(os) $::tcl_platform(machine)"
+	puts "median of $opts(-reps) runs of at least $opts(-mintime) us each"
+
+	set regressions [report "Throughput" {mode size us/call MB/s} \
+		[throughput] throughput $baseline]
+	incr regressions [report "Per-message overhead ($opts(-messages) messages)" \
+		{pattern size us/msg msgs/s} [overhead] overhead $baseline]
+
+	if {!$opts(-keep)} {
+		file delete -force $opts(-dir)
+	}
+	if {$opts(-save)} {
+		saveBaseline
+		puts "\nbaseline saved to $opts(-baseline)"
+	} elseif {$regressions} {
+		puts "\n$regressions regression(s) over $opts(-tolerance)%"
+		exit 1
+	}
+}
+
+bench::main $argv
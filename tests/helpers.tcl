@@ -0,0 +1,27 @@
+# helpers.tcl --
+#
+# Procedures shared by the test files, which source this file;
+# it is not a test file itself.
+#
+# $Id$
+
+# Writes data to the named file in the temporary directory (or to the
+# file itself if name is an absolute path), byte for byte, and returns
+# the path of the file.
+proc writeData {name data} {
+	set path [file join [temporaryDirectory] $name]
+	set fd [open $path w]
+	fconfigure $fd -translation binary
+	puts -nonewline $fd $data
+	close $fd
+	return $path
+}
+
+# Returns the contents of the named file, byte for byte.
+proc readData {path} {
+	set fd [open $path]
+	fconfigure $fd -translation binary
+	set data [read $fd]
+	close $fd
+	return $data
+}
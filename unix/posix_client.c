@@ -0,0 +1,227 @@
+/*
+ * posix_client.c --
+ *
+ *	This file implements the client of the local hashing daemon
+ *	(misc/tthd.c): a request is a line "DIGEST path" sent over
+ *	a Unix domain socket, answered by "OK thex size" or
+ *	"ERR message".
+ *
+ * Copyright (c) 2007 Konstantin Khomoutov <flatworm@users.sourceforge.net>
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * $Id$
+ *
+ */
+
+#include "tclclient.h"
+
+#ifdef USE_DAEMON
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "base32.h"
+
+/*
+ * Longest reply expected: "OK ", the digest, a size and a newline,
+ * or an error message.
+ */
+#define REPLY_MAX 512
+
+
+/*
+ * Connects to the daemon; returns the socket or -1.
+ */
+static int
+Client_Connect (
+		Tcl_Interp *interp,
+		Tcl_Obj    *socketPtr
+		)
+{
+	struct sockaddr_un addr;
+	const char *path;
+	int fd, len;
+
+	path = Tcl_GetStringFromObj(socketPtr, &len);
+	if (len >= (int) sizeof(addr.sun_path)) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "socket path \"", path,
+				"\" is too long", NULL);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, len);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd != -1 && connect(fd, (struct sockaddr *) &addr,
+			sizeof(addr)) == -1) {
+		Tcl_SetErrno(errno);
+		close(fd);
+		fd = -1;
+	} else if (fd == -1) {
+		Tcl_SetErrno(errno);
+	}
+	if (fd == -1) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to connect to the hashing daemon"
+				" at \"", path, "\": ", Tcl_PosixError(interp), NULL);
+	}
+
+	return fd;
+}
+
+
+/*
+ * Writes the whole buffer; returns 0 or -1.
+ */
+static int
+Client_Write (
+		int        fd,
+		const char *bytes,
+		int        len
+		)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, bytes, len);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		bytes += n;
+		len   -= n;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Reads a reply line, without its newline; returns 0 or -1.
+ */
+static int
+Client_ReadLine (
+		int  fd,
+		char *line,
+		int  size
+		)
+{
+	ssize_t n;
+	int len = 0;
+
+	while (len < size - 1) {
+		n = read(fd, line + len, 1);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (n == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (line[len] == '\n') {
+			line[len] = '\0';
+			return 0;
+		}
+		++len;
+	}
+
+	errno = EPROTO;
+	return -1;
+}
+
+
+/*
+ *
+ */
+int
+TTH_DigestFromDaemon (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *socketPtr,
+		Tcl_Obj      *filePtr,
+		byte         digest[],
+		Tcl_WideInt  *sizePtr
+		)
+{
+	Tcl_Obj *pathPtr;
+	Tcl_DString request;
+	const char *path;
+	char reply[REPLY_MAX];
+	size_t badpos;
+	int fd, code;
+
+	/* The daemon runs in another directory */
+	pathPtr = Tcl_FSGetNormalizedPath(interp, filePtr);
+	if (pathPtr == NULL) {
+		return TCL_ERROR;
+	}
+	path = Tcl_GetString(pathPtr);
+	if (strchr(path, '\n') != NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "file name \"", Tcl_GetString(filePtr),
+				"\" contains a newline", NULL);
+		return TCL_ERROR;
+	}
+
+	fd = Client_Connect(interp, socketPtr);
+	if (fd == -1) {
+		return TCL_ERROR;
+	}
+
+	Tcl_DStringInit(&request);
+	Tcl_DStringAppend(&request, "DIGEST ", -1);
+	Tcl_DStringAppend(&request, path, -1);
+	Tcl_DStringAppend(&request, "\n", 1);
+	code = Client_Write(fd, Tcl_DStringValue(&request),
+			Tcl_DStringLength(&request));
+	Tcl_DStringFree(&request);
+	if (code == 0) {
+		code = Client_ReadLine(fd, reply, sizeof(reply));
+	}
+	if (code == -1) {
+		Tcl_SetErrno(errno);
+		close(fd);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to talk to the hashing daemon"
+				" at \"", Tcl_GetString(socketPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+	close(fd);
+
+	if (strncmp(reply, "ERR ", 4) == 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to hash file named \"",
+				Tcl_GetString(filePtr), "\": ", reply + 4, NULL);
+		return TCL_ERROR;
+	}
+	if (strncmp(reply, "OK ", 3) != 0
+			|| strlen(reply) < 3 + BASE32_DESTLEN(TIGERSIZE)
+			|| reply[2 + BASE32_DESTLEN(TIGERSIZE)] != ' '
+			|| from_base32(reply + 3, BASE32_DESTLEN(TIGERSIZE) - 1,
+				digest, &badpos) != TIGERSIZE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "invalid reply from the hashing daemon: \"",
+				reply, "\"", NULL);
+		return TCL_ERROR;
+	}
+	*sizePtr = (Tcl_WideInt) strtoll(reply + 3 + BASE32_DESTLEN(TIGERSIZE),
+			NULL, 10);
+
+	return TCL_OK;
+}
+
+#endif /* USE_DAEMON */
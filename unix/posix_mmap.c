@@ -21,24 +21,35 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
 
 #include "tiger.h"
 #include "tigertree.h"
 #include "tclmmap.h"
+#include "tclprobe.h"
+
+/*
+ * Whether a whole file of the given positive size can be mapped,
+ * which is not the case of large files on 32-bit systems; off_t is
+ * signed, so the comparison is done on unsigned 64-bit values.
+ */
+#define MMAP_FITS(size) ((Tcl_WideUInt) (size) <= (Tcl_WideUInt) SIZE_MAX)
 
 /*
  *
  */
 int
-TTH_GetDigestUsingMmap (
+TTH_UpdateUsingMmap (
 		Tcl_Interp   *interp,
 		Tcl_Obj      *filePtr,
-		byte         digest[]
+		DigestUpdateProc *updateProc,
+		ClientData   clientData,
+		TTH_Throttle *throttlePtr
 		)
 {
 	int fd;
 	off_t offset, len;
-	TT_CONTEXT context;
 	byte *dataPtr;
 	long pagesize;
 	struct stat finfo;
@@ -51,8 +62,6 @@ TTH_GetDigestUsingMmap (
 		return TCL_ERROR;
 	}
 
-	tt_init(&context);
-
 #ifdef _SC_PAGESIZE
 	pagesize = sysconf(_SC_PAGESIZE);
 #else
@@ -80,6 +89,7 @@ TTH_GetDigestUsingMmap (
 		} else {
 			len = pagesize;
 		}
+		TTH_ThrottleIo(throttlePtr, len);
 		dataPtr = (byte *) mmap(0, len, PROT_READ, MAP_SHARED, fd, offset);
 		if (dataPtr == MAP_FAILED) {
 			Tcl_ResetResult(interp);
@@ -88,7 +98,8 @@ TTH_GetDigestUsingMmap (
 			close(fd);
 			return TCL_ERROR;
 		}
-		tt_update(&context, dataPtr, len);
+		TTH_PROBE3(io__chunk, "mmap", (Tcl_WideInt) offset, len);
+		updateProc(clientData, dataPtr, (int) len);
 		if (munmap(dataPtr, len) == -1) {
 			Tcl_ResetResult(interp);
 			Tcl_AppendResult(interp, "munmap() failed on file named \"",
@@ -99,11 +110,539 @@ TTH_GetDigestUsingMmap (
 		offset += len;
 	}
 
-	tt_digest(&context, digest);
 	close(fd);
 
 	return TCL_OK;
 }
 
-#endif /* ifdef HAVE_MMAP */
 
+/*
+ * State of copying one file to another.
+ */
+struct TTH_MmapCopy {
+	int     in;        /* source file */
+	int     out;       /* destination file */
+	off_t   offset;    /* current position in both files */
+	off_t   size;      /* size of the source file */
+	long    pagesize;
+	Tcl_Obj *srcPtr;   /* names of the files, for error messages */
+	Tcl_Obj *dstPtr;
+};
+
+
+/*
+ *
+ */
+TTH_MmapCopy *
+TTH_MmapCopyOpen (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *srcPtr,
+		Tcl_Obj      *dstPtr
+		)
+{
+	TTH_MmapCopy *copyPtr;
+	struct stat finfo, dinfo;
+	int in, out;
+
+	in = open(Tcl_GetString(srcPtr), O_RDONLY);
+	if (in == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to open file named \"",
+				Tcl_GetString(srcPtr), "\": ", Tcl_PosixError(interp), NULL);
+		return NULL;
+	}
+	if (fstat(in, &finfo) == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to stat file named \"",
+				Tcl_GetString(srcPtr), "\": ", Tcl_PosixError(interp), NULL);
+		close(in);
+		return NULL;
+	}
+
+	/*
+	 * The destination is truncated only after making sure it is not
+	 * the source: truncating a file being mapped makes accesses to
+	 * the mapping raise SIGBUS.
+	 */
+	out = open(Tcl_GetString(dstPtr), O_WRONLY | O_CREAT, 0666);
+	if (out == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to open file named \"",
+				Tcl_GetString(dstPtr), "\": ", Tcl_PosixError(interp), NULL);
+		close(in);
+		return NULL;
+	}
+	if (fstat(out, &dinfo) == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to stat file named \"",
+				Tcl_GetString(dstPtr), "\": ", Tcl_PosixError(interp), NULL);
+		close(in);
+		close(out);
+		return NULL;
+	}
+	if (dinfo.st_dev == finfo.st_dev && dinfo.st_ino == finfo.st_ino) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "can not copy file named \"",
+				Tcl_GetString(srcPtr), "\" onto itself", NULL);
+		close(in);
+		close(out);
+		return NULL;
+	}
+	if (ftruncate(out, 0) == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to truncate file named \"",
+				Tcl_GetString(dstPtr), "\": ", Tcl_PosixError(interp), NULL);
+		close(in);
+		close(out);
+		return NULL;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	copyPtr = (TTH_MmapCopy *) ckalloc(sizeof(TTH_MmapCopy));
+	copyPtr->in       = in;
+	copyPtr->out      = out;
+	copyPtr->offset   = 0;
+	copyPtr->size     = finfo.st_size;
+	copyPtr->pagesize = sysconf(_SC_PAGESIZE);
+	copyPtr->srcPtr   = srcPtr;
+	copyPtr->dstPtr   = dstPtr;
+	Tcl_IncrRefCount(srcPtr);
+	Tcl_IncrRefCount(dstPtr);
+
+	return copyPtr;
+}
+
+
+/*
+ * Maps the next window of the source file, hashes it
+ * and writes it to the destination file.
+ */
+int
+TTH_MmapCopyStep (
+		Tcl_Interp   *interp,
+		TTH_MmapCopy *copyPtr,
+		TT_CONTEXT   *contextPtr,
+		size_t       window,
+		Tcl_WideInt  *copiedPtr,
+		int          *donePtr
+		)
+{
+	struct stat finfo;
+	byte *dataPtr;
+	off_t len;
+	size_t done;
+	ssize_t written;
+
+	/* Mappings must start at page boundaries */
+	window -= window % copyPtr->pagesize;
+	if (window == 0) {
+		window = copyPtr->pagesize;
+	}
+
+	if (copyPtr->size - copyPtr->offset < (off_t) window) {
+		len = copyPtr->size - copyPtr->offset;
+	} else {
+		len = window;
+	}
+	if (len == 0) {
+		*donePtr = 1;
+		return TCL_OK;
+	}
+
+	/*
+	 * Pages of the mapping past the current end of the source
+	 * raise SIGBUS, so a source truncated meanwhile is an error.
+	 */
+	if (fstat(copyPtr->in, &finfo) == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to stat file named \"",
+				Tcl_GetString(copyPtr->srcPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+	if (finfo.st_size < copyPtr->offset + len) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "file named \"",
+				Tcl_GetString(copyPtr->srcPtr),
+				"\" was truncated while being copied", NULL);
+		return TCL_ERROR;
+	}
+
+	dataPtr = (byte *) mmap(0, len, PROT_READ, MAP_SHARED,
+			copyPtr->in, copyPtr->offset);
+	if (dataPtr == MAP_FAILED) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "mmap() failed on file named \"",
+				Tcl_GetString(copyPtr->srcPtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(dataPtr, len, MADV_SEQUENTIAL);
+#endif
+
+	tt_update(contextPtr, dataPtr, len);
+
+	for (done = 0; done < (size_t) len; done += written) {
+		written = write(copyPtr->out, dataPtr + done, len - done);
+		if (written == -1) {
+			if (errno == EINTR) {
+				written = 0;
+				continue;
+			}
+			Tcl_SetErrno(errno);
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "failed to write to file named \"",
+					Tcl_GetString(copyPtr->dstPtr), "\": ",
+					Tcl_PosixError(interp), NULL);
+			munmap(dataPtr, len);
+			return TCL_ERROR;
+		}
+	}
+
+	munmap(dataPtr, len);
+
+	copyPtr->offset += len;
+	*copiedPtr += len;
+	*donePtr = copyPtr->offset >= copyPtr->size;
+
+	return TCL_OK;
+}
+
+
+/*
+ *
+ */
+void
+TTH_MmapCopyClose (
+		TTH_MmapCopy *copyPtr
+		)
+{
+	close(copyPtr->in);
+	close(copyPtr->out);
+	Tcl_DecrRefCount(copyPtr->srcPtr);
+	Tcl_DecrRefCount(copyPtr->dstPtr);
+	ckfree((char *) copyPtr);
+}
+
+/*
+ * Mapping of a whole file.
+ */
+struct TTH_Mapping {
+	void   *addr;
+	size_t length;
+};
+
+
+/*
+ *
+ */
+TTH_Mapping *
+TTH_MapFile (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *filePtr,
+		const byte   **dataPtr,
+		size_t       *lengthPtr
+		)
+{
+	TTH_Mapping *mapPtr;
+	struct stat finfo;
+	void *addr;
+	int fd;
+
+	fd = open(Tcl_GetString(filePtr), O_RDONLY);
+	if (fd == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to open file named \"",
+				Tcl_GetString(filePtr), "\": ", Tcl_PosixError(interp), NULL);
+		return NULL;
+	}
+	if (fstat(fd, &finfo) == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to stat file named \"",
+				Tcl_GetString(filePtr), "\": ", Tcl_PosixError(interp), NULL);
+		close(fd);
+		return NULL;
+	}
+
+	addr = NULL;
+	if (finfo.st_size > 0) {
+		if (MMAP_FITS(finfo.st_size)) {
+			addr = mmap(0, (size_t) finfo.st_size, PROT_READ, MAP_SHARED,
+					fd, 0);
+		} else {
+			addr = MAP_FAILED;
+			errno = EFBIG;
+		}
+		if (addr == MAP_FAILED) {
+			Tcl_SetErrno(errno);
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "mmap() failed on file named \"",
+					Tcl_GetString(filePtr), "\": ",
+					Tcl_PosixError(interp), NULL);
+			close(fd);
+			return NULL;
+		}
+	}
+	/* The mapping outlives the descriptor */
+	close(fd);
+
+	mapPtr = (TTH_Mapping *) ckalloc(sizeof(TTH_Mapping));
+	mapPtr->addr   = addr;
+	mapPtr->length = (size_t) finfo.st_size;
+
+	*dataPtr   = (const byte *) addr;
+	*lengthPtr = mapPtr->length;
+	return mapPtr;
+}
+
+
+/*
+ *
+ */
+void
+TTH_UnmapFile (
+		TTH_Mapping  *mapPtr
+		)
+{
+	if (mapPtr->addr != NULL) {
+		munmap(mapPtr->addr, mapPtr->length);
+	}
+	ckfree((char *) mapPtr);
+}
+
+/*
+ * Files up to this size are mapped without checking
+ * whether they are cached.
+ */
+#define ENGINE_SMALLFILE  (4 * 1024 * 1024)
+
+/* Number of pages checked to tell whether a file is cached */
+#define ENGINE_PROBES     64
+
+/* Size of the buffer used to read files, and of chunks of mapped data */
+#define ENGINE_BUFSIZE    (1024 * 1024)
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) \
+	|| defined(__OpenBSD__) || defined(__APPLE__) || defined(__sun)
+#define HAVE_MINCORE 1
+#endif
+
+
+/*
+ * Tells whether most of the mapped file is in the page cache
+ * by checking a sample of its pages.
+ */
+static int
+Engine_IsCached (
+		void   *addr,
+		size_t length
+		)
+{
+#ifdef HAVE_MINCORE
+	unsigned char vec;
+	size_t pages, step, i;
+	long pagesize;
+	int probes, cached;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	pages = (length + pagesize - 1) / pagesize;
+	step = pages / ENGINE_PROBES;
+	if (step == 0) {
+		step = 1;
+	}
+
+	probes = cached = 0;
+	for (i = 0; i < pages; i += step) {
+		++probes;
+		if (mincore((char *) addr + i * pagesize, (size_t) pagesize,
+					(void *) &vec) == 0 && (vec & 1)) {
+			++cached;
+		}
+	}
+
+	return cached * 2 >= probes;
+#else
+	return 0;
+#endif
+}
+
+
+/*
+ * Feeds the mapped file to updateProc. When the I/O is throttled,
+ * read-ahead is disabled and each chunk is only prefetched once
+ * the throttle lets it through.
+ */
+static void
+Engine_UpdateFromMapping (
+		const byte       *data,
+		size_t           length,
+		TTH_Throttle     *throttlePtr,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData
+		)
+{
+	size_t len, offset;
+	int throttled;
+
+	throttled = TTH_ThrottleActive(throttlePtr);
+#if defined(MADV_RANDOM) && defined(MADV_SEQUENTIAL)
+	madvise((void *) data, length, throttled ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+
+	for (offset = 0; offset < length; offset += len) {
+		len = length - offset < ENGINE_BUFSIZE
+			? length - offset : ENGINE_BUFSIZE;
+		if (throttled) {
+			TTH_ThrottleIo(throttlePtr, len);
+#ifdef MADV_WILLNEED
+			madvise((void *) (data + offset), len, MADV_WILLNEED);
+#endif
+		}
+		TTH_PROBE3(io__chunk, "mmap", offset, len);
+		updateProc(clientData, data + offset, (int) len);
+	}
+}
+
+
+/*
+ * Reads the file using a large buffer. The pages of a file which
+ * was not cached are dropped from the cache behind the reads, so hashing
+ * large cold files does not evict the data of others.
+ */
+static int
+Engine_UpdateUsingRead (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		int              fd,
+		off_t            size,
+		int              cold,
+		TTH_Throttle     *throttlePtr,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData
+		)
+{
+	byte *buffer;
+	off_t offset;
+	ssize_t n;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	/* Throttled reads are not read ahead more aggressively */
+	if (!TTH_ThrottleActive(throttlePtr)) {
+		posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+
+	buffer = (byte *) ckalloc(ENGINE_BUFSIZE);
+
+	offset = 0;
+	for (;;) {
+		n = pread(fd, buffer, ENGINE_BUFSIZE, offset);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		TTH_ThrottleIo(throttlePtr, n);
+		TTH_PROBE3(io__chunk, "read", (Tcl_WideInt) offset, n);
+		updateProc(clientData, buffer, (int) n);
+#ifdef POSIX_FADV_DONTNEED
+		if (cold) {
+			posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+		}
+#endif
+		offset += n;
+	}
+
+	ckfree((char *) buffer);
+
+	if (n == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "error reading \"", Tcl_GetString(filePtr),
+				"\": ", Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+
+/*
+ * Hashes a regular file: small files are mapped, larger ones are
+ * mapped if they are mostly cached and read using pread() otherwise.
+ */
+int
+TTH_UpdateFromFile (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		FILE_ENGINE      engine,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr,
+		FILE_ENGINE      *usedPtr
+		)
+{
+	struct stat finfo;
+	void *addr;
+	int fd, code, cold;
+
+	fd = open(Tcl_GetString(filePtr), O_RDONLY);
+	if (fd == -1) {
+		Tcl_SetErrno(errno);
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "couldn't open \"", Tcl_GetString(filePtr),
+				"\": ", Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+	if (fstat(fd, &finfo) == -1 || !S_ISREG(finfo.st_mode)
+			|| finfo.st_size == 0) {
+		/* Pipes, devices and files like those in /proc are streamed */
+		close(fd);
+		return TCL_CONTINUE;
+	}
+
+	cold = 0;
+	addr = MAP_FAILED;
+	if (engine != FE_READ && MMAP_FITS(finfo.st_size)) {
+		addr = mmap(0, (size_t) finfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	if (addr != MAP_FAILED && engine == FE_AUTO
+			&& finfo.st_size > ENGINE_SMALLFILE
+			&& !Engine_IsCached(addr, (size_t) finfo.st_size)) {
+		munmap(addr, (size_t) finfo.st_size);
+		addr = MAP_FAILED;
+		cold = 1;
+	}
+
+	if (addr != MAP_FAILED) {
+		Engine_UpdateFromMapping((const byte *) addr, (size_t) finfo.st_size,
+				throttlePtr, updateProc, clientData);
+		munmap(addr, (size_t) finfo.st_size);
+		*usedPtr = FE_MMAP;
+		code = TCL_OK;
+	} else {
+		/* Also used if the file can not be mapped */
+		code = Engine_UpdateUsingRead(interp, filePtr, fd, finfo.st_size,
+				cold, throttlePtr, updateProc, clientData);
+		*usedPtr = FE_READ;
+	}
+
+	close(fd);
+	return code;
+}
+
+#endif /* ifdef HAVE_MMAP */
\ No newline at end of file
@@ -26,14 +26,15 @@
 #include <tclIntPlatDecls.h>
 
 int
-TTH_GetDigestUsingMmap (
+TTH_UpdateUsingMmap (
 		Tcl_Interp   *interp,
 		Tcl_Obj      *filePtr,
-		byte         digest[]
+		DigestUpdateProc *updateProc,
+		ClientData   clientData,
+		TTH_Throttle *throttlePtr
 		)
 {
 	SYSTEM_INFO sysinfo;
-	TT_CONTEXT context;
 	CONST TCHAR *nativeName = "C:\\video\\1984.mkv";
 	HANDLE hFile, hMap;
 	DWORD fsizeLow, fsizeHigh;
@@ -87,8 +88,6 @@ TTH_GetDigestUsingMmap (
 	pagesize = sysinfo.dwPageSize * 1024;
 	/* pagesize = sysinfo.dwPageSize; */
 
-	tt_init(&context);
-
 	offset = 0;
 	while (offset < fsize) {
 		if (fsize - offset < pagesize) {
@@ -96,6 +95,7 @@ TTH_GetDigestUsingMmap (
 		} else {
 			len = pagesize;
 		}
+		TTH_ThrottleIo(throttlePtr, len);
 		dataPtr = MapViewOfFile(hMap, FILE_MAP_READ, 
 				(offset >> 32), offset & ULL(0xFFFFFFFF), len);
 		if (dataPtr == NULL) {
@@ -107,7 +107,7 @@ TTH_GetDigestUsingMmap (
 			CloseHandle(hFile);
 			return TCL_ERROR;
 		}
-		tt_update(&context, dataPtr, len);
+		updateProc(clientData, dataPtr, (int) len);
 		if (UnmapViewOfFile(dataPtr) == 0) {
 			Tcl_ResetResult(interp);
 			Tcl_AppendResult(interp, "failed to unmap view of file", NULL);
@@ -118,11 +118,225 @@ TTH_GetDigestUsingMmap (
 		offset += len;
 	}
 
-	tt_digest(&context, digest);
-
 	CloseHandle(hMap);
 	CloseHandle(hFile);
 
 	return TCL_OK;
 }
 
+
+/*
+ * Mapping of a whole file.
+ */
+struct TTH_Mapping {
+	HANDLE hFile;
+	HANDLE hMap;
+	LPVOID addr;
+};
+
+
+/*
+ *
+ */
+TTH_Mapping *
+TTH_MapFile (
+		Tcl_Interp   *interp,
+		Tcl_Obj      *filePtr,
+		const byte   **dataPtr,
+		size_t       *lengthPtr
+		)
+{
+	TTH_Mapping *mapPtr;
+	CONST WCHAR *nativeName;
+	HANDLE hFile, hMap;
+	DWORD fsizeLow, fsizeHigh;
+	LPVOID addr;
+
+	nativeName = (CONST WCHAR *) Tcl_FSGetNativePath(filePtr);
+	if (nativeName == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to get native name for file named \"",
+				Tcl_GetString(filePtr), "\"", NULL);
+		return NULL;
+	}
+
+	hFile = CreateFileW(nativeName, GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		TclWinConvertError(GetLastError());
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to open file named \"",
+				Tcl_GetString(filePtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		return NULL;
+	}
+
+	fsizeLow = GetFileSize(hFile, &fsizeHigh);
+	if (fsizeLow == 0xFFFFFFFF && GetLastError() != NO_ERROR) {
+		TclWinConvertError(GetLastError());
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to stat file named \"",
+				Tcl_GetString(filePtr), "\": ",
+				Tcl_PosixError(interp), NULL);
+		CloseHandle(hFile);
+		return NULL;
+	}
+
+	hMap = NULL;
+	addr = NULL;
+	if (fsizeLow != 0 || fsizeHigh != 0) {
+		hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMap != NULL) {
+			addr = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (addr == NULL) {
+			TclWinConvertError(GetLastError());
+			Tcl_ResetResult(interp);
+			Tcl_AppendResult(interp, "failed to map file named \"",
+					Tcl_GetString(filePtr), "\": ",
+					Tcl_PosixError(interp), NULL);
+			if (hMap != NULL) {
+				CloseHandle(hMap);
+			}
+			CloseHandle(hFile);
+			return NULL;
+		}
+	}
+
+	mapPtr = (TTH_Mapping *) ckalloc(sizeof(TTH_Mapping));
+	mapPtr->hFile = hFile;
+	mapPtr->hMap  = hMap;
+	mapPtr->addr  = addr;
+
+	*dataPtr   = (const byte *) addr;
+	*lengthPtr = (size_t) (((word64) fsizeHigh << 32) | (word64) fsizeLow);
+	return mapPtr;
+}
+
+
+/*
+ *
+ */
+void
+TTH_UnmapFile (
+		TTH_Mapping  *mapPtr
+		)
+{
+	if (mapPtr->addr != NULL) {
+		UnmapViewOfFile(mapPtr->addr);
+	}
+	if (mapPtr->hMap != NULL) {
+		CloseHandle(mapPtr->hMap);
+	}
+	CloseHandle(mapPtr->hFile);
+	ckfree((char *) mapPtr);
+}
+
+
+/*
+ * Files up to this size are mapped by default; Windows offers
+ * no cheap way of telling whether a file is cached.
+ */
+#define ENGINE_SMALLFILE  (4 * 1024 * 1024)
+
+/* Size of the buffer used to read files, and of chunks of mapped data */
+#define ENGINE_BUFSIZE    (1024 * 1024)
+
+
+/*
+ * Hashes a regular file: small files are mapped,
+ * larger ones are read using ReadFile().
+ */
+int
+TTH_UpdateFromFile (
+		Tcl_Interp       *interp,
+		Tcl_Obj          *filePtr,
+		FILE_ENGINE      engine,
+		DigestUpdateProc *updateProc,
+		ClientData       clientData,
+		TTH_Throttle     *throttlePtr,
+		FILE_ENGINE      *usedPtr
+		)
+{
+	CONST WCHAR *nativeName;
+	HANDLE hFile, hMap;
+	DWORD fsizeLow, fsizeHigh, n;
+	word64 fsize, len;
+	const byte *addr, *p;
+	byte *buffer;
+	int code;
+
+	nativeName = (CONST WCHAR *) Tcl_FSGetNativePath(filePtr);
+	if (nativeName == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "failed to get native name for file named \"",
+				Tcl_GetString(filePtr), "\"", NULL);
+		return TCL_ERROR;
+	}
+
+	hFile = CreateFileW(nativeName, GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		TclWinConvertError(GetLastError());
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "couldn't open \"", Tcl_GetString(filePtr),
+				"\": ", Tcl_PosixError(interp), NULL);
+		return TCL_ERROR;
+	}
+
+	fsizeLow = GetFileSize(hFile, &fsizeHigh);
+	fsize = ((word64) fsizeHigh << 32) | (word64) fsizeLow;
+	if (GetFileType(hFile) != FILE_TYPE_DISK
+			|| (fsizeLow == 0xFFFFFFFF && GetLastError() != NO_ERROR)
+			|| fsize == 0) {
+		/* Pipes, devices and empty files are streamed */
+		CloseHandle(hFile);
+		return TCL_CONTINUE;
+	}
+
+	addr = NULL;
+	if (engine == FE_MMAP || (engine == FE_AUTO && fsize <= ENGINE_SMALLFILE)) {
+		hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMap != NULL) {
+			addr = (const byte *) MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(hMap);
+		}
+	}
+
+	code = TCL_OK;
+	if (addr != NULL) {
+		for (p = addr; fsize > 0; p += len, fsize -= len) {
+			len = fsize < ENGINE_BUFSIZE ? fsize : ENGINE_BUFSIZE;
+			TTH_ThrottleIo(throttlePtr, len);
+			updateProc(clientData, p, (int) len);
+		}
+		UnmapViewOfFile((LPCVOID) addr);
+		*usedPtr = FE_MMAP;
+	} else {
+		/* Also used if the file can not be mapped */
+		buffer = (byte *) ckalloc(ENGINE_BUFSIZE);
+		for (;;) {
+			if (!ReadFile(hFile, buffer, ENGINE_BUFSIZE, &n, NULL)) {
+				TclWinConvertError(GetLastError());
+				Tcl_ResetResult(interp);
+				Tcl_AppendResult(interp, "error reading \"",
+						Tcl_GetString(filePtr), "\": ",
+						Tcl_PosixError(interp), NULL);
+				code = TCL_ERROR;
+				break;
+			}
+			if (n == 0) {
+				break;
+			}
+			TTH_ThrottleIo(throttlePtr, n);
+			updateProc(clientData, buffer, (int) n);
+		}
+		ckfree((char *) buffer);
+		*usedPtr = FE_READ;
+	}
+
+	CloseHandle(hFile);
+	return code;
+}